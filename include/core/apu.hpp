@@ -1,18 +1,27 @@
 #ifndef APU_HPP
 #define APU_HPP
 
+#include "util/audiofilter.hpp"
+#include "util/blipbuffer.hpp"
+#include "util/schema.hpp"
 #include "util/serializer.hpp"
 #include "util/util.hpp"
 
 #include <array>
 #include <cstdint>
 
+class APUThread;
 class Bus;
 
 class APU {
 public:
+    struct State;
+
     APU(Bus& bus);
 
+    // A replica that is not part of a console, used to synthesize audio on another thread. See APUThread.
+    explicit APU(State& state);
+
     void resetAPU();
 
     void write(uint16_t addr, uint8_t value);
@@ -25,12 +34,42 @@ public:
     // Handles writes to 0x4017
     void writeFrameCounter(uint8_t value);
 
-    void executeHalfCycle();
+    // The APU runs lazily. Each cycle the bus only counts the cycles the APU owes, and the APU catches up on them
+    // when its registers are accessed, when it reaches a point where it affects the rest of the console, or when audio is read.
+    void clock() {
+        state.pendingCycles++;
+        if (state.pendingCycles >= state.cyclesUntilSync) {
+            synchronize();
+        }
+    }
+    void synchronize();
+
+    // Unlike synchronize, this also brings the channel state up to date when it is kept on an APU thread.
+    // Needed before all of the APU state is read at once, like for save states.
+    void synchronizeChannels();
+
+    // Only used by a replica
+    void catchUpTo(uint64_t cycle);
+
+    // While a thread is attached, it runs the channels and synthesizes the audio instead of this APU
+    void setAPUThread(APUThread* thread);
+
     bool irqRequested() const;
 
     void receiveDMCSample(uint8_t sample);
 
-    float getAudioSample() const;
+    // Audio is synthesized from amplitude changes and read out in bulk, once per frame
+    void setAudioRates(double clockRate, double sampleRate);
+
+    // Changes the sample rate without discarding any samples, for dynamic rate control
+    void adjustAudioSampleRate(double sampleRate);
+    void endAudioFrame();
+    size_t readAudioSamples(float* output, size_t maxSamples);
+
+    // While disabled, the channels keep running but nothing is added to the audio output.
+    // Used for frames that are emulated and then thrown away, like run-ahead. Once enabled again,
+    // the output carries on from where it was disabled as if the frames in between took no time.
+    void setAudioOutputEnabled(bool enabled);
 
     // Serialization
     void serialize(Serializer& s) const;
@@ -44,27 +83,28 @@ private:
 
     struct Pulse {
         uint32_t data;
-        BitField<0, 8, uint32_t>  reg4000{ data };
-        BitField<8, 8, uint32_t>  reg4001{ data };
-        BitField<16, 8, uint32_t> reg4002{ data };
-        BitField<24, 8, uint32_t> reg4003{ data };
+
+        using Reg4000 = BitField<0, 8, uint32_t>;
+        using Reg4001 = BitField<8, 8, uint32_t>;
+        using Reg4002 = BitField<16, 8, uint32_t>;
+        using Reg4003 = BitField<24, 8, uint32_t>;
 
         // 0x4000 / 0x4004
-        BitField<0, 4, uint32_t> volumeOrEnvelopeRate{ data };
-        BitField<4, 1, uint32_t> constantVolume{ data };
-        BitField<5, 1, uint32_t> envelopeLoopOrLengthCounterHalt{ data };
-        BitField<6, 2, uint32_t> duty{ data };
+        using VolumeOrEnvelopeRate = BitField<0, 4, uint32_t>;
+        using ConstantVolume = BitField<4, 1, uint32_t>;
+        using EnvelopeLoopOrLengthCounterHalt = BitField<5, 1, uint32_t>;
+        using Duty = BitField<6, 2, uint32_t>;
 
-        // 0x4001 / 0x4005  
-        BitField<8, 3, uint32_t> sweepUnitShift{ data };
-        BitField<11, 1, uint32_t> sweepUnitNegate{ data };
-        BitField<12, 3, uint32_t> sweepUnitPeriod{ data };
-        BitField<15, 1, uint32_t> sweepUnitEnabled{ data };
+        // 0x4001 / 0x4005
+        using SweepUnitShift = BitField<8, 3, uint32_t>;
+        using SweepUnitNegate = BitField<11, 1, uint32_t>;
+        using SweepUnitPeriod = BitField<12, 3, uint32_t>;
+        using SweepUnitEnabled = BitField<15, 1, uint32_t>;
 
         // 0x4002 / 0x4006
         // 0x4003 / 0x4007
-        BitField<16, 11, uint32_t> timer{ data }; // Use one combined timer instead of timer low/high
-        BitField<27, 5, uint32_t> lengthCounterLoad{ data };
+        using Timer = BitField<16, 11, uint32_t>; // Use one combined timer instead of timer low/high
+        using LengthCounterLoad = BitField<27, 5, uint32_t>;
 
         struct Internal {
             uint16_t timerCounter;
@@ -76,28 +116,47 @@ private:
             uint8_t sweepDividerCounter;
             bool sweepMutesChannel;
             bool sweepReloadFlag;
+
+            static constexpr auto fields() {
+                return std::make_tuple(
+                    makeField("timerCounter", &Internal::timerCounter),
+                    makeField("dutyCycleIndex", &Internal::dutyCycleIndex),
+                    makeField("lengthCounter", &Internal::lengthCounter),
+                    makeField("envelopeStartFlag", &Internal::envelopeStartFlag),
+                    makeField("envelope", &Internal::envelope),
+                    makeField("envelopeDividerCounter", &Internal::envelopeDividerCounter),
+                    makeField("sweepDividerCounter", &Internal::sweepDividerCounter),
+                    makeField("sweepMutesChannel", &Internal::sweepMutesChannel),
+                    makeField("sweepReloadFlag", &Internal::sweepReloadFlag)
+                );
+            }
         };
 
         Internal i;
+
+        static constexpr auto fields() {
+            return std::make_tuple(makeField("data", &Pulse::data), makeField("i", &Pulse::i));
+        }
     };
 
     struct Triangle {
         uint32_t data;
-        BitField<0, 8, uint32_t>  reg4008{ data };
-        BitField<16, 8, uint32_t> reg400A{ data };
-        BitField<24, 8, uint32_t> reg400B{ data };
+
+        using Reg4008 = BitField<0, 8, uint32_t>;
+        using Reg400A = BitField<16, 8, uint32_t>;
+        using Reg400B = BitField<24, 8, uint32_t>;
 
         // 0x4008
-        BitField<0, 7, uint32_t> linearCounterLoad{ data };
-        BitField<7, 1, uint32_t> lengthCounterHaltOrLinearCounterControl{ data };
+        using LinearCounterLoad = BitField<0, 7, uint32_t>;
+        using LengthCounterHaltOrLinearCounterControl = BitField<7, 1, uint32_t>;
 
         // 0x4009
         // Unused
 
         // 0x400A
         // 0x400B
-        BitField<16, 11, uint32_t> timer{ data }; // Use one combined timer instead of timer low/high
-        BitField<27, 5, uint32_t>  lengthCounterLoad{ data };
+        using Timer = BitField<16, 11, uint32_t>; // Use one combined timer instead of timer low/high
+        using LengthCounterLoad = BitField<27, 5, uint32_t>;
 
         // Internal state
         struct Internal {
@@ -107,28 +166,44 @@ private:
             uint8_t sequenceIndex;
             uint8_t lengthCounter;
             uint8_t outputValue;
+
+            static constexpr auto fields() {
+                return std::make_tuple(
+                    makeField("timerCounter", &Internal::timerCounter),
+                    makeField("linearCounter", &Internal::linearCounter),
+                    makeField("linearCounterReloadFlag", &Internal::linearCounterReloadFlag),
+                    makeField("sequenceIndex", &Internal::sequenceIndex),
+                    makeField("lengthCounter", &Internal::lengthCounter),
+                    makeField("outputValue", &Internal::outputValue)
+                );
+            }
         };
 
         Internal i;
+
+        static constexpr auto fields() {
+            return std::make_tuple(makeField("data", &Triangle::data), makeField("i", &Triangle::i));
+        }
     };
 
     struct Noise {
         uint16_t data; // Pack all noise info into 16 bits
 
+
         // 0x400C
-        BitField<0, 4, uint16_t> volumeOrEnvelope{ data };
-        BitField<4, 1, uint16_t> constantVolume{ data };
-        BitField<5, 1, uint16_t> envelopeLoopOrLengthCounterHalt{ data };
+        using VolumeOrEnvelope = BitField<0, 4, uint16_t>;
+        using ConstantVolume = BitField<4, 1, uint16_t>;
+        using EnvelopeLoopOrLengthCounterHalt = BitField<5, 1, uint16_t>;
 
         // 0x400D
         // Unused
 
         // 0x400E
-        BitField<6, 4, uint16_t> noisePeriod{ data };
-        BitField<10, 1, uint16_t> loopNoise{ data };
+        using NoisePeriod = BitField<6, 4, uint16_t>;
+        using LoopNoise = BitField<10, 1, uint16_t>;
 
         // 0x400F
-        BitField<11, 5, uint16_t> lengthCounterLoad{ data };
+        using LengthCounterLoad = BitField<11, 5, uint16_t>;
 
         struct Internal {
             uint16_t timerCounter;
@@ -137,33 +212,49 @@ private:
             uint8_t envelope;
             uint8_t envelopeDividerCounter;
             uint16_t shiftRegister;
+
+            static constexpr auto fields() {
+                return std::make_tuple(
+                    makeField("timerCounter", &Internal::timerCounter),
+                    makeField("lengthCounter", &Internal::lengthCounter),
+                    makeField("envelopeStartFlag", &Internal::envelopeStartFlag),
+                    makeField("envelope", &Internal::envelope),
+                    makeField("envelopeDividerCounter", &Internal::envelopeDividerCounter),
+                    makeField("shiftRegister", &Internal::shiftRegister)
+                );
+            }
         };
 
         Internal i;
+
+        static constexpr auto fields() {
+            return std::make_tuple(makeField("data", &Noise::data), makeField("i", &Noise::i));
+        }
     };
 
     struct DMC {
         uint32_t data;
-        BitField<0, 8, uint32_t>  reg4010{ data };
-        BitField<8, 8, uint32_t>  reg4011{ data };
-        BitField<16, 8, uint32_t> reg4012{ data };
-        BitField<24, 8, uint32_t> reg4013{ data };
+
+        using Reg4010 = BitField<0, 8, uint32_t>;
+        using Reg4011 = BitField<8, 8, uint32_t>;
+        using Reg4012 = BitField<16, 8, uint32_t>;
+        using Reg4013 = BitField<24, 8, uint32_t>;
 
         // 0x4010
-        BitField<0, 4, uint32_t> frequency{ data };
+        using Frequency = BitField<0, 4, uint32_t>;
         // Bits 4-5 are unused
-        BitField<6, 1, uint32_t> loopSample{ data };
-        BitField<7, 1, uint32_t> irqEnable{ data };
+        using LoopSample = BitField<6, 1, uint32_t>;
+        using IrqEnable = BitField<7, 1, uint32_t>;
 
         // 0x4011
-        BitField<8, 7, uint32_t> outputLevel{ data };
+        using OutputLevel = BitField<8, 7, uint32_t>;
         // Bit 15 is unused
 
         // 0x4012
-        BitField<16, 8, uint32_t> sampleAddress{ data };
+        using SampleAddress = BitField<16, 8, uint32_t>;
 
         // 0x4013
-        BitField<24, 8, uint32_t> sampleLength{ data };
+        using SampleLength = BitField<24, 8, uint32_t>;
 
         struct Internal {
             uint16_t currentAddress;
@@ -175,40 +266,88 @@ private:
             uint8_t bitsRemaining;
             bool silenceFlag;
             bool irqFlag;
+
+            static constexpr auto fields() {
+                return std::make_tuple(
+                    makeField("currentAddress", &Internal::currentAddress),
+                    makeField("bytesRemaining", &Internal::bytesRemaining),
+                    makeField("timerCounter", &Internal::timerCounter),
+                    makeField("sampleBuffer", &Internal::sampleBuffer),
+                    makeField("sampleBufferEmpty", &Internal::sampleBufferEmpty),
+                    makeField("shiftRegister", &Internal::shiftRegister),
+                    makeField("bitsRemaining", &Internal::bitsRemaining),
+                    makeField("silenceFlag", &Internal::silenceFlag),
+                    makeField("irqFlag", &Internal::irqFlag)
+                );
+            }
         };
 
         Internal i;
+
+        static constexpr auto fields() {
+            return std::make_tuple(makeField("data", &DMC::data), makeField("i", &DMC::i));
+        }
     };
 
     struct Status {
         uint8_t data;
 
-        BitField<0, 1> enablePulse1{ data };
-        BitField<1, 1> enablePulse2{ data };
-        BitField<2, 1> enableTriangle{ data };
-        BitField<3, 1> enableNoise{ data };
-        BitField<4, 1> enableDmc{ data };
+
+        using EnablePulse1 = BitField<0, 1>;
+        using EnablePulse2 = BitField<1, 1>;
+        using EnableTriangle = BitField<2, 1>;
+        using EnableNoise = BitField<3, 1>;
+        using EnableDmc = BitField<4, 1>;
         // Bit 5 is unused
-        BitField<6, 1> frameInterrupt{ data };
-        BitField<7, 1> dmcInterrupt{ data };
+        using FrameInterrupt = BitField<6, 1>;
+        using DmcInterrupt = BitField<7, 1>;
     };
 
-    std::array<Pulse, 2> pulses;
-    Triangle triangle;
-    Noise noise;
-    DMC dmc;
-    Status status;
-
-    bool frameSequenceMode;
-    bool interruptInhibitFlag;
-    bool frameInterruptFlag;
+public:
+    // All emulated APU state, stored inside the Bus state block
+    struct State {
+        std::array<Pulse, 2> pulses;
+        Triangle triangle;
+        Noise noise;
+        DMC dmc;
+        Status status;
+
+        bool frameSequenceMode;
+        bool interruptInhibitFlag;
+        bool frameInterruptFlag;
+
+        uint64_t frameCounter;
+        uint64_t totalCycles;
+
+        // Cycles the APU still has to catch up on, and how many it can fall behind before it has to
+        uint32_t pendingCycles;
+        uint32_t cyclesUntilSync;
+
+        // The catch-up counters are rebuilt after loading, so they are left out
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("pulses", &State::pulses),
+                makeField("triangle", &State::triangle),
+                makeField("noise", &State::noise),
+                makeField("dmc", &State::dmc),
+                makeField("status", &State::status),
+                makeField("frameSequenceMode", &State::frameSequenceMode),
+                makeField("interruptInhibitFlag", &State::interruptInhibitFlag),
+                makeField("frameInterruptFlag", &State::frameInterruptFlag),
+                makeField("frameCounter", &State::frameCounter),
+                makeField("totalCycles", &State::totalCycles)
+            );
+        }
+    };
 
-    uint64_t frameCounter;
-    uint64_t totalCycles;
+private:
+    Bus* bus; // Null for a replica
+    State& state;
 
-    Bus& bus;
+    APUThread* apuThread;
+    bool runsChannels() const;
 
-    const std::array<uint8_t, 4> DUTY_CYCLES = {
+    static constexpr std::array<uint8_t, 4> DUTY_CYCLES = {
         0b00000001,
         0b00000011,
         0b00001111,
@@ -219,6 +358,10 @@ private:
     static constexpr int FOUR_STEP_SEQUENCE_LENGTH = 29830;
     static constexpr int FIVE_STEP_SEQUENCE_LENGTH = 37282;
 
+    // Positions within each sequence where the frame sequencer does something
+    static constexpr std::array<uint16_t, 6> FOUR_STEP_SEQUENCE_STEPS = { 0, STEP_SEQUENCE[0], STEP_SEQUENCE[1], STEP_SEQUENCE[2], STEP_SEQUENCE[3] - 1, STEP_SEQUENCE[3] };
+    static constexpr std::array<uint16_t, 4> FIVE_STEP_SEQUENCE_STEPS = { STEP_SEQUENCE[0], STEP_SEQUENCE[1], STEP_SEQUENCE[2], STEP_SEQUENCE[4] };
+
     static constexpr std::array<uint8_t, 0x20> LENGTH_COUNTER_TABLE = {
         10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
         12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
@@ -237,10 +380,36 @@ private:
         428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
     };
 
+    // Audio output is not part of the emulated state
+    BlipBuffer audioBuffer;
+    double audioClockRate;
+    int32_t audioAmplitude;
+    uint32_t audioFrameCycles;
+    void updateAudioOutput();
+
+    bool audioOutputEnabled;
+    int32_t disabledAudioAmplitude;
+    uint32_t disabledAudioFrameCycles;
+
+    // The analog filters between the mixer and the audio output of the console, see https://www.nesdev.org/wiki/APU_Mixer
+    AudioFilter highPassFilter90Hz{ AudioFilter::Type::HIGH_PASS, 90.0 };
+    AudioFilter highPassFilter440Hz{ AudioFilter::Type::HIGH_PASS, 440.0 };
+    AudioFilter lowPassFilter14kHz{ AudioFilter::Type::LOW_PASS, 14000.0 };
+
+    static constexpr uint32_t NO_EVENT = UINT32_MAX;
+    void scheduleSync();
+    uint32_t cyclesUntilFrameStep(uint64_t frameCounter) const;
+    void runFrameStep();
+    uint32_t cyclesUntilTimerEvent() const;
+    void clockTimers();
+    void skipCycles(uint32_t cycles);
+    bool isTriangleTimerRunning() const;
+
     void quarterClock();
     void halfClock();
 
     void restartDmcSample();
+    void requestDmcSample();
 
     bool getPulseStatus(bool pulseNum) const;
 };
@@ -0,0 +1,97 @@
+#ifndef APUTHREAD_HPP
+#define APUTHREAD_HPP
+
+#include "core/apu.hpp"
+#include "util/blipbuffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the channel logic and mixing of the APU on a dedicated thread.
+// Apart from $4015 reads, the frame IRQ and DMC DMA, the rest of the console never sees what the APU does.
+// So while a thread is attached, the console's APU only keeps the frame sequencer, the length counters and the DMC up to date,
+// and logs everything that changes the APU from outside together with the cycle it happened on.
+// A replica of the APU replays the log on this thread, reproducing the channel outputs cycle for cycle, and synthesizes the audio.
+class APUThread {
+public:
+    // Called on the APU thread with each frame of samples
+    using SampleCallback = std::function<void(const float* samples, size_t numSamples)>;
+
+    APUThread(SampleCallback sampleCallback);
+    ~APUThread();
+
+    APUThread(const APUThread&) = delete;
+    APUThread& operator=(const APUThread&) = delete;
+
+    void setAudioRates(double clockRate, double sampleRate);
+
+    // Takes effect from the next audio frame the APU thread synthesizes
+    void adjustAudioSampleRate(double sampleRate);
+
+    // Logging, called by the console's APU once it has caught up to the given cycle
+    void logWrite(uint64_t cycle, uint16_t addr, uint8_t value);
+    void logReadStatus(uint64_t cycle);
+    void logDMCSample(uint64_t cycle, uint8_t sample);
+
+    // Ends the audio frame on the given cycle and hands the log of the frame over to the APU thread
+    void logEndAudioFrame(uint64_t cycle);
+
+    // Replaces the state of the replica, after the console's APU has been reset or loaded
+    void restart(const APU::State& state);
+
+    // Waits for the replica to catch up to the given cycle and copies out its state, which includes the up to date channel state
+    void fetchState(uint64_t cycle, APU::State& state);
+
+private:
+    struct LogEntry {
+        enum class Type : uint8_t {
+            WRITE,
+            READ_STATUS,
+            DMC_SAMPLE,
+            END_AUDIO_FRAME
+        };
+
+        uint64_t cycle;
+        Type type;
+        uint16_t addr;
+        uint8_t value;
+    };
+
+    SampleCallback sampleCallback;
+
+    // Only touched by the emulation thread
+    std::vector<LogEntry> log;
+
+    // Shared between both threads, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable idleCondition;
+    std::vector<LogEntry> submittedLog;
+    bool replaying;
+    bool stopRequested;
+
+    // Zero when no adjustment is pending
+    std::atomic<double> adjustedSampleRate;
+
+    // Only touched by the APU thread, or by the emulation thread while the APU thread is idle
+    std::vector<LogEntry> replayLog;
+    APU::State replicaState;
+    APU replica;
+    std::array<float, BlipBuffer::MAX_SAMPLES> frameSamples;
+
+    std::thread thread;
+
+    void run();
+    void replay(const LogEntry& entry);
+    void submitLog(); // Called with the mutex held
+    void waitUntilIdle(std::unique_lock<std::mutex>& lock);
+};
+
+#endif // APUTHREAD_HPP
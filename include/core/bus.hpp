@@ -6,44 +6,95 @@
 #include "core/controller.hpp"
 #include "core/cpu.hpp"
 #include "core/ppu.hpp"
+#include "util/schema.hpp"
 #include "util/serializer.hpp"
 #include "util/util.hpp"
+#include "util/writetracker.hpp"
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <type_traits>
 
 class Bus {
 public:
+    struct State;
+    struct Snapshot;
+
+    // Has to be bumped by any change that makes the core run a game differently,
+    // since states cached by an older core would no longer match what this one would have run into, see WarmStartCache
+    static constexpr uint32_t CORE_VERSION = 1;
+
     Bus();
 
+    // The components hold references into the console, so it can only be copied with clone
+    Bus(const Bus&) = delete;
+    Bus& operator=(const Bus&) = delete;
+
     Cartridge::Status tryInitDevices(const std::string& filePath);
+
+    // An independent console in the same state as this one, for trying different input from the same point, e.g. in a tree search.
+    // The ROM data is shared instead of copied, and nothing is read from disk. Returns nullptr if no ROM has been loaded.
+    // Only the emulated state is copied: the clone's display is blank until it finishes a frame, and its audio output starts empty.
+    // A clone can be brought back to the state of any console running the same ROM with saveSnapshot and loadSnapshot,
+    // which is cheaper than making a new one.
+    std::unique_ptr<Bus> clone() const;
     void reset();
 
     uint8_t view(uint16_t address) const;
     uint8_t read(uint16_t address);
     void write(uint16_t address, uint8_t value);
 
+    void executeCycle();
 
-    std::unique_ptr<Cartridge> cartridge;
+    // Runs a cycle without the PPU, for playing music files that only need the CPU and the APU
+    void executeAudioCycle();
 
-    std::unique_ptr<APU> apu;
-    std::unique_ptr<CPU> cpu;
-    std::unique_ptr<PPU> ppu;
+    void setController(bool controller, uint8_t value);
 
-    uint64_t totalCycles;
+    void requestDmcDma(uint16_t address);
 
-    void executeCycle();
+    // The MMC3 scanline counter is only brought up to date when its registers or the rendering state change, or when it raises an IRQ.
+    // It has to be synchronized before the mapper is serialized, and restarted after the console has been loaded from a save state.
+    void synchronizeScanlineCounter();
+    void restartScanlineCounter();
 
-    void setController(bool controller, uint8_t value);
+    // Snapshots copy the entire state block, so they can only be loaded back into a Bus running the same ROM
+    void saveSnapshot(State& snapshot) const;
+    void loadSnapshot(const State& snapshot);
 
-    void requestDmcDma(uint16_t address);
+    // Incremental snapshots only copy the pages written since the snapshot was last saved.
+    // Loading one copies back only the pages written since it was saved, so it has to have been saved at least once.
+    void saveSnapshot(Snapshot& snapshot);
+    void loadSnapshot(const Snapshot& snapshot);
 
     // Serialization
     void serialize(Serializer& s) const;
     void deserialize(Deserializer& d);
 
+    // The whole console, as stored in save states: bus, CPU, PPU, APU and mapper, in that order.
+    // The APU and the MMC3 scanline counter are brought up to date before they are serialized, and the counter is restarted
+    // after the console has been deserialized. A console that failed to deserialize (!d.good()) is left partly loaded.
+    void serializeAll(Serializer& s);
+    void deserializeAll(Deserializer& d);
+
+    // A 64-bit hash of each part of the emulated state, quick enough to take every frame.
+    // Covers the same state as a save state, so two consoles that ran the same ROM with the same input should always match.
+    struct StateHashes {
+        uint64_t bus;
+        uint64_t cpu;
+        uint64_t ppu;
+        uint64_t apu;
+        uint64_t mapper;
+
+        uint64_t combined() const;
+    };
+    StateHashes hashState();
+
 private:
     void resetBus();
+    void attachScanlineCounter();
+    void executeCPUCycle(); // Everything in a cycle apart from the PPU and interrupt handling
 
     // Memory ranges for devices
     static constexpr MemoryRange RAM_ADDRESSABLE_RANGE{ 0x0000, 0x1FFF };
@@ -51,18 +102,9 @@ private:
     static constexpr MemoryRange IO_ADDRESSABLE_RANGE{ 0x4000, 0x401F };
     static constexpr MemoryRange CARTRIDGE_ADDRESSABLE_RANGE{ 0x4020, 0xFFFF };
 
-    std::array<uint8_t, 0x800> ram;
-
     static constexpr uint16_t CONTROLLER_1_DATA = 0x4016;
     static constexpr uint16_t CONTROLLER_2_DATA = 0x4017;
 
-    // TODO: Consider adding NES zapper support
-    std::array<Controller, 2> controllers;
-
-    // After a write to 0x4016 we read controller information into here
-    std::array<uint8_t, 2> controllerData;
-    bool strobe;
-
     static constexpr uint16_t OAM_DMA_ADDR = 0x4014;
 
     struct OamDma {
@@ -71,8 +113,17 @@ private:
         uint8_t page;
         uint8_t offset;
         uint8_t data;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("requested", &OamDma::requested),
+                makeField("ongoing", &OamDma::ongoing),
+                makeField("page", &OamDma::page),
+                makeField("offset", &OamDma::offset),
+                makeField("data", &OamDma::data)
+            );
+        }
     };
-    OamDma oamDma;
     void oamDmaCycle();
 
     struct DmcDma {
@@ -81,13 +132,95 @@ private:
         uint16_t address;
         uint8_t data;
         uint8_t delay;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("requested", &DmcDma::requested),
+                makeField("ongoing", &DmcDma::ongoing),
+                makeField("address", &DmcDma::address),
+                makeField("data", &DmcDma::data),
+                makeField("delay", &DmcDma::delay)
+            );
+        }
     };
-    DmcDma dmcDma;
     void dmcDmaCycle();
 
     static constexpr MemoryRange APU_ADDRESSABLE_RANGE{ 0x4000, 0x4013 };
     static constexpr uint16_t APU_STATUS = 0x4015;
     static constexpr uint16_t APU_FRAME_COUNTER = 0x4017;
+
+    // Writes that can change when the MMC3 raises its next IRQ
+    static constexpr uint8_t PPU_MASK_REGISTER = static_cast<uint8_t>(PPU::Register::PPUMASK);
+    static constexpr MemoryRange SCANLINE_COUNTER_REGISTERS{ 0xC000, 0xFFFF };
+
+    struct ScanlineCounter {
+        static constexpr uint64_t NEVER = UINT64_MAX;
+        uint64_t irqDot; // The PPU dot on which the counter raises its next IRQ
+        uint64_t syncDot; // The counter has been clocked for every dot before this one
+        PPU::FramePosition syncPosition;
+    };
+
+public:
+    // All emulated state in the console. Only the ROM data and the host-side display buffers live outside of this block.
+    // Each component keeps a reference to its own part of the block instead of storing its state inline.
+    struct State {
+        std::array<uint8_t, 0x800> ram;
+
+        // TODO: Consider adding NES zapper support
+        std::array<Controller, 2> controllers;
+
+        // After a write to 0x4016 we read controller information into here
+        std::array<uint8_t, 2> controllerData;
+        bool strobe;
+
+        uint64_t totalCycles;
+
+        OamDma oamDma;
+        DmcDma dmcDma;
+        ScanlineCounter scanlineCounter;
+
+        CPU::State cpu;
+        PPU::State ppu;
+        APU::State apu;
+        Mapper::State mapper;
+
+        // Only the bus's own part of the block. The components serialize their parts themselves.
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("totalCycles", &State::totalCycles),
+                makeField("ram", &State::ram),
+                makeField("controllerData", &State::controllerData),
+                makeField("strobe", &State::strobe),
+                makeField("oamDma", &State::oamDma),
+                makeField("dmcDma", &State::dmcDma)
+            );
+        }
+    };
+    static_assert(std::is_trivially_copyable<State>::value, "Console state must be trivially copyable");
+
+    struct Snapshot {
+        std::unique_ptr<State> state;
+        uint64_t generation = 0; // The write tracker generation the snapshot was last saved at, 0 if it never was
+    };
+
+    State state;
+
+    // Knows which pages of the state block were written when, for incremental snapshots.
+    // The RAM, the PPU memories and the cartridge RAM are tracked, which is most of the block.
+    WriteTracker writeTracker;
+
+    // The components are owned by value, so the whole console is a single object with no heap allocations.
+    // They are declared after the state block since they bind references into it during construction.
+    Cartridge cartridge;
+    APU apu;
+    CPU cpu;
+    PPU ppu;
+
+private:
+    // Points into the cartridge for MMC3 cartridges, otherwise nullptr
+    Mapper4* scanlineCounter;
+
+    void copyWrittenPages(const State& from, State& to, uint64_t since, bool markCopied);
 };
 
 #endif // BUS_HPP
\ No newline at end of file
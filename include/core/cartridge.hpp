@@ -2,6 +2,16 @@
 #define CARTRIDGE_HPP
 
 #include "core/mapper/mapper.hpp"
+#include "core/mapper/mapper0.hpp"
+#include "core/mapper/mapper1.hpp"
+#include "core/mapper/mapper2.hpp"
+#include "core/mapper/mapper3.hpp"
+#include "core/mapper/mapper4.hpp"
+#include "core/mapper/mapper7.hpp"
+#include "core/mapper/mapper9.hpp"
+#include "core/mapper/mapper66.hpp"
+#include "core/mapper/mappernsf.hpp"
+#include "core/romimage.hpp"
 
 #include "util/util.hpp"
 
@@ -9,10 +19,13 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 class Cartridge {
 public:
-    Cartridge(const std::string& filePath);
+    Cartridge();
 
     enum class Code {
         SUCCESS,
@@ -31,13 +44,74 @@ public:
         std::string message;
     };
 
+    Status load(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker);
+
+    // Loads the same ROM as another cartridge, sharing its image instead of opening the file again
+    Status loadFrom(const Cartridge& other, Mapper::State& mapperState, WriteTracker& writeTracker);
     Status getStatus() const;
 
-    std::unique_ptr<Mapper> mapper;
+    // The image of the loaded ROM file, or nullptr if no ROM has been loaded
+    const std::shared_ptr<const RomImage>& getRomImage() const;
+
+    // The header of the loaded NSF file, or nullptr if the loaded file is a regular ROM
+    const MapperNSF::Header* getNsfHeader() const;
+
+    // Points into mapperStorage once a ROM has been loaded, otherwise nullptr
+    Mapper* mapper;
+
+    // The mapper calls made while the console runs. They dispatch on the type held in mapperStorage instead of going through mapper,
+    // and the mappers are final, so each one is a direct call that the compiler can inline. Only valid once a ROM has been loaded.
+    uint8_t mapPRGView(uint16_t cpuAddress) const {
+        return visitMapper(mapperStorage, [cpuAddress](const auto& m) { return m.mapPRGView(cpuAddress); });
+    }
+    uint8_t mapPRGRead(uint16_t cpuAddress) {
+        return visitMapper(mapperStorage, [cpuAddress](auto& m) { return m.mapPRGRead(cpuAddress); });
+    }
+    void mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
+        visitMapper(mapperStorage, [cpuAddress, value](auto& m) { m.mapPRGWrite(cpuAddress, value); });
+    }
+
+    uint8_t mapCHRView(uint16_t ppuAddress) const {
+        return visitMapper(mapperStorage, [ppuAddress](const auto& m) { return m.mapCHRView(ppuAddress); });
+    }
+    uint8_t mapCHRRead(uint16_t ppuAddress) {
+        return visitMapper(mapperStorage, [ppuAddress](auto& m) { return m.mapCHRRead(ppuAddress); });
+    }
+    void mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
+        visitMapper(mapperStorage, [ppuAddress, value](auto& m) { m.mapCHRWrite(ppuAddress, value); });
+    }
+
+    Mapper::MirrorMode getMirrorMode() const {
+        return visitMapper(mapperStorage, [](const auto& m) { return m.getMirrorMode(); });
+    }
 
 private:
     Status status;
-    Status loadINESFile(const std::string& filePath);
+    Status loadINESFile(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker);
+    Status loadNSFFile(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker);
+    Status loadINESImage(std::shared_ptr<const RomImage> image, Mapper::State& mapperState, WriteTracker& writeTracker);
+    Status loadNSFImage(std::shared_ptr<const RomImage> image, Mapper::State& mapperState, WriteTracker& writeTracker);
+
+    // Holds the PRG and CHR data of the loaded ROM, shared with any other cartridge that loaded the same file
+    std::shared_ptr<const RomImage> romImage;
+
+    // The mapper is constructed in place so that it is stored inside the cartridge instead of on the heap
+    std::variant<std::monostate, Mapper0, Mapper1, Mapper2, Mapper3, Mapper4, Mapper7, Mapper9, Mapper66, MapperNSF> mapperStorage;
+    Mapper* createMapper(const Mapper::Config& config, ByteView prg, ByteView chr, Mapper::State& mapperState, WriteTracker& writeTracker);
+
+    // Calls function with the mapper in storage as its own type. Nothing is called while no mapper has been created.
+    template <typename Storage, typename Function>
+    static auto visitMapper(Storage& storage, const Function& function) -> decltype(function(std::get<Mapper0>(storage))) {
+        using Result = decltype(function(std::get<Mapper0>(storage)));
+        return std::visit([&function](auto& m) -> Result {
+            if constexpr (std::is_same<std::decay_t<decltype(m)>, std::monostate>::value) {
+                return Result();
+            }
+            else {
+                return function(m);
+            }
+        }, storage);
+    }
 };
 
 #endif // CARTRIDGE_HPP
@@ -1,6 +1,7 @@
 #ifndef CPU_HPP
 #define CPU_HPP
 
+#include "util/schema.hpp"
 #include "util/serializer.hpp"
 #include "util/util.hpp"
 
@@ -95,30 +96,51 @@ private:
     // +--------- Negative
     struct StatusRegister {
         uint8_t data;
-        BitField<0, 1> carry{ data };
-        BitField<1, 1> zero{ data };
-        BitField<2, 1> interrupt{ data };
-        BitField<3, 1> decimal{ data }; // Unimplemented - not used on the NES
-        BitField<4, 1> break_{ data };
-        BitField<5, 1> unused{ data };
-        BitField<6, 1> overflow{ data };
-        BitField<7, 1> negative{ data };
+
+        using Carry = BitField<0, 1>;
+        using Zero = BitField<1, 1>;
+        using Interrupt = BitField<2, 1>;
+        using Decimal = BitField<3, 1>; // Unimplemented - not used on the NES
+        using Break = BitField<4, 1>;
+        using Unused = BitField<5, 1>;
+        using Overflow = BitField<6, 1>;
+        using Negative = BitField<7, 1>;
     };
 
-    // CPU state variables
-    uint16_t pc; // program counter
-    uint8_t a; // accumulator
-    uint8_t x; // x register
-    uint8_t y; // y register
-    StatusRegister sr; // status register
-    uint8_t sp; // stack pointer
-
-    // Helper variables
-    uint8_t remainingCycles;
-    bool shouldAdvancePC;
+public:
+    // All emulated CPU state. It is stored inside the Bus state block rather than in the CPU itself,
+    // so that the whole console can be snapshotted with a single memcpy.
+    struct State {
+        uint16_t pc; // program counter
+        uint8_t a; // accumulator
+        uint8_t x; // x register
+        uint8_t y; // y register
+        StatusRegister sr; // status register
+        uint8_t sp; // stack pointer
+
+        // Helper variables
+        uint8_t remainingCycles;
+        bool shouldAdvancePC;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("pc", &State::pc),
+                makeField("a", &State::a),
+                makeField("x", &State::x),
+                makeField("y", &State::y),
+                makeField("sr", &State::sr),
+                makeField("sp", &State::sp),
+                makeField("remainingCycles", &State::remainingCycles),
+                makeField("shouldAdvancePC", &State::shouldAdvancePC)
+            );
+        }
+    };
+
+private:
     static const std::array<Opcode, MAX_NUM_OPCODES> lookup;
 
     Bus& bus;
+    State& state;
 
     // Initialization
     static std::array<Opcode, MAX_NUM_OPCODES> initLookup();
@@ -134,7 +156,7 @@ private:
     uint16_t pop16BitDataFromStack();
 
     // Flags
-    void setNZFlags(uint8_t x);
+    void setNZFlags(uint8_t value);
     void pushFlagsToStack(bool breakFlagValue);
 
     // Addressing mode functions
@@ -1,13 +1,19 @@
 #ifndef MAPPER_HPP
 #define MAPPER_HPP
 
+#include "util/schema.hpp"
 #include "util/serializer.hpp"
+#include "util/statehash.hpp"
 #include "util/util.hpp"
+#include "util/writetracker.hpp"
 
+#include <array>
 #include <cstdint>
-#include <memory>
+#include <functional>
+#include <new>
 #include <optional>
-#include <vector>
+#include <string>
+#include <type_traits>
 
 class Mapper {
 public:
@@ -31,43 +37,71 @@ public:
         bool alternativeNametableLayout;
     };
 
+    // All emulated cartridge state. This lives inside the Bus state block, so every mapper uses the same layout:
+    // mapper specific registers are placed in a small fixed region at the front, followed by the cartridge RAM.
+    struct State {
+        static constexpr size_t MAX_REGISTERS_SIZE = 32;
+        alignas(uint64_t) std::array<uint8_t, MAX_REGISTERS_SIZE> registers;
+
+        std::array<uint8_t, 8 * KB> prgRam;
+        std::array<uint8_t, 8 * KB> chrRam;
+
+        // Extra nametable memory for cartridges that use a four screen layout
+        std::array<uint8_t, 4 * KB> nametableRam;
+
+        // Only the RAM. Each mapper lays out its own registers, and lists them in a schema of its own.
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("prgRam", &State::prgRam),
+                makeField("chrRam", &State::chrRam),
+                makeField("nametableRam", &State::nametableRam)
+            );
+        }
+    };
+
     const Config config;
     virtual ~Mapper() = default;
 
     virtual void reset() = 0;
 
-    static std::unique_ptr<Mapper> createMapper(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
-
     // "View" is different from "read" because view functions do not change the state of the mapper.
     // This gives us a way to see the internals of the cartridge without modifying the state of the mapper.
     // This can be useful for debugging.
     // By default, the "read" methods function the same as the "view" methods, but this behavior can be overridden by mappers that change state after reads.
     virtual uint8_t mapPRGView(uint16_t cpuAddress) const = 0;
-    virtual uint8_t mapPRGRead(uint16_t cpuAddress);
+    virtual uint8_t mapPRGRead(uint16_t cpuAddress) { return mapPRGView(cpuAddress); }
     virtual void mapPRGWrite(uint16_t cpuAddress, uint8_t value) = 0;
 
     virtual uint8_t mapCHRView(uint16_t ppuAddress) const = 0;
-    virtual uint8_t mapCHRRead(uint16_t ppuAddress);
+    virtual uint8_t mapCHRRead(uint16_t ppuAddress) { return mapCHRView(ppuAddress); }
     virtual void mapCHRWrite(uint16_t ppuAddress, uint8_t value) = 0;
 
     // By default this returns the mirror mode that was set by the cartridge, but some mappers change the mirroring on their own.
-    virtual MirrorMode getMirrorMode() const;
+    virtual MirrorMode getMirrorMode() const { return config.initialMirrorMode; }
 
     // Serialization
     virtual void serialize(Serializer& s) const = 0;
     virtual void deserialize(Deserializer& d) = 0;
 
+    // Calls onDifference with the path of every register and RAM value that differs from another mapper of the same type,
+    // e.g. "registers.irqTimer" or "prgRam[42]"
+    using OnDifference = std::function<void(const std::string& path)>;
+    void diff(const Mapper& other, const OnDifference& onDifference) const;
+
+    // Hashes the registers and all of the cartridge RAM, for Bus::hashState
+    void hash(StateHash& h) const;
+
 private:
     template<uint16_t rangeStart, uint16_t rangeEnd>
     struct Ram8KB {
-        Ram8KB(bool enable) : isEnabled(enable) {
+        using Data = std::array<uint8_t, 8 * KB>;
+
+        Ram8KB(bool enable, Data& data, WriteTracker& writeTracker) : isEnabled(enable), data(data), writeTracker(writeTracker) {
             reset();
         }
 
         void reset() {
-            if (isEnabled) {
-                data.assign(8 * KB, 0);
-            }
+            data.fill(0);
         }
 
         std::optional<uint8_t> tryRead(uint16_t address) const {
@@ -79,14 +113,26 @@ private:
 
         bool tryWrite(uint16_t address, uint8_t value) {
             if (isEnabled && range.contains(address)) {
-                data[address & MASK<8 * KB>()] = value;
+                uint8_t& byte = data[address & MASK<8 * KB>()];
+                byte = value;
+                writeTracker.markWritten(&byte);
                 return true;
             }
             return false;
         }
 
+        // Disabled RAM is stored as an empty vector so that the save state format does not depend on the RAM size
+        void serialize(Serializer& s) const {
+            s.serializePartialArray(data, isEnabled ? data.size() : 0);
+        }
+
+        void deserialize(Deserializer& d) {
+            d.deserializePartialArray(data);
+        }
+
         const bool isEnabled;
-        std::vector<uint8_t> data;
+        Data& data;
+        WriteTracker& writeTracker;
 
         static constexpr MemoryRange range{ rangeStart, rangeEnd };
         static_assert(range.size() == 8 * KB, "Memory must be 8KB");
@@ -96,10 +142,29 @@ private:
     static constexpr MemoryRange PRG_RAM_RANGE{ 0x6000, 0x7FFF };
 
 protected:
-    Mapper(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
+
+    // ROM data is owned by the cartridge
+    const ByteView prg;
+    const ByteView chr;
+
+    State& state;
+
+    // Writes to the RAM in the state block are marked here, the registers are small enough to be copied with every snapshot
+    WriteTracker& writeTracker;
+
+    // Mappers with registers diff and hash them with the schema of their register struct
+    virtual void diffRegisters(const Mapper& other, const OnDifference& onDifference) const;
+    virtual void hashRegisters(StateHash& h) const;
 
-    const std::vector<uint8_t> prg;
-    const std::vector<uint8_t> chr;
+    // Constructs a mapper's register struct in the register region of the state block
+    template <typename Registers>
+    Registers& createRegisters() {
+        static_assert(std::is_trivially_copyable<Registers>::value, "Mapper registers must be trivially copyable");
+        static_assert(sizeof(Registers) <= State::MAX_REGISTERS_SIZE, "Mapper registers do not fit in the state block");
+        static_assert(alignof(Registers) <= alignof(uint64_t), "Mapper registers are over-aligned");
+        return *new (state.registers.data()) Registers{};
+    }
 
     static constexpr MemoryRange PRG_RANGE{ 0x8000, 0xFFFF };
     static constexpr MemoryRange CHR_RANGE{ 0x0000, 0x1FFF };
@@ -109,7 +174,7 @@ protected:
     using ChrRam = Ram8KB<CHR_RANGE.lo, CHR_RANGE.hi>;
 
     // Helper function to choose whether to read from CHR ROM or RAM
-    static uint8_t readChrRomOrRam(uint32_t mappedAddress, const std::vector<uint8_t>& chr, const ChrRam& chrRam);
+    static uint8_t readChrRomOrRam(uint32_t mappedAddress, ByteView chr, const ChrRam& chrRam);
 };
 
 #endif // MAPPER_HPP
\ No newline at end of file
@@ -3,9 +3,9 @@
 
 #include "core/mapper/mapper.hpp"
 
-class Mapper0 : public Mapper {
+class Mapper0 final : public Mapper {
 public:
-    Mapper0(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper0(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
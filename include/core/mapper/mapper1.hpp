@@ -7,9 +7,9 @@
 
 #include <array>
 
-class Mapper1 : public Mapper {
+class Mapper1 final : public Mapper {
 public:
-    Mapper1(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper1(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
@@ -44,7 +44,6 @@ private:
 
     void internalRegisterWrite(uint16_t address, uint8_t value);
 
-    uint8_t shiftRegister;
     static constexpr uint8_t SHIFT_REGISTER_RESET = 0x10;
 
     // Mapper 1 Control (https://www.nesdev.org/wiki/MMC1)
@@ -60,14 +59,11 @@ private:
     // +----- CHR ROM bank mode (0: switch 8 KB at a time; 1: switch two separate 4 KB banks)
     struct Control {
         uint8_t data;
-        BitField<0, 2> mirroring{ data };
-        BitField<2, 2> prgRomMode{ data };
-        BitField<4, 1> chrRomMode{ data };
-    };
-    Control control;
 
-    uint8_t chrBank0;
-    uint8_t chrBank1;
+        using Mirroring = BitField<0, 2>;
+        using PrgRomMode = BitField<2, 2>;
+        using ChrRomMode = BitField<4, 1>;
+    };
 
     // 4bit0
     // -----
@@ -79,10 +75,31 @@ private:
     //     1: fixed bank affects A16-A14 and bit 3 directly controls A17)
     struct PRGBank {
         uint8_t data;
-        BitField<0, 4> prgRomSelect{ data };
-        BitField<4, 1> prgRamDisable{ data };
+
+        using PrgRomSelect = BitField<0, 4>;
+        using PrgRamDisable = BitField<4, 1>;
+    };
+
+    struct Registers {
+        uint8_t shiftRegister;
+        Control control;
+        uint8_t chrBank0;
+        uint8_t chrBank1;
+        PRGBank prgBank;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("shiftRegister", &Registers::shiftRegister),
+                makeField("control", &Registers::control),
+                makeField("chrBank0", &Registers::chrBank0),
+                makeField("chrBank1", &Registers::chrBank1),
+                makeField("prgBank", &Registers::prgBank)
+            );
+        }
     };
-    PRGBank prgBank;
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
     ChrRam chrRam;
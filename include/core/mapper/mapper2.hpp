@@ -5,9 +5,9 @@
 
 #include "util/util.hpp"
 
-class Mapper2 : public Mapper {
+class Mapper2 final : public Mapper {
 public:
-    Mapper2(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper2(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
@@ -25,7 +25,19 @@ private:
     static constexpr MemoryRange PRG_RANGE_SWICHABLE{ 0x8000, 0xBFFF };
     static constexpr MemoryRange PRG_RANGE_FIXED{ 0xC000, 0xFFFF };
     static constexpr MemoryRange BANK_SELECT_RANGE = PRG_RANGE;
-    uint8_t currentBank;
+
+    struct Registers {
+        uint8_t currentBank;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("currentBank", &Registers::currentBank)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
     ChrRam chrRam;
@@ -5,9 +5,9 @@
 
 #include "util/util.hpp"
 
-class Mapper3 : public Mapper {
+class Mapper3 final : public Mapper {
 public:
-    Mapper3(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper3(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
     
@@ -23,7 +23,19 @@ public:
 
 private:
     static constexpr MemoryRange BANK_SELECT_RANGE = PRG_RANGE;
-    uint8_t currentBank;
+
+    struct Registers {
+        uint8_t currentBank;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("currentBank", &Registers::currentBank)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
 };
@@ -5,9 +5,9 @@
 
 #include <array>
 
-class Mapper4 : public Mapper {
+class Mapper4 final : public Mapper {
 public:
-    Mapper4(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper4(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
@@ -19,7 +19,10 @@ public:
 
     MirrorMode getMirrorMode() const override;
 
-    void clockIRQTimer();
+    // The IRQ counter is clocked once per rendered scanline. It is not clocked as it happens,
+    // so the bus catches it up on several clocks at once and asks how many clocks are left until the next IRQ.
+    void clockIRQTimer(uint64_t clocks);
+    uint32_t clocksUntilIRQ() const; // 0 if the counter will not raise an IRQ
     bool irqRequested() const;
 
     // Serialization
@@ -48,21 +51,42 @@ private:
     static constexpr MemoryRange IRQ_DISABLE_OR_IRQ_ENABLE{ 0xE000, 0xFFFF };
 
     // Some games use special nametable mirroring and have custom nametables within the mapper itself
+    // These are stored in the nametable RAM of the mapper state
     static constexpr MemoryRange ALTERNATIVE_NAMETABLE_RANGE{0x2000, 0x2FFF};
-    std::vector<uint8_t> customNametable;
-
-    uint8_t bankSelect;
-    uint8_t bankData;
-    bool mirroring;
-    uint8_t prgRamProtect;
-    uint8_t irqReloadValue;
-    uint8_t irqTimer;
-    bool irqEnabled;
-    bool irqReloadPending;
-    bool irqRequest;
-
-    std::array<uint8_t, 2> prgSwitchableBankSelect;
-    std::array<uint8_t, 6> chrSwitchableBankSelect;
+
+    struct Registers {
+        uint8_t bankSelect;
+        uint8_t bankData;
+        bool mirroring;
+        uint8_t prgRamProtect;
+        uint8_t irqReloadValue;
+        uint8_t irqTimer;
+        bool irqEnabled;
+        bool irqReloadPending;
+        bool irqRequest;
+
+        std::array<uint8_t, 2> prgSwitchableBankSelect;
+        std::array<uint8_t, 6> chrSwitchableBankSelect;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("bankSelect", &Registers::bankSelect),
+                makeField("bankData", &Registers::bankData),
+                makeField("mirroring", &Registers::mirroring),
+                makeField("prgRamProtect", &Registers::prgRamProtect),
+                makeField("irqReloadValue", &Registers::irqReloadValue),
+                makeField("irqTimer", &Registers::irqTimer),
+                makeField("irqEnabled", &Registers::irqEnabled),
+                makeField("irqReloadPending", &Registers::irqReloadPending),
+                makeField("irqRequest", &Registers::irqRequest),
+                makeField("prgSwitchableBankSelect", &Registers::prgSwitchableBankSelect),
+                makeField("chrSwitchableBankSelect", &Registers::chrSwitchableBankSelect)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
 
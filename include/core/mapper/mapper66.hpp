@@ -5,9 +5,9 @@
 
 #include "util/util.hpp"
 
-class Mapper66 : public Mapper {
+class Mapper66 final : public Mapper {
 public:
-    Mapper66(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper66(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
@@ -23,8 +23,21 @@ public:
 
 private:
     static constexpr MemoryRange BANK_SELECT_RANGE = PRG_RANGE;
-    uint8_t currentPRGBank;
-    uint8_t currentCHRBank;
+
+    struct Registers {
+        uint8_t currentPRGBank;
+        uint8_t currentCHRBank;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("currentPRGBank", &Registers::currentPRGBank),
+                makeField("currentCHRBank", &Registers::currentCHRBank)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
 };
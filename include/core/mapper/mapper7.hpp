@@ -3,9 +3,9 @@
 
 #include "core/mapper/mapper.hpp"
 
-class Mapper7 : public Mapper {
+class Mapper7 final : public Mapper {
 public:
-    Mapper7(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper7(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
 
@@ -22,7 +22,19 @@ public:
     void deserialize(Deserializer& d) override;
 
 private:
-    uint8_t bankSelect;
+    struct Registers {
+        uint8_t bankSelect;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("bankSelect", &Registers::bankSelect)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
+
     PrgRam prgRam;
     ChrRam chrRam;
 };
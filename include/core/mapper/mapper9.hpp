@@ -5,9 +5,9 @@
 
 #include <array>
 
-class Mapper9 : public Mapper {
+class Mapper9 final : public Mapper {
 public:
-    Mapper9(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr);
+    Mapper9(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker);
 
     void reset() override;
     
@@ -44,14 +44,30 @@ private:
     static constexpr MemoryRange LATCH_2_DISABLE{ 0x1FD8, 0x1FDF };
     static constexpr MemoryRange LATCH_2_ENABLE{ 0x1FE8, 0x1FEF };
 
-    uint8_t prgBankSelect;
+    struct Registers {
+        uint8_t prgBankSelect;
 
-    bool chrLatch1;
-    bool chrLatch2;
-    std::array<uint8_t, 2> chrBank1Select;
-    std::array<uint8_t, 2> chrBank2Select;
+        bool chrLatch1;
+        bool chrLatch2;
+        std::array<uint8_t, 2> chrBank1Select;
+        std::array<uint8_t, 2> chrBank2Select;
 
-    bool mirroring;
+        bool mirroring;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("prgBankSelect", &Registers::prgBankSelect),
+                makeField("chrLatch1", &Registers::chrLatch1),
+                makeField("chrLatch2", &Registers::chrLatch2),
+                makeField("chrBank1Select", &Registers::chrBank1Select),
+                makeField("chrBank2Select", &Registers::chrBank2Select),
+                makeField("mirroring", &Registers::mirroring)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
 
     PrgRam prgRam;
 };
@@ -0,0 +1,74 @@
+#ifndef MAPPERNSF_HPP
+#define MAPPERNSF_HPP
+
+#include "core/mapper/mapper.hpp"
+
+#include "util/util.hpp"
+
+#include <array>
+#include <cstdint>
+
+// The "cartridge" of an NSF music file (https://www.nesdev.org/wiki/NSF).
+// NSF files have no iNES mapper number. Their data is either loaded flat at the load address,
+// or split into 4KB banks that are switched in by writing to $5FF8-$5FFF.
+// The mapper also provides a tiny idle loop that the CPU spins in between calls to the init and play routines.
+class MapperNSF final : public Mapper {
+public:
+    // The fields of the NSF header that are needed for playback
+    struct Header {
+        uint8_t songCount;
+        uint8_t startingSong; // 1-based, as stored in the file
+        uint16_t loadAddress;
+        uint16_t initAddress;
+        uint16_t playAddress;
+        uint16_t playSpeedNtsc; // Microseconds between calls to the play routine
+        std::array<uint8_t, 8> initialBanks;
+        bool isBankswitched;
+    };
+
+    // The idle loop is a single JMP to itself
+    static constexpr uint16_t IDLE_LOOP_ADDRESS = 0x5FF0;
+
+    MapperNSF(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker, const Header& header);
+
+    const Header header;
+
+    void reset() override;
+
+    uint8_t mapPRGView(uint16_t cpuAddress) const override;
+    void mapPRGWrite(uint16_t cpuAddress, uint8_t value) override;
+
+    uint8_t mapCHRView(uint16_t ppuAddress) const override;
+    void mapCHRWrite(uint16_t ppuAddress, uint8_t value) override;
+
+    // Serialization
+    void serialize(Serializer& s) const override;
+    void deserialize(Deserializer& d) override;
+
+private:
+    static constexpr MemoryRange IDLE_LOOP_RANGE{ IDLE_LOOP_ADDRESS, IDLE_LOOP_ADDRESS + 2 };
+    static constexpr MemoryRange BANK_SELECT_RANGE{ 0x5FF8, 0x5FFF };
+    static constexpr uint16_t BANK_SIZE = 4 * KB;
+
+    // Bank offsets are relative to the start of the 4KB page that contains the load address,
+    // so the first (loadAddress - page start) bytes of the first bank are padding that reads as zero
+    const uint32_t padding;
+
+    struct Registers {
+        std::array<uint8_t, 8> banks;
+
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("banks", &Registers::banks)
+            );
+        }
+    };
+    Registers& registers;
+    void diffRegisters(const Mapper& other, const OnDifference& onDifference) const override;
+    void hashRegisters(StateHash& h) const override;
+
+    PrgRam prgRam;
+    ChrRam chrRam;
+};
+
+#endif // MAPPERNSF_HPP
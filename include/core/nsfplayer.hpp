@@ -0,0 +1,50 @@
+#ifndef NSFPLAYER_HPP
+#define NSFPLAYER_HPP
+
+#include "core/bus.hpp"
+#include "core/mapper/mappernsf.hpp"
+
+#include <cstdint>
+
+// Plays the songs of an NSF file that has been loaded into a bus.
+// Only the CPU and the APU are run. The init routine is called once when a song starts,
+// and the play routine is called on a timer at the rate given in the NSF header instead of on the PPU's vblank.
+// The audio is read from the APU as usual, so songs can be rendered without a display as fast as the CPU allows.
+class NsfPlayer {
+public:
+    // NSF play speeds are given in real time, so they are converted to cycles with the NTSC clock rate
+    static constexpr uint64_t CPU_CLOCK_RATE = 1789773;
+
+    // The bus must have an NSF file loaded. Starts the song that the NSF header marks as the first one.
+    explicit NsfPlayer(Bus& bus);
+
+    uint8_t getSongCount() const;
+    uint8_t getCurrentSong() const; // 0-based
+
+    // Resets the console and calls the init routine of the given song
+    void startSong(uint8_t song);
+
+    // Runs the given number of CPU cycles, calling the play routine whenever its timer expires
+    void run(uint64_t cycles);
+
+private:
+    // 60.1Hz, for files that leave the play speed empty
+    static constexpr uint16_t DEFAULT_PLAY_SPEED = 16639;
+
+    static constexpr uint64_t MICROSECONDS_PER_SECOND = 1000000;
+
+    Bus& bus;
+    const MapperNSF::Header& header;
+    uint8_t currentSong;
+
+    // The play timer counts in millionths of a cycle, so the play speed in microseconds converts exactly
+    uint64_t playPeriod;
+    uint64_t playTimer;
+    bool playPending;
+
+    // Calls a routine as if by a JSR from the idle loop, so its RTS returns the CPU to the idle loop
+    void callRoutine(uint16_t address);
+    bool isIdle() const;
+};
+
+#endif // NSFPLAYER_HPP
@@ -2,15 +2,17 @@
 #define PPU_HPP
 
 #include "core/cartridge.hpp"
+#include "util/schema.hpp"
 #include "util/serializer.hpp"
 #include "util/util.hpp"
+#include "util/writetracker.hpp"
 
-#include <memory>
-#include <vector>
 
 class PPU {
 public:
-    PPU(Cartridge& cartridge);
+    struct State;
+
+    PPU(Cartridge& cartridge, State& state, WriteTracker& writeTracker);
     void resetPPU();
 
     enum class Register {
@@ -48,25 +50,38 @@ public:
         PatternTable backgroundPatternTable;
         PatternTable spritePatternTable;
     };
-    std::unique_ptr<PatternTables> getPatternTables(uint8_t backgroundPalleteNumber, uint8_t spritePalleteNumber) const;
+    void getPatternTables(PatternTables& tables, uint8_t backgroundPalleteNumber, uint8_t spritePalleteNumber) const;
 
     std::array<uint32_t, 0x20> getPalleteRamColors() const;
 
     void executeCycle();
 
     using Display = std::array<std::array<uint32_t, 256>, 240>;
-    std::unique_ptr<Display> finishedDisplay;
+    const Display& getFinishedDisplay() const;
 
     static constexpr uint16_t OAM_BUFFER_SIZE = 0x100;
     static constexpr uint16_t OAM_SPRITES = OAM_BUFFER_SIZE / 4;
     using OAMBuffer = std::array<uint8_t, OAM_BUFFER_SIZE>;
-    OAMBuffer oamBuffer;
 
-    bool frameReadyFlag;
+    bool frameReady() const;
+    void clearFrameReady();
 
     bool nmiRequested() const;
     void clearNMIRequest();
-    bool irqRequested() const;
+
+    bool isRenderingEnabled() const;
+
+    // The MMC3 counts scanlines by watching the PPU address bus, which it sees at dot 280 of every visible scanline while rendering is enabled.
+    // Instead of clocking the counter on each of those dots, the bus uses these to work out how many clocks it missed and when the next IRQ is due.
+    // Positions are counted in dots from the start of the pre-render scanline.
+    struct FramePosition {
+        uint32_t dot;
+        bool oddFrame;
+    };
+    FramePosition getFramePosition() const;
+    uint64_t getTotalDots() const;
+    static uint64_t countScanlineCounterClocks(FramePosition position, uint64_t dots);
+    static uint64_t dotsUntilScanlineCounterClock(FramePosition position, uint32_t clocks); // Assumes clocks >= 1
 
     // Serialization
     void serialize(Serializer& s) const;
@@ -99,15 +114,16 @@ private:
     // +--------- Generate an NMI at the start of the
     //         vertical blanking interval (0: off; 1: on)
     struct Control {
-        uint8_t data = 0;
-        BitField<0, 1> nametableX{ data };
-        BitField<1, 1> nametableY{ data };
-        BitField<2, 1> vramAddressIncrement{ data };
-        BitField<3, 1> spritePatternTable{ data };
-        BitField<4, 1> backgroundPatternTable{ data };
-        BitField<5, 1> spriteSize{ data };
-        BitField<6, 1> ppuSelect{ data };
-        BitField<7, 1> nmiEnabled{ data };
+        uint8_t data;
+
+        using NametableX = BitField<0, 1>;
+        using NametableY = BitField<1, 1>;
+        using VramAddressIncrement = BitField<2, 1>;
+        using SpritePatternTable = BitField<3, 1>;
+        using BackgroundPatternTable = BitField<4, 1>;
+        using SpriteSize = BitField<5, 1>;
+        using PpuSelect = BitField<6, 1>;
+        using NmiEnabled = BitField<7, 1>;
     };
 
     // Mask ($2001) > write
@@ -129,14 +145,15 @@ private:
     // +--------- Emphasize blue
     struct Mask {
         uint8_t data;
-        BitField<0, 1> greyscale{ data };
-        BitField<1, 1> showBackgroundLeft{ data };
-        BitField<2, 1> showSpritesLeft{ data };
-        BitField<3, 1> showBackground{ data };
-        BitField<4, 1> showSprites{ data };
-        BitField<5, 1> emphRed{ data };
-        BitField<6, 1> emphGreen{ data };
-        BitField<7, 1> emphBlue{ data };
+
+        using Greyscale = BitField<0, 1>;
+        using ShowBackgroundLeft = BitField<1, 1>;
+        using ShowSpritesLeft = BitField<2, 1>;
+        using ShowBackground = BitField<3, 1>;
+        using ShowSprites = BitField<4, 1>;
+        using EmphRed = BitField<5, 1>;
+        using EmphGreen = BitField<6, 1>;
+        using EmphBlue = BitField<7, 1>;
     };
 
     // Status ($2002) < read
@@ -165,10 +182,11 @@ private:
     //         pre-render line.
     struct Status {
         uint8_t data;
-        BitField<0, 5> openBus{ data };
-        BitField<5, 1> spriteOverflow{ data };
-        BitField<6, 1> sprite0Hit{ data };
-        BitField<7, 1> vBlankStarted{ data };
+
+        using OpenBus = BitField<0, 5>;
+        using SpriteOverflow = BitField<5, 1>;
+        using Sprite0Hit = BitField<6, 1>;
+        using VBlankStarted = BitField<7, 1>;
     };
 
     // https://www.nesdev.org/wiki/PPU_scrolling
@@ -181,33 +199,150 @@ private:
     // Note that while the v register has 15 bits, the PPU memory space is only 14 bits wide. The highest bit is unused for access through $2007.
     struct InternalRegister {
         uint16_t data;
-        BitField<0, 5, uint16_t>  coarseX{ data };
-        BitField<5, 5, uint16_t>  coarseY{ data };
-        BitField<10, 1, uint16_t> nametableX{ data };
-        BitField<11, 1, uint16_t> nametableY{ data };
-        BitField<12, 3, uint16_t> fineY{ data };
+
+        using CoarseX = BitField<0, 5, uint16_t>;
+        using CoarseY = BitField<5, 5, uint16_t>;
+        using NametableX = BitField<10, 1, uint16_t>;
+        using NametableY = BitField<11, 1, uint16_t>;
+        using FineY = BitField<12, 3, uint16_t>;
     };
 
-    Control control;
-    Mask mask;
-    Status status;
+    struct OAMEntry {
+        uint8_t y;
+        uint8_t tileIndex;
+        uint8_t attributes;
+        uint8_t x;
 
-    uint16_t getNameTableIndex(uint16_t address) const;
-    uint8_t viewNameTable(uint16_t address) const;
-    uint8_t readNameTable(uint16_t address);
+        // Reversed, since save states store the entry as a single 32-bit integer with y in the low byte
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("x", &OAMEntry::x),
+                makeField("attributes", &OAMEntry::attributes),
+                makeField("tileIndex", &OAMEntry::tileIndex),
+                makeField("y", &OAMEntry::y)
+            );
+        }
+    };
+
+    struct SpriteData {
+        OAMEntry oam;
+        uint8_t patternTableLo;
+        uint8_t patternTableHi;
 
-    // Some registers require two instructions to write the data, 
-    // and so we store a boolean to represent which byte of the data we are currently writing
-    bool addressLatch;
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("oam", &SpriteData::oam),
+                makeField("patternTableLo", &SpriteData::patternTableLo),
+                makeField("patternTableHi", &SpriteData::patternTableHi)
+            );
+        }
+    };
 
-    // This is where we write addresses to in PPUSCROLL and PPUDATA (lo/hi byte is controlled by addressLatch)
-    InternalRegister temporaryVramAddress;
-    InternalRegister vramAddress;
+    static constexpr int MAX_SPRITES = 8;
 
-    uint8_t fineX;
+    using NameTable = std::array<uint8_t, 2 * KB>;
 
-    // Reading PPU data takes two instruction cycles, so we store data that we haven't yet read here
-    uint8_t ppuBusData;
+public:
+    // All emulated PPU state. Like the other components, the PPU keeps this inside the Bus state block.
+    // The displays are host-side output buffers and are not part of the state.
+    struct State {
+        Control control;
+        Mask mask;
+        Status status;
+
+        // Some registers require two instructions to write the data, 
+        // and so we store a boolean to represent which byte of the data we are currently writing
+        bool addressLatch;
+
+        // This is where we write addresses to in PPUSCROLL and PPUDATA (lo/hi byte is controlled by addressLatch)
+        InternalRegister temporaryVramAddress;
+        InternalRegister vramAddress;
+
+        uint8_t fineX;
+
+        // Reading PPU data takes two instruction cycles, so we store data that we haven't yet read here
+        uint8_t ppuBusData;
+
+        std::array<uint8_t, 0x20> palleteRam;
+        NameTable nameTable;
+
+        int32_t scanline;
+        int32_t cycle;
+        bool oddFrame;
+
+        // internal latches
+        uint16_t patternTableLoShifter;
+        uint16_t patternTableHiShifter;
+        uint16_t attributeTableLoShifter;
+        uint16_t attributeTableHiShifter;
+
+        uint8_t nextNameTableByte;
+
+        uint8_t nextPatternTableLo;
+        uint8_t nextPatternTableHi;
+        bool nextAttributeTableLo;
+        bool nextAttributeTableHi;
+
+        std::array<SpriteData, MAX_SPRITES> currentScanlineSprites;
+        uint8_t numCurrentScanlineSprites;
+        bool sprite0OnCurrentScanline;
+
+        OAMBuffer oamBuffer;
+        uint8_t oamAddress;
+
+        bool frameReadyFlag;
+
+        bool nmiRequest;
+        uint8_t nmiDelayCounter;
+
+        // Counts every dot since power on
+        uint64_t totalDots;
+
+        // The frame ready flag and the dot count are not saved
+        static constexpr auto fields() {
+            return std::make_tuple(
+                makeField("control", &State::control),
+                makeField("mask", &State::mask),
+                makeField("status", &State::status),
+                makeField("addressLatch", &State::addressLatch),
+                makeField("temporaryVramAddress", &State::temporaryVramAddress),
+                makeField("vramAddress", &State::vramAddress),
+                makeField("fineX", &State::fineX),
+                makeField("ppuBusData", &State::ppuBusData),
+                makeField("palleteRam", &State::palleteRam),
+                makeField("nameTable", &State::nameTable),
+                makeField("scanline", &State::scanline),
+                makeField("cycle", &State::cycle),
+                makeField("oddFrame", &State::oddFrame),
+                makeField("patternTableLoShifter", &State::patternTableLoShifter),
+                makeField("patternTableHiShifter", &State::patternTableHiShifter),
+                makeField("attributeTableLoShifter", &State::attributeTableLoShifter),
+                makeField("attributeTableHiShifter", &State::attributeTableHiShifter),
+                makeField("nextNameTableByte", &State::nextNameTableByte),
+                makeField("nextPatternTableLo", &State::nextPatternTableLo),
+                makeField("nextPatternTableHi", &State::nextPatternTableHi),
+                makeField("nextAttributeTableLo", &State::nextAttributeTableLo),
+                makeField("nextAttributeTableHi", &State::nextAttributeTableHi),
+                makeField("oamAddress", &State::oamAddress),
+                makeField("nmiRequest", &State::nmiRequest),
+                makeRetiredField<bool>("irqRequest"), // The MMC3 IRQ line, which is now kept by the mapper alone
+                makeField("oamBuffer", &State::oamBuffer),
+                makeCountedArrayField("currentScanlineSprites", &State::currentScanlineSprites, &State::numCurrentScanlineSprites, 1),
+                makeField("sprite0OnCurrentScanline", &State::sprite0OnCurrentScanline, 1),
+                makeField("nmiDelayCounter", &State::nmiDelayCounter, 1)
+            );
+        }
+    };
+
+private:
+    State& state;
+
+    // Writes to the nametables, palettes and OAM are marked here so that snapshots only copy what changed
+    WriteTracker& writeTracker;
+
+    uint16_t getNameTableIndex(uint16_t address) const;
+    uint8_t viewNameTable(uint16_t address) const;
+    uint8_t readNameTable(uint16_t address);
 
     static constexpr MemoryRange PATTERN_TABLE_RANGE{ 0x0000, 0x1FFF };
     static constexpr MemoryRange NAMETABLE_RANGE{ 0x2000, /*0x2FFF*/ 0x3EFF };
@@ -222,37 +357,14 @@ private:
         0xFFFFFFFF, 0xFFB6E1FF, 0xFFCED1FF, 0xFFE9C3FF, 0xFFFFBCFF, 0xFFFFBDF4, 0xFFFFC6C3, 0xFFFFD59A, 0xFFE9E681, 0xFFCEF481, 0xFFB6FB9A, 0xFFA9FAC3, 0xFFA9F0F4, 0xFFB8B8B8, 0xFF000000, 0xFF000000,
     };
 
-    std::array<uint8_t, 0x20> palleteRam;
     uint8_t getPalleteRamIndexRead(uint16_t address) const;
     uint8_t getPalleteRamIndexWrite(uint16_t address) const;
 
-    using NameTable = std::array<uint8_t, 2 * KB>;
-    NameTable nameTable;
-
-    int32_t scanline;
-    int32_t cycle;
-    bool oddFrame;
-
-    // internal latches
-    uint16_t patternTableLoShifter;
-    uint16_t patternTableHiShifter;
-    uint16_t attributeTableLoShifter;
-    uint16_t attributeTableHiShifter;
-
-    uint8_t nextNameTableByte;
-
-    uint8_t nextPatternTableLo;
-    uint8_t nextPatternTableHi;
-    bool nextAttributeTableLo;
-    bool nextAttributeTableHi;
-
     // Rendering helper functions
     void preRenderScanline();
     void visibleScanlines();
     void verticalBlankScanlines();
 
-    void handleMapper4IRQ();
-
     void doRenderingPipeline();
     void doStandardFetchCycle();
 
@@ -266,42 +378,39 @@ private:
     void reloadShifters();
     void shiftShifters();
 
-    bool isRenderingEnabled() const;
-
     void incrementCycle();
     void incrementCoarseX();
     void incrementY();
 
-    struct OAMEntry {
-        uint8_t y;
-        uint8_t tileIndex;
-        uint8_t attributes;
-        uint8_t x;
-    };
-
-    struct SpriteData {
-        OAMEntry oam;
-        uint8_t patternTableLo;
-        uint8_t patternTableHi;
-    };
-
-    static constexpr int MAX_SPRITES = 8;
-    std::vector<SpriteData> currentScanlineSprites;
-    bool sprite0OnCurrentScanline;
     void fillCurrentScanlineSprites();
 
-    std::unique_ptr<Display> workingDisplay;
 
-    uint8_t oamAddress;
+    // The two displays are swapped at the end of each frame
+    std::array<Display, 2> displays;
+    Display* workingDisplay;
+    Display* finishedDisplay;
 
     uint16_t getPalleteRamAddress(uint8_t backgroundTable, uint8_t patternTable) const;
     uint8_t viewPalleteRam(uint16_t address) const;
 
-    bool nmiRequest;
-    bool irqRequest;
-
     static constexpr uint8_t NMI_DELAY_TIME = 3;
-    uint8_t nmiDelayCounter;
+
+    // Frame timing. Odd frames skip the first dot of scanline 0.
+    static constexpr uint32_t DOTS_PER_SCANLINE = 341;
+    static constexpr uint32_t SCANLINES_PER_FRAME = 262;
+    static constexpr uint32_t NUM_VISIBLE_SCANLINES = 240;
+    static constexpr uint32_t SCANLINE_COUNTER_DOT = 280; // TODO: Think this should really be 260, but breaks things...
+    static uint32_t getFrameLength(bool oddFrame);
+    static uint32_t countScanlineCounterClocksBefore(uint32_t dot, bool oddFrame); // Within a single frame
+
+    // Display colors are stored as 0xAARRGGBB
+    struct Color {
+        uint32_t data;
+
+        using Blue = BitField<0, 8, uint32_t>;
+        using Green = BitField<8, 8, uint32_t>;
+        using Red = BitField<16, 8, uint32_t>;
+    };
 
     // Color tint bits (https://www.nesdev.org/wiki/NTSC_video)
     // Tests performed on NTSC NES show that emphasis does not affect the black colors in columns $E or $F, but it does affect all other columns, including the blacks and greys in column $D.
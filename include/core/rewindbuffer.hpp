@@ -0,0 +1,83 @@
+#ifndef REWINDBUFFER_HPP
+#define REWINDBUFFER_HPP
+
+#include "core/bus.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Keeps a bounded history of the console so that it can be played backwards.
+// Every few frames the state block is snapshotted, and the controller input of every frame is recorded in between.
+// Most snapshots are stored as their difference from the newest keyframe: the two states are XORed together and the runs of zeros
+// are left out, which shrinks a snapshot from the full state block to a few hundred bytes.
+// Only the pages written since the keyframe are compared against it, see WriteTracker.
+// When the history outgrows its memory budget, the oldest keyframe is dropped together with the snapshots that depend on it.
+class RewindBuffer {
+public:
+    struct Input {
+        uint8_t controller1;
+        uint8_t controller2;
+    };
+
+    static constexpr uint32_t SNAPSHOT_INTERVAL = 4; // In frames
+    static constexpr uint32_t KEYFRAME_INTERVAL = 30; // In snapshots, so a keyframe every 2 seconds
+
+    explicit RewindBuffer(size_t maxBytes);
+
+    // Forgets the history and starts a new one from the current state, e.g. after a reset or loading a save state
+    void restart(Bus& bus);
+
+    // Called after every frame that was run forwards, with the input it was run with
+    void recordFrame(Bus& bus, Input input);
+
+    // Moves back by one frame. Restores the closest snapshot before the previous frame,
+    // and returns the inputs of the frames that have to be run again to finish the previous frame.
+    // Returns false and leaves the console alone if the history does not reach back that far.
+    bool stepBack(Bus& bus, std::vector<Input>& replayInputs);
+
+private:
+    static constexpr size_t NUM_STATE_WORDS = sizeof(Bus::State) / sizeof(uint64_t);
+    static constexpr size_t WORDS_PER_PAGE = WriteTracker::PAGE_SIZE / sizeof(uint64_t);
+    static_assert(sizeof(Bus::State) % sizeof(uint64_t) == 0, "Snapshots are compared a word at a time");
+
+    struct Snapshot {
+        uint64_t frame;
+        bool isKeyframe;
+
+        // Keyframes are stored as their difference from an all zero state
+        std::vector<uint8_t> delta;
+    };
+
+    size_t maxBytes;
+    size_t usedBytes;
+
+    uint64_t currentFrame;
+    std::deque<Snapshot> snapshots;
+
+    // inputs[i] is the input of frame firstInputFrame + i
+    std::deque<Input> inputs;
+    uint64_t firstInputFrame;
+
+    // The newest keyframe, which new snapshots are compared against
+    Bus::Snapshot keyframe;
+    uint32_t snapshotsSinceKeyframe;
+
+    std::unique_ptr<Bus::State> scratch;
+
+    // Buffers of dropped snapshots are reused so that taking a snapshot does not allocate
+    std::vector<std::vector<uint8_t>> spareBuffers;
+
+    void takeSnapshot(Bus& bus);
+    void dropSnapshot(Snapshot& snapshot);
+    void dropOldestKeyframe();
+    void decodeSnapshot(size_t index, Bus::State& state) const;
+
+    // Without a reference the state is compared against all zeros
+    static void encodeDelta(const Bus& bus, const Bus::Snapshot* reference, std::vector<uint8_t>& delta);
+    static void applyDelta(const std::vector<uint8_t>& delta, Bus::State& state);
+};
+
+#endif // REWINDBUFFER_HPP
@@ -0,0 +1,93 @@
+#ifndef ROLLBACKSESSION_HPP
+#define ROLLBACKSESSION_HPP
+
+#include "core/bus.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+// Two player netplay in which neither player waits for the other's input.
+// The remote player's input is predicted to be the same as the last input received from them, and every frame is run
+// straight away with the prediction. When the real input arrives and turns out different, the console is rolled back to
+// a snapshot from before the first wrong frame and the frames since then are run again.
+// The session only keeps the input and the snapshots. Sending the local input to the other player is up to the caller.
+class RollbackSession {
+public:
+    // The furthest the remote input can ever fall behind before the session has to wait for it, which sets how many snapshots are kept
+    static constexpr uint32_t MAX_ROLLBACK_FRAMES = 8;
+
+    // The share of the frame time that a frame, including the frames it runs again, is allowed to take.
+    // The rest is left for showing the frame and for the timing of a frame varying from one to the next.
+    static constexpr double FRAME_TIME_BUDGET = 0.75;
+
+    // The largest rollback window in which the worst case still fits FRAME_TIME_BUDGET, given how long one frame takes to run.
+    // A window of n frames runs at most n frames at once: the new one, and n - 1 that are run again.
+    // A machine that cannot even fit two frames gets a window of 1, in which nothing is predicted and every frame waits for the remote input.
+    static uint32_t fitRollbackFrames(double frameNs, double frameTimeNs);
+
+    // Runs one frame with the given controller input.
+    // Resimulated frames replace frames that were already shown and heard, so they should not output anything.
+    // The session disables the APU's audio output while they run.
+    using RunFrame = std::function<void(uint8_t controller1, uint8_t controller2, bool isResimulation)>;
+
+    // Both players have to start from the same state, e.g. right after loading the ROM. The local player is 0 or 1.
+    RollbackSession(Bus& bus, int localPlayer, RunFrame runFrame);
+
+    // Input that is too old to matter, or was already received, is ignored
+    void addRemoteInput(uint32_t frame, uint8_t buttons);
+
+    // How far the remote input can fall behind before the session waits for it, from 1 to MAX_ROLLBACK_FRAMES.
+    // Starts at MAX_ROLLBACK_FRAMES. A smaller window stalls sooner, but keeps the frames that roll back cheaper.
+    // It can be changed at any time, frames that are already further behind are only run again once the remote input arrives.
+    void setRollbackFrames(uint32_t frames);
+    uint32_t getRollbackFrames() const;
+
+    // False while the remote input is too far behind to keep predicting it, in which case the caller has to wait for more
+    bool canAdvance() const;
+
+    // Rolls back and runs the frames again if the remote input was mispredicted, then runs the next frame with the local input.
+    // Returns the number of frames that were run again.
+    uint32_t advanceFrame(uint8_t localButtons);
+
+    // The number of frames run so far, which is also the number of the next frame
+    uint32_t getCurrentFrame() const;
+
+    // The remote input has been received for every frame before this one
+    uint32_t getConfirmedRemoteFrames() const;
+
+    // Local input of one of the last INPUT_HISTORY frames, for sending it to the other player
+    static constexpr uint32_t INPUT_HISTORY = 64;
+    uint8_t getLocalInput(uint32_t frame) const;
+
+private:
+    static_assert(INPUT_HISTORY >= 2 * MAX_ROLLBACK_FRAMES, "Input has to be kept for as long as the other player may need it again");
+
+    static constexpr uint32_t NO_MISPREDICTION = UINT32_MAX;
+
+    Bus& bus;
+    int localPlayer;
+    RunFrame runFrame;
+
+    uint32_t rollbackFrames;
+    uint32_t currentFrame;
+    uint32_t confirmedRemoteFrames;
+    uint32_t firstMispredictedFrame;
+
+    struct FrameInput {
+        uint32_t frame; // Slots are reused every INPUT_HISTORY frames
+        uint8_t local;
+        uint8_t remote; // Received, or the prediction the frame was run with
+        bool isRemoteReceived;
+    };
+    std::array<FrameInput, INPUT_HISTORY> inputs;
+
+    // snapshots[frame % MAX_ROLLBACK_FRAMES] is the state from before the frame was run
+    std::array<Bus::Snapshot, MAX_ROLLBACK_FRAMES> snapshots;
+
+    FrameInput& getInput(uint32_t frame);
+    uint8_t predictRemoteInput() const;
+    void runFrameWithInput(uint32_t frame, bool isResimulation);
+};
+
+#endif // ROLLBACKSESSION_HPP
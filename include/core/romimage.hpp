@@ -0,0 +1,51 @@
+#ifndef ROMIMAGE_HPP
+#define ROMIMAGE_HPP
+
+#include "util/arena.hpp"
+#include "util/sha256.hpp"
+#include "util/util.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// The immutable contents of a ROM file, together with its SHA-256 hash.
+// The file is memory mapped where the platform supports it and read into an arena otherwise.
+// Images are reference counted and shared between every cartridge that has the same file loaded,
+// so running several instances of one game keeps a single copy of the ROM data in memory.
+class RomImage {
+public:
+    // Returns nullptr if the file could not be opened
+    static std::shared_ptr<const RomImage> open(const std::string& filePath);
+
+    ~RomImage();
+
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    ByteView getData() const;
+    const Sha256::Digest& getHash() const;
+
+private:
+    RomImage();
+
+    const uint8_t* data;
+    size_t size;
+    bool isMapped;
+
+    // Only used when the file could not be memory mapped
+    Arena fallbackArena;
+
+    Sha256::Digest hash;
+
+    // Used to tell whether a cached image is still up to date with the file on disk
+    std::filesystem::file_time_type lastWriteTime;
+
+    static std::shared_ptr<RomImage> load(const std::string& filePath);
+    bool tryMap(const std::string& filePath);
+    bool tryRead(const std::string& filePath);
+};
+
+#endif // ROMIMAGE_HPP
@@ -0,0 +1,63 @@
+#ifndef WARMSTARTCACHE_HPP
+#define WARMSTARTCACHE_HPP
+
+#include "core/bus.hpp"
+#include "util/sha256.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Skips the frames a game spends starting up before it first looks at the controllers.
+// Nothing the player does can make a difference before the first $4016 strobe, so the state at that point only depends on the ROM
+// and on the console's power-on state. The first time a ROM is started, the console is run to the strobe as fast as possible and
+// the state is stored in the cache directory, under the hash of the ROM. Later starts restore it from there instead.
+// A cached state is only used if it was made by the same core version from the same power-on state, which also covers
+// the battery backed RAM a game may read while starting up.
+class WarmStartCache {
+public:
+    explicit WarmStartCache(const std::string& directory);
+
+    struct Status {
+        enum class Code {
+            RESTORED,
+            CAPTURED,
+            NO_STROBE, // The game did not strobe the controllers within MAX_BOOT_FRAMES, the console is left at power-on
+            UNSUPPORTED, // NSF files, which do not read the controllers
+            WRITING_ERROR // The console was still run to the strobe
+        };
+
+        Code code;
+        uint64_t skippedCycles;
+        std::string message;
+    };
+
+    // Called right after the ROM was loaded, and before anything else has run
+    Status apply(Bus& bus);
+
+private:
+    static constexpr uint32_t FILE_ID = 0x4E455357; // "NESW"
+    static constexpr uint8_t FILE_VERSION = 1;
+
+    // 30 seconds, far longer than any game takes to start up
+    static constexpr uint64_t MAX_BOOT_FRAMES = 30 * 60;
+    static constexpr uint64_t CYCLES_PER_FRAME = (262 * 341) / 3;
+
+    // FILE FORMAT
+    //      File ID
+    //      File version
+    //      Bus::CORE_VERSION
+    //      Size of the state block
+    //      Hash of the power-on state
+    //      Whether the game strobed the controllers within MAX_BOOT_FRAMES
+    //      Number of cycles skipped
+    //      Bus, CPU, PPU, APU and mapper state, as in a save state, if it did
+
+    std::string directory;
+
+    std::string getFilePath(const Sha256::Digest& romHash) const;
+    bool tryRestore(Bus& bus, const std::string& filePath, uint64_t powerOnHash, Status& status) const;
+    uint64_t runToFirstStrobe(Bus& bus) const;
+    bool write(Bus& bus, const std::string& filePath, uint64_t powerOnHash, bool strobed, uint64_t skippedCycles) const;
+};
+
+#endif // WARMSTARTCACHE_HPP
@@ -0,0 +1,33 @@
+#ifndef AUDIORATECONTROL_HPP
+#define AUDIORATECONTROL_HPP
+
+#include <cstddef>
+
+// Dynamic rate control, as described by Hans-Kristian Arntzen in "Dynamic Rate Control for Retro Game Emulators".
+// The emulator produces audio at a rate tied to its frame pacing, which never quite matches the rate the audio device consumes it at.
+// Instead of dropping or repeating samples when the two drift apart, the sample rate audio is synthesized at
+// is nudged by a fraction of a percent, depending on how far the queue depth is from its target.
+// A change that small is not audible as a change in pitch.
+class AudioRateControl {
+public:
+    AudioRateControl(double sampleRate, size_t targetQueueDepth);
+
+    // Takes the queue depth at the end of a frame and returns the sample rate to synthesize the next frame at
+    double update(size_t queueDepth);
+
+    double getSampleRate() const;
+
+private:
+    // The most the sample rate is ever adjusted by, as a fraction of the nominal rate
+    static constexpr double MAX_ADJUSTMENT = 0.005;
+
+    // The depth is smoothed over a few frames, since it jumps by up to a frame of samples depending on when the queue is read from
+    static constexpr double DEPTH_SMOOTHING = 0.125;
+
+    double nominalSampleRate;
+    double targetQueueDepth;
+    double smoothedQueueDepth;
+    double sampleRate;
+};
+
+#endif // AUDIORATECONTROL_HPP
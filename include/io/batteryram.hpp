@@ -0,0 +1,79 @@
+#ifndef BATTERYRAM_HPP
+#define BATTERYRAM_HPP
+
+#include "util/util.hpp"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Keeps the battery backed PRG RAM of a cartridge in a .sav file next to the ROM.
+// The RAM itself stays in the console's state block. Once per frame the emulation thread copies the pages that changed
+// into a shared memory mapping of the file, which never waits on the disk.
+// A background thread writes the dirty pages back with msync every so often, and once more when the file is closed.
+// Where memory mapping is not available, the background thread rewrites the file from a copy of the RAM instead.
+// The file is locked while it is open. Another instance that opens the same file only gets a private copy of the saved RAM,
+// which is never written back.
+class BatteryRam {
+public:
+    using Data = std::array<uint8_t, 8 * KB>;
+
+    BatteryRam();
+    ~BatteryRam();
+
+    BatteryRam(const BatteryRam&) = delete;
+    BatteryRam& operator=(const BatteryRam&) = delete;
+
+    static std::string getSaveFilePath(const std::string& romFilePath);
+
+    // Opens the file, creating it if it does not exist yet. Returns false if it could not be opened.
+    bool open(const std::string& filePath);
+
+    // True if another instance already had the file open, so changes to the RAM are not saved
+    bool isReadOnly() const;
+
+    // Copies the saved RAM into the cartridge. A newly created file reads as all zeros.
+    void load(Data& prgRam) const;
+
+    // Called by the emulation thread after every frame
+    void update(const Data& prgRam);
+
+private:
+    static constexpr std::chrono::seconds FLUSH_INTERVAL{ 1 };
+
+    std::string filePath;
+
+    // Either the memory mapping of the file, or fallbackData
+    uint8_t* data;
+    bool isMapped;
+    bool readOnly;
+    Data fallbackData;
+
+    // The descriptor that holds the lock on the file, or -1
+    int lockedFile;
+
+    // Pages are compared and flushed as a whole. When mapped, they match the pages of the mapping so they can be passed to msync.
+    size_t pageSize;
+    size_t numPages;
+
+    // Shared with the flush thread, guarded by mutex.
+    // Only the emulation thread writes to data, and only while holding the mutex.
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    uint32_t dirtyPages;
+    bool stopRequested;
+
+    std::thread flushThread;
+
+    bool tryMap();
+    bool tryRead();
+    void runFlushThread();
+    void flush(uint32_t pages, const Data& snapshot);
+};
+
+#endif // BATTERYRAM_HPP
@@ -1,13 +1,24 @@
 #ifndef EMULATORTHREAD_HPP
 #define EMULATORTHREAD_HPP
 
+#include "core/aputhread.hpp"
 #include "core/bus.hpp"
+#include "core/nsfplayer.hpp"
+#include "core/rewindbuffer.hpp"
+#include "core/rollbacksession.hpp"
+#include "core/warmstartcache.hpp"
+#include "io/audioratecontrol.hpp"
+#include "io/batteryram.hpp"
 #include "io/iotypes.hpp"
+#include "io/netplayconnection.hpp"
 #include "io/savestate.hpp"
 
 #include <array>
+#include <atomic>
+#include <memory>
 #include <optional>
 #include <queue>
+#include <vector>
 
 #include <QImage>
 #include <QObject>
@@ -42,13 +53,11 @@ private:
 	// 262 scanlines, 341 cycles per scanline, 3 PPU cycles per CPU cycle
 	static constexpr int EXPECTED_CPU_CYCLES_PER_FRAME = (262 * 341) / 3;
 	static constexpr int INSTRUCTIONS_PER_SECOND = EXPECTED_CPU_CYCLES_PER_FRAME * FPS;
-
-	// Audio pacing
-	static constexpr size_t AUDIO_QUEUE_TARGET_FILL_SAMPLES = AUDIO_SAMPLE_RATE / 20; // 50ms audio latency
+	static constexpr int FRAME_CYCLE_LIMIT = EXPECTED_CPU_CYCLES_PER_FRAME + 5;
 
 	Bus bus;
 	std::atomic<bool> isRunning;
-	bool soundReady;
+	std::atomic<bool> soundReady;
 
 	KeyboardInput localKeyInput;
 	const KeyboardInput& sharedKeyInput;
@@ -59,21 +68,118 @@ private:
 	uint8_t lastFrameStepCount;
 	uint8_t lastSaveCount;
 	uint8_t lastLoadCount;
+	uint8_t lastQuickSaveCount;
+	uint8_t lastQuickLoadCount;
 	bool debugWindowOpenLastFrame;
 
 	bool executeCycle();
 	void runUntilFrameReady();
+	void runRecordedFrame();
 	void runSteps(uint8_t numSteps);
 
 	CircularBuffer<uint16_t, DebugWindowState::NUM_INSTS_ABOVE_AND_BELOW> recentPCs;
 	std::array<QString, DebugWindowState::NUM_INSTS_TOTAL> getInsts() const;
 
+	// Pattern table buffers are reused between debug frames instead of being allocated every frame
+	std::array<std::shared_ptr<PPU::PatternTables>, 3> patternTablesBuffers;
+	size_t nextPatternTablesBuffer;
+	std::shared_ptr<PPU::PatternTables> getPatternTablesBuffer();
+
 	AudioQueue& audioSamples;
 
-	int scaledAudioClock;
+	// Audio pacing
+	size_t audioTargetQueueSamples;
+	AudioRateControl audioRateControl;
+	void updateAudioRate();
+
+	// Queue statistics, printed once a second when NES_AUDIO_STATS=1 is set
+	bool audioStatsEnabled;
+	int audioStatsFrames;
+	size_t minAudioQueueDepth;
+	size_t maxAudioQueueDepth;
+	void updateAudioStats(size_t queueDepth);
+
+	std::array<float, BlipBuffer::MAX_SAMPLES> audioFrameSamples;
+	std::atomic<bool> audioMuted;
+	void outputAudioFrame();
+	void queueAudioSamples(const float* samples, size_t numSamples);
+
+	// Synthesizes audio on its own thread when NES_APU_THREAD=1 is set, otherwise null
+	std::unique_ptr<APUThread> apuThread;
+
+	// Only set when an NSF file is loaded, in which case the songs are played instead of running the PPU
+	// Left and right on the first controller switch between songs
+	std::optional<NsfPlayer> nsfPlayer;
+	uint8_t lastNsfButtons;
+	void updateNsfSong();
+
+	// Only set for cartridges with battery backed PRG RAM, which is kept in a .sav file next to the ROM
+	std::unique_ptr<BatteryRam> batteryRam;
+
+	// Holding the rewind key plays the game backwards, one frame per frame. Not available for NSF files.
+	static constexpr size_t REWIND_BUFFER_BYTES = 16 * KB * KB;
+	std::unique_ptr<RewindBuffer> rewindBuffer;
+	std::vector<RewindBuffer::Input> rewindReplayInputs;
+	bool rewindFrame();
+
+	// Run-ahead hides the input lag built into games. After each frame, the console is run a few frames further with the same input
+	// and the last of those frames is shown, then the state from before is restored. Set with NES_RUN_AHEAD=<frames>.
+	// Not available for NSF files or together with the APU thread.
+	static constexpr int MAX_RUN_AHEAD_FRAMES = 8;
+	int runAheadFrames;
+	Bus::Snapshot runAheadSnapshot;
+	void runAhead();
+	void runFrameWithoutOutput();
+
+	// The time spent running ahead, printed once a second when NES_RUN_AHEAD_STATS=1 is set
+	bool runAheadStatsEnabled;
+	int runAheadStatsFrames;
+	int64_t runAheadStatsNs;
+	int64_t maxRunAheadNs;
+	void updateRunAheadStats(int64_t runAheadNs);
+
+	// Two player rollback netplay, set with NES_NETPLAY=<player>,<local port>,<remote host>,<remote port>.
+	// The keyboard controls the given player, 1 or 2, and the other player's input comes over UDP.
+	// Rewind, run-ahead, resets, loading save states and stepping are turned off, since the two consoles have to stay the same.
+	struct NetplaySettings {
+		int player;
+		uint16_t localPort;
+		QString remoteHost;
+		uint16_t remotePort;
+	};
+	std::optional<NetplaySettings> netplaySettings;
+	std::unique_ptr<RollbackSession> rollbackSession;
+	std::unique_ptr<NetplayConnection> netplayConnection; // Created on the emulation thread, which polls its socket
+	static std::optional<NetplaySettings> parseNetplaySettings(const QString& setting);
+	bool startNetplay();
+	bool updateNetplay(bool canRunFrame);
+
+	// How far the other player's input can fall behind before the game waits for it. Set with NES_NETPLAY_ROLLBACK=<frames>,
+	// otherwise 0, and the window is fitted to how long a frame takes to run on this machine so that rolling back stays within a frame.
+	uint32_t fixedRollbackFrames;
+
+	// How long a frame takes to run. Follows a slower frame at once, and a faster one slowly, so that the window shrinks
+	// as soon as the game gets more expensive to run.
+	double netplayFrameNs;
+	void fitRollbackWindow(uint32_t numFramesRun, int64_t frameNs);
+	void runNetplayFrame(uint8_t controller1, uint8_t controller2, bool isResimulation);
+
+	// Netplay statistics, printed once a second when NES_NETPLAY_STATS=1 is set
+	bool netplayStatsEnabled;
+	int netplayStatsFrames;
+	int netplayStalledFrames;
+	uint32_t resimulatedFrames;
+	uint32_t maxResimulatedFrames;
+	int64_t maxNetplayFrameNs;
+	void updateNetplayStats(bool ranFrame, uint32_t numResimulated, int64_t frameNs);
 
 	// Save states
 	SaveState saveState;
+
+	// Quick-save slots only live in memory, so they are saved and loaded within the frame they are requested on
+	std::array<Bus::Snapshot, KeyboardInput::NUM_QUICK_SAVE_SLOTS> quickSaveSlots;
+	void quickSave(uint8_t slot);
+	bool quickLoad(uint8_t slot);
 };
 
 #endif // EMULATORTHREAD_HPP
\ No newline at end of file
@@ -4,14 +4,18 @@
 #include "core/ppu.hpp"
 #include "io/threadsafeaudioqueue.hpp"
 
+#include <algorithm>
 #include <array>
 #include <memory>
 #include <mutex>
 
 #include <QMetaType>
 #include <QString>
+#include <QtGlobal>
 
 struct KeyboardInput {
+    static constexpr uint8_t NUM_QUICK_SAVE_SLOTS = 4;
+
     // NES controllers
     uint8_t controller1ButtonMask;
     uint8_t controller2ButtonMask;
@@ -20,6 +24,7 @@ struct KeyboardInput {
     bool paused;
     bool muted;
     bool debugWindowEnabled;
+    bool rewinding; // While the rewind key is held
 
     // Debug window settings
     uint8_t spritePallete;
@@ -34,9 +39,13 @@ struct KeyboardInput {
     uint8_t frameStepCount;
     uint8_t saveCount;
     uint8_t loadCount;
+    uint8_t quickSaveCount;
+    uint8_t quickLoadCount;
 
     // Data corresponding to a save/load request
     QString mostRecentSaveFilePath;
+    uint8_t quickSaveSlot;
+    uint8_t quickLoadSlot;
 };
 
 struct DebugWindowState {
@@ -58,7 +67,21 @@ struct DebugWindowState {
 Q_DECLARE_METATYPE(DebugWindowState)
 
 static constexpr int AUDIO_SAMPLE_RATE = 44100;
-static constexpr size_t AUDIO_QUEUE_MAX_CAPACITY = AUDIO_SAMPLE_RATE / 10; // Enough space to store 100ms of audio
+static constexpr size_t AUDIO_QUEUE_MAX_CAPACITY = 8192; // Enough space to store 100ms of audio, rounded up to a power of two
 using AudioQueue = ThreadSafeAudioQueue<AUDIO_QUEUE_MAX_CAPACITY>;
 
+// The audio queue is kept at about this depth, which sets the audio latency.
+// It can be tuned per host with NES_AUDIO_LATENCY_MS.
+static constexpr int DEFAULT_AUDIO_LATENCY_MS = 20;
+inline size_t getAudioTargetQueueSamples() {
+    bool ok = false;
+    int latencyMs = qEnvironmentVariableIntValue("NES_AUDIO_LATENCY_MS", &ok);
+    if (!ok || latencyMs <= 0) {
+        latencyMs = DEFAULT_AUDIO_LATENCY_MS;
+    }
+
+    size_t samples = static_cast<size_t>(AUDIO_SAMPLE_RATE) * latencyMs / 1000;
+    return std::min(samples, AUDIO_QUEUE_MAX_CAPACITY / 2);
+}
+
 #endif // IOTYPES_HPP
\ No newline at end of file
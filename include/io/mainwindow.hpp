@@ -52,6 +52,9 @@ private:
 
 	void setControllerData(bool controller, Controller::Button button, bool value);
 
+	// Pauses the game while the file dialog is open, without holding the input lock, so the emulator thread is never blocked on it
+	QString chooseSaveStateFile(bool isSaving);
+
 	// Rendering
 	QImage mainWindowData;
 	DebugWindowState debugWindowData;
@@ -84,6 +87,7 @@ private:
 	static constexpr Qt::Key RESET_KEY = Qt::Key_R;
 	static constexpr Qt::Key PAUSE_KEY = Qt::Key_C;
 	static constexpr Qt::Key MUTE_KEY = Qt::Key_M;
+	static constexpr Qt::Key REWIND_KEY = Qt::Key_Backspace;
 
 	// Debug controls
 	static constexpr Qt::Key DEBUG_WINDOW_KEY = Qt::Key_D;
@@ -96,6 +100,10 @@ private:
 	static constexpr Qt::Key SAVE_KEY = Qt::Key_S;
 	static constexpr Qt::Key LOAD_KEY = Qt::Key_L;
 	static constexpr Qt::Key QUICK_LOAD_KEY = Qt::Key_K;
+
+	// Quick-save slot controls
+	static constexpr std::array<Qt::Key, KeyboardInput::NUM_QUICK_SAVE_SLOTS> QUICK_SAVE_SLOT_KEYS = { Qt::Key_F1, Qt::Key_F2, Qt::Key_F3, Qt::Key_F4 };
+	static constexpr std::array<Qt::Key, KeyboardInput::NUM_QUICK_SAVE_SLOTS> QUICK_LOAD_SLOT_KEYS = { Qt::Key_F5, Qt::Key_F6, Qt::Key_F7, Qt::Key_F8 };
 };
 
 #endif // MAINWINDOW_HPP
\ No newline at end of file
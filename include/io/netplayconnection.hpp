@@ -0,0 +1,48 @@
+#ifndef NETPLAYCONNECTION_HPP
+#define NETPLAYCONNECTION_HPP
+
+#include "core/rollbacksession.hpp"
+#include "util/serializer.hpp"
+
+#include <cstdint>
+
+#include <QHostAddress>
+#include <QString>
+#include <QUdpSocket>
+
+// Carries controller input between the two players of a RollbackSession over UDP.
+// Every packet holds the local input of all the frames the other player has not confirmed yet, so a lost packet is made up for
+// by the next one, along with the number of frames of the other player's input received so far.
+// The socket is polled without an event loop, so the connection has to be created and used on the emulation thread.
+class NetplayConnection {
+public:
+    NetplayConnection();
+
+    // The remote host can be an address or a host name. Returns false if the local port could not be bound.
+    bool open(uint16_t localPort, const QString& remoteHost, uint16_t remotePort);
+    QString getErrorString() const;
+
+    // Passes the input received since the last call to the session
+    void receive(RollbackSession& session);
+
+    // Called once per frame, also while the session is waiting, since the other player may be waiting too
+    void send(const RollbackSession& session);
+
+private:
+    static constexpr uint32_t PACKET_ID = 0x4E45534E; // "NESN"
+
+    // Never more than this many frames are sent at once, which is far more than the other player can fall behind
+    static constexpr uint32_t MAX_FRAMES_PER_PACKET = RollbackSession::INPUT_HISTORY / 2;
+
+    QUdpSocket socket;
+    QHostAddress remoteAddress;
+    uint16_t remotePort;
+    QString errorString;
+
+    // The other player has received the local input of every frame before this one
+    uint32_t remoteConfirmedFrames;
+
+    Serializer packet;
+};
+
+#endif // NETPLAYCONNECTION_HPP
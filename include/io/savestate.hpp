@@ -2,16 +2,34 @@
 #define SAVESTATE_HPP
 
 #include "core/bus.hpp"
+#include "util/serializer.hpp"
+#include "util/sha256.hpp"
 
-#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <QByteArray>
 #include <QString>
 
+// Save state files are compressed, read and written on a background thread, so that a slow disk never holds up a frame.
+// Creating a save state only serializes the console into memory on the emulation thread. Loading one is done in two steps:
+// the file is prefetched, decompressed and checked in the background, and the result is applied later at a frame boundary.
+// A body that turns out to be corrupted while it is applied leaves the console as it was.
 class SaveState {
 public:
-    SaveState(Bus& bus, const QString& romFilePath);
+    SaveState(Bus& bus);
+
+    // Waits for the save states that are still being written, but drops the loads that have not been applied yet
+    ~SaveState();
+
+    SaveState(const SaveState&) = delete;
+    SaveState& operator=(const SaveState&) = delete;
 
     struct CreateStatus {
         enum class Code {
@@ -39,7 +57,19 @@ public:
         std::string message;
     };
 
-    CreateStatus createSaveState(const QString& filePath) const;
+    // Captures the state of the console right away, the file is written in the background.
+    // The result is reported through takeCreateStatus once the file has been written.
+    void requestCreate(const QString& filePath);
+    std::optional<CreateStatus> takeCreateStatus();
+
+    // Starts reading the file in the background. Only the most recent request is applied, older ones are dropped.
+    void requestLoad(const QString& filePath);
+
+    // Loads the requested save state into the console once it has been read, otherwise returns nullopt.
+    // Called by the emulation thread between frames.
+    std::optional<LoadStatus> applyLoad();
+
+    // Reads and loads a save state on the calling thread, for loading one before the emulation starts
     LoadStatus loadSaveState(const QString& filePath);
 
 private:
@@ -54,27 +84,61 @@ private:
     //      Save state minor version
     //      Save state patch
     //      Hash of ROM file
-    //      Bus state
-    //      CPU state
-    //      PPU state
-    //      APU state
-    //      Mapper state
+    //      Body, compressed with qCompress since version 1.2:
+    //          Bus state
+    //          CPU state
+    //          PPU state
+    //          APU state
+    //          Mapper state
 
     // All save state files must begin with this ID to distinguish them from other binary data files
     static constexpr uint32_t FORMAT_ID = 0xABCD1234;
 
     static constexpr uint8_t VERSION_MAJOR = 1;
-    static constexpr uint8_t VERSION_MINOR = 1;
+    static constexpr uint8_t VERSION_MINOR = 2;
     static constexpr uint8_t VERSION_PATCH = 0;
 
-    static constexpr int HASH_BYTES = 32;
-    using RomHash = std::array<uint8_t, HASH_BYTES>;
-    std::optional<RomHash> createRomHash(const QString& filePath) const;
-    const std::optional<RomHash> ROM_HASH;
+    static constexpr uint8_t FIRST_COMPRESSED_MINOR_VERSION = 2;
+
+    // SHA-256 of the whole ROM file
+    using RomHash = Sha256::Digest;
+    std::optional<RomHash> getRomHash() const;
 
     Bus& bus;
-};
 
+    // A save state that has been read and checked, ready to be deserialized into the console
+    struct LoadedFile {
+        LoadStatus status;
+        Version version;
+        QByteArray body;
+    };
+
+    // Both only touch the file and the data they are given, so they can run on either thread
+    static CreateStatus writeFile(const QString& filePath, const RomHash& romHash, const std::vector<uint8_t>& body);
+    static LoadedFile readFile(const QString& filePath, const RomHash& romHash);
+
+    LoadStatus applyLoadedFile(const LoadedFile& loadedFile);
 
+    struct Request {
+        bool isLoad;
+        QString filePath;
+        RomHash romHash;
+        std::vector<uint8_t> body; // Only for creating a save state
+        uint32_t loadNumber; // Only for loading one
+    };
+
+    // Shared with the I/O thread, guarded by mutex.
+    // Requests are handled in order, so loading a file right after saving it reads what was saved.
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::deque<Request> requests;
+    std::deque<CreateStatus> createStatuses;
+    std::optional<LoadedFile> loadedFile;
+    uint32_t latestLoadNumber;
+    bool stopRequested;
+
+    std::thread ioThread;
+    void runIOThread();
+};
 
-#endif // SAVESTATE_HPP
\ No newline at end of file
+#endif // SAVESTATE_HPP
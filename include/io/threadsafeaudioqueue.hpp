@@ -1,16 +1,22 @@
 #ifndef THREADSAFEAUDIOQUEUE_HPP
 #define THREADSAFEAUDIOQUEUE_HPP
 
-#include "util/circularbuffer.hpp"
-
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include <mutex>
-#include <type_traits>
 
+// Lock-free single-producer/single-consumer ring buffer of audio samples.
+// Samples are pushed by the thread that synthesizes them and popped by the audio device, each in bulk.
+// The read and write indices run freely and are masked into the buffer, which is why the capacity has to be a power of two.
 template <size_t Capacity>
 class ThreadSafeAudioQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
 public:
-    ThreadSafeAudioQueue() = default;
+    ThreadSafeAudioQueue() : writeIndex(0), overrunCount(0), readIndex(0), underrunCount(0), starved(false), buffer{} {}
     ~ThreadSafeAudioQueue() = default;
 
     ThreadSafeAudioQueue(const ThreadSafeAudioQueue&) = delete;
@@ -18,42 +24,97 @@ public:
     ThreadSafeAudioQueue(ThreadSafeAudioQueue&&) = delete;
     ThreadSafeAudioQueue& operator=(ThreadSafeAudioQueue&&) = delete;
 
+    // Safe to call from either thread
     size_t size() const {
-        std::lock_guard<std::mutex> guard(mtx);
-        return audioBuffer.size();
+        // The read index is loaded first, so it can never be ahead of the write index
+        size_t read = readIndex.load(std::memory_order_acquire);
+        size_t write = writeIndex.load(std::memory_order_acquire);
+        return write - read;
     }
 
-    void forcePush(float data) {
-        // This evicts the oldest item in the audio queue if there are too many samples.
-        // It keeps the audio in sync with the video but sometimes leads to audio glitches if audio is ahead
-        std::lock_guard<std::mutex> guard(mtx);
-        audioBuffer.forcePush(data);
+    // Producer only
+    // Samples that do not fit are dropped. Returns the number of samples pushed.
+    size_t push(const float* samples, size_t numSamples) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+        size_t read = readIndex.load(std::memory_order_acquire);
+        size_t count = std::min(numSamples, Capacity - (write - read));
+        if (count < numSamples) {
+            overrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // The free space wraps around the end of the buffer at most once
+        size_t start = write & MASK;
+        size_t firstPart = std::min(count, Capacity - start);
+        std::memcpy(&buffer[start], samples, firstPart * sizeof(float));
+        std::memcpy(&buffer[0], samples + firstPart, (count - firstPart) * sizeof(float));
+
+        writeIndex.store(write + count, std::memory_order_release);
+        return count;
     }
 
-    void erase() {
-        std::lock_guard<std::mutex> guard(mtx);
-        audioBuffer.erase();
+    // Consumer only
+    size_t pop(float* output, size_t maxSamples) {
+        return popIntoBytes(reinterpret_cast<char*>(output), maxSamples);
     }
 
+    // Consumer only
+    // Fills a byte buffer that may not be aligned for floats, returning the number of bytes written
     size_t popManyIntoBuffer(char* outputBuffer, size_t maxSize) {
-        size_t maxEntries = maxSize / sizeof(float);
-        size_t numEntries = 0;
-        {
-            std::lock_guard<std::mutex> guard(mtx);
-            numEntries = std::min(audioBuffer.size(), maxEntries);
-            for (size_t i = 0; i < numEntries; i++) {
-                size_t index = i * sizeof(float);
-                float* address = reinterpret_cast<float*>(&outputBuffer[index]);
-                float output = audioBuffer.pop();
-                std::memcpy(address, &output, sizeof(float));
-            }
-        }
-        return numEntries * sizeof(float);
+        return popIntoBytes(outputBuffer, maxSize / sizeof(float)) * sizeof(float);
+    }
+
+    // Consumer only
+    void erase() {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Safe to call from either thread
+    // Overruns are pushes that did not fit, underruns are the times the consumer found the queue empty
+    uint64_t getOverrunCount() const {
+        return overrunCount.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getUnderrunCount() const {
+        return underrunCount.load(std::memory_order_relaxed);
     }
 
 private:
-    CircularBuffer<float, Capacity> audioBuffer;
-    mutable std::mutex mtx;
+    static constexpr size_t MASK = Capacity - 1;
+
+    // Each side only writes to its own variables, so they are kept on separate cache lines
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Producer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> writeIndex;
+    std::atomic<uint64_t> overrunCount;
+
+    // Consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> readIndex;
+    std::atomic<uint64_t> underrunCount;
+    bool starved; // Only counts one underrun until samples arrive again
+
+    alignas(CACHE_LINE_SIZE) std::array<float, Capacity> buffer;
+
+    size_t popIntoBytes(char* output, size_t maxSamples) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+        size_t write = writeIndex.load(std::memory_order_acquire);
+        size_t count = std::min(maxSamples, write - read);
+        if (count > 0) {
+            starved = false;
+        }
+        else if (maxSamples > 0 && !starved) {
+            starved = true;
+            underrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t start = read & MASK;
+        size_t firstPart = std::min(count, Capacity - start);
+        std::memcpy(output, &buffer[start], firstPart * sizeof(float));
+        std::memcpy(output + firstPart * sizeof(float), &buffer[0], (count - firstPart) * sizeof(float));
+
+        readIndex.store(read + count, std::memory_order_release);
+        return count;
+    }
 };
 
-#endif // THREADSAFEAUDIOQUEUE_HPP
\ No newline at end of file
+#endif // THREADSAFEAUDIOQUEUE_HPP
@@ -0,0 +1,46 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// A single block of memory that hands out allocations by bumping an offset.
+// Everything in the arena is released at once when the arena is destroyed, so it can only hold trivially destructible data.
+// Large arenas are backed by huge pages where the platform supports it.
+class Arena {
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    Arena();
+    explicit Arena(size_t capacity);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    // Returns nullptr if the arena does not have enough space left
+    uint8_t* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena allocations are never destroyed");
+        return reinterpret_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    size_t getCapacity() const;
+    size_t getUsed() const;
+
+private:
+    uint8_t* memory;
+    size_t capacity;
+    size_t used;
+    bool usesHugePages;
+
+    void release();
+};
+
+#endif // ARENA_HPP
@@ -0,0 +1,33 @@
+#ifndef AUDIOFILTER_HPP
+#define AUDIOFILTER_HPP
+
+#include <cstddef>
+
+// First-order high-pass or low-pass filter, run over a whole block of samples at a time
+class AudioFilter {
+public:
+    enum class Type {
+        HIGH_PASS,
+        LOW_PASS
+    };
+
+    AudioFilter(Type type, double cutoffFrequency);
+
+    void setSampleRate(double sampleRate);
+    void reset();
+
+    void process(float* samples, size_t numSamples);
+
+private:
+    Type type;
+    double cutoffFrequency;
+
+    // For a high-pass filter: y[n] = coefficient * (y[n-1] + x[n] - x[n-1])
+    // For a low-pass filter:  y[n] = y[n-1] + coefficient * (x[n] - y[n-1])
+    float coefficient;
+
+    float lastInput;
+    float lastOutput;
+};
+
+#endif // AUDIOFILTER_HPP
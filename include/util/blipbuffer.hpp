@@ -0,0 +1,58 @@
+#ifndef BLIPBUFFER_HPP
+#define BLIPBUFFER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Band-limited step synthesis.
+// Instead of point sampling a signal at the output rate, every change in amplitude is added as a delta at the clock it happened on.
+// Each delta is spread over neighbouring output samples with a windowed sinc kernel, so the result is free of aliasing,
+// and the samples of a whole frame are produced at once by integrating the buffer.
+class BlipBuffer {
+public:
+    // The most samples that can be buffered before they have to be read
+    static constexpr size_t MAX_SAMPLES = 2048;
+
+    // A delta of AMPLITUDE_UNIT raises the output by 1.0
+    static constexpr int32_t AMPLITUDE_UNIT = 1 << 15;
+
+    BlipBuffer();
+
+    void setRates(double clockRate, double sampleRate);
+    void clear();
+
+    // Time is measured in clocks from the start of the current frame
+    void addDelta(uint32_t time, int32_t delta);
+
+    // Ends the current frame after the given number of clocks, making its samples available to read
+    void endFrame(uint32_t clocks);
+
+    size_t samplesAvailable() const;
+    size_t readSamples(float* output, size_t maxSamples);
+
+private:
+    // Positions are fixed point, measured in output samples
+    static constexpr int FRACTION_BITS = 32;
+
+    static constexpr int PHASE_BITS = 5;
+    static constexpr int PHASE_COUNT = 1 << PHASE_BITS;
+    static constexpr int KERNEL_WIDTH = 16;
+
+    // The taps of each kernel phase sum to exactly KERNEL_UNIT, so integrating the buffer never drifts
+    static constexpr int32_t KERNEL_UNIT = 1 << 15;
+    using Kernel = std::array<std::array<int32_t, KERNEL_WIDTH>, PHASE_COUNT>;
+    static const Kernel& getKernel();
+
+    uint64_t timeFactor;
+
+    // Position of the start of the current frame, relative to the first unread sample
+    uint64_t offset;
+
+    int64_t integrator;
+
+    // Deltas are written up to a kernel width past the end of the frame
+    std::array<int64_t, MAX_SAMPLES + KERNEL_WIDTH> buffer;
+};
+
+#endif // BLIPBUFFER_HPP
@@ -0,0 +1,377 @@
+#ifndef SCHEMA_HPP
+#define SCHEMA_HPP
+
+#include "util/serializer.hpp"
+#include "util/statehash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// A schema lists the fields of a state struct once, at compile time. Serialization, hashing and diffing are all generated from
+// that one list, so they cannot drift apart. A struct declares its schema with a static constexpr function:
+//     struct Example {
+//         uint8_t a;
+//         std::array<uint8_t, 4> b;
+//
+//         static constexpr auto fields() {
+//             return std::make_tuple(
+//                 makeField("a", &Example::a),
+//                 makeField("b", &Example::b, 1) // Only in save states of minor version 1 and later
+//             );
+//         }
+//     };
+// Fields are serialized in the order they are listed, which does not have to be the order they are declared in.
+// A field can hold an integer, a bool, a register (a struct whose data member holds all of its BitFields),
+// a struct with a schema of its own, or a std::array of any of these.
+// Everything is resolved at compile time, so the generated code is the same as a hand written list of calls.
+
+template <typename Class, typename T>
+struct Field {
+    const char* name;
+    T Class::* member;
+    uint8_t sinceMinorVersion;
+};
+
+template <typename Class, typename T>
+constexpr Field<Class, T> makeField(const char* name, T Class::* member, uint8_t sinceMinorVersion = 0) {
+    return { name, member, sinceMinorVersion };
+}
+
+// The first count elements of an array, where count is another member of the struct.
+// Stored in the same format as Serializer::serializePartialArray.
+template <typename Class, typename T, size_t capacity, typename Count>
+struct CountedArrayField {
+    const char* name;
+    std::array<T, capacity> Class::* member;
+    Count Class::* count;
+    uint8_t sinceMinorVersion;
+};
+
+template <typename Class, typename T, size_t capacity, typename Count>
+constexpr CountedArrayField<Class, T, capacity, Count> makeCountedArrayField(
+    const char* name, std::array<T, capacity> Class::* member, Count Class::* count, uint8_t sinceMinorVersion = 0) {
+
+    return { name, member, count, sinceMinorVersion };
+}
+
+// A field that is no longer part of the state, but keeps its place in the save state format.
+// It is written as zero, skipped when reading, and left out of hashes and diffs.
+template <typename T>
+struct RetiredField {
+    const char* name;
+};
+
+template <typename T>
+constexpr RetiredField<T> makeRetiredField(const char* name) {
+    return { name };
+}
+
+class Schema {
+public:
+    template <typename T>
+    static void serialize(Serializer& s, const T& object) {
+        writeFields(s, object);
+    }
+
+    // Fields that are newer than the save state being read are zeroed
+    template <typename T>
+    static void deserialize(Deserializer& d, T& object) {
+        forEachField<T>([&](const auto& field) { readField(d, object, field); });
+    }
+
+    template <typename T>
+    static void hash(StateHash& h, const T& object) {
+        writeFields(h, object);
+    }
+
+    // Calls onDifference with the path of every value that differs between a and b, e.g. "pulses[1].i.timerCounter"
+    template <typename T, typename OnDifference>
+    static void diff(const T& a, const T& b, const OnDifference& onDifference) {
+        std::string path;
+        diffFields(a, b, path, onDifference);
+    }
+
+private:
+    template <typename T, typename = void>
+    struct HasSchema : std::false_type {};
+
+    template <typename T>
+    struct HasSchema<T, std::void_t<decltype(T::fields())>> : std::true_type {};
+
+    template <typename T, typename = void>
+    struct IsRegister : std::false_type {};
+
+    template <typename T>
+    struct IsRegister<T, std::void_t<decltype(std::declval<T&>().data)>> : std::is_unsigned<decltype(std::declval<T&>().data)> {};
+
+    template <typename T>
+    struct IsArray : std::false_type {};
+
+    template <typename T, size_t size>
+    struct IsArray<std::array<T, size>> : std::true_type {};
+
+    template <typename T, typename Visitor>
+    static void forEachField(const Visitor& visitor) {
+        std::apply([&](const auto&... fields) { (visitor(fields), ...); }, T::fields());
+    }
+
+    static bool includes(const Serializer& s, uint8_t sinceMinorVersion) { return s.version.minor >= sinceMinorVersion; }
+    static bool includes(const Deserializer& d, uint8_t sinceMinorVersion) { return d.version.minor >= sinceMinorVersion; }
+    static bool includes(const StateHash&, uint8_t) { return true; }
+
+    static bool isHashing(const Serializer&) { return false; }
+    static bool isHashing(const StateHash&) { return true; }
+
+    // Writing, shared by serialization and hashing
+
+    template <typename Sink, typename T>
+    static void writeFields(Sink& sink, const T& object) {
+        forEachField<T>([&](const auto& field) { writeField(sink, object, field); });
+    }
+
+    template <typename Sink, typename Class, typename T>
+    static void writeField(Sink& sink, const Class& object, const Field<Class, T>& field) {
+        if (includes(sink, field.sinceMinorVersion)) {
+            writeValue(sink, object.*field.member);
+        }
+    }
+
+    template <typename Sink, typename Class, typename T, size_t capacity, typename Count>
+    static void writeField(Sink& sink, const Class& object, const CountedArrayField<Class, T, capacity, Count>& field) {
+        if (includes(sink, field.sinceMinorVersion)) {
+            const std::array<T, capacity>& array = object.*field.member;
+            size_t count = std::min<size_t>(object.*field.count, capacity);
+            sink.serializeUInt64(static_cast<uint64_t>(count));
+            for (size_t i = 0; i < count; i++) {
+                writeValue(sink, array[i]);
+            }
+        }
+    }
+
+    template <typename Sink, typename Class, typename T>
+    static void writeField(Sink& sink, const Class&, const RetiredField<T>&) {
+        if (!isHashing(sink)) {
+            writeValue(sink, T{});
+        }
+    }
+
+    template <typename Sink, typename T>
+    static void writeValue(Sink& sink, const T& value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            sink.serializeBool(value);
+        }
+        else if constexpr (std::is_same<T, uint8_t>::value) {
+            sink.serializeUInt8(value);
+        }
+        else if constexpr (std::is_same<T, uint16_t>::value) {
+            sink.serializeUInt16(value);
+        }
+        else if constexpr (std::is_same<T, uint32_t>::value) {
+            sink.serializeUInt32(value);
+        }
+        else if constexpr (std::is_same<T, uint64_t>::value) {
+            sink.serializeUInt64(value);
+        }
+        else if constexpr (std::is_same<T, int32_t>::value) {
+            sink.serializeInt32(value);
+        }
+        else if constexpr (IsArray<T>::value) {
+            if constexpr (std::is_same<typename T::value_type, uint8_t>::value) {
+                sink.serializeBytes(value.data(), value.size());
+            }
+            else {
+                for (const auto& element : value) {
+                    writeValue(sink, element);
+                }
+            }
+        }
+        else if constexpr (HasSchema<T>::value) {
+            writeFields(sink, value);
+        }
+        else {
+            static_assert(IsRegister<T>::value, "Schema fields must be integers, bools, registers, arrays or structs with schemas");
+            writeValue(sink, value.data);
+        }
+    }
+
+    // Reading
+
+    template <typename Class, typename T>
+    static void readField(Deserializer& d, Class& object, const Field<Class, T>& field) {
+        if (includes(d, field.sinceMinorVersion)) {
+            readValue(d, object.*field.member);
+        }
+        else {
+            clearValue(object.*field.member);
+        }
+    }
+
+    template <typename Class, typename T, size_t capacity, typename Count>
+    static void readField(Deserializer& d, Class& object, const CountedArrayField<Class, T, capacity, Count>& field) {
+        if (includes(d, field.sinceMinorVersion)) {
+            size_t count = d.deserializePartialArray(object.*field.member, [&](T& element) { readValue(d, element); });
+            object.*field.count = static_cast<Count>(count);
+        }
+        else {
+            object.*field.count = 0;
+        }
+    }
+
+    template <typename Class, typename T>
+    static void readField(Deserializer& d, Class&, const RetiredField<T>&) {
+        T discarded{};
+        readValue(d, discarded);
+    }
+
+    template <typename T>
+    static void readValue(Deserializer& d, T& value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            d.deserializeBool(value);
+        }
+        else if constexpr (std::is_same<T, uint8_t>::value) {
+            d.deserializeUInt8(value);
+        }
+        else if constexpr (std::is_same<T, uint16_t>::value) {
+            d.deserializeUInt16(value);
+        }
+        else if constexpr (std::is_same<T, uint32_t>::value) {
+            d.deserializeUInt32(value);
+        }
+        else if constexpr (std::is_same<T, uint64_t>::value) {
+            d.deserializeUInt64(value);
+        }
+        else if constexpr (std::is_same<T, int32_t>::value) {
+            d.deserializeInt32(value);
+        }
+        else if constexpr (IsArray<T>::value) {
+            if constexpr (std::is_same<typename T::value_type, uint8_t>::value) {
+                d.deserializeBytes(value.data(), value.size());
+            }
+            else {
+                for (auto& element : value) {
+                    readValue(d, element);
+                }
+            }
+        }
+        else if constexpr (HasSchema<T>::value) {
+            deserialize(d, value);
+        }
+        else {
+            static_assert(IsRegister<T>::value, "Schema fields must be integers, bools, registers, arrays or structs with schemas");
+            readValue(d, value.data);
+        }
+    }
+
+    // Registers cannot be assigned as a whole, so values are cleared member by member
+    template <typename T>
+    static void clearValue(T& value) {
+        if constexpr (std::is_arithmetic<T>::value) {
+            value = 0;
+        }
+        else if constexpr (IsArray<T>::value) {
+            for (auto& element : value) {
+                clearValue(element);
+            }
+        }
+        else if constexpr (HasSchema<T>::value) {
+            forEachField<T>([&](const auto& field) { clearField(value, field); });
+        }
+        else {
+            clearValue(value.data);
+        }
+    }
+
+    template <typename Class, typename T>
+    static void clearField(Class& object, const Field<Class, T>& field) {
+        clearValue(object.*field.member);
+    }
+
+    template <typename Class, typename T, size_t capacity, typename Count>
+    static void clearField(Class& object, const CountedArrayField<Class, T, capacity, Count>& field) {
+        object.*field.count = 0;
+    }
+
+    template <typename Class, typename T>
+    static void clearField(Class&, const RetiredField<T>&) {}
+
+    // Diffing
+
+    template <typename T, typename OnDifference>
+    static void diffFields(const T& a, const T& b, std::string& path, const OnDifference& onDifference) {
+        forEachField<T>([&](const auto& field) { diffField(a, b, field, path, onDifference); });
+    }
+
+    template <typename Class, typename T, typename OnDifference>
+    static void diffField(const Class& a, const Class& b, const Field<Class, T>& field, std::string& path, const OnDifference& onDifference) {
+        size_t length = appendName(path, field.name);
+        diffValue(a.*field.member, b.*field.member, path, onDifference);
+        path.resize(length);
+    }
+
+    template <typename Class, typename T, size_t capacity, typename Count, typename OnDifference>
+    static void diffField(
+        const Class& a, const Class& b, const CountedArrayField<Class, T, capacity, Count>& field, std::string& path, const OnDifference& onDifference) {
+
+        size_t length = appendName(path, field.name);
+        size_t countA = std::min<size_t>(a.*field.count, capacity);
+        size_t countB = std::min<size_t>(b.*field.count, capacity);
+        if (countA != countB) {
+            onDifference(path);
+        }
+        for (size_t i = 0; i < std::min(countA, countB); i++) {
+            diffElement(a.*field.member, b.*field.member, i, path, onDifference);
+        }
+        path.resize(length);
+    }
+
+    template <typename Class, typename T, typename OnDifference>
+    static void diffField(const Class&, const Class&, const RetiredField<T>&, std::string&, const OnDifference&) {}
+
+    template <typename T, typename OnDifference>
+    static void diffValue(const T& a, const T& b, std::string& path, const OnDifference& onDifference) {
+        if constexpr (std::is_arithmetic<T>::value) {
+            if (a != b) {
+                onDifference(path);
+            }
+        }
+        else if constexpr (IsArray<T>::value) {
+            for (size_t i = 0; i < a.size(); i++) {
+                diffElement(a, b, i, path, onDifference);
+            }
+        }
+        else if constexpr (HasSchema<T>::value) {
+            diffFields(a, b, path, onDifference);
+        }
+        else {
+            diffValue(a.data, b.data, path, onDifference);
+        }
+    }
+
+    template <typename Array, typename OnDifference>
+    static void diffElement(const Array& a, const Array& b, size_t index, std::string& path, const OnDifference& onDifference) {
+        size_t length = path.size();
+        path += '[';
+        path += std::to_string(index);
+        path += ']';
+        diffValue(a[index], b[index], path, onDifference);
+        path.resize(length);
+    }
+
+    // Returns the length of the path before the name was appended
+    static size_t appendName(std::string& path, const char* name) {
+        size_t length = path.size();
+        if (!path.empty()) {
+            path += '.';
+        }
+        path += name;
+        return length;
+    }
+};
+
+#endif // SCHEMA_HPP
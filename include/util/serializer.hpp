@@ -1,9 +1,12 @@
 #ifndef SERIALIZER_HPP
 #define SERIALIZER_HPP
 
+#include "util/util.hpp"
+
+#include <algorithm>
 #include <array>
 #include <cstdint>
-#include <functional>
+#include <cstring>
 #include <vector>
 
 struct Version {
@@ -12,57 +15,109 @@ struct Version {
     uint8_t patch;
 };
 
+// Integers are stored big endian, so the format matches the files written by earlier versions through QDataStream.
+// Both classes work on memory only and are not virtual, so every field compiles down to a few stores or loads.
+// Byte arrays are copied in bulk.
+
+// Appends to a contiguous byte buffer, which the caller then writes to a file or keeps in memory
 class Serializer {
 public:
     Serializer() { version = {}; }
-    virtual ~Serializer() = default;
 
     Version version;
 
-    virtual void serializeUInt8(uint8_t data) = 0;
-    virtual void serializeUInt16(uint16_t data) = 0;
-    virtual void serializeUInt32(uint32_t data) = 0;
-    virtual void serializeUInt64(uint64_t data) = 0;
-    virtual void serializeInt32(int32_t data) = 0;
+    void serializeUInt8(uint8_t data) { buffer.push_back(data); }
+    void serializeUInt16(uint16_t data) { serializeBigEndian(data); }
+    void serializeUInt32(uint32_t data) { serializeBigEndian(data); }
+    void serializeUInt64(uint64_t data) { serializeBigEndian(data); }
+    void serializeInt32(int32_t data) { serializeBigEndian(static_cast<uint32_t>(data)); }
 
     void serializeBool(bool data) {
         serializeUInt8(static_cast<uint8_t>(data));
     }
 
+    void serializeBytes(const uint8_t* data, size_t size) {
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
     // Serialize arrays/vectors of arbitrary type if user supplies a serialization function
-    template <typename T, size_t size>
-    void serializeArray(const std::array<T, size>& data, const std::function<void(const T&)>& serializeT) {
+    template <typename T, size_t size, typename SerializeT>
+    void serializeArray(const std::array<T, size>& data, const SerializeT& serializeT) {
         for (const T& t : data) {
             serializeT(t);
         }
     }
 
-    template <typename T>
-    void serializeVector(const std::vector<T>& data, const std::function<void(const T&)>& serializeT) {
+    template <typename T, typename SerializeT>
+    void serializeVector(const std::vector<T>& data, const SerializeT& serializeT) {
         serializeUInt64(static_cast<uint64_t>(data.size()));
         for (const T& t : data) {
             serializeT(t);
         }
     }
 
-    // Defined here for convenience since serializing arrays and vectors of uint8_t is very common
-    const std::function<void(const uint8_t&)> uInt8Func = [&](const uint8_t& data) -> void {
-        this->serializeUInt8(data);
-    };
+    // Serialize the first size elements of a fixed size array, using the same format as serializeVector
+    template <typename T, size_t capacity, typename SerializeT>
+    void serializePartialArray(const std::array<T, capacity>& data, size_t size, const SerializeT& serializeT) {
+        serializeUInt64(static_cast<uint64_t>(size));
+        for (size_t i = 0; i < size; i++) {
+            serializeT(data[i]);
+        }
+    }
+
+    // Byte arrays are common enough, and large enough in the case of RAM, to be copied in one go
+    template <size_t size>
+    void serializeArray(const std::array<uint8_t, size>& data) {
+        serializeBytes(data.data(), size);
+    }
+
+    template <size_t capacity>
+    void serializePartialArray(const std::array<uint8_t, capacity>& data, size_t size) {
+        serializeUInt64(static_cast<uint64_t>(size));
+        serializeBytes(data.data(), std::min(size, capacity));
+    }
+
+    const std::vector<uint8_t>& getBuffer() const { return buffer; }
+
+    // Empties the buffer but keeps its memory, so a serializer can be reused without allocating
+    void clear() { buffer.clear(); }
+
+private:
+    std::vector<uint8_t> buffer;
+
+    template <typename T>
+    void serializeBigEndian(T data) {
+        uint8_t bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bytes[i] = static_cast<uint8_t>(data >> (8 * (sizeof(T) - 1 - i)));
+        }
+        serializeBytes(bytes, sizeof(T));
+    }
 };
 
+// Reads from a block of bytes that must outlive the deserializer.
+// Reading past the end zeroes the data and makes good() return false, so callers only need to check once at the end.
 class Deserializer {
 public:
-    Deserializer() { version = {}; }
-    virtual ~Deserializer() = default;
+    explicit Deserializer(ByteView bytes) : bytes(bytes), position(0), failed(false) { version = {}; }
 
     Version version;
 
-    virtual void deserializeUInt8(uint8_t& data) = 0;
-    virtual void deserializeUInt16(uint16_t& data) = 0;
-    virtual void deserializeUInt32(uint32_t& data) = 0;
-    virtual void deserializeUInt64(uint64_t& data) = 0;
-    virtual void deserializeInt32(int32_t& data) = 0;
+    bool good() const { return !failed; }
+
+    // The bytes that have not been read yet
+    ByteView getRemaining() const { return { bytes.data + position, bytes.size - position }; }
+
+    void deserializeUInt8(uint8_t& data) { deserializeBytes(&data, 1); }
+    void deserializeUInt16(uint16_t& data) { deserializeBigEndian(data); }
+    void deserializeUInt32(uint32_t& data) { deserializeBigEndian(data); }
+    void deserializeUInt64(uint64_t& data) { deserializeBigEndian(data); }
+
+    void deserializeInt32(int32_t& data) {
+        uint32_t temp;
+        deserializeBigEndian(temp);
+        data = static_cast<int32_t>(temp);
+    }
 
     void deserializeBool(bool& data) {
         uint8_t temp;
@@ -70,28 +125,101 @@ public:
         data = static_cast<bool>(temp);
     }
 
+    void deserializeBytes(uint8_t* data, size_t size) {
+        if (size > bytes.size - position) {
+            failed = true;
+            position = bytes.size;
+            std::memset(data, 0, size);
+            return;
+        }
+        std::memcpy(data, bytes.data + position, size);
+        position += size;
+    }
+
     // Deserialize arrays/vectors of arbitrary type if user supplies a deserialization function
-    template <typename T, size_t size>
-    void deserializeArray(std::array<T, size>& data, const std::function<void(T&)>& deserializeT) {
+    template <typename T, size_t size, typename DeserializeT>
+    void deserializeArray(std::array<T, size>& data, const DeserializeT& deserializeT) {
         for (T& t : data) {
             deserializeT(t);
         }
     }
 
-    template <typename T>
-    void deserializeVector(std::vector<T>& data, const std::function<void(T&)>& deserializeT) {
+    template <typename T, typename DeserializeT>
+    void deserializeVector(std::vector<T>& data, const DeserializeT& deserializeT) {
         uint64_t sizeDeserialized;
         deserializeUInt64(sizeDeserialized);
+        if (!isSizeReadable(sizeDeserialized)) {
+            return;
+        }
         data.resize(sizeDeserialized);
         for (T& t : data) {
             deserializeT(t);
         }
     }
 
-    // Defined here for convenience since deserializing arrays and vectors of uint8_t is very common
-    const std::function<void(uint8_t&)> uInt8Func = [&](uint8_t& data) -> void {
-        this->deserializeUInt8(data);
-    };
+    // Deserialize a vector into a fixed size array, returning the number of elements stored
+    // Elements that do not fit in the array are deserialized and then discarded
+    template <typename T, size_t capacity, typename DeserializeT>
+    size_t deserializePartialArray(std::array<T, capacity>& data, const DeserializeT& deserializeT) {
+        uint64_t sizeDeserialized;
+        deserializeUInt64(sizeDeserialized);
+        if (!isSizeReadable(sizeDeserialized)) {
+            return 0;
+        }
+        for (uint64_t i = 0; i < sizeDeserialized; i++) {
+            if (i < capacity) {
+                deserializeT(data[i]);
+            }
+            else {
+                T discarded{};
+                deserializeT(discarded);
+            }
+        }
+        return static_cast<size_t>(std::min<uint64_t>(sizeDeserialized, capacity));
+    }
+
+    template <size_t size>
+    void deserializeArray(std::array<uint8_t, size>& data) {
+        deserializeBytes(data.data(), size);
+    }
+
+    template <size_t capacity>
+    size_t deserializePartialArray(std::array<uint8_t, capacity>& data) {
+        uint64_t sizeDeserialized;
+        deserializeUInt64(sizeDeserialized);
+        if (!isSizeReadable(sizeDeserialized)) {
+            return 0;
+        }
+        size_t size = static_cast<size_t>(std::min<uint64_t>(sizeDeserialized, capacity));
+        deserializeBytes(data.data(), size);
+        position += static_cast<size_t>(sizeDeserialized - size);
+        return size;
+    }
+
+private:
+    ByteView bytes;
+    size_t position;
+    bool failed;
+
+    template <typename T>
+    void deserializeBigEndian(T& data) {
+        uint8_t temp[sizeof(T)];
+        deserializeBytes(temp, sizeof(T));
+        data = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            data = static_cast<T>((data << 8) | temp[i]);
+        }
+    }
+
+    // Every element takes at least a byte, so a corrupted size can be caught before anything is allocated or read
+    bool isSizeReadable(uint64_t size) {
+        if (size > bytes.size - position) {
+            failed = true;
+            position = bytes.size;
+            return false;
+        }
+        return true;
+    }
 };
 
-#endif // SERIALIZER_HPP
\ No newline at end of file
+#endif // SERIALIZER_HPP
@@ -0,0 +1,34 @@
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include "util/util.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Incremental SHA-256 (FIPS 180-4), used to identify ROM images without depending on Qt
+class Sha256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+    Sha256();
+
+    void update(const uint8_t* data, size_t size);
+    Digest finalize();
+
+    static Digest hash(ByteView data);
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    std::array<uint32_t, 8> h;
+    std::array<uint8_t, BLOCK_SIZE> block;
+    size_t blockUsed;
+    uint64_t totalBytes;
+
+    void processBlock(const uint8_t* data);
+};
+
+#endif // SHA256_HPP
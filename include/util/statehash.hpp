@@ -0,0 +1,58 @@
+#ifndef STATEHASH_HPP
+#define STATEHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// A fast 64-bit hash for telling emulator states apart. It is not cryptographic.
+// It takes the same calls as Serializer, so anything that can be serialized can be hashed without building a buffer.
+// Bulk data is consumed 8 bytes at a time.
+class StateHash {
+public:
+    StateHash() : hash(SEED) {}
+
+    void serializeUInt8(uint8_t data) { addWord(data); }
+    void serializeUInt16(uint16_t data) { addWord(data); }
+    void serializeUInt32(uint32_t data) { addWord(data); }
+    void serializeUInt64(uint64_t data) { addWord(data); }
+    void serializeInt32(int32_t data) { addWord(static_cast<uint32_t>(data)); }
+    void serializeBool(bool data) { addWord(data); }
+
+    void serializeBytes(const uint8_t* data, size_t size) {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(uint64_t));
+            addWord(word);
+        }
+
+        // The length goes in the top byte of the last word, so that trailing zeros still change the hash
+        uint64_t tail = static_cast<uint64_t>(size & 0xFF) << 56;
+        std::memcpy(&tail, data + i, size - i);
+        addWord(tail);
+    }
+
+    // Finalized with the MurmurHash3 mixer, so that every bit of the state affects every bit of the hash
+    uint64_t get() const {
+        uint64_t h = hash;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t SEED = 0x9E3779B97F4A7C15ull;
+
+    uint64_t hash;
+
+    void addWord(uint64_t word) {
+        hash ^= word * 0x87C37B91114253D5ull;
+        hash = ((hash << 27) | (hash >> 37)) * 0x4CF5AD432745937Full + 0x52DCE729;
+    }
+};
+
+#endif // STATEHASH_HPP
@@ -1,6 +1,7 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <type_traits>
@@ -14,50 +15,33 @@ constexpr uint32_t MASK() {
     return x - 1;
 }
 
+// A BitField names a range of bits within an integer register, and reads or writes them in the integer itself, e.g.:
+//     struct Register {
+//         uint8_t data;
+//
+//         using FlagA = BitField<0, 1>;
+//         using ValueB = BitField<1, 7>;
+//     };
+//     Register::ValueB::set(reg.data, Register::ValueB::get(reg.data) + 1);
+// A register only holds its integer, so it stays trivially copyable, and is copied or compared through its data member.
 template <uint8_t Offset, uint8_t Size, typename T = uint8_t>
-class BitField {
+struct BitField {
     static_assert(std::is_unsigned<T>::value, "BitField type must be unsigned");
     static_assert(Size > 0, "BitField size must be positive");
     static_assert(Offset + Size <= 8 * sizeof(T), "Bit subset must fit within BitField type");
 
-public:
-    BitField(T& data) : data(data) {}
-    ~BitField() = default;
-
-    BitField(const BitField&) = delete;
-    BitField& operator=(const BitField&) = delete;
-    BitField(BitField&&) = delete;
-    BitField& operator=(BitField&&) = delete;
-
-    operator T() const { return get(); }
-
-    BitField& operator=(T rhs) { set(rhs); return *this; }
-
-    BitField& operator+=(T rhs) { set(get() + rhs); return *this; }
-    BitField& operator-=(T rhs) { set(get() - rhs); return *this; }
-    BitField& operator&=(T rhs) { set(get() & rhs); return *this; }
-    BitField& operator|=(T rhs) { set(get() | rhs); return *this; }
-    BitField& operator^=(T rhs) { set(get() ^ rhs); return *this; }
-
-    BitField& operator<<=(uint8_t rhs) { set(get() << rhs); return *this; }
-    BitField& operator>>=(uint8_t rhs) { set(get() >> rhs); return *this; }
-
-    BitField& operator++() { set(get() + 1); return *this; }
-    BitField& operator--() { set(get() - 1); return *this; }
-
-private:
-    static constexpr T unshiftedMask = (static_cast<T>(1) << Size) - 1;
-    static constexpr T shiftedMask = unshiftedMask << Offset;
-
-    T& data;
-
-    T get() const {
+    static constexpr T get(T data) {
         return (data >> Offset) & unshiftedMask;
     }
 
-    void set(T value) {
-        data = (data & ~shiftedMask) | ((value & unshiftedMask) << Offset);
+    // The value is truncated to the size of the field
+    static constexpr void set(T& data, T value) {
+        data = static_cast<T>((data & ~shiftedMask) | ((value & unshiftedMask) << Offset));
     }
+
+private:
+    static constexpr T unshiftedMask = static_cast<T>((static_cast<uint64_t>(1) << Size) - 1);
+    static constexpr T shiftedMask = static_cast<T>(unshiftedMask << Offset);
 };
 
 struct MemoryRange {
@@ -66,6 +50,13 @@ struct MemoryRange {
     constexpr bool contains(uint16_t addr) const { return (addr >= lo) && (addr <= hi); }
 };
 
+// Non-owning, read-only view of a contiguous block of bytes
+struct ByteView {
+    const uint8_t* data;
+    size_t size;
+    uint8_t operator[](size_t index) const { return data[index]; }
+};
+
 std::string toHexString8(uint8_t x);
 std::string toHexString16(uint16_t x);
 std::string toHexString32(uint32_t x);
@@ -0,0 +1,79 @@
+#ifndef WRITETRACKER_HPP
+#define WRITETRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Remembers when each 256 byte page of a block of memory was last written, so that a copy of the block can be brought up to date
+// by copying only the pages that were written since the copy was made.
+// Time is counted in generations. Starting a generation returns its number, and every write after that is stamped with it,
+// so a page was written after a copy was made if its stamp is at least the generation the copy was made at.
+// Only the pages that lie entirely in tracked memory are watched. Writes to those have to be marked by whoever makes them,
+// and every other page counts as always written.
+class WriteTracker {
+public:
+    static constexpr size_t PAGE_SIZE = 256;
+
+    WriteTracker(const void* block, size_t size) :
+        block(static_cast<const uint8_t*>(block)),
+        size(size),
+        generation(1),
+        pageGenerations((size + PAGE_SIZE - 1) / PAGE_SIZE, 0),
+        trackedBytes(pageGenerations.size(), 0) {
+    }
+
+    // Marks a part of the block as memory whose writes are marked
+    void track(const void* start, size_t length) {
+        size_t offset = static_cast<const uint8_t*>(start) - block;
+        size_t end = offset + length;
+        while (offset < end) {
+            size_t pageEnd = (offset / PAGE_SIZE + 1) * PAGE_SIZE;
+            size_t chunkEnd = pageEnd < end ? pageEnd : end;
+            trackedBytes[offset / PAGE_SIZE] += chunkEnd - offset;
+            offset = chunkEnd;
+        }
+    }
+
+    void markWritten(const void* address) {
+        pageGenerations[(static_cast<const uint8_t*>(address) - block) / PAGE_SIZE] = generation;
+    }
+
+    // For anything that replaces the whole block at once, like a reset or loading a save state
+    void markAllWritten() {
+        for (uint64_t& pageGeneration : pageGenerations) {
+            pageGeneration = generation;
+        }
+    }
+
+    uint64_t startGeneration() {
+        return ++generation;
+    }
+
+    // Generation 0 is before anything was written, so every page has been written since then
+    bool wasWrittenSince(size_t page, uint64_t since) const {
+        return pageGenerations[page] >= since || !isTracked(page);
+    }
+
+    size_t getNumPages() const {
+        return pageGenerations.size();
+    }
+
+    size_t getPageSize(size_t page) const {
+        return page + 1 < pageGenerations.size() ? PAGE_SIZE : size - page * PAGE_SIZE;
+    }
+
+private:
+    const uint8_t* block;
+    size_t size;
+
+    uint64_t generation;
+    std::vector<uint64_t> pageGenerations;
+    std::vector<size_t> trackedBytes;
+
+    bool isTracked(size_t page) const {
+        return trackedBytes[page] == getPageSize(page);
+    }
+};
+
+#endif // WRITETRACKER_HPP
@@ -1,72 +1,131 @@
 #include "core/apu.hpp"
 
+#include "core/aputhread.hpp"
 #include "core/bus.hpp"
 
-APU::APU(Bus& bus) : bus(bus) {
-    resetAPU();
+#include <algorithm>
+#include <initializer_list>
+
+// https://www.nesdev.org/wiki/APU_Mixer
+
+// The NES APU mixer takes the channel outputs and converts them to an analog audio signal.
+// Each channel has its own internal digital-to-analog convertor (DAC), implemented in a way that causes non-linearity and interaction between channels, so calculation of the resulting amplitude is somewhat involved.
+// In particular, games such as Super Mario Bros. and StarTropics use the DMC level ($4011) as a crude volume control for the triangle and noise channels.
+
+// The mixer is approximated with two lookup tables, one for the pulse channels and one for the triangle, noise and DMC channels:
+
+// output = pulse_out + tnd_out
+
+// pulse_out = pulse_table[pulse1 + pulse2]
+// tnd_out = tnd_table[3 * triangle + 2 * noise + dmc]
+
+//                          95.52
+// pulse_table[n] = --------------------
+//                   (8128.0 / n) + 100
+
+//                          163.67
+// tnd_table[n] = ---------------------
+//                 (24329.0 / n) + 100
+
+// Entries are stored in BlipBuffer amplitude units
+static constexpr std::array<int32_t, 31> PULSE_TABLE = []() {
+    std::array<int32_t, 31> table = {};
+    for (size_t n = 1; n < table.size(); n++) {
+        table[n] = static_cast<int32_t>(95.52 / (8128.0 / n + 100.0) * BlipBuffer::AMPLITUDE_UNIT + 0.5);
+    }
+    return table;
+}();
+
+static constexpr std::array<int32_t, 203> TND_TABLE = []() {
+    std::array<int32_t, 203> table = {};
+    for (size_t n = 1; n < table.size(); n++) {
+        table[n] = static_cast<int32_t>(163.67 / (24329.0 / n + 100.0) * BlipBuffer::AMPLITUDE_UNIT + 0.5);
+    }
+    return table;
+}();
+
+APU::APU(Bus& bus) : bus(&bus), state(bus.state.apu), apuThread(nullptr), audioClockRate(0), audioAmplitude(0), audioFrameCycles(0),
+    audioOutputEnabled(true), disabledAudioAmplitude(0), disabledAudioFrameCycles(0) {
+}
+
+APU::APU(State& state) : bus(nullptr), state(state), apuThread(nullptr), audioClockRate(0), audioAmplitude(0), audioFrameCycles(0),
+    audioOutputEnabled(true), disabledAudioAmplitude(0), disabledAudioFrameCycles(0) {
 }
 
 void APU::resetAPU() {
     for (int i = 0; i < 2; i++) {
-        pulses[i].data = 0;
-        pulses[i].i = {};
+        state.pulses[i].data = 0;
+        state.pulses[i].i = {};
     }
 
-    triangle.data = 0;
-    triangle.i = {};
+    state.triangle.data = 0;
+    state.triangle.i = {};
+
+    state.noise.data = 0;
+    state.noise.i = {};
+    state.noise.i.shiftRegister = 1;
 
-    noise.data = 0;
-    noise.i = {};
-    noise.i.shiftRegister = 1;
+    state.dmc.data = 0;
+    state.dmc.i = {};
+    state.dmc.i.currentAddress = 0xC000;
+    state.dmc.i.sampleBufferEmpty = true;
+    state.dmc.i.silenceFlag = true;
+    state.dmc.i.bitsRemaining = 8;
 
-    dmc.data = 0;
-    dmc.i = {};
-    dmc.i.currentAddress = 0xC000;
-    dmc.i.sampleBufferEmpty = true;
-    dmc.i.silenceFlag = true;
-    dmc.i.bitsRemaining = 8;
+    state.status.data = 0;
 
-    status.data = 0;
+    state.frameCounter = 0;
+    state.totalCycles = 0;
 
-    frameCounter = 0;
-    totalCycles = 0;
+    state.frameSequenceMode = false;
+    state.interruptInhibitFlag = false;
+    state.frameInterruptFlag = false;
 
-    frameSequenceMode = false;
-    interruptInhibitFlag = false;
-    frameInterruptFlag = false;
+    state.pendingCycles = 0;
+    scheduleSync();
+
+    if (apuThread != nullptr) {
+        apuThread->restart(state);
+    }
 }
 
 void APU::write(uint16_t addr, uint8_t value) {
+    synchronize();
+
+    if (apuThread != nullptr) {
+        apuThread->logWrite(state.totalCycles, addr, value);
+    }
+
     if (PULSE_RANGE.contains(addr)) {
         bool pulseNum = (addr >> 2) & 1;
-        Pulse& pulse = pulses[pulseNum];
+        Pulse& pulse = state.pulses[pulseNum];
 
         switch (addr & 0x3) {
             case 0: // 0x4000 / 0x4004
-                pulse.reg4000 = value;
+                Pulse::Reg4000::set(pulse.data, value);
                 break;
 
             case 1: // 0x4001 / 0x4005
-                pulse.reg4001 = value;
+                Pulse::Reg4001::set(pulse.data, value);
 
                 pulse.i.sweepReloadFlag = true;
 
-                if (!pulse.sweepUnitEnabled || !pulse.sweepUnitShift) {
+                if (!Pulse::SweepUnitEnabled::get(pulse.data) || !Pulse::SweepUnitShift::get(pulse.data)) {
                     pulse.i.sweepMutesChannel = false;
                 }
                 break;
 
             case 2: // 0x4002 / 0x4006
-                pulse.reg4002 = value;
+                Pulse::Reg4002::set(pulse.data, value);
                 break;
 
             default: // 0x4003 / 0x4007
-                pulse.reg4003 = value;
+                Pulse::Reg4003::set(pulse.data, value);
 
-                pulse.i.timerCounter = pulse.timer;
+                pulse.i.timerCounter = Pulse::Timer::get(pulse.data);
 
                 if (getPulseStatus(pulseNum)) {
-                    pulse.i.lengthCounter = LENGTH_COUNTER_TABLE[pulse.lengthCounterLoad];
+                    pulse.i.lengthCounter = LENGTH_COUNTER_TABLE[Pulse::LengthCounterLoad::get(pulse.data)];
                 }
 
                 pulse.i.envelopeStartFlag = true;
@@ -77,7 +136,7 @@ void APU::write(uint16_t addr, uint8_t value) {
     else if (TRIANGLE_RANGE.contains(addr)) {
         switch (addr & 0x3) {
             case 0: // 0x4008
-                triangle.reg4008 = value;
+                Triangle::Reg4008::set(state.triangle.data, value);
                 break;
 
             case 1: // 0x4009
@@ -85,27 +144,27 @@ void APU::write(uint16_t addr, uint8_t value) {
                 break;
 
             case 2: // 0x400A
-                triangle.reg400A = value;
+                Triangle::Reg400A::set(state.triangle.data, value);
                 break;
 
             default: // 0x400B
-                triangle.reg400B = value;
+                Triangle::Reg400B::set(state.triangle.data, value);
 
-                triangle.i.timerCounter = triangle.timer;
+                state.triangle.i.timerCounter = Triangle::Timer::get(state.triangle.data);
 
-                if (status.enableTriangle) {
-                    triangle.i.lengthCounter = LENGTH_COUNTER_TABLE[triangle.lengthCounterLoad];
+                if (Status::EnableTriangle::get(state.status.data)) {
+                    state.triangle.i.lengthCounter = LENGTH_COUNTER_TABLE[Triangle::LengthCounterLoad::get(state.triangle.data)];
                 }
-                triangle.i.linearCounterReloadFlag = true;
+                state.triangle.i.linearCounterReloadFlag = true;
                 break;
         }
     }
     else if (NOISE_RANGE.contains(addr)) {
         switch (addr & 0x3) {
             case 0: // 0x400C
-                noise.volumeOrEnvelope = value & 0xF;
-                noise.constantVolume = (value >> 4) & 0x1;
-                noise.envelopeLoopOrLengthCounterHalt = (value >> 5) & 0x1;
+                Noise::VolumeOrEnvelope::set(state.noise.data, value & 0xF);
+                Noise::ConstantVolume::set(state.noise.data, (value >> 4) & 0x1);
+                Noise::EnvelopeLoopOrLengthCounterHalt::set(state.noise.data, (value >> 5) & 0x1);
                 break;
 
             case 1: // 0x400D
@@ -113,114 +172,232 @@ void APU::write(uint16_t addr, uint8_t value) {
                 break;
 
             case 2: // 0x400E
-                noise.noisePeriod = value & 0xF;
-                noise.loopNoise = (value >> 7) & 0x1;
-                noise.i.timerCounter = NOISE_PERIOD_TABLE[noise.noisePeriod];
+                Noise::NoisePeriod::set(state.noise.data, value & 0xF);
+                Noise::LoopNoise::set(state.noise.data, (value >> 7) & 0x1);
+                state.noise.i.timerCounter = NOISE_PERIOD_TABLE[Noise::NoisePeriod::get(state.noise.data)];
                 break;
 
             default: // 0x400F
-                noise.lengthCounterLoad = (value >> 3) & 0x1F;
-                if (status.enableNoise) {
-                    noise.i.lengthCounter = LENGTH_COUNTER_TABLE[noise.lengthCounterLoad];
+                Noise::LengthCounterLoad::set(state.noise.data, (value >> 3) & 0x1F);
+                if (Status::EnableNoise::get(state.status.data)) {
+                    state.noise.i.lengthCounter = LENGTH_COUNTER_TABLE[Noise::LengthCounterLoad::get(state.noise.data)];
                 }
-                noise.i.envelopeStartFlag = true;
+                state.noise.i.envelopeStartFlag = true;
                 break;
         }
     }
     else if (DMC_RANGE.contains(addr)) {
         switch (addr & 0x3) {
             case 0: // 0x4010
-                dmc.reg4010 = value;
+                DMC::Reg4010::set(state.dmc.data, value);
 
-                if (!dmc.irqEnable) {
-                    dmc.i.irqFlag = false;
+                if (!DMC::IrqEnable::get(state.dmc.data)) {
+                    state.dmc.i.irqFlag = false;
                 }
 
-                dmc.i.timerCounter = DMC_RATE_TABLE[dmc.frequency];
+                state.dmc.i.timerCounter = DMC_RATE_TABLE[DMC::Frequency::get(state.dmc.data)];
                 break;
 
             case 1: // 0x4011
-                dmc.reg4011 = value;
+                DMC::Reg4011::set(state.dmc.data, value);
                 break;
 
             case 2: // 0x4012
-                dmc.reg4012 = value;
+                DMC::Reg4012::set(state.dmc.data, value);
                 break;
 
             case 3: // 0x4013
-                dmc.reg4013 = value;
+                DMC::Reg4013::set(state.dmc.data, value);
                 break;
         }
     }
+
+    scheduleSync();
 }
 
 uint8_t APU::viewStatus() const {
-    Status tempStatus{ status.data };
+    Status tempStatus{ state.status.data };
 
-    tempStatus.enablePulse1 &= pulses[0].i.lengthCounter > 0;
-    tempStatus.enablePulse2 &= pulses[1].i.lengthCounter > 0;
-    tempStatus.enableTriangle &= triangle.i.lengthCounter > 0 && triangle.i.linearCounter > 0;
-    tempStatus.enableNoise &= noise.i.lengthCounter > 0;
-    tempStatus.enableDmc &= dmc.i.bytesRemaining > 0;
-    tempStatus.frameInterrupt |= frameInterruptFlag;
-    tempStatus.dmcInterrupt |= dmc.i.irqFlag;
+    Status::EnablePulse1::set(tempStatus.data, Status::EnablePulse1::get(tempStatus.data) & (state.pulses[0].i.lengthCounter > 0));
+    Status::EnablePulse2::set(tempStatus.data, Status::EnablePulse2::get(tempStatus.data) & (state.pulses[1].i.lengthCounter > 0));
+    Status::EnableTriangle::set(tempStatus.data, Status::EnableTriangle::get(tempStatus.data) & (state.triangle.i.lengthCounter > 0 && state.triangle.i.linearCounter > 0));
+    Status::EnableNoise::set(tempStatus.data, Status::EnableNoise::get(tempStatus.data) & (state.noise.i.lengthCounter > 0));
+    Status::EnableDmc::set(tempStatus.data, Status::EnableDmc::get(tempStatus.data) & (state.dmc.i.bytesRemaining > 0));
+    Status::FrameInterrupt::set(tempStatus.data, Status::FrameInterrupt::get(tempStatus.data) | state.frameInterruptFlag);
+    Status::DmcInterrupt::set(tempStatus.data, Status::DmcInterrupt::get(tempStatus.data) | state.dmc.i.irqFlag);
 
     return tempStatus.data;
 }
 
 uint8_t APU::readStatus() {
-    frameInterruptFlag = false;
-    dmc.i.irqFlag = false;
+    synchronize();
+
+    if (apuThread != nullptr) {
+        apuThread->logReadStatus(state.totalCycles);
+    }
+
+    state.frameInterruptFlag = false;
+    state.dmc.i.irqFlag = false;
     return viewStatus();
 }
 
 void APU::writeStatus(uint8_t value) {
-    status.data = value;
+    synchronize();
 
-    if (!status.enablePulse1) pulses[0].i.lengthCounter = 0;
-    if (!status.enablePulse2) pulses[1].i.lengthCounter = 0;
+    if (apuThread != nullptr) {
+        apuThread->logWrite(state.totalCycles, 0x4015, value);
+    }
+
+    state.status.data = value;
+
+    if (!Status::EnablePulse1::get(state.status.data)) state.pulses[0].i.lengthCounter = 0;
+    if (!Status::EnablePulse2::get(state.status.data)) state.pulses[1].i.lengthCounter = 0;
 
-    if (!status.enableTriangle) {
-        triangle.i.lengthCounter = 0;
-        triangle.i.outputValue = 0;
+    if (!Status::EnableTriangle::get(state.status.data)) {
+        state.triangle.i.lengthCounter = 0;
+        state.triangle.i.outputValue = 0;
     }
 
-    if (!status.enableNoise) noise.i.lengthCounter = 0;
+    if (!Status::EnableNoise::get(state.status.data)) state.noise.i.lengthCounter = 0;
 
-    if (!status.enableDmc) {
-        dmc.i.bytesRemaining = 0;
+    if (!Status::EnableDmc::get(state.status.data)) {
+        state.dmc.i.bytesRemaining = 0;
     }
-    else if (dmc.i.bytesRemaining == 0) {
+    else if (state.dmc.i.bytesRemaining == 0) {
         // Silent until first sample is loaded
-        dmc.i.silenceFlag = true;
+        state.dmc.i.silenceFlag = true;
 
         restartDmcSample();
     }
+
+    scheduleSync();
 }
 
 void APU::writeFrameCounter(uint8_t value) {
-    frameSequenceMode = (value >> 7) & 1;
-    interruptInhibitFlag = (value >> 6) & 1;
+    synchronize();
 
-    if (interruptInhibitFlag) {
-        frameInterruptFlag = false;
+    if (apuThread != nullptr) {
+        apuThread->logWrite(state.totalCycles, 0x4017, value);
     }
 
-    if (!frameSequenceMode) {
+    state.frameSequenceMode = (value >> 7) & 1;
+    state.interruptInhibitFlag = (value >> 6) & 1;
+
+    if (state.interruptInhibitFlag) {
+        state.frameInterruptFlag = false;
+    }
+
+    if (!state.frameSequenceMode) {
         quarterClock();
         halfClock();
     }
 
-    frameCounter = 0;
+    state.frameCounter = 0;
+
+    scheduleSync();
+}
+
+void APU::synchronize() {
+    uint32_t remainingCycles = state.pendingCycles;
+    state.pendingCycles = 0;
+
+    while (remainingCycles > 0) {
+        if (cyclesUntilFrameStep(state.frameCounter) == 0) {
+            runFrameStep();
+        }
+
+        uint32_t cycles;
+        uint32_t cyclesUntilTimer = cyclesUntilTimerEvent();
+        if (cyclesUntilTimer == 0) {
+            // A timer runs out on this cycle, so it is run on its own
+            clockTimers();
+            updateAudioOutput();
+            cycles = 1;
+        }
+        else {
+            // Nothing changes the channel outputs until the next timer event or frame sequencer step, so those cycles are skipped in one go
+            updateAudioOutput();
+            cycles = std::min({ remainingCycles, cyclesUntilTimer, cyclesUntilFrameStep(state.frameCounter + 1) + 1 });
+            skipCycles(cycles);
+        }
+
+        audioFrameCycles += cycles;
+        state.frameCounter += cycles;
+        state.totalCycles += cycles;
+        remainingCycles -= cycles;
+    }
+
+    scheduleSync();
+}
+
+void APU::synchronizeChannels() {
+    synchronize();
+
+    if (apuThread != nullptr) {
+        // The replica has the same state as this APU, except that its channels are up to date
+        apuThread->fetchState(state.totalCycles, state);
+    }
+}
+
+void APU::catchUpTo(uint64_t cycle) {
+    state.pendingCycles = static_cast<uint32_t>(cycle - state.totalCycles);
+    synchronize();
+}
+
+void APU::setAPUThread(APUThread* thread) {
+    synchronize();
+
+    apuThread = thread;
+    if (apuThread != nullptr) {
+        apuThread->restart(state);
+    }
+}
+
+bool APU::runsChannels() const {
+    return apuThread == nullptr;
+}
+
+void APU::scheduleSync() {
+    // The rest of the console only sees the APU through its IRQ line and DMC DMA requests.
+    // Those can only change on a frame sequencer step or when the DMC finishes playing a byte, so the APU has to catch up by then at the latest.
+    uint64_t cyclesUntilSync = cyclesUntilFrameStep(state.frameCounter);
+
+    if (Status::EnableDmc::get(state.status.data) && !state.dmc.i.silenceFlag) {
+        uint64_t dmcPeriod = DMC_RATE_TABLE[DMC::Frequency::get(state.dmc.data)] + 1;
+        uint64_t bitsRemaining = std::max<uint8_t>(state.dmc.i.bitsRemaining, 1);
+        cyclesUntilSync = std::min(cyclesUntilSync, state.dmc.i.timerCounter + (bitsRemaining - 1) * dmcPeriod);
+    }
+
+    // Counted so that the APU catches up straight after running the cycle the event happens on
+    state.cyclesUntilSync = static_cast<uint32_t>(cyclesUntilSync + 1);
 }
 
-void APU::executeHalfCycle() {
+uint32_t APU::cyclesUntilFrameStep(uint64_t frameCounter) const {
+    auto cyclesUntilStep = [](uint64_t frameCounter, const auto& steps, uint32_t sequenceLength) -> uint32_t {
+        uint32_t position = static_cast<uint32_t>(frameCounter % sequenceLength);
+        for (uint16_t step : steps) {
+            if (step >= position) {
+                return step - position;
+            }
+        }
+        return sequenceLength - position + steps[0];
+    };
+
+    if (!state.frameSequenceMode) {
+        return cyclesUntilStep(frameCounter, FOUR_STEP_SEQUENCE_STEPS, FOUR_STEP_SEQUENCE_LENGTH);
+    }
+    else {
+        return cyclesUntilStep(frameCounter, FIVE_STEP_SEQUENCE_STEPS, FIVE_STEP_SEQUENCE_LENGTH);
+    }
+}
+
+void APU::runFrameStep() {
     bool quarterClockCycle = false;
     bool halfClockCycle = false;
 
-    if (!frameSequenceMode) {
+    if (!state.frameSequenceMode) {
         // 4 step sequence
-        switch (frameCounter % FOUR_STEP_SEQUENCE_LENGTH) {
+        switch (state.frameCounter % FOUR_STEP_SEQUENCE_LENGTH) {
             case STEP_SEQUENCE[0]:
                 quarterClockCycle = true;
                 break;
@@ -232,15 +409,15 @@ void APU::executeHalfCycle() {
                 quarterClockCycle = true;
                 break;
             case STEP_SEQUENCE[3] - 1:
-                frameInterruptFlag = !interruptInhibitFlag;
+                state.frameInterruptFlag = !state.interruptInhibitFlag;
                 break;
             case STEP_SEQUENCE[3]:
                 quarterClockCycle = true;
                 halfClockCycle = true;
-                frameInterruptFlag = !interruptInhibitFlag;
+                state.frameInterruptFlag = !state.interruptInhibitFlag;
                 break;
             case 0: /*STEP_SEQUENCE[3] + 1*/
-                if (frameCounter > 0) frameInterruptFlag = !interruptInhibitFlag;
+                if (state.frameCounter > 0) state.frameInterruptFlag = !state.interruptInhibitFlag;
                 break;
             default:
                 break;
@@ -248,7 +425,7 @@ void APU::executeHalfCycle() {
     }
     else {
         // 5 step sequence
-        switch (frameCounter % FIVE_STEP_SEQUENCE_LENGTH) {
+        switch (state.frameCounter % FIVE_STEP_SEQUENCE_LENGTH) {
             case STEP_SEQUENCE[0]:
                 quarterClockCycle = true;
                 break;
@@ -265,7 +442,7 @@ void APU::executeHalfCycle() {
             case STEP_SEQUENCE[4]:
                 quarterClockCycle = true;
                 halfClockCycle = true;
-                frameInterruptFlag = !interruptInhibitFlag;
+                state.frameInterruptFlag = !state.interruptInhibitFlag;
                 break;
             default:
                 break;
@@ -279,15 +456,47 @@ void APU::executeHalfCycle() {
     if (halfClockCycle) {
         halfClock();
     }
+}
+
+uint32_t APU::cyclesUntilTimerEvent() const {
+    // Pulse and noise timers are clocked on odd cycles, the triangle and DMC timers on every cycle
+    uint32_t cyclesUntilOddCycle = !(state.totalCycles & 1);
+    uint32_t cycles = NO_EVENT;
+
+    if (Status::EnableDmc::get(state.status.data)) {
+        cycles = std::min(cycles, static_cast<uint32_t>(state.dmc.i.timerCounter));
+    }
+
+    if (!runsChannels()) {
+        return cycles;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (getPulseStatus(i)) {
+            cycles = std::min(cycles, cyclesUntilOddCycle + 2u * state.pulses[i].i.timerCounter);
+        }
+    }
+
+    if (Status::EnableNoise::get(state.status.data)) {
+        cycles = std::min(cycles, cyclesUntilOddCycle + 2u * state.noise.i.timerCounter);
+    }
 
-    if (totalCycles & 1) {
+    if (isTriangleTimerRunning()) {
+        cycles = std::min(cycles, static_cast<uint32_t>(state.triangle.i.timerCounter));
+    }
+
+    return cycles;
+}
+
+void APU::clockTimers() {
+    if ((state.totalCycles & 1) && runsChannels()) {
         // Clock pulse timers
         for (int i = 0; i < 2; i++) {
             if (getPulseStatus(i)) {
-                Pulse& pulse = pulses[i];
+                Pulse& pulse = state.pulses[i];
 
                 if (pulse.i.timerCounter == 0) {
-                    uint16_t timerReload = pulse.timer;
+                    uint16_t timerReload = Pulse::Timer::get(pulse.data);
                     pulse.i.timerCounter = timerReload;
                     pulse.i.dutyCycleIndex = (pulse.i.dutyCycleIndex + 1) & 0x7;
                 }
@@ -298,84 +507,81 @@ void APU::executeHalfCycle() {
         }
 
         // Clock noise timer
-        if (status.enableNoise) {
-            if (noise.i.timerCounter == 0) {
-                noise.i.timerCounter = NOISE_PERIOD_TABLE[noise.noisePeriod];
+        if (Status::EnableNoise::get(state.status.data)) {
+            if (state.noise.i.timerCounter == 0) {
+                state.noise.i.timerCounter = NOISE_PERIOD_TABLE[Noise::NoisePeriod::get(state.noise.data)];
 
                 // Clock LFSR
-                uint8_t shift = noise.loopNoise ? 6 : 1;
-                uint8_t feedback = (noise.i.shiftRegister & 1) ^ ((noise.i.shiftRegister >> shift) & 1);
+                uint8_t shift = Noise::LoopNoise::get(state.noise.data) ? 6 : 1;
+                uint8_t feedback = (state.noise.i.shiftRegister & 1) ^ ((state.noise.i.shiftRegister >> shift) & 1);
 
-                noise.i.shiftRegister >>= 1;
-                noise.i.shiftRegister |= (feedback << 14);
+                state.noise.i.shiftRegister >>= 1;
+                state.noise.i.shiftRegister |= (feedback << 14);
             }
             else {
-                noise.i.timerCounter--;
+                state.noise.i.timerCounter--;
             }
         }
     }
 
     // Clock triangle timer
-    uint16_t triangleTimerPeriod = triangle.timer;
-    if (status.enableTriangle && triangleTimerPeriod >= 2) {
-        if (triangle.i.lengthCounter > 0 && triangle.i.linearCounter > 0) {
-            if (triangle.i.timerCounter == 0) {
-                triangle.i.timerCounter = triangleTimerPeriod;
-                triangle.i.sequenceIndex = (triangle.i.sequenceIndex + 1) & 0x1F;
-                triangle.i.outputValue = TRIANGLE_SEQUENCE[triangle.i.sequenceIndex];
-            }
-            else {
-                triangle.i.timerCounter--;
-            }
+    if (runsChannels() && isTriangleTimerRunning()) {
+        if (state.triangle.i.timerCounter == 0) {
+            state.triangle.i.timerCounter = Triangle::Timer::get(state.triangle.data);
+            state.triangle.i.sequenceIndex = (state.triangle.i.sequenceIndex + 1) & 0x1F;
+            state.triangle.i.outputValue = TRIANGLE_SEQUENCE[state.triangle.i.sequenceIndex];
+        }
+        else {
+            state.triangle.i.timerCounter--;
         }
     }
 
     // Clock DMC reader
-    if (status.enableDmc) {
-        if (dmc.i.timerCounter == 0) {
-            dmc.i.timerCounter = DMC_RATE_TABLE[dmc.frequency];
+    if (Status::EnableDmc::get(state.status.data)) {
+        if (state.dmc.i.timerCounter == 0) {
+            state.dmc.i.timerCounter = DMC_RATE_TABLE[DMC::Frequency::get(state.dmc.data)];
 
-            if (!dmc.i.silenceFlag) {
-                bool shiftBit = dmc.i.shiftRegister & 1;
-                dmc.i.shiftRegister >>= 1;
+            if (!state.dmc.i.silenceFlag) {
+                bool shiftBit = state.dmc.i.shiftRegister & 1;
+                state.dmc.i.shiftRegister >>= 1;
 
                 // Update output level
                 if (shiftBit) {
-                    if (dmc.outputLevel <= 125) {
-                        dmc.outputLevel += 2;
+                    if (DMC::OutputLevel::get(state.dmc.data) <= 125) {
+                        DMC::OutputLevel::set(state.dmc.data, DMC::OutputLevel::get(state.dmc.data) + 2);
                     }
                 }
                 else {
-                    if (dmc.outputLevel >= 2) {
-                        dmc.outputLevel -= 2;
+                    if (DMC::OutputLevel::get(state.dmc.data) >= 2) {
+                        DMC::OutputLevel::set(state.dmc.data, DMC::OutputLevel::get(state.dmc.data) - 2);
                     }
                 }
 
-                dmc.i.bitsRemaining--;
-                if (dmc.i.bitsRemaining == 0) {
-                    dmc.i.bitsRemaining = 8;
+                state.dmc.i.bitsRemaining--;
+                if (state.dmc.i.bitsRemaining == 0) {
+                    state.dmc.i.bitsRemaining = 8;
 
-                    if (dmc.i.sampleBufferEmpty) {
-                        dmc.i.silenceFlag = true;
+                    if (state.dmc.i.sampleBufferEmpty) {
+                        state.dmc.i.silenceFlag = true;
                     }
                     else {
-                        dmc.i.silenceFlag = false;
-                        dmc.i.shiftRegister = dmc.i.sampleBuffer;
-                        dmc.i.sampleBufferEmpty = true;
+                        state.dmc.i.silenceFlag = false;
+                        state.dmc.i.shiftRegister = state.dmc.i.sampleBuffer;
+                        state.dmc.i.sampleBufferEmpty = true;
 
                         // Reset bits counter when loading new sample
-                        dmc.i.bitsRemaining = 8;
+                        state.dmc.i.bitsRemaining = 8;
 
                         // Try to reload sample buffer via DMA
-                        if (dmc.i.bytesRemaining) {
-                            bus.requestDmcDma(dmc.i.currentAddress);
+                        if (state.dmc.i.bytesRemaining) {
+                            requestDmcSample();
                         }
-                        else if (dmc.i.bytesRemaining == 0) {
-                            if (dmc.loopSample) {
+                        else if (state.dmc.i.bytesRemaining == 0) {
+                            if (DMC::LoopSample::get(state.dmc.data)) {
                                 restartDmcSample();
                             }
-                            else if (dmc.irqEnable) {
-                                dmc.i.irqFlag = true;
+                            else if (DMC::IrqEnable::get(state.dmc.data)) {
+                                state.dmc.i.irqFlag = true;
                             }
                         }
                     }
@@ -383,34 +589,62 @@ void APU::executeHalfCycle() {
             }
         }
         else {
-            dmc.i.timerCounter--;
+            state.dmc.i.timerCounter--;
+        }
+    }
+}
+
+void APU::skipCycles(uint32_t cycles) {
+    // None of the timers run out within these cycles, so they only count down
+    if (Status::EnableDmc::get(state.status.data)) {
+        state.dmc.i.timerCounter -= static_cast<uint16_t>(cycles);
+    }
+
+    if (!runsChannels()) {
+        return;
+    }
+
+    uint16_t oddCycles = static_cast<uint16_t>(((state.totalCycles + cycles) >> 1) - (state.totalCycles >> 1));
+
+    for (int i = 0; i < 2; i++) {
+        if (getPulseStatus(i)) {
+            state.pulses[i].i.timerCounter -= oddCycles;
         }
     }
 
-    frameCounter++;
-    totalCycles++;
+    if (Status::EnableNoise::get(state.status.data)) {
+        state.noise.i.timerCounter -= oddCycles;
+    }
+
+    if (isTriangleTimerRunning()) {
+        state.triangle.i.timerCounter -= static_cast<uint16_t>(cycles);
+    }
+}
+
+bool APU::isTriangleTimerRunning() const {
+    return Status::EnableTriangle::get(state.status.data) && Triangle::Timer::get(state.triangle.data) >= 2 && state.triangle.i.lengthCounter > 0 && state.triangle.i.linearCounter > 0;
 }
 
 void APU::quarterClock() {
     // Clock pulse envelopes
     {
         for (int i = 0; i < 2; ++i) {
-            Pulse& pulse = pulses[i];
+            Pulse& pulse = state.pulses[i];
             if (pulse.i.envelopeStartFlag) {
                 pulse.i.envelopeStartFlag = false;
                 pulse.i.envelope = 0xF;
-                pulse.i.envelopeDividerCounter = pulse.volumeOrEnvelopeRate;
+                pulse.i.envelopeDividerCounter = Pulse::VolumeOrEnvelopeRate::get(pulse.data);
             }
             else {
                 if (pulse.i.envelopeDividerCounter > 0) {
                     pulse.i.envelopeDividerCounter--;
                 }
                 else {
-                    pulse.i.envelopeDividerCounter = pulse.volumeOrEnvelopeRate;
+                    pulse.i.envelopeDividerCounter = Pulse::VolumeOrEnvelopeRate::get(pulse.data);
                     if (pulse.i.envelope) {
                         pulse.i.envelope--;
                     }
-                    else if (pulse.envelopeLoopOrLengthCounterHalt) {
+                    else if (Pulse::EnvelopeLoopOrLengthCounterHalt::get(pulse.data)) {
                         pulse.i.envelope = 0xF;
                     }
                 }
@@ -420,22 +654,22 @@ void APU::quarterClock() {
 
     // Clock noise envelope
     {
-        if (noise.i.envelopeStartFlag) {
-            noise.i.envelopeStartFlag = false;
-            noise.i.envelope = 0xF;
-            noise.i.envelopeDividerCounter = noise.volumeOrEnvelope;
+        if (state.noise.i.envelopeStartFlag) {
+            state.noise.i.envelopeStartFlag = false;
+            state.noise.i.envelope = 0xF;
+            state.noise.i.envelopeDividerCounter = Noise::VolumeOrEnvelope::get(state.noise.data);
         }
         else {
-            if (noise.i.envelopeDividerCounter > 0) {
-                noise.i.envelopeDividerCounter--;
+            if (state.noise.i.envelopeDividerCounter > 0) {
+                state.noise.i.envelopeDividerCounter--;
             }
             else {
-                noise.i.envelopeDividerCounter = noise.volumeOrEnvelope;
-                if (noise.i.envelope) {
-                    noise.i.envelope--;
+                state.noise.i.envelopeDividerCounter = Noise::VolumeOrEnvelope::get(state.noise.data);
+                if (state.noise.i.envelope) {
+                    state.noise.i.envelope--;
                 }
-                else if (noise.envelopeLoopOrLengthCounterHalt) {
-                    noise.i.envelope = 0xF;
+                else if (Noise::EnvelopeLoopOrLengthCounterHalt::get(state.noise.data)) {
+                    state.noise.i.envelope = 0xF;
                 }
             }
         }
@@ -443,15 +677,15 @@ void APU::quarterClock() {
 
     // Clock triangle linear counter
     {
-        if (triangle.i.linearCounterReloadFlag) {
-            triangle.i.linearCounter = triangle.linearCounterLoad;
+        if (state.triangle.i.linearCounterReloadFlag) {
+            state.triangle.i.linearCounter = Triangle::LinearCounterLoad::get(state.triangle.data);
         }
-        else if (triangle.i.linearCounter > 0) {
-            triangle.i.linearCounter--;
+        else if (state.triangle.i.linearCounter > 0) {
+            state.triangle.i.linearCounter--;
         }
 
-        if (!triangle.lengthCounterHaltOrLinearCounterControl) {
-            triangle.i.linearCounterReloadFlag = false;
+        if (!Triangle::LengthCounterHaltOrLinearCounterControl::get(state.triangle.data)) {
+            state.triangle.i.linearCounterReloadFlag = false;
         }
     }
 }
@@ -461,28 +695,28 @@ void APU::halfClock() {
     {
         // Pulse
         for (int i = 0; i < 2; i++) {
-            if (getPulseStatus(i) && pulses[i].i.lengthCounter && !pulses[i].envelopeLoopOrLengthCounterHalt) pulses[i].i.lengthCounter--;
+            if (getPulseStatus(i) && state.pulses[i].i.lengthCounter && !Pulse::EnvelopeLoopOrLengthCounterHalt::get(state.pulses[i].data)) state.pulses[i].i.lengthCounter--;
         }
 
         // Triangle
-        if (status.enableTriangle && triangle.i.lengthCounter > 0 && !triangle.lengthCounterHaltOrLinearCounterControl) {
-            triangle.i.lengthCounter--;
+        if (Status::EnableTriangle::get(state.status.data) && state.triangle.i.lengthCounter > 0 && !Triangle::LengthCounterHaltOrLinearCounterControl::get(state.triangle.data)) {
+            state.triangle.i.lengthCounter--;
         }
 
         // Noise
-        if (status.enableNoise && noise.i.lengthCounter > 0 && !noise.envelopeLoopOrLengthCounterHalt) {
-            noise.i.lengthCounter--;
+        if (Status::EnableNoise::get(state.status.data) && state.noise.i.lengthCounter > 0 && !Noise::EnvelopeLoopOrLengthCounterHalt::get(state.noise.data)) {
+            state.noise.i.lengthCounter--;
         }
     }
 
     // Clock sweep units
     {
         for (int i = 0; i < 2; i++) {
-            Pulse& pulse = pulses[i];
+            Pulse& pulse = state.pulses[i];
             bool sweepClockedThisTick = false;
 
             if (pulse.i.sweepReloadFlag) {
-                pulse.i.sweepDividerCounter = pulse.sweepUnitPeriod + 1;
+                pulse.i.sweepDividerCounter = Pulse::SweepUnitPeriod::get(pulse.data) + 1;
                 sweepClockedThisTick = true;
                 pulse.i.sweepReloadFlag = false;
             }
@@ -493,16 +727,16 @@ void APU::halfClock() {
 
             if (!pulse.i.sweepDividerCounter) {
                 sweepClockedThisTick = true;
-                pulse.i.sweepDividerCounter = pulse.sweepUnitPeriod + 1;
+                pulse.i.sweepDividerCounter = Pulse::SweepUnitPeriod::get(pulse.data) + 1;
             }
 
             if (sweepClockedThisTick) {
-                if (pulse.sweepUnitEnabled && pulse.sweepUnitShift > 0 && pulse.i.lengthCounter > 0) {
-                    uint16_t currentPeriod = pulse.timer;
-                    uint16_t changeAmount = currentPeriod >> pulse.sweepUnitShift;
+                if (Pulse::SweepUnitEnabled::get(pulse.data) && Pulse::SweepUnitShift::get(pulse.data) > 0 && pulse.i.lengthCounter > 0) {
+                    uint16_t currentPeriod = Pulse::Timer::get(pulse.data);
+                    uint16_t changeAmount = currentPeriod >> Pulse::SweepUnitShift::get(pulse.data);
                     uint16_t targetPeriod;
 
-                    if (pulse.sweepUnitNegate) {
+                    if (Pulse::SweepUnitNegate::get(pulse.data)) {
                         targetPeriod = currentPeriod - changeAmount;
 
                         // Pulse 1 and pulse 2 are treated differently
@@ -519,7 +753,7 @@ void APU::halfClock() {
                     }
                     else {
                         pulse.i.sweepMutesChannel = false;
-                        pulse.timer = targetPeriod;
+                        Pulse::Timer::set(pulse.data, targetPeriod);
                     }
                 }
             }
@@ -528,235 +762,168 @@ void APU::halfClock() {
 }
 
 bool APU::irqRequested() const {
-    return frameInterruptFlag || dmc.i.irqFlag;
+    return state.frameInterruptFlag || state.dmc.i.irqFlag;
 }
 
-float APU::getAudioSample() const {
-    // https://www.nesdev.org/wiki/APU_Mixer
+void APU::setAudioRates(double clockRate, double sampleRate) {
+    audioClockRate = clockRate;
+    audioBuffer.setRates(clockRate, sampleRate);
+    audioBuffer.clear();
+    audioFrameCycles = 0;
 
-    // The NES APU mixer takes the channel outputs and converts them to an analog audio signal. 
-    // Each channel has its own internal digital-to-analog convertor (DAC), implemented in a way that causes non-linearity and interaction between channels, so calculation of the resulting amplitude is somewhat involved.
-    // In particular, games such as Super Mario Bros. and StarTropics use the DMC level ($4011) as a crude volume control for the triangle and noise channels.
+    for (AudioFilter* filter : { &highPassFilter90Hz, &highPassFilter440Hz, &lowPassFilter14kHz }) {
+        filter->setSampleRate(sampleRate);
+        filter->reset();
+    }
+}
 
-    // The following formula[1] calculates the approximate audio output level within the range of 0.0 to 1.0. It is the sum of two sub-groupings of the channels:
+void APU::adjustAudioSampleRate(double sampleRate) {
+    // Amplitude changes already in the current frame were placed at the old rate, so the frame is ended early
+    synchronize();
+    audioBuffer.endFrame(audioFrameCycles);
+    audioFrameCycles = 0;
 
-    // output = pulse_out + tnd_out
+    audioBuffer.setRates(audioClockRate, sampleRate);
+}
 
-    //                             95.88
-    // pulse_out = ------------------------------------
-    //              (8128 / (pulse1 + pulse2)) + 100
+void APU::endAudioFrame() {
+    synchronize();
 
-    //                                        159.79
-    // tnd_out = -------------------------------------------------------------
-    //                                     1
-    //            ----------------------------------------------------- + 100
-    //             (triangle / 8227) + (noise / 12241) + (dmc / 22638)
+    if (apuThread != nullptr) {
+        apuThread->logEndAudioFrame(state.totalCycles);
+        return;
+    }
 
-    auto mixPulse = [](uint8_t pulse1, uint8_t pulse2) -> float {
-        if (!pulse1 && !pulse2) return 0.0f;
-        return 95.88f / ((8128.0f / (pulse1 + pulse2)) + 100.0f);
-    };
+    audioBuffer.endFrame(audioFrameCycles);
+    audioFrameCycles = 0;
+}
+
+void APU::setAudioOutputEnabled(bool enabled) {
+    if (enabled == audioOutputEnabled) {
+        return;
+    }
 
-    auto mixTND = [](uint8_t triangle, uint8_t noise, uint8_t dmc) -> float {
-        if (!triangle && !noise && !dmc) return 0.0f;
+    // Cycles that are still pending belong to the output setting they were run under
+    synchronize();
 
-        float sum = (triangle / 8227.0f) + (noise / 12241.0f) + (dmc / 22638.0f);
-        return 159.79f / ((1.0f / sum) + 100.0f);
-    };
+    if (enabled) {
+        audioAmplitude = disabledAudioAmplitude;
+        audioFrameCycles = disabledAudioFrameCycles;
+    }
+    else {
+        disabledAudioAmplitude = audioAmplitude;
+        disabledAudioFrameCycles = audioFrameCycles;
+    }
+    audioOutputEnabled = enabled;
+}
+
+size_t APU::readAudioSamples(float* output, size_t maxSamples) {
+    size_t numSamples = audioBuffer.readSamples(output, maxSamples);
+
+    // The filters run over the whole frame at once.
+    // Dynamic rate control changes the sample rate by too little to affect them, so they keep the nominal rate.
+    highPassFilter90Hz.process(output, numSamples);
+    highPassFilter440Hz.process(output, numSamples);
+    lowPassFilter14kHz.process(output, numSamples);
+
+    return numSamples;
+}
+
+void APU::updateAudioOutput() {
+    if (!runsChannels() || !audioOutputEnabled) {
+        return;
+    }
 
     // Get pulse outputs
     std::array<uint8_t, 2> pulseOutputs = {};
     for (int i = 0; i < 2; i++) {
-        const Pulse& pulse = pulses[i];
-        if (getPulseStatus(i) && pulse.i.lengthCounter > 0 && pulse.i.timerCounter >= 9 && !pulse.i.sweepMutesChannel) {
-            uint8_t dutyCycle = DUTY_CYCLES[pulse.duty];
+        const Pulse& pulse = state.pulses[i];
+        if (getPulseStatus(i) && pulse.i.lengthCounter > 0 && Pulse::Timer::get(pulse.data) >= 8 && !pulse.i.sweepMutesChannel) {
+            uint8_t dutyCycle = DUTY_CYCLES[Pulse::Duty::get(pulse.data)];
             bool dutyOutput = (dutyCycle >> pulse.i.dutyCycleIndex) & 1;
 
             if (dutyOutput) {
-                uint8_t volume = pulse.constantVolume ? pulse.volumeOrEnvelopeRate : pulse.i.envelope;
+                uint8_t volume = Pulse::ConstantVolume::get(pulse.data) ? Pulse::VolumeOrEnvelopeRate::get(pulse.data) : pulse.i.envelope;
                 pulseOutputs[i] = volume;
             }
         }
     }
 
     // Get triangle outputs
-    uint8_t triangleOutput = triangle.i.outputValue;
+    uint8_t triangleOutput = state.triangle.i.outputValue;
 
     // Get noise output
     uint8_t noiseOutput = 0;
-    bool shiftRegisterBitSet = noise.i.shiftRegister & 1;
-    if (status.enableNoise && noise.i.lengthCounter > 0 && !shiftRegisterBitSet) {
-        uint8_t volume = noise.constantVolume ? noise.volumeOrEnvelope : noise.i.envelope;
+    bool shiftRegisterBitSet = state.noise.i.shiftRegister & 1;
+    if (Status::EnableNoise::get(state.status.data) && state.noise.i.lengthCounter > 0 && !shiftRegisterBitSet) {
+        uint8_t volume = Noise::ConstantVolume::get(state.noise.data) ? Noise::VolumeOrEnvelope::get(state.noise.data) : state.noise.i.envelope;
         noiseOutput = volume;
     }
 
     // Get DMC output
-    uint8_t dmcOutput = dmc.outputLevel;
+    uint8_t dmcOutput = DMC::OutputLevel::get(state.dmc.data);
 
-    return mixPulse(pulseOutputs[0], pulseOutputs[1]) + mixTND(triangleOutput, noiseOutput, dmcOutput);
+    // Only changes in amplitude are recorded
+    int32_t amplitude = PULSE_TABLE[pulseOutputs[0] + pulseOutputs[1]] + TND_TABLE[3 * triangleOutput + 2 * noiseOutput + dmcOutput];
+    if (amplitude != audioAmplitude) {
+        audioBuffer.addDelta(audioFrameCycles, amplitude - audioAmplitude);
+        audioAmplitude = amplitude;
+    }
 }
 
 void APU::receiveDMCSample(uint8_t sample) {
-    dmc.i.sampleBuffer = sample;
-    dmc.i.sampleBufferEmpty = false;
-    dmc.i.silenceFlag = false;
+    synchronize();
 
-    if (dmc.i.currentAddress == 0xFFFF) {
-        dmc.i.currentAddress = 0x8000;
+    if (apuThread != nullptr) {
+        apuThread->logDMCSample(state.totalCycles, sample);
+    }
+
+    state.dmc.i.sampleBuffer = sample;
+    state.dmc.i.sampleBufferEmpty = false;
+    state.dmc.i.silenceFlag = false;
+
+    if (state.dmc.i.currentAddress == 0xFFFF) {
+        state.dmc.i.currentAddress = 0x8000;
     }
     else {
-        dmc.i.currentAddress++;
+        state.dmc.i.currentAddress++;
     }
 
-    dmc.i.bytesRemaining--;
+    state.dmc.i.bytesRemaining--;
+
+    scheduleSync();
 }
 
 void APU::restartDmcSample() {
-    dmc.i.currentAddress = 0xC000 | (dmc.sampleAddress << 6);
-    dmc.i.bytesRemaining = (dmc.sampleLength << 4) + 1;
+    state.dmc.i.currentAddress = 0xC000 | (DMC::SampleAddress::get(state.dmc.data) << 6);
+    state.dmc.i.bytesRemaining = (DMC::SampleLength::get(state.dmc.data) << 4) + 1;
 
     // Request the first sample of the new loop
-    bus.requestDmcDma(dmc.i.currentAddress);
+    requestDmcSample();
+}
+
+void APU::requestDmcSample() {
+    // A replica is sent its samples through the log instead
+    if (bus != nullptr) {
+        bus->requestDmcDma(state.dmc.i.currentAddress);
+    }
 }
 
 bool APU::getPulseStatus(bool pulseNum) const {
-    return !pulseNum ? status.enablePulse1 : status.enablePulse2;
+    return !pulseNum ? Status::EnablePulse1::get(state.status.data) : Status::EnablePulse2::get(state.status.data);
 }
 
 void APU::serialize(Serializer& s) const {
-    auto serializePulse = [](Serializer& s, const Pulse& pulse) -> void {
-        s.serializeUInt32(pulse.data);
-
-        // Internal state
-        s.serializeUInt16(pulse.i.timerCounter);
-        s.serializeUInt8(pulse.i.dutyCycleIndex);
-        s.serializeUInt8(pulse.i.lengthCounter);
-        s.serializeBool(pulse.i.envelopeStartFlag);
-        s.serializeUInt8(pulse.i.envelope);
-        s.serializeUInt8(pulse.i.envelopeDividerCounter);
-        s.serializeUInt8(pulse.i.sweepDividerCounter);
-        s.serializeBool(pulse.i.sweepMutesChannel);
-        s.serializeBool(pulse.i.sweepReloadFlag);
-    };
-
-    auto serializeTriangle = [](Serializer& s, const Triangle& triangle) -> void {
-        s.serializeUInt32(triangle.data);
-
-        // Internal state
-        s.serializeUInt16(triangle.i.timerCounter);
-        s.serializeUInt8(triangle.i.linearCounter);
-        s.serializeBool(triangle.i.linearCounterReloadFlag);
-        s.serializeUInt8(triangle.i.sequenceIndex);
-        s.serializeUInt8(triangle.i.lengthCounter);
-        s.serializeUInt8(triangle.i.outputValue);
-    };
-
-    auto serializeNoise = [](Serializer& s, const Noise& noise) -> void {
-        s.serializeUInt16(noise.data);
-
-        // Internal state
-        s.serializeUInt16(noise.i.timerCounter);
-        s.serializeUInt8(noise.i.lengthCounter);
-        s.serializeBool(noise.i.envelopeStartFlag);
-        s.serializeUInt8(noise.i.envelope);
-        s.serializeUInt8(noise.i.envelopeDividerCounter);
-        s.serializeUInt16(noise.i.shiftRegister);
-    };
-
-    auto serializeDMC = [](Serializer& s, const DMC& dmc) -> void {
-        s.serializeUInt32(dmc.data);
-
-        // Internal state
-        s.serializeUInt16(dmc.i.currentAddress);
-        s.serializeUInt16(dmc.i.bytesRemaining);
-        s.serializeUInt16(dmc.i.timerCounter);
-        s.serializeUInt8(dmc.i.sampleBuffer);
-        s.serializeBool(dmc.i.sampleBufferEmpty);
-        s.serializeUInt8(dmc.i.shiftRegister);
-        s.serializeUInt8(dmc.i.bitsRemaining);
-        s.serializeBool(dmc.i.silenceFlag);
-        s.serializeBool(dmc.i.irqFlag);
-    };
-
-    serializePulse(s, pulses[0]);
-    serializePulse(s, pulses[1]);
-    serializeTriangle(s, triangle);
-    serializeNoise(s, noise);
-    serializeDMC(s, dmc);
-
-    s.serializeUInt8(status.data);
-    s.serializeBool(frameSequenceMode);
-    s.serializeBool(interruptInhibitFlag);
-    s.serializeBool(frameInterruptFlag);
-    s.serializeUInt64(frameCounter);
-    s.serializeUInt64(totalCycles);
+    Schema::serialize(s, state);
 }
 
 void APU::deserialize(Deserializer& d) {
-    auto deserializePulse = [](Deserializer& d, Pulse& pulse) -> void {
-        d.deserializeUInt32(pulse.data);
-
-        // Internal state
-        d.deserializeUInt16(pulse.i.timerCounter);
-        d.deserializeUInt8(pulse.i.dutyCycleIndex);
-        d.deserializeUInt8(pulse.i.lengthCounter);
-        d.deserializeBool(pulse.i.envelopeStartFlag);
-        d.deserializeUInt8(pulse.i.envelope);
-        d.deserializeUInt8(pulse.i.envelopeDividerCounter);
-        d.deserializeUInt8(pulse.i.sweepDividerCounter);
-        d.deserializeBool(pulse.i.sweepMutesChannel);
-        d.deserializeBool(pulse.i.sweepReloadFlag);
-    };
-
-    auto deserializeTriangle = [](Deserializer& d, Triangle& triangle) -> void {
-        d.deserializeUInt32(triangle.data);
+    Schema::deserialize(d, state);
 
-        // Internal state
-        d.deserializeUInt16(triangle.i.timerCounter);
-        d.deserializeUInt8(triangle.i.linearCounter);
-        d.deserializeBool(triangle.i.linearCounterReloadFlag);
-        d.deserializeUInt8(triangle.i.sequenceIndex);
-        d.deserializeUInt8(triangle.i.lengthCounter);
-        d.deserializeUInt8(triangle.i.outputValue);
-    };
+    state.pendingCycles = 0;
+    scheduleSync();
 
-    auto deserializeNoise = [](Deserializer& d, Noise& noise) -> void {
-        d.deserializeUInt16(noise.data);
-
-        // Internal state
-        d.deserializeUInt16(noise.i.timerCounter);
-        d.deserializeUInt8(noise.i.lengthCounter);
-        d.deserializeBool(noise.i.envelopeStartFlag);
-        d.deserializeUInt8(noise.i.envelope);
-        d.deserializeUInt8(noise.i.envelopeDividerCounter);
-        d.deserializeUInt16(noise.i.shiftRegister);
-    };
-
-    auto deserializeDMC = [](Deserializer& d, DMC& dmc) -> void {
-        d.deserializeUInt32(dmc.data);
-
-        // Internal state
-        d.deserializeUInt16(dmc.i.currentAddress);
-        d.deserializeUInt16(dmc.i.bytesRemaining);
-        d.deserializeUInt16(dmc.i.timerCounter);
-        d.deserializeUInt8(dmc.i.sampleBuffer);
-        d.deserializeBool(dmc.i.sampleBufferEmpty);
-        d.deserializeUInt8(dmc.i.shiftRegister);
-        d.deserializeUInt8(dmc.i.bitsRemaining);
-        d.deserializeBool(dmc.i.silenceFlag);
-        d.deserializeBool(dmc.i.irqFlag);
-    };
-
-    deserializePulse(d, pulses[0]);
-    deserializePulse(d, pulses[1]);
-    deserializeTriangle(d, triangle);
-    deserializeNoise(d, noise);
-    deserializeDMC(d, dmc);
-
-    d.deserializeUInt8(status.data);
-    d.deserializeBool(frameSequenceMode);
-    d.deserializeBool(interruptInhibitFlag);
-    d.deserializeBool(frameInterruptFlag);
-    d.deserializeUInt64(frameCounter);
-    d.deserializeUInt64(totalCycles);
+    if (apuThread != nullptr) {
+        apuThread->restart(state);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "core/aputhread.hpp"
+
+#include <utility>
+
+APUThread::APUThread(SampleCallback sampleCallback) :
+    sampleCallback(std::move(sampleCallback)),
+    replaying(false),
+    stopRequested(false),
+    adjustedSampleRate(0.0),
+    replicaState{},
+    replica(replicaState) {
+    replica.resetAPU();
+    thread = std::thread(&APUThread::run, this);
+}
+
+APUThread::~APUThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wakeCondition.notify_one();
+    thread.join();
+}
+
+void APUThread::setAudioRates(double clockRate, double sampleRate) {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitUntilIdle(lock);
+    replica.setAudioRates(clockRate, sampleRate);
+}
+
+void APUThread::adjustAudioSampleRate(double sampleRate) {
+    adjustedSampleRate.store(sampleRate, std::memory_order_relaxed);
+}
+
+void APUThread::logWrite(uint64_t cycle, uint16_t addr, uint8_t value) {
+    log.push_back({ cycle, LogEntry::Type::WRITE, addr, value });
+}
+
+void APUThread::logReadStatus(uint64_t cycle) {
+    log.push_back({ cycle, LogEntry::Type::READ_STATUS, 0x4015, 0 });
+}
+
+void APUThread::logDMCSample(uint64_t cycle, uint8_t sample) {
+    log.push_back({ cycle, LogEntry::Type::DMC_SAMPLE, 0, sample });
+}
+
+void APUThread::logEndAudioFrame(uint64_t cycle) {
+    log.push_back({ cycle, LogEntry::Type::END_AUDIO_FRAME, 0, 0 });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    submitLog();
+}
+
+void APUThread::restart(const APU::State& state) {
+    // Whatever was logged before the restart is still played
+    std::unique_lock<std::mutex> lock(mutex);
+    submitLog();
+    waitUntilIdle(lock);
+
+    replicaState = state;
+}
+
+void APUThread::fetchState(uint64_t cycle, APU::State& state) {
+    std::unique_lock<std::mutex> lock(mutex);
+    submitLog();
+    waitUntilIdle(lock);
+
+    replica.catchUpTo(cycle);
+    state = replicaState;
+}
+
+void APUThread::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wakeCondition.wait(lock, [this]() { return stopRequested || !submittedLog.empty(); });
+        if (stopRequested) {
+            break;
+        }
+
+        // The log is replayed without holding the lock, so the emulation thread can keep submitting frames meanwhile
+        std::swap(submittedLog, replayLog);
+        replaying = true;
+        lock.unlock();
+
+        for (const LogEntry& entry : replayLog) {
+            replay(entry);
+        }
+        replayLog.clear();
+
+        lock.lock();
+        replaying = false;
+        idleCondition.notify_all();
+    }
+}
+
+void APUThread::replay(const LogEntry& entry) {
+    replica.catchUpTo(entry.cycle);
+
+    switch (entry.type) {
+        case LogEntry::Type::WRITE:
+            if (entry.addr == 0x4015) {
+                replica.writeStatus(entry.value);
+            }
+            else if (entry.addr == 0x4017) {
+                replica.writeFrameCounter(entry.value);
+            }
+            else {
+                replica.write(entry.addr, entry.value);
+            }
+            break;
+
+        case LogEntry::Type::READ_STATUS:
+            // Reading the status clears the interrupt flags
+            replica.readStatus();
+            break;
+
+        case LogEntry::Type::DMC_SAMPLE:
+            replica.receiveDMCSample(entry.value);
+            break;
+
+        case LogEntry::Type::END_AUDIO_FRAME: {
+            replica.endAudioFrame();
+            size_t numSamples = replica.readAudioSamples(frameSamples.data(), frameSamples.size());
+            if (numSamples > 0) {
+                sampleCallback(frameSamples.data(), numSamples);
+            }
+
+            double sampleRate = adjustedSampleRate.exchange(0.0, std::memory_order_relaxed);
+            if (sampleRate > 0.0) {
+                replica.adjustAudioSampleRate(sampleRate);
+            }
+            break;
+        }
+    }
+}
+
+void APUThread::submitLog() {
+    if (log.empty()) {
+        return;
+    }
+
+    // The APU thread may not have taken the previous frame yet
+    submittedLog.insert(submittedLog.end(), log.begin(), log.end());
+    log.clear();
+    wakeCondition.notify_one();
+}
+
+void APUThread::waitUntilIdle(std::unique_lock<std::mutex>& lock) {
+    idleCondition.wait(lock, [this]() { return !replaying && submittedLog.empty(); });
+}
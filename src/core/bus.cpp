@@ -1,185 +1,268 @@
 #include "core/bus.hpp"
 
-Bus::Bus() {
+#include <cstring>
+
+Bus::Bus() :
+    state{},
+    writeTracker(&state, sizeof(State)),
+    cartridge(),
+    apu(*this),
+    cpu(*this),
+    ppu(cartridge, state.ppu, writeTracker),
+    scanlineCounter(nullptr) {
+
+    writeTracker.track(&state.ram, sizeof(state.ram));
+    writeTracker.track(&state.ppu.palleteRam, sizeof(state.ppu.palleteRam));
+    writeTracker.track(&state.ppu.nameTable, sizeof(state.ppu.nameTable));
+    writeTracker.track(&state.ppu.oamBuffer, sizeof(state.ppu.oamBuffer));
+    writeTracker.track(&state.mapper.prgRam, sizeof(state.mapper.prgRam));
+    writeTracker.track(&state.mapper.chrRam, sizeof(state.mapper.chrRam));
+    writeTracker.track(&state.mapper.nametableRam, sizeof(state.mapper.nametableRam));
+
     resetBus();
 }
 
 void Bus::resetBus() {
-    ram = {};
+    state.ram = {};
 
-    controllers = {};
-    controllerData = {};
-    strobe = 0;
+    state.controllers = {};
+    state.controllerData = {};
+    state.strobe = 0;
 
-    totalCycles = 0;
+    state.totalCycles = 0;
 
-    oamDma = {};
-    dmcDma = {};
+    state.oamDma = {};
+    state.dmcDma = {};
+    state.scanlineCounter = { ScanlineCounter::NEVER, 0, {} };
 }
 
 void Bus::reset() {
     resetBus();
 
-    cartridge->mapper->reset();
+    cartridge.mapper->reset();
+
+    apu.resetAPU();
+    cpu.resetCPU();
+    ppu.resetPPU();
+
+    restartScanlineCounter();
 
-    apu->resetAPU();
-    cpu->resetCPU();
-    ppu->resetPPU();
+    writeTracker.markAllWritten();
 }
 
 Cartridge::Status Bus::tryInitDevices(const std::string& filePath) {
-    cartridge = std::make_unique<Cartridge>(filePath);
-    const Cartridge::Status& status = cartridge->getStatus();
+    Cartridge::Status status = cartridge.load(filePath, state.mapper, writeTracker);
+    attachScanlineCounter();
     if (status.code != Cartridge::Code::SUCCESS) {
         return status;
     }
 
-    apu = std::make_unique<APU>(*this);
-    cpu = std::make_unique<CPU>(*this);
-    ppu = std::make_unique<PPU>(*cartridge);
+    // The CPU reads its reset vector from the cartridge, so the components can only be reset once the ROM is loaded
+    reset();
 
     return status;
 }
 
+std::unique_ptr<Bus> Bus::clone() const {
+    std::unique_ptr<Bus> copy = std::make_unique<Bus>();
+    Cartridge::Status status = copy->cartridge.loadFrom(cartridge, copy->state.mapper, copy->writeTracker);
+    if (status.code != Cartridge::Code::SUCCESS) {
+        return nullptr;
+    }
+    copy->attachScanlineCounter();
+
+    // The mapper registers live in the state block as well, so this also overwrites the freshly constructed mapper's registers
+    copy->loadSnapshot(state);
+    return copy;
+}
+
+void Bus::attachScanlineCounter() {
+    // We can static_cast instead of dynamic_cast because we explicitly checked id
+    if (cartridge.mapper != nullptr && cartridge.mapper->config.id == 4) {
+        scanlineCounter = static_cast<Mapper4*>(cartridge.mapper);
+    }
+    else {
+        scanlineCounter = nullptr;
+    }
+}
+
 uint8_t Bus::view(uint16_t address) const {
     if (RAM_ADDRESSABLE_RANGE.contains(address)) {
-        return ram[address & 0x7FF];
+        return state.ram[address & 0x7FF];
     }
     else if (PPU_ADDRESSABLE_RANGE.contains(address)) {
-        return ppu->view(address & 0x7);
+        return ppu.view(address & 0x7);
     }
     else if (IO_ADDRESSABLE_RANGE.contains(address)) {
         if (address == CONTROLLER_1_DATA || address == CONTROLLER_2_DATA) {
             // The view mode returns all controller outputs at once
-            return controllerData[address & 1];
+            return state.controllerData[address & 1];
         }
         else if (address == APU_STATUS) {
-            return apu->viewStatus();
+            return apu.viewStatus();
         }
         else {
             return 0;
         }
     }
     else { // if (CARTRIDGE_ADDRESSABLE_RANGE.contains(address))
-        return cartridge->mapper->mapPRGView(address);
+        return cartridge.mapPRGView(address);
     }
 }
 
 uint8_t Bus::read(uint16_t address) {
     if (RAM_ADDRESSABLE_RANGE.contains(address)) {
-        return ram[address & 0x7FF];
+        return state.ram[address & 0x7FF];
     }
     else if (PPU_ADDRESSABLE_RANGE.contains(address)) {
-        return ppu->read(address & 0x7);
+        return ppu.read(address & 0x7);
     }
     else if (IO_ADDRESSABLE_RANGE.contains(address)) {
         if (address == CONTROLLER_1_DATA || address == CONTROLLER_2_DATA) {
-            uint8_t data = controllerData[address & 1] & 1;
-            if (!strobe) {
-                controllerData[address & 1] >>= 1;
+            uint8_t data = state.controllerData[address & 1] & 1;
+            if (!state.strobe) {
+                state.controllerData[address & 1] >>= 1;
             }
             return data;
         }
         else if (address == APU_STATUS) {
-            return apu->readStatus();
+            return apu.readStatus();
         }
         else {
             return 0;
         }
     }
     else { // if (CARTRIDGE_ADDRESSABLE_RANGE.contains(address))
-        return cartridge->mapper->mapPRGRead(address);
+        return cartridge.mapPRGRead(address);
     }
 }
 
 void Bus::write(uint16_t address, uint8_t value) {
     if (RAM_ADDRESSABLE_RANGE.contains(address)) {
-        ram[address & 0x7FF] = value;
+        uint8_t& byte = state.ram[address & 0x7FF];
+        byte = value;
+        writeTracker.markWritten(&byte);
     }
     else if (PPU_ADDRESSABLE_RANGE.contains(address)) {
-        ppu->write(address & 0x7, value); // TODO: what happens when write fails?
+        if ((address & 0x7) == PPU_MASK_REGISTER) {
+            // The counter is only clocked while rendering is enabled
+            synchronizeScanlineCounter();
+            ppu.write(address & 0x7, value);
+            synchronizeScanlineCounter();
+        }
+        else {
+            ppu.write(address & 0x7, value); // TODO: what happens when write fails?
+        }
     }
     else if (IO_ADDRESSABLE_RANGE.contains(address)) {
         if (APU_ADDRESSABLE_RANGE.contains(address)) {
-            apu->write(address, value);
+            apu.write(address, value);
         }
         else if (address == CONTROLLER_1_DATA) {
-            strobe = value & 1;
-            if (strobe) {
-                controllerData[0] = controllers[0].getButtons();
-                controllerData[1] = controllers[1].getButtons();
+            state.strobe = value & 1;
+            if (state.strobe) {
+                state.controllerData[0] = state.controllers[0].getButtons();
+                state.controllerData[1] = state.controllers[1].getButtons();
             }
         }
         else if (address == OAM_DMA_ADDR) {
-            oamDma.requested = true;
-            oamDma.page = value;
+            state.oamDma.requested = true;
+            state.oamDma.page = value;
         }
         else if (address == APU_STATUS) {
-            apu->writeStatus(value);
+            apu.writeStatus(value);
         }
         else if (address == APU_FRAME_COUNTER) {
-            apu->writeFrameCounter(value);
+            apu.writeFrameCounter(value);
         }
     }
     else { // if (CARTRIDGE_ADDRESSABLE_RANGE.contains(address)) 
-        cartridge->mapper->mapPRGWrite(address, value);
+        if (scanlineCounter != nullptr && SCANLINE_COUNTER_REGISTERS.contains(address)) {
+            synchronizeScanlineCounter();
+            cartridge.mapPRGWrite(address, value);
+            synchronizeScanlineCounter();
+        }
+        else {
+            cartridge.mapPRGWrite(address, value);
+        }
     }
 }
 
 void Bus::executeCycle() {
     // Three PPU cycles for every CPU cycle
-    ppu->executeCycle();
-    ppu->executeCycle();
-    ppu->executeCycle();
+    ppu.executeCycle();
+    ppu.executeCycle();
+    ppu.executeCycle();
 
-    // Handle DMA transfers
-    if (oamDma.requested) {
-        oamDmaCycle();
-    }
-    else if (dmcDma.requested) {
-        dmcDmaCycle();
-    }
-    else {
-        cpu->executeCycle();
-    }
+    executeCPUCycle();
 
-    // 2 CPU Cycles for every APU cycle
-    apu->executeHalfCycle();
+    // The scanline counter only needs attention once the dot of its next IRQ has passed
+    if (state.ppu.totalDots > state.scanlineCounter.irqDot) {
+        synchronizeScanlineCounter();
+    }
 
-    bool nmiRequested = ppu->nmiRequested();
-    bool irqRequested = ppu->irqRequested() || apu->irqRequested();
+    bool nmiRequested = ppu.nmiRequested();
+    bool scanlineIrqRequested = scanlineCounter != nullptr && scanlineCounter->irqRequested();
+    bool irqRequested = scanlineIrqRequested || apu.irqRequested();
 
     // Handle interrupt requests
     if (nmiRequested) {
-        cpu->NMI();
-        ppu->clearNMIRequest();
+        cpu.NMI();
+        ppu.clearNMIRequest();
     }
 
     if (irqRequested) {
-        cpu->IRQ();
+        cpu.IRQ();
     }
 
-    totalCycles++;
+    state.totalCycles++;
+}
+
+void Bus::executeAudioCycle() {
+    executeCPUCycle();
+
+    if (apu.irqRequested()) {
+        cpu.IRQ();
+    }
+
+    state.totalCycles++;
+}
+
+void Bus::executeCPUCycle() {
+    // Handle DMA transfers
+    if (state.oamDma.requested) {
+        oamDmaCycle();
+    }
+    else if (state.dmcDma.requested) {
+        dmcDmaCycle();
+    }
+    else {
+        cpu.executeCycle();
+    }
+
+    // The APU only counts this cycle here and catches up on it later, see APU::clock
+    apu.clock();
 }
 
 void Bus::oamDmaCycle() {
-    bool cycleMod = totalCycles & 1;
+    bool cycleMod = state.totalCycles & 1;
 
-    if (!oamDma.ongoing && cycleMod == 0) {
-        oamDma.ongoing = true;
+    if (!state.oamDma.ongoing && cycleMod == 0) {
+        state.oamDma.ongoing = true;
     }
 
-    if (oamDma.ongoing) {
+    if (state.oamDma.ongoing) {
         if (cycleMod == 0) {
-            uint16_t dmaAddress = (oamDma.page << 8) | oamDma.offset;
-            oamDma.data = read(dmaAddress);
+            uint16_t dmaAddress = (state.oamDma.page << 8) | state.oamDma.offset;
+            state.oamDma.data = read(dmaAddress);
         }
         else {
-            ppu->oamBuffer[oamDma.offset] = oamDma.data;
-            oamDma.offset++;
-            if (oamDma.offset == 0) {
-                oamDma.requested = false;
-                oamDma.ongoing = false;
+            state.ppu.oamBuffer[state.oamDma.offset] = state.oamDma.data;
+            writeTracker.markWritten(&state.ppu.oamBuffer[state.oamDma.offset]);
+            state.oamDma.offset++;
+            if (state.oamDma.offset == 0) {
+                state.oamDma.requested = false;
+                state.oamDma.ongoing = false;
             }
         }
     }
@@ -187,79 +270,158 @@ void Bus::oamDmaCycle() {
 
 void Bus::dmcDmaCycle() {
     // DMC DMA takes 4 cycles (3 stall cycles + 1 read)
-    if (!dmcDma.ongoing) {
-        dmcDma.ongoing = true;
-        dmcDma.delay = 0;
+    if (!state.dmcDma.ongoing) {
+        state.dmcDma.ongoing = true;
+        state.dmcDma.delay = 0;
     }
 
     // Count cycles
-    dmcDma.delay++;
+    state.dmcDma.delay++;
 
     // On the 4th cycle, read the data and pass to DMC
-    if (dmcDma.delay >= 4) {
-        dmcDma.data = read(dmcDma.address);
-        apu->receiveDMCSample(dmcDma.data);
-        dmcDma.requested = false;
-        dmcDma.ongoing = false;
-        dmcDma.delay = 0;
+    if (state.dmcDma.delay >= 4) {
+        state.dmcDma.data = read(state.dmcDma.address);
+        apu.receiveDMCSample(state.dmcDma.data);
+        state.dmcDma.requested = false;
+        state.dmcDma.ongoing = false;
+        state.dmcDma.delay = 0;
     }
 }
 
 void Bus::requestDmcDma(uint16_t address) {
-    dmcDma.requested = true;
-    dmcDma.address = address;
+    state.dmcDma.requested = true;
+    state.dmcDma.address = address;
+}
+
+void Bus::synchronizeScanlineCounter() {
+    if (scanlineCounter == nullptr) {
+        return;
+    }
+
+    // Rendering can only be switched on or off at a synchronization, so it has been in the same state since the last one
+    ScanlineCounter& counter = state.scanlineCounter;
+    if (ppu.isRenderingEnabled()) {
+        uint64_t clocks = PPU::countScanlineCounterClocks(counter.syncPosition, ppu.getTotalDots() - counter.syncDot);
+        scanlineCounter->clockIRQTimer(clocks);
+    }
+
+    restartScanlineCounter();
+}
+
+void Bus::restartScanlineCounter() {
+    ScanlineCounter& counter = state.scanlineCounter;
+    counter.syncDot = ppu.getTotalDots();
+    counter.syncPosition = ppu.getFramePosition();
+
+    uint32_t clocks = (scanlineCounter != nullptr && ppu.isRenderingEnabled()) ? scanlineCounter->clocksUntilIRQ() : 0;
+    if (clocks == 0) {
+        counter.irqDot = ScanlineCounter::NEVER;
+    }
+    else {
+        counter.irqDot = counter.syncDot + PPU::dotsUntilScanlineCounterClock(counter.syncPosition, clocks);
+    }
 }
 
 void Bus::setController(bool controller, uint8_t value) {
-    controllers[controller].setButtons(value);
+    state.controllers[controller].setButtons(value);
+}
+
+void Bus::saveSnapshot(State& snapshot) const {
+    snapshot = state;
+}
+
+void Bus::loadSnapshot(const State& snapshot) {
+    state = snapshot;
+    writeTracker.markAllWritten();
+}
+
+void Bus::saveSnapshot(Snapshot& snapshot) {
+    if (snapshot.state == nullptr) {
+        snapshot.state = std::make_unique<State>();
+        snapshot.generation = 0;
+    }
+
+    copyWrittenPages(state, *snapshot.state, snapshot.generation, false);
+    snapshot.generation = writeTracker.startGeneration();
+}
+
+void Bus::loadSnapshot(const Snapshot& snapshot) {
+    // The pages copied back are different from what other snapshots last saw, so they count as written
+    copyWrittenPages(*snapshot.state, state, snapshot.generation, true);
+}
+
+void Bus::copyWrittenPages(const State& from, State& to, uint64_t since, bool markCopied) {
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(&from);
+    uint8_t* destination = reinterpret_cast<uint8_t*>(&to);
+
+    for (size_t page = 0; page < writeTracker.getNumPages(); page++) {
+        if (writeTracker.wasWrittenSince(page, since)) {
+            size_t offset = page * WriteTracker::PAGE_SIZE;
+            std::memcpy(destination + offset, source + offset, writeTracker.getPageSize(page));
+            if (markCopied) {
+                writeTracker.markWritten(destination + offset);
+            }
+        }
+    }
 }
 
 void Bus::serialize(Serializer& s) const {
-    s.serializeUInt64(totalCycles);
-    s.serializeArray(ram, s.uInt8Func);
-    s.serializeArray(controllerData, s.uInt8Func);
-    s.serializeBool(strobe);
-
-    auto serializeOamDma = [](Serializer& s, const OamDma& dma) {
-        s.serializeBool(dma.requested);
-        s.serializeBool(dma.ongoing);
-        s.serializeUInt8(dma.page);
-        s.serializeUInt8(dma.offset);
-        s.serializeUInt8(dma.data);
-    };
-    serializeOamDma(s, oamDma);
-
-    auto serializeDmcDma = [](Serializer& s, const DmcDma& dma) {
-        s.serializeBool(dma.requested);
-        s.serializeBool(dma.ongoing);
-        s.serializeUInt16(dma.address);
-        s.serializeUInt8(dma.data);
-        s.serializeUInt8(dma.delay);
-    };
-    serializeDmcDma(s, dmcDma);
+    Schema::serialize(s, state);
 }
 
 void Bus::deserialize(Deserializer& d) {
-    d.deserializeUInt64(totalCycles);
-    d.deserializeArray(ram, d.uInt8Func);
-    d.deserializeArray(controllerData, d.uInt8Func);
-    d.deserializeBool(strobe);
-
-    auto serializeOamDma = [](Deserializer& d, OamDma& dma) -> void {
-        d.deserializeBool(dma.requested);
-        d.deserializeBool(dma.ongoing);
-        d.deserializeUInt8(dma.page);
-        d.deserializeUInt8(dma.offset);
-        d.deserializeUInt8(dma.data);
+    Schema::deserialize(d, state);
+
+    // A save state replaces the whole block. The components are deserialized right after the bus, within the same generation.
+    writeTracker.markAllWritten();
+}
+
+void Bus::serializeAll(Serializer& s) {
+    serialize(s);
+    cpu.serialize(s);
+    ppu.serialize(s);
+    apu.synchronizeChannels(); // The APU may be behind the rest of the console
+    apu.serialize(s);
+    synchronizeScanlineCounter();
+    cartridge.mapper->serialize(s);
+}
+
+void Bus::deserializeAll(Deserializer& d) {
+    deserialize(d);
+    cpu.deserialize(d);
+    ppu.deserialize(d);
+    apu.deserialize(d);
+    cartridge.mapper->deserialize(d);
+    restartScanlineCounter();
+}
+
+uint64_t Bus::StateHashes::combined() const {
+    StateHash h;
+    for (uint64_t part : { bus, cpu, ppu, apu, mapper }) {
+        h.serializeUInt64(part);
+    }
+    return h.get();
+}
+
+Bus::StateHashes Bus::hashState() {
+    // Brought up to date the same way as before a save state is created
+    apu.synchronizeChannels();
+    synchronizeScanlineCounter();
+
+    auto hashSchema = [](const auto& object) {
+        StateHash h;
+        Schema::hash(h, object);
+        return h.get();
     };
-    serializeOamDma(d, oamDma);
-
-    auto serializeDmcDma = [](Deserializer& d, DmcDma& dma) -> void {
-        d.deserializeBool(dma.requested);
-        d.deserializeBool(dma.ongoing);
-        d.deserializeUInt16(dma.address);
-        d.deserializeUInt8(dma.data);
-        d.deserializeUInt8(dma.delay);
+
+    StateHash mapperHash;
+    cartridge.mapper->hash(mapperHash);
+
+    return {
+        hashSchema(state),
+        hashSchema(state.cpu),
+        hashSchema(state.ppu),
+        hashSchema(state.apu),
+        mapperHash.get()
     };
-    serializeDmcDma(d, dmcDma);
 }
\ No newline at end of file
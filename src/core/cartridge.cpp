@@ -1,14 +1,57 @@
 #include "core/cartridge.hpp"
 
+#include <algorithm>
 #include <filesystem>
-#include <fstream>
-#include <vector>
+#include <utility>
 
-Cartridge::Cartridge(const std::string& filePath) {
-    status = loadINESFile(filePath);
+Cartridge::Cartridge() : mapper(nullptr) {
+    status = { Code::MISSING_FILE, "No ROM has been loaded." };
 }
 
-Cartridge::Status Cartridge::loadINESFile(const std::string& filePath) {
+Cartridge::Status Cartridge::load(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    mapper = nullptr;
+    mapperStorage.emplace<std::monostate>();
+    romImage.reset();
+
+    if (std::filesystem::path(filePath).extension() == ".nsf") {
+        status = loadNSFFile(filePath, mapperState, writeTracker);
+    }
+    else {
+        status = loadINESFile(filePath, mapperState, writeTracker);
+    }
+    return status;
+}
+
+Cartridge::Status Cartridge::loadFrom(const Cartridge& other, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    mapper = nullptr;
+    mapperStorage.emplace<std::monostate>();
+    romImage.reset();
+
+    if (other.romImage == nullptr) {
+        status = { Code::MISSING_FILE, "No ROM has been loaded." };
+    }
+    else if (other.getNsfHeader() != nullptr) {
+        status = loadNSFImage(other.romImage, mapperState, writeTracker);
+    }
+    else {
+        status = loadINESImage(other.romImage, mapperState, writeTracker);
+    }
+    return status;
+}
+
+Cartridge::Status Cartridge::loadINESFile(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    if (std::filesystem::path(filePath).extension() != ".nes") {
+        return { Code::INCORRECT_EXTENSION, "Requested file (" + filePath + ") has an incorrect extension (.nes or .nsf is required)." };
+    }
+
+    std::shared_ptr<const RomImage> image = RomImage::open(filePath);
+    if (image == nullptr) {
+        return { Code::MISSING_FILE, "Requested file (" + filePath + ") does not exist." };
+    }
+    return loadINESImage(std::move(image), mapperState, writeTracker);
+}
+
+Cartridge::Status Cartridge::loadINESImage(std::shared_ptr<const RomImage> image, Mapper::State& mapperState, WriteTracker& writeTracker) {
     // iNES file format (https://www.nesdev.org/wiki/INES)
     // An iNES file consists of the following sections, in order:
     // Header (16 bytes)
@@ -36,38 +79,26 @@ Cartridge::Status Cartridge::loadINESFile(const std::string& filePath) {
         std::array<uint8_t, 5> unused;
     };
 
-    if (std::filesystem::path(filePath).extension() != ".nes") {
-        return { Code::INCORRECT_EXTENSION, "Requested file (" + filePath + ") has an incorrect extension (.nes is required)." };
-    }
+    // Everything below is parsed in place from the image, nothing is copied out of it
+    ByteView file = image->getData();
+    size_t offset = 0;
 
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        return { Code::MISSING_FILE, "Requested file (" + filePath + ") does not exist." };
+    static constexpr size_t HEADER_SIZE = 16;
+    if (file.size < HEADER_SIZE) {
+        return { Code::MISSING_HEADER, "iNES header missing or incomplete." };
     }
 
-    auto readHeader = [](std::ifstream& file, Header& header) -> void {
-        std::array<uint8_t, 16> buffer;
-        file.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(uint8_t));
-        if (!file) {
-            return;
-        }
-
-        header.name = { buffer[0], buffer[1], buffer[2], buffer[3] };
-        header.prgChunks = buffer[4];
-        header.chrChunks = buffer[5];
-        header.flag6 = buffer[6];
-        header.flag7 = buffer[7];
-        header.flag8 = buffer[8];
-        header.flag9 = buffer[9];
-        header.flag10 = buffer[10];
-        header.unused = { buffer[11], buffer[12], buffer[13], buffer[14], buffer[15] };
-    };
-
     Header header;
-    readHeader(file, header);
-    if (!file) {
-        return { Code::MISSING_HEADER, "iNES header missing or incomplete." };
-    }
+    header.name = { file[0], file[1], file[2], file[3] };
+    header.prgChunks = file[4];
+    header.chrChunks = file[5];
+    header.flag6 = file[6];
+    header.flag7 = file[7];
+    header.flag8 = file[8];
+    header.flag9 = file[9];
+    header.flag10 = file[10];
+    header.unused = { file[11], file[12], file[13], file[14], file[15] };
+    offset += HEADER_SIZE;
 
     static constexpr std::array<uint8_t, 4> correctName = { 'N', 'E', 'S', '\x1A' };
     if (header.name != correctName) {
@@ -79,11 +110,10 @@ Cartridge::Status Cartridge::loadINESFile(const std::string& filePath) {
         static constexpr uint16_t TRAINER_SIZE = 0x200;
 
         // TODO: Maybe we should put the trainer data somewhere...
-        file.ignore(TRAINER_SIZE);
-
-        if (!file) {
+        if (file.size - offset < TRAINER_SIZE) {
             return { Code::MISSING_TRAINER, "Trainer data should be present, but missing or incomplete." };
         }
+        offset += TRAINER_SIZE;
     }
 
     uint8_t iNESVersion = (((header.flag7 >> 2) & 0x3) == 2) ? 2 : 1;
@@ -109,20 +139,23 @@ Cartridge::Status Cartridge::loadINESFile(const std::string& filePath) {
 
     // TODO: Parse iNES 2.0 fields
 
-    std::vector<uint8_t> prg(header.prgChunks * Mapper::PRG_ROM_CHUNK_SIZE);
-    file.read(reinterpret_cast<char*>(prg.data()), prg.size() * sizeof(uint8_t));
-    if (!file) {
+    // PRG and CHR are views into the shared image, which the cartridge keeps alive for as long as the mapper exists
+    size_t prgSize = header.prgChunks * Mapper::PRG_ROM_CHUNK_SIZE;
+    size_t chrSize = header.chrChunks * Mapper::CHR_ROM_CHUNK_SIZE;
+
+    if (file.size - offset < prgSize) {
         return { Code::MISSING_PRG, "Program data missing or incomplete." };
     }
+    ByteView prg = { file.data + offset, prgSize };
+    offset += prgSize;
 
     // For iNES 1.0 we assume that a value of 0 for char rom chunks means we have 1 chunk of CHR RAM (handled within mapper).
     // In iNES 2.0 the size is specified
     // TODO: Add iNES 2.0 support
-    std::vector<uint8_t> chr(header.chrChunks * Mapper::CHR_ROM_CHUNK_SIZE);
-    file.read(reinterpret_cast<char*>(chr.data()), chr.size() * sizeof(uint8_t));
-    if (!file) {
+    if (file.size - offset < chrSize) {
         return { Code::MISSING_CHR, "Character data missing or incomplete." };
     }
+    ByteView chr = { file.data + offset, chrSize };
 
     bool mirrorModeId = header.flag6 & 1;
     bool hasBatteryBackedPrgRam = (header.flag6 >> 1) & 1;
@@ -135,14 +168,121 @@ Cartridge::Status Cartridge::loadINESFile(const std::string& filePath) {
         hasBatteryBackedPrgRam,
         alternativeNametableLayout
     };
-    mapper = Mapper::createMapper(config, prg, chr);
+    mapper = createMapper(config, prg, chr, mapperState, writeTracker);
     if (mapper == nullptr) {
         return { Code::UNIMPLEMENTED_MAPPER, "The requested mapper (" + std::to_string(mapperId) + ") is currently not supported." };
     }
+    romImage = std::move(image);
+
+    return { Code::SUCCESS, "" };
+}
+
+Cartridge::Status Cartridge::loadNSFFile(const std::string& filePath, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    std::shared_ptr<const RomImage> image = RomImage::open(filePath);
+    if (image == nullptr) {
+        return { Code::MISSING_FILE, "Requested file (" + filePath + ") does not exist." };
+    }
+    return loadNSFImage(std::move(image), mapperState, writeTracker);
+}
+
+Cartridge::Status Cartridge::loadNSFImage(std::shared_ptr<const RomImage> image, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    // NSF file format (https://www.nesdev.org/wiki/NSF)
+    // An NSF file consists of a 128 byte header followed by the program data.
+    // The program data has no fixed size and is copied to the load address, or split into 4KB banks if bankswitching is used.
+
+    // NSF header (https://www.nesdev.org/wiki/NSF)
+    // 00-04	Constant $4E $45 $53 $4D $1A (ASCII "NESM" followed by MS-DOS end-of-file)
+    // 05	Version number
+    // 06	Total songs
+    // 07	Starting song (1-based)
+    // 08-09	Load address of the data (little endian)
+    // 0A-0B	Init address of the data
+    // 0C-0D	Play address of the data
+    // 0E-2D	Song name, artist and copyright (null terminated strings)
+    // 6E-6F	Play speed in microseconds for NTSC
+    // 70-77	Bankswitch init values (all zero if bankswitching is not used)
+    // 78-79	Play speed in microseconds for PAL
+    // 7A	PAL/NTSC bits
+    // 7B	Extra sound chip support
+    // 7C-7F	NSF2 fields
+    ByteView file = image->getData();
+
+    static constexpr size_t HEADER_SIZE = 0x80;
+    if (file.size < HEADER_SIZE) {
+        return { Code::MISSING_HEADER, "NSF header missing or incomplete." };
+    }
+
+    static constexpr std::array<uint8_t, 5> correctName = { 'N', 'E', 'S', 'M', '\x1A' };
+    std::array<uint8_t, 5> name = { file[0], file[1], file[2], file[3], file[4] };
+    if (name != correctName) {
+        return { Code::INCORRECT_HEADER_NAME, "File header contains incorrect name." };
+    }
+
+    auto read16 = [&](size_t offset) -> uint16_t {
+        return static_cast<uint16_t>(file[offset] | (file[offset + 1] << 8));
+    };
+
+    MapperNSF::Header header;
+    header.songCount = file[0x06];
+    header.startingSong = file[0x07];
+    header.loadAddress = read16(0x08);
+    header.initAddress = read16(0x0A);
+    header.playAddress = read16(0x0C);
+    header.playSpeedNtsc = read16(0x6E);
+    for (size_t i = 0; i < header.initialBanks.size(); i++) {
+        header.initialBanks[i] = file[0x70 + i];
+    }
+    header.isBankswitched = std::any_of(header.initialBanks.begin(), header.initialBanks.end(), [](uint8_t bank) { return bank != 0; });
+
+    uint8_t extraSoundChips = file[0x7B];
+    if (extraSoundChips != 0) {
+        return { Code::UNIMPLEMENTED_MAPPER, "NSF files that use expansion audio are currently not supported." };
+    }
+
+    // Without bankswitching the data has to fit between the load address and the end of the address space
+    ByteView prg = { file.data + HEADER_SIZE, file.size - HEADER_SIZE };
+    if (prg.size == 0 || (!header.isBankswitched && (header.loadAddress < 0x8000 || prg.size > 0x10000u - header.loadAddress))) {
+        return { Code::MISSING_PRG, "Program data missing or does not fit at the load address." };
+    }
+
+    // NSF files have no CHR data. The PPU is not used during playback, but it is still given CHR RAM to read from.
+    Mapper::Config config = {
+        0,
+        0,
+        0,
+        Mapper::MirrorMode::HORIZONTAL,
+        false,
+        false
+    };
+    mapper = &mapperStorage.emplace<MapperNSF>(config, prg, ByteView{ nullptr, 0 }, mapperState, writeTracker, header);
+    romImage = std::move(image);
 
     return { Code::SUCCESS, "" };
 }
 
 Cartridge::Status Cartridge::getStatus() const {
     return status;
+}
+
+const std::shared_ptr<const RomImage>& Cartridge::getRomImage() const {
+    return romImage;
+}
+
+const MapperNSF::Header* Cartridge::getNsfHeader() const {
+    const MapperNSF* nsfMapper = std::get_if<MapperNSF>(&mapperStorage);
+    return nsfMapper != nullptr ? &nsfMapper->header : nullptr;
+}
+
+Mapper* Cartridge::createMapper(const Mapper::Config& config, ByteView prg, ByteView chr, Mapper::State& mapperState, WriteTracker& writeTracker) {
+    switch (config.id) {
+        case 0:     return &mapperStorage.emplace<Mapper0>(config, prg, chr, mapperState, writeTracker);
+        case 1:     return &mapperStorage.emplace<Mapper1>(config, prg, chr, mapperState, writeTracker);
+        case 2:     return &mapperStorage.emplace<Mapper2>(config, prg, chr, mapperState, writeTracker);
+        case 3:     return &mapperStorage.emplace<Mapper3>(config, prg, chr, mapperState, writeTracker);
+        case 4:     return &mapperStorage.emplace<Mapper4>(config, prg, chr, mapperState, writeTracker);
+        case 7:     return &mapperStorage.emplace<Mapper7>(config, prg, chr, mapperState, writeTracker);
+        case 9:     return &mapperStorage.emplace<Mapper9>(config, prg, chr, mapperState, writeTracker);
+        case 66:    return &mapperStorage.emplace<Mapper66>(config, prg, chr, mapperState, writeTracker);
+        default:    return nullptr; // TODO: Add more mappers
+    }
 }
\ No newline at end of file
@@ -5,31 +5,30 @@
 
 const std::array<CPU::Opcode, CPU::MAX_NUM_OPCODES> CPU::lookup = CPU::initLookup();
 
-CPU::CPU(Bus& bus) : bus(bus) {
-    resetCPU();
+CPU::CPU(Bus& bus) : bus(bus), state(bus.state.cpu) {
 }
 
 void CPU::resetCPU() {
     // Init registers
-    a = 0;
-    x = 0;
-    y = 0;
-    sp = 0;
-    sr.data = 0;
-    sr.unused = 1;
-    shouldAdvancePC = false;
+    state.a = 0;
+    state.x = 0;
+    state.y = 0;
+    state.sp = 0;
+    state.sr.data = 0;
+    StatusRegister::Unused::set(state.sr.data, 1);
+    state.shouldAdvancePC = false;
 
     reset();
 }
 
 void CPU::executeCycle() {
-    if (remainingCycles == 0) {
+    if (state.remainingCycles == 0) {
         // By default, we should advance the program counter to the next instruction.
         // However certian instructions (e.g. jumps and breaks) instead set the program counter directly.
         // Those instructions should set shouldAdvancePC to false.
-        shouldAdvancePC = true;
+        state.shouldAdvancePC = true;
 
-        uint8_t index = bus.read(pc);
+        uint8_t index = bus.read(state.pc);
         const Opcode& currentOpcode = lookup[index];
         const Instruction& inst = currentOpcode.instruction;
         const AddressingMode& mode = currentOpcode.addressingMode;
@@ -37,17 +36,17 @@ void CPU::executeCycle() {
 
         (this->*inst.execute)(operand);
 
-        if (shouldAdvancePC) {
-            pc += mode.instructionSize;
+        if (state.shouldAdvancePC) {
+            state.pc += mode.instructionSize;
         }
 
-        remainingCycles += currentOpcode.numDefaultCycles;
+        state.remainingCycles += currentOpcode.numDefaultCycles;
 
         bool needExtraCycle = operand.mightNeedExtraCycle && inst.mightNeedExtraCycle;
-        remainingCycles += needExtraCycle;
+        state.remainingCycles += needExtraCycle;
     }
 
-    remainingCycles--;
+    state.remainingCycles--;
 }
 
 // Reset (description from from https://www.masswerk.at/6502/6502_instruction_set.html)
@@ -62,16 +61,16 @@ void CPU::executeCycle() {
 // for the program counter, which is provided by the reset vector at $FFFC.)
 void CPU::reset() {
     // Reset program counter
-    pc = read16BitData(RESET_VECTOR);
+    state.pc = read16BitData(RESET_VECTOR);
 
     // Stack pointer is decremented by 3 for some reason
-    sp -= 3;
+    state.sp -= 3;
 
     // Set I flag
-    sr.interrupt = 1;
+    StatusRegister::Interrupt::set(state.sr.data, 1);
 
     // Reset takes 7 cycles
-    remainingCycles = 7;
+    state.remainingCycles = 7;
 }
 
 // Interrupts (descriptions from https://www.masswerk.at/6502/6502_instruction_set.html)
@@ -81,17 +80,17 @@ void CPU::reset() {
 // In any way, the interrupt disable flag is set to inhibit any further IRQ as control is transferred to the interrupt handler specified by the respective interrupt vector.
 // The RTI instruction restores the status register from the stack and behaves otherwise like the JSR instruction. (The break flag is always ignored as the status is read from the stack, as it isn't a real processor flag anyway.)
 bool CPU::IRQ() {
-    if (!sr.interrupt) {
-        push16BitDataToStack(pc);
+    if (!StatusRegister::Interrupt::get(state.sr.data)) {
+        push16BitDataToStack(state.pc);
         pushFlagsToStack(0);
 
-        sr.interrupt = 1;
+        StatusRegister::Interrupt::set(state.sr.data, 1);
 
-        pc = read16BitData(IRQ_BRK_VECTOR);
-        shouldAdvancePC = false;
+        state.pc = read16BitData(IRQ_BRK_VECTOR);
+        state.shouldAdvancePC = false;
 
         // IRQ takes 7 cycles
-        remainingCycles = 7;
+        state.remainingCycles = 7;
         return true;
     }
 
@@ -99,38 +98,38 @@ bool CPU::IRQ() {
 }
 
 void CPU::NMI() {
-    push16BitDataToStack(pc);
+    push16BitDataToStack(state.pc);
     pushFlagsToStack(0);
 
-    sr.interrupt = 1;
+    StatusRegister::Interrupt::set(state.sr.data, 1);
 
-    pc = read16BitData(NMI_VECTOR);
-    shouldAdvancePC = false;
+    state.pc = read16BitData(NMI_VECTOR);
+    state.shouldAdvancePC = false;
 
     // NMI takes 7 cycles
-    remainingCycles = 7;
+    state.remainingCycles = 7;
 }
 
 uint16_t CPU::getPC() const {
-    return pc;
+    return state.pc;
 }
 uint8_t CPU::getA() const {
-    return a;
+    return state.a;
 }
 uint8_t CPU::getX() const {
-    return x;
+    return state.x;
 }
 uint8_t CPU::getY() const {
-    return y;
+    return state.y;
 }
 uint8_t CPU::getSR() const {
-    return sr.data;
+    return state.sr.data;
 }
 uint8_t CPU::getSP() const {
-    return sp;
+    return state.sp;
 }
 uint8_t CPU::getRemainingCycles() const {
-    return remainingCycles;
+    return state.remainingCycles;
 }
 
 std::array<CPU::Opcode, CPU::MAX_NUM_OPCODES> CPU::initLookup() {
@@ -427,9 +426,9 @@ uint8_t CPU::getDataView(const AddressingMode::ReturnType& operand) const {
 }
 
 // The N and Z flags are often set alongside each other during instructions
-void CPU::setNZFlags(uint8_t x) {
-    sr.negative = (x >> 7) & 1;
-    sr.zero = x == 0;
+void CPU::setNZFlags(uint8_t value) {
+    StatusRegister::Negative::set(state.sr.data, (value >> 7) & 1);
+    StatusRegister::Zero::set(state.sr.data, value == 0);
 }
 
 uint16_t CPU::view16BitData(uint16_t address) const {
@@ -454,14 +453,14 @@ void CPU::write16BitData(uint16_t address, uint16_t data) {
 }
 
 void CPU::push8BitDataToStack(uint8_t data) {
-    bus.write(STACK_OFFSET + sp, data);
-    sp--;
+    bus.write(STACK_OFFSET + state.sp, data);
+    state.sp--;
 }
 
 uint8_t CPU::pop8BitDataFromStack() {
     // Since the stack grows backwards, we need to read from sp + 1
-    uint8_t data = bus.read(STACK_OFFSET + ((sp + 1) & 0xFF));
-    sp++;
+    uint8_t data = bus.read(STACK_OFFSET + ((state.sp + 1) & 0xFF));
+    state.sp++;
     return data;
 }
 
@@ -469,26 +468,26 @@ void CPU::push16BitDataToStack(uint16_t data) {
     // Since the stack grows backwards, we need to write the least signifigant bit to sp - 1
     uint8_t lo = data & 0xFF;
     uint8_t hi = (data >> 8) & 0xFF;
-    bus.write(STACK_OFFSET + ((sp - 1) & 0xFF), lo);
-    bus.write(STACK_OFFSET + sp, hi);
-    sp -= 2;
+    bus.write(STACK_OFFSET + ((state.sp - 1) & 0xFF), lo);
+    bus.write(STACK_OFFSET + state.sp, hi);
+    state.sp -= 2;
 }
 
 uint16_t CPU::pop16BitDataFromStack() {
     // Since the stack grows backwards, we need to read from sp + 1
     // uint16_t data = read16BitData(STACK_OFFSET + sp + 1);
-    uint8_t lo = bus.read(STACK_OFFSET + ((sp + 1) & 0xFF));
-    uint8_t hi = bus.read(STACK_OFFSET + ((sp + 2) & 0xFF));
-    sp += 2;
+    uint8_t lo = bus.read(STACK_OFFSET + ((state.sp + 1) & 0xFF));
+    uint8_t hi = bus.read(STACK_OFFSET + ((state.sp + 2) & 0xFF));
+    state.sp += 2;
 
     uint16_t data = (hi << 8) | lo;
     return data;
 }
 
 void CPU::pushFlagsToStack(bool breakFlagValue) {
-    StatusRegister srTemp{ sr.data };
-    srTemp.break_ = breakFlagValue;
-    srTemp.unused = 1;
+    StatusRegister srTemp{ state.sr.data };
+    StatusRegister::Break::set(srTemp.data, breakFlagValue);
+    StatusRegister::Unused::set(srTemp.data, 1);
     push8BitDataToStack(srTemp.data);
 }
 
@@ -502,36 +501,36 @@ bool isPageChange(uint16_t address1, uint16_t address2) {
 // Accumulator
 // These instructions have register A (the accumulator) as the target. Examples are LSR A and ROL A.
 CPU::AddressingMode::ReturnType CPU::ACC() {
-    return { a, 0 };
+    return { state.a, 0 };
 }
 
 // Absolute
 // Absolute addressing specifies the memory location explicitly in the two bytes following the opcode. So JMP $4032 will set the PC to $4032. The hex for this is 4C 32 40. The 6502 is a little endian machine, so any 16 bit (2 byte) value is stored with the LSB first. All instructions that use absolute addressing are 3 bytes.
 CPU::AddressingMode::ReturnType CPU::ABS() {
-    uint16_t address = read16BitData(pc + 1);
+    uint16_t address = read16BitData(state.pc + 1);
     return { address, 0 };
 }
 
 // Absolute Indexed X
 // This addressing mode makes the target address by adding the contents of the X or Y register to an absolute address. For example, this 6502 code can be used to fill 10 bytes with $FF starting at address $1009, counting down to address $1000.
 CPU::AddressingMode::ReturnType CPU::ABX() {
-    uint16_t oldAddress = read16BitData(pc + 1);
-    uint16_t newAddress = oldAddress + x;
+    uint16_t oldAddress = read16BitData(state.pc + 1);
+    uint16_t newAddress = oldAddress + state.x;
     return { newAddress, isPageChange(oldAddress, newAddress) };
 }
 
 // Absolute Indexed Y
 // This addressing mode makes the target address by adding the contents of the X or Y register to an absolute address. For example, this 6502 code can be used to fill 10 bytes with $FF starting at address $1009, counting down to address $1000.
 CPU::AddressingMode::ReturnType CPU::ABY() {
-    uint16_t oldAddress = read16BitData(pc + 1);
-    uint16_t newAddress = oldAddress + y;
+    uint16_t oldAddress = read16BitData(state.pc + 1);
+    uint16_t newAddress = oldAddress + state.y;
     return { newAddress, isPageChange(oldAddress, newAddress) };
 }
 
 // Immediate
 // These instructions have their data defined as the next byte after the opcode. ORA #$B2 will perform a logical (also called bitwise) of the value B2 with the accumulator. Remember that in assembly when you see a # sign, it indicates an immediate value. If $B2 was written without a #, it would indicate an address or offset.
 CPU::AddressingMode::ReturnType CPU::IMM() {
-    return { bus.read(pc + 1), 0 };
+    return { bus.read(state.pc + 1), 0 };
 }
 
 // Implied
@@ -543,7 +542,7 @@ CPU::AddressingMode::ReturnType CPU::IMP() {
 // Indirect
 // The JMP instruction is the only instruction that uses this addressing mode. It is a 3 byte instruction - the 2nd and 3rd bytes are an absolute address. The set the PC to the address stored at that address. So maybe this would be clearer.
 CPU::AddressingMode::ReturnType CPU::IND() {
-    uint16_t pointer = read16BitData(pc + 1);
+    uint16_t pointer = read16BitData(state.pc + 1);
 
     uint16_t address;
 
@@ -566,7 +565,7 @@ CPU::AddressingMode::ReturnType CPU::IND() {
 // If X + the immediate byte will wrap around to a zero-page address. So you could code that like targetAddress = (X + opcode[1]) & 0xFF .
 // Indexed Indirect instructions are 2 bytes - the second byte is the zero-page address - $20 in the example. Obviously the fetched address has to be stored in the zero page.
 CPU::AddressingMode::ReturnType CPU::IZX() {
-    uint8_t pointer = bus.read(pc + 1) + x;
+    uint8_t pointer = bus.read(state.pc + 1) + state.x;
 
     // We can't use read16BitData(pointer) because of zero page wrapping
     uint8_t lo = bus.read(pointer);
@@ -581,31 +580,31 @@ CPU::AddressingMode::ReturnType CPU::IZX() {
 // Indirect Indexed instructions are 2 bytes - the second byte is the zero-page address - $86 in the example. (So the fetched address has to be stored in the zero page.)
 // While indexed indirect addressing will only generate a zero-page address, this mode's target address is not wrapped - it can be anywhere in the 16-bit address space.
 CPU::AddressingMode::ReturnType CPU::IZY() {
-    uint8_t pointer = bus.read(pc + 1);
+    uint8_t pointer = bus.read(state.pc + 1);
 
     // We can't use read16BitData(pointer) because of zero page wrapping
     uint8_t lo = bus.read(pointer);
     uint8_t hi = bus.read((pointer + 1) & 0xFF);
     uint16_t oldAddress = (hi << 8) | lo;
 
-    uint16_t newAddress = oldAddress + y;
+    uint16_t newAddress = oldAddress + state.y;
     return { newAddress, isPageChange(oldAddress, newAddress) };
 }
 
 // Relative
 // Relative addressing on the 6502 is only used for branch operations. The byte after the opcode is the branch offset. If the branch is taken, the new address will the the current PC plus the offset. The offset is a signed byte, so it can jump a maximum of 127 bytes forward, or 128 bytes backward. (For more info about signed numbers, check here.)
 CPU::AddressingMode::ReturnType CPU::REL() {
-    uint8_t offset = bus.read(pc + 1);
+    uint8_t offset = bus.read(state.pc + 1);
 
     // Relative addressing is done from the end of the instruction, so we need to add 2 to this address.
-    uint16_t newAddress = pc + 2 + static_cast<int8_t>(offset);
-    return { newAddress, isPageChange(pc + 2, newAddress) };
+    uint16_t newAddress = state.pc + 2 + static_cast<int8_t>(offset);
+    return { newAddress, isPageChange(state.pc + 2, newAddress) };
 }
 
 // Zero-Page
 // Zero-Page is an addressing mode that is only capable of addressing the first 256 bytes of the CPU's memory map. You can think of it as absolute addressing for the first 256 bytes. The instruction LDA $35 will put the value stored in memory location $35 into A. The advantage of zero-page are two - the instruction takes one less byte to specify, and it executes in less CPU cycles. Most programs are written to store the most frequently used variables in the first 256 memory locations so they can take advantage of zero page addressing.
 CPU::AddressingMode::ReturnType CPU::ZPG() {
-    uint16_t address = bus.read(pc + 1);
+    uint16_t address = bus.read(state.pc + 1);
     return { address, 0 };
 }
 
@@ -613,7 +612,7 @@ CPU::AddressingMode::ReturnType CPU::ZPG() {
 // This works just like absolute indexed, but the target address is limited to the first 0xFF bytes.
 // The target address will wrap around and will always be in the zero page. If the instruction is LDA $C0,X, and X is $60, then the target address will be $20. $C0+$60 = $120, but the carry is discarded in the calculation of the target address.
 CPU::AddressingMode::ReturnType CPU::ZPX() {
-    uint16_t address = (bus.read(pc + 1) + x) & 0xFF;
+    uint16_t address = (bus.read(state.pc + 1) + state.x) & 0xFF;
     return { address, 0 };
 }
 
@@ -621,7 +620,7 @@ CPU::AddressingMode::ReturnType CPU::ZPX() {
 // This works just like absolute indexed, but the target address is limited to the first 0xFF bytes.
 // The target address will wrap around and will always be in the zero page. If the instruction is LDA $C0,X, and X is $60, then the target address will be $20. $C0+$60 = $120, but the carry is discarded in the calculation of the target address.
 CPU::AddressingMode::ReturnType CPU::ZPY() {
-    uint16_t address = (bus.read(pc + 1) + y) & 0xFF;
+    uint16_t address = (bus.read(state.pc + 1) + state.y) & 0xFF;
     return { address, 0 };
 }
 
@@ -636,17 +635,17 @@ CPU::AddressingMode::ReturnType CPU::ZPY() {
 //  +	+	+	-	-	+
 void CPU::ADC(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    uint16_t fullSum = a + data + sr.carry;
+    uint16_t fullSum = state.a + data + StatusRegister::Carry::get(state.sr.data);
 
-    sr.carry = fullSum > 0xFF;
+    StatusRegister::Carry::set(state.sr.data, fullSum > 0xFF);
 
     // Set the overflow flag only when the two addends have the same sign, and result has a different sign
-    uint8_t overflowCondition = ~(a ^ data) & (a ^ static_cast<uint8_t>(fullSum));
-    sr.overflow = (overflowCondition >> 7) & 1;
+    uint8_t overflowCondition = ~(state.a ^ data) & (state.a ^ static_cast<uint8_t>(fullSum));
+    StatusRegister::Overflow::set(state.sr.data, (overflowCondition >> 7) & 1);
 
     setNZFlags(static_cast<uint8_t>(fullSum));
 
-    a = static_cast<uint8_t>(fullSum);
+    state.a = static_cast<uint8_t>(fullSum);
 }
 
 // AND
@@ -656,9 +655,9 @@ void CPU::ADC(const AddressingMode::ReturnType& operand) {
 //  +	+	-	-	-	-
 void CPU::AND(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    a &= data;
+    state.a &= data;
 
-    setNZFlags(a);
+    setNZFlags(state.a);
 }
 
 // ASL
@@ -677,11 +676,11 @@ void CPU::ASL(const AddressingMode::ReturnType& operand) {
     }
     else {
         // If there is no address to write to, then we are in accumulator addressing mode
-        shift = a << 1;
-        a = static_cast<uint8_t>(shift);
+        shift = state.a << 1;
+        state.a = static_cast<uint8_t>(shift);
     }
 
-    sr.carry = shift > 0xFF;
+    StatusRegister::Carry::set(state.sr.data, shift > 0xFF);
     setNZFlags(static_cast<uint8_t>(shift));
 }
 
@@ -691,13 +690,13 @@ void CPU::ASL(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BCC(const AddressingMode::ReturnType& operand) {
-    if (!sr.carry) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (!StatusRegister::Carry::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -708,13 +707,13 @@ void CPU::BCC(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BCS(const AddressingMode::ReturnType& operand) {
-    if (sr.carry) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (StatusRegister::Carry::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -725,13 +724,13 @@ void CPU::BCS(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BEQ(const AddressingMode::ReturnType& operand) {
-    if (sr.zero) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (StatusRegister::Zero::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -749,9 +748,9 @@ void CPU::BEQ(const AddressingMode::ReturnType& operand) {
 void CPU::BIT(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
 
-    sr.zero = (a & data) == 0;
-    sr.negative = (data >> 7) & 1;
-    sr.overflow = (data >> 6) & 1;
+    StatusRegister::Zero::set(state.sr.data, (state.a & data) == 0);
+    StatusRegister::Negative::set(state.sr.data, (data >> 7) & 1);
+    StatusRegister::Overflow::set(state.sr.data, (data >> 6) & 1);
 }
 
 // BMI
@@ -760,13 +759,13 @@ void CPU::BIT(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BMI(const AddressingMode::ReturnType& operand) {
-    if (sr.negative) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (StatusRegister::Negative::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -777,13 +776,13 @@ void CPU::BMI(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BNE(const AddressingMode::ReturnType& operand) {
-    if (!sr.zero) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (!StatusRegister::Zero::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -794,13 +793,13 @@ void CPU::BNE(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BPL(const AddressingMode::ReturnType& operand) {
-    if (!sr.negative) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (!StatusRegister::Negative::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -820,13 +819,13 @@ void CPU::BPL(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	1	-	-
 void CPU::BRK(const AddressingMode::ReturnType& /*operand*/) {
-    push16BitDataToStack(pc + 2);
+    push16BitDataToStack(state.pc + 2);
     pushFlagsToStack(1);
 
-    sr.interrupt = 1;
+    StatusRegister::Interrupt::set(state.sr.data, 1);
 
-    pc = read16BitData(IRQ_BRK_VECTOR);
-    shouldAdvancePC = false;
+    state.pc = read16BitData(IRQ_BRK_VECTOR);
+    state.shouldAdvancePC = false;
 }
 
 // BVC
@@ -835,13 +834,13 @@ void CPU::BRK(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BVC(const AddressingMode::ReturnType& operand) {
-    if (!sr.overflow) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (!StatusRegister::Overflow::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -852,13 +851,13 @@ void CPU::BVC(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::BVS(const AddressingMode::ReturnType& operand) {
-    if (sr.overflow) {
-        pc = getAddress(operand);
-        shouldAdvancePC = false;
-        remainingCycles++;
+    if (StatusRegister::Overflow::get(state.sr.data)) {
+        state.pc = getAddress(operand);
+        state.shouldAdvancePC = false;
+        state.remainingCycles++;
 
         if (operand.mightNeedExtraCycle) {
-            remainingCycles++;
+            state.remainingCycles++;
         }
     }
 }
@@ -869,7 +868,7 @@ void CPU::BVS(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	0	-	-	-
 void CPU::CLC(const AddressingMode::ReturnType& /*operand*/) {
-    sr.carry = 0;
+    StatusRegister::Carry::set(state.sr.data, 0);
 }
 
 // CLD
@@ -878,7 +877,7 @@ void CPU::CLC(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	0	-
 void CPU::CLD(const AddressingMode::ReturnType& /*operand*/) {
-    sr.decimal = 0;
+    StatusRegister::Decimal::set(state.sr.data, 0);
 }
 
 // CLI
@@ -887,7 +886,7 @@ void CPU::CLD(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	0	-	-
 void CPU::CLI(const AddressingMode::ReturnType& /*operand*/) {
-    sr.interrupt = 0;
+    StatusRegister::Interrupt::set(state.sr.data, 0);
 }
 
 // CLV
@@ -896,7 +895,7 @@ void CPU::CLI(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	0
 void CPU::CLV(const AddressingMode::ReturnType& /*operand*/) {
-    sr.overflow = 0;
+    StatusRegister::Overflow::set(state.sr.data, 0);
 }
 
 // Compare Memory with Accumulator
@@ -905,8 +904,8 @@ void CPU::CLV(const AddressingMode::ReturnType& /*operand*/) {
 //  +	+	+	-	-	-
 void CPU::CMP(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    uint16_t cmp = a - data;
-    sr.carry = a >= data;
+    uint16_t cmp = state.a - data;
+    StatusRegister::Carry::set(state.sr.data, state.a >= data);
     setNZFlags(cmp);
 }
 
@@ -917,8 +916,8 @@ void CPU::CMP(const AddressingMode::ReturnType& operand) {
 //  +	+	+	-	-	-
 void CPU::CPX(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    uint16_t cmp = x - data;
-    sr.carry = x >= data;
+    uint16_t cmp = state.x - data;
+    StatusRegister::Carry::set(state.sr.data, state.x >= data);
     setNZFlags(cmp);
 }
 
@@ -929,8 +928,8 @@ void CPU::CPX(const AddressingMode::ReturnType& operand) {
 //  +	+	+	-	-	-
 void CPU::CPY(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    uint16_t cmp = y - data;
-    sr.carry = y >= data;
+    uint16_t cmp = state.y - data;
+    StatusRegister::Carry::set(state.sr.data, state.y >= data);
     setNZFlags(cmp);
 }
 
@@ -952,8 +951,8 @@ void CPU::DEC(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::DEX(const AddressingMode::ReturnType& /*operand*/) {
-    x--;
-    setNZFlags(x);
+    state.x--;
+    setNZFlags(state.x);
 }
 
 // DEY
@@ -962,8 +961,8 @@ void CPU::DEX(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::DEY(const AddressingMode::ReturnType& /*operand*/) {
-    y--;
-    setNZFlags(y);
+    state.y--;
+    setNZFlags(state.y);
 }
 
 // EOR
@@ -973,8 +972,8 @@ void CPU::DEY(const AddressingMode::ReturnType& /*operand*/) {
 //  +	+	-	-	-	-
 void CPU::EOR(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    a ^= data;
-    setNZFlags(a);
+    state.a ^= data;
+    setNZFlags(state.a);
 }
 
 // INC
@@ -995,8 +994,8 @@ void CPU::INC(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::INX(const AddressingMode::ReturnType& /*operand*/) {
-    x++;
-    setNZFlags(x);
+    state.x++;
+    setNZFlags(state.x);
 }
 
 // Increment Index Y by One
@@ -1004,8 +1003,8 @@ void CPU::INX(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::INY(const AddressingMode::ReturnType& /*operand*/) {
-    y++;
-    setNZFlags(y);
+    state.y++;
+    setNZFlags(state.y);
 }
 
 // JMP
@@ -1016,8 +1015,8 @@ void CPU::INY(const AddressingMode::ReturnType& /*operand*/) {
 //  -	-	-	-	-	-
 void CPU::JMP(const AddressingMode::ReturnType& operand) {
     uint16_t addr = getAddress(operand);
-    pc = addr;
-    shouldAdvancePC = false;
+    state.pc = addr;
+    state.shouldAdvancePC = false;
 }
 
 // JSR
@@ -1028,10 +1027,10 @@ void CPU::JMP(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::JSR(const AddressingMode::ReturnType& operand) {
-    push16BitDataToStack(pc + 2);
+    push16BitDataToStack(state.pc + 2);
     uint16_t addr = getAddress(operand);
-    pc = addr;
-    shouldAdvancePC = false;
+    state.pc = addr;
+    state.shouldAdvancePC = false;
 }
 
 // LDA
@@ -1041,8 +1040,8 @@ void CPU::JSR(const AddressingMode::ReturnType& operand) {
 //  +	+	-	-	-	-
 void CPU::LDA(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    a = data;
-    setNZFlags(a);
+    state.a = data;
+    setNZFlags(state.a);
 }
 
 // LDX
@@ -1052,8 +1051,8 @@ void CPU::LDA(const AddressingMode::ReturnType& operand) {
 //  +	+	-	-	-	-
 void CPU::LDX(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    x = data;
-    setNZFlags(x);
+    state.x = data;
+    setNZFlags(state.x);
 }
 
 // LDY
@@ -1063,8 +1062,8 @@ void CPU::LDX(const AddressingMode::ReturnType& operand) {
 //  +	+	-	-	-	-
 void CPU::LDY(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    y = data;
-    setNZFlags(y);
+    state.y = data;
+    setNZFlags(state.y);
 }
 
 // LSR
@@ -1077,7 +1076,7 @@ void CPU::LSR(const AddressingMode::ReturnType& operand) {
         uint16_t addr = getAddress(operand);
         uint8_t data = getDataRead(operand);
 
-        sr.carry = data & 1;
+        StatusRegister::Carry::set(state.sr.data, data & 1);
 
         data >>= 1;
         bus.write(addr, data);
@@ -1086,9 +1085,9 @@ void CPU::LSR(const AddressingMode::ReturnType& operand) {
     }
     else {
         // If there is no address to write to, then we are in accumulator addressing mode
-        sr.carry = a & 1;
-        a >>= 1;
-        setNZFlags(a);
+        StatusRegister::Carry::set(state.sr.data, state.a & 1);
+        state.a >>= 1;
+        setNZFlags(state.a);
     }
 }
 
@@ -1107,8 +1106,8 @@ void CPU::NOP(const AddressingMode::ReturnType& /*operand*/) {
 //  +	+	-	-	-	-
 void CPU::ORA(const AddressingMode::ReturnType& operand) {
     uint8_t data = getDataRead(operand);
-    a |= data;
-    setNZFlags(a);
+    state.a |= data;
+    setNZFlags(state.a);
 }
 
 // PHA
@@ -1117,7 +1116,7 @@ void CPU::ORA(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::PHA(const AddressingMode::ReturnType& /*operand*/) {
-    push8BitDataToStack(a);
+    push8BitDataToStack(state.a);
 }
 
 // PHP
@@ -1137,8 +1136,8 @@ void CPU::PHP(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::PLA(const AddressingMode::ReturnType& /*operand*/) {
-    a = pop8BitDataFromStack();
-    setNZFlags(a);
+    state.a = pop8BitDataFromStack();
+    setNZFlags(state.a);
 }
 
 // PLP
@@ -1149,9 +1148,9 @@ void CPU::PLA(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  from stack
 void CPU::PLP(const AddressingMode::ReturnType& /*operand*/) {
-    sr.data = pop8BitDataFromStack();
-    sr.break_ = 0;
-    sr.unused = 1;
+    state.sr.data = pop8BitDataFromStack();
+    StatusRegister::Break::set(state.sr.data, 0);
+    StatusRegister::Unused::set(state.sr.data, 1);
 }
 
 // ROL
@@ -1165,16 +1164,16 @@ void CPU::ROL(const AddressingMode::ReturnType& operand) {
         uint16_t addr = getAddress(operand);
         uint8_t data = getDataRead(operand);
 
-        shift = (data << 1) | static_cast<uint8_t>(sr.carry);
+        shift = (data << 1) | StatusRegister::Carry::get(state.sr.data);
         bus.write(addr, static_cast<uint8_t>(shift));
     }
     else {
         // If there is no address to write to, then we are in accumulator addressing mode
-        shift = (a << 1) | static_cast<uint8_t>(sr.carry);
-        a = static_cast<uint8_t>(shift);
+        shift = (state.a << 1) | StatusRegister::Carry::get(state.sr.data);
+        state.a = static_cast<uint8_t>(shift);
     }
 
-    sr.carry = shift > 0xFF;
+    StatusRegister::Carry::set(state.sr.data, shift > 0xFF);
     setNZFlags(static_cast<uint8_t>(shift));
 }
 
@@ -1190,16 +1189,16 @@ void CPU::ROR(const AddressingMode::ReturnType& operand) {
         uint16_t addr = getAddress(operand);
         uint8_t data = getDataRead(operand);
 
-        shift = (sr.carry << 7) | (data >> 1);
-        sr.carry = data & 1;
+        shift = (StatusRegister::Carry::get(state.sr.data) << 7) | (data >> 1);
+        StatusRegister::Carry::set(state.sr.data, data & 1);
         bus.write(addr, shift);
     }
     else {
         // If there is no address to write to, then we are in accumulator addressing mode
-        shift = (sr.carry << 7) | (a >> 1);
-        sr.carry = a & 1;
+        shift = (StatusRegister::Carry::get(state.sr.data) << 7) | (state.a >> 1);
+        StatusRegister::Carry::set(state.sr.data, state.a & 1);
 
-        a = shift;
+        state.a = shift;
     }
 
     setNZFlags(shift);
@@ -1213,11 +1212,11 @@ void CPU::ROR(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  from stack
 void CPU::RTI(const AddressingMode::ReturnType& /*operand*/) {
-    sr.data = pop8BitDataFromStack();
-    sr.break_ = 0;
-    sr.unused = 1;
-    pc = pop16BitDataFromStack();
-    shouldAdvancePC = false;
+    state.sr.data = pop8BitDataFromStack();
+    StatusRegister::Break::set(state.sr.data, 0);
+    StatusRegister::Unused::set(state.sr.data, 1);
+    state.pc = pop16BitDataFromStack();
+    state.shouldAdvancePC = false;
 }
 
 // RTS
@@ -1226,8 +1225,8 @@ void CPU::RTI(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::RTS(const AddressingMode::ReturnType& /*operand*/) {
-    pc = pop16BitDataFromStack() + 1;
-    shouldAdvancePC = false;
+    state.pc = pop16BitDataFromStack() + 1;
+    state.shouldAdvancePC = false;
 }
 
 // SBC
@@ -1238,17 +1237,17 @@ void CPU::RTS(const AddressingMode::ReturnType& /*operand*/) {
 void CPU::SBC(const AddressingMode::ReturnType& operand) {
     // SBC becomes equivalent to ADC after we flip the bits of data
     uint8_t data = getDataRead(operand) ^ 0xFF;
-    uint16_t fullSum = a + data + sr.carry;
+    uint16_t fullSum = state.a + data + StatusRegister::Carry::get(state.sr.data);
 
-    sr.carry = fullSum > 0xFF;
+    StatusRegister::Carry::set(state.sr.data, fullSum > 0xFF);
 
     // Set the overflow flag only when the two addends have the same sign, and result has a different sign
-    uint8_t overflowCondition = ~(a ^ data) & (a ^ static_cast<uint8_t>(fullSum));
-    sr.overflow = (overflowCondition >> 7) & 1;
+    uint8_t overflowCondition = ~(state.a ^ data) & (state.a ^ static_cast<uint8_t>(fullSum));
+    StatusRegister::Overflow::set(state.sr.data, (overflowCondition >> 7) & 1);
 
     setNZFlags(static_cast<uint8_t>(fullSum));
 
-    a = static_cast<uint8_t>(fullSum);
+    state.a = static_cast<uint8_t>(fullSum);
 }
 
 // SEC
@@ -1257,7 +1256,7 @@ void CPU::SBC(const AddressingMode::ReturnType& operand) {
 // N	Z	C	I	D	V
 // -	-	1	-	-	-
 void CPU::SEC(const AddressingMode::ReturnType& /*operand*/) {
-    sr.carry = 1;
+    StatusRegister::Carry::set(state.sr.data, 1);
 }
 
 // SED
@@ -1266,7 +1265,7 @@ void CPU::SEC(const AddressingMode::ReturnType& /*operand*/) {
 // N	Z	C	I	D	V
 // -	-	-	-	1	-
 void CPU::SED(const AddressingMode::ReturnType& /*operand*/) {
-    sr.decimal = 1;
+    StatusRegister::Decimal::set(state.sr.data, 1);
 }
 
 // SEI
@@ -1275,7 +1274,7 @@ void CPU::SED(const AddressingMode::ReturnType& /*operand*/) {
 // N	Z	C	I	D	V
 // -	-	-	1	-	-
 void CPU::SEI(const AddressingMode::ReturnType& /*operand*/) {
-    sr.interrupt = 1;
+    StatusRegister::Interrupt::set(state.sr.data, 1);
 }
 
 // STA
@@ -1285,7 +1284,7 @@ void CPU::SEI(const AddressingMode::ReturnType& /*operand*/) {
 //  -	-	-	-	-	-
 void CPU::STA(const AddressingMode::ReturnType& operand) {
     uint16_t addr = getAddress(operand);
-    bus.write(addr, a);
+    bus.write(addr, state.a);
 }
 
 // STX
@@ -1295,7 +1294,7 @@ void CPU::STA(const AddressingMode::ReturnType& operand) {
 //  -	-	-	-	-	-
 void CPU::STX(const AddressingMode::ReturnType& operand) {
     uint16_t addr = getAddress(operand);
-    bus.write(addr, x);
+    bus.write(addr, state.x);
 }
 
 // STY
@@ -1305,7 +1304,7 @@ void CPU::STX(const AddressingMode::ReturnType& operand) {
 //  -	-	-	-	-	-
 void CPU::STY(const AddressingMode::ReturnType& operand) {
     uint16_t addr = getAddress(operand);
-    bus.write(addr, y);
+    bus.write(addr, state.y);
 }
 
 // TAX
@@ -1314,8 +1313,8 @@ void CPU::STY(const AddressingMode::ReturnType& operand) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::TAX(const AddressingMode::ReturnType& /*operand*/) {
-    x = a;
-    setNZFlags(x);
+    state.x = state.a;
+    setNZFlags(state.x);
 }
 
 // TAY
@@ -1324,8 +1323,8 @@ void CPU::TAX(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::TAY(const AddressingMode::ReturnType& /*operand*/) {
-    y = a;
-    setNZFlags(y);
+    state.y = state.a;
+    setNZFlags(state.y);
 }
 
 // TSX
@@ -1334,8 +1333,8 @@ void CPU::TAY(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::TSX(const AddressingMode::ReturnType& /*operand*/) {
-    x = sp;
-    setNZFlags(x);
+    state.x = state.sp;
+    setNZFlags(state.x);
 }
 
 // TXA
@@ -1344,8 +1343,8 @@ void CPU::TSX(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  +	+	-	-	-	-
 void CPU::TXA(const AddressingMode::ReturnType& /*operand*/) {
-    a = x;
-    setNZFlags(a);
+    state.a = state.x;
+    setNZFlags(state.a);
 }
 
 // TXS
@@ -1354,7 +1353,7 @@ void CPU::TXA(const AddressingMode::ReturnType& /*operand*/) {
 //  N	Z	C	I	D	V
 //  -	-	-	-	-	-
 void CPU::TXS(const AddressingMode::ReturnType& /*operand*/) {
-    sp = x;
+    state.sp = state.x;
 }
 
 // TYA
@@ -1363,8 +1362,8 @@ void CPU::TXS(const AddressingMode::ReturnType& /*operand*/) {
 // N	Z	C	I	D	V
 // +	+	-	-	-	-
 void CPU::TYA(const AddressingMode::ReturnType& /*operand*/) {
-    a = y;
-    setNZFlags(a);
+    state.a = state.y;
+    setNZFlags(state.a);
 }
 
 // UNI
@@ -1428,23 +1427,9 @@ const CPU::Opcode& CPU::getOpcode(uint16_t address) const {
 }
 
 void CPU::serialize(Serializer& s) const {
-    s.serializeUInt16(pc);
-    s.serializeUInt8(a);
-    s.serializeUInt8(x);
-    s.serializeUInt8(y);
-    s.serializeUInt8(sr.data);
-    s.serializeUInt8(sp);
-    s.serializeUInt8(remainingCycles);
-    s.serializeBool(shouldAdvancePC);
+    Schema::serialize(s, state);
 }
 
 void CPU::deserialize(Deserializer& d) {
-    d.deserializeUInt16(pc);
-    d.deserializeUInt8(a);
-    d.deserializeUInt8(x);
-    d.deserializeUInt8(y);
-    d.deserializeUInt8(sr.data);
-    d.deserializeUInt8(sp);
-    d.deserializeUInt8(remainingCycles);
-    d.deserializeBool(shouldAdvancePC);
+    Schema::deserialize(d, state);
 }
\ No newline at end of file
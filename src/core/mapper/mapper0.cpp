@@ -1,9 +1,9 @@
 #include "core/mapper/mapper0.hpp"
 
-Mapper0::Mapper0(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam),
-    chrRam(config.chrChunks == 0) {
+Mapper0::Mapper0(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker),
+    chrRam(config.chrChunks == 0, state.chrRam, writeTracker) {
 }
 
 void Mapper0::reset() {
@@ -40,15 +40,15 @@ void Mapper0::mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
 }
 
 void Mapper0::serialize(Serializer& s) const {
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    prgRam.serialize(s);
     if (chrRam.isEnabled) {
-        s.serializeVector(chrRam.data, s.uInt8Func);
+        chrRam.serialize(s);
     }
 }
 
 void Mapper0::deserialize(Deserializer& d) {
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    prgRam.deserialize(d);
     if (chrRam.isEnabled) {
-        d.deserializeVector(chrRam.data, d.uInt8Func);
+        chrRam.deserialize(d);
     }
 }
\ No newline at end of file
@@ -2,21 +2,22 @@
 
 #include "core/cartridge.hpp"
 
-Mapper2::Mapper2(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam),
-    chrRam(config.chrChunks == 0) {
+Mapper2::Mapper2(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker),
+    chrRam(config.chrChunks == 0, state.chrRam, writeTracker) {
 
     reset();
 }
 
 void Mapper2::reset() {
-    currentBank = 0;
+    registers.currentBank = 0;
 }
 
 uint8_t Mapper2::mapPRGView(uint16_t cpuAddress) const {
     if (PRG_RANGE_SWICHABLE.contains(cpuAddress)) {
-        uint32_t mappedAddress = PRG_ROM_CHUNK_SIZE * currentBank + (cpuAddress & MASK<PRG_ROM_CHUNK_SIZE>());
+        uint32_t mappedAddress = PRG_ROM_CHUNK_SIZE * registers.currentBank + (cpuAddress & MASK<PRG_ROM_CHUNK_SIZE>());
         return prg[mappedAddress];
     }
     else if (PRG_RANGE_FIXED.contains(cpuAddress)) {
@@ -30,7 +31,7 @@ uint8_t Mapper2::mapPRGView(uint16_t cpuAddress) const {
 
 void Mapper2::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (BANK_SELECT_RANGE.contains(cpuAddress)) {
-        currentBank = value & 0x7;
+        registers.currentBank = value & 0x7;
     }
     else {
         prgRam.tryWrite(cpuAddress, value);
@@ -46,17 +47,25 @@ void Mapper2::mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
 }
 
 void Mapper2::serialize(Serializer& s) const {
-    s.serializeUInt8(currentBank);
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
     if (chrRam.isEnabled) {
-        s.serializeVector(chrRam.data, s.uInt8Func);
+        chrRam.serialize(s);
     }
 }
 
 void Mapper2::deserialize(Deserializer& d) {
-    d.deserializeUInt8(currentBank);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
     if (chrRam.isEnabled) {
-        d.deserializeVector(chrRam.data, d.uInt8Func);
+        chrRam.deserialize(d);
     }
+}
+
+void Mapper2::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper2&>(other).registers, onDifference);
+}
+
+void Mapper2::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
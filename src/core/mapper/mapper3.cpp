@@ -2,15 +2,16 @@
 
 #include "core/cartridge.hpp"
 
-Mapper3::Mapper3(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam) {
+Mapper3::Mapper3(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker) {
 
     reset();
 }
 
 void Mapper3::reset() {
-    currentBank = 0;
+    registers.currentBank = 0;
 }
 
 uint8_t Mapper3::mapPRGView(uint16_t cpuAddress) const {
@@ -32,7 +33,7 @@ uint8_t Mapper3::mapPRGView(uint16_t cpuAddress) const {
 
 void Mapper3::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (BANK_SELECT_RANGE.contains(cpuAddress)) {
-        currentBank = value;
+        registers.currentBank = value;
     }
     else {
         prgRam.tryWrite(cpuAddress, value);
@@ -41,7 +42,7 @@ void Mapper3::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
 
 uint8_t Mapper3::mapCHRView(uint16_t ppuAddress) const {
     if (CHR_RANGE.contains(ppuAddress)) {
-        return chr[CHR_ROM_CHUNK_SIZE * currentBank + ppuAddress];
+        return chr[CHR_ROM_CHUNK_SIZE * registers.currentBank + ppuAddress];
     }
 
     return 0;
@@ -52,11 +53,19 @@ void Mapper3::mapCHRWrite(uint16_t /*ppuAddress*/, uint8_t /*value*/) {
 }
 
 void Mapper3::serialize(Serializer& s) const {
-    s.serializeUInt8(currentBank);
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
 }
 
 void Mapper3::deserialize(Deserializer& d) {
-    d.deserializeUInt8(currentBank);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
+}
+
+void Mapper3::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper3&>(other).registers, onDifference);
+}
+
+void Mapper3::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
@@ -1,28 +1,31 @@
 #include "core/mapper/mapper4.hpp"
 
-Mapper4::Mapper4(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(true) { // Mapper 4 has PRG RAM by default
+#include <algorithm>
+
+Mapper4::Mapper4(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(true, state.prgRam, writeTracker) { // Mapper 4 has PRG RAM by default
 
     reset();
 }
 
 void Mapper4::reset() {
-    bankSelect = 0;
-    bankData = 0;
-    mirroring = (config.initialMirrorMode == MirrorMode::HORIZONTAL);
-    prgRamProtect = 0;
-    irqReloadValue = 0;
-    irqTimer = 0;
-    irqEnabled = 0;
-    irqReloadPending = 0;
-    irqRequest = 0;
-
-    prgSwitchableBankSelect = {};
-    chrSwitchableBankSelect = {};
+    registers.bankSelect = 0;
+    registers.bankData = 0;
+    registers.mirroring = (config.initialMirrorMode == MirrorMode::HORIZONTAL);
+    registers.prgRamProtect = 0;
+    registers.irqReloadValue = 0;
+    registers.irqTimer = 0;
+    registers.irqEnabled = 0;
+    registers.irqReloadPending = 0;
+    registers.irqRequest = 0;
+
+    registers.prgSwitchableBankSelect = {};
+    registers.chrSwitchableBankSelect = {};
 
     if (config.alternativeNametableLayout) {
-        customNametable.assign(4 * KB, 0);
+        state.nametableRam.fill(0);
     }
 
     if (!config.hasBatteryBackedPrgRam) {
@@ -30,34 +33,60 @@ void Mapper4::reset() {
     }
 }
 
-void Mapper4::clockIRQTimer() {
-    if (irqTimer == 0 || irqReloadPending) {
-        irqTimer = irqReloadValue;
-        irqReloadPending = false;
+void Mapper4::clockIRQTimer(uint64_t clocks) {
+    // Steps straight from one reload to the next instead of clocking the counter one scanline at a time
+    while (clocks > 0) {
+        if (registers.irqTimer == 0 || registers.irqReloadPending) {
+            registers.irqTimer = registers.irqReloadValue;
+            registers.irqReloadPending = false;
+            clocks--;
+        }
+        else {
+            uint8_t steps = static_cast<uint8_t>(std::min<uint64_t>(clocks, registers.irqTimer));
+            registers.irqTimer -= steps;
+            clocks -= steps;
+        }
+
+        // The IRQ stays asserted until it is acknowledged by writing to $E000
+        if (registers.irqTimer == 0) {
+            registers.irqRequest |= registers.irqEnabled;
+
+            // With a reload value of 0 the counter stays at 0, so the remaining clocks change nothing
+            if (registers.irqReloadValue == 0) {
+                break;
+            }
+        }
+    }
+}
+
+uint32_t Mapper4::clocksUntilIRQ() const {
+    if (!registers.irqEnabled) {
+        return 0;
+    }
+    else if (registers.irqTimer == 0 || registers.irqReloadPending) {
+        return registers.irqReloadValue + 1;
     }
     else {
-        irqTimer--;
+        return registers.irqTimer;
     }
-
-    irqRequest = irqEnabled && (irqTimer == 0);
 }
 
 bool Mapper4::irqRequested() const {
-    return irqRequest;
+    return registers.irqRequest;
 }
 
 uint8_t Mapper4::mapPRGView(uint16_t cpuAddress) const {
-    bool prgRomBankMode = (bankSelect >> 6) & 1;
+    bool prgRomBankMode = (registers.bankSelect >> 6) & 1;
     uint16_t addressMask8KB = cpuAddress & MASK<8 * KB>();
     uint16_t prgChunks8KB = config.prgChunks << 1;
 
     if (PRG_RANGE.contains(cpuAddress)) {
         uint32_t mappedAddress;
         if (PRG_ROM_8KB_SWITCHABLE_1[prgRomBankMode].contains(cpuAddress)) {
-            mappedAddress = (8 * KB) * prgSwitchableBankSelect[0] + addressMask8KB;
+            mappedAddress = (8 * KB) * registers.prgSwitchableBankSelect[0] + addressMask8KB;
         }
         else if (PRG_ROM_8KB_SWITCHABLE_2.contains(cpuAddress)) {
-            mappedAddress = (8 * KB) * prgSwitchableBankSelect[1] + addressMask8KB;
+            mappedAddress = (8 * KB) * registers.prgSwitchableBankSelect[1] + addressMask8KB;
         }
         else if (PRG_ROM_8KB_FIXED_1[prgRomBankMode].contains(cpuAddress)) {
             mappedAddress = (8 * KB) * (prgChunks8KB - 2) + addressMask8KB;
@@ -78,43 +107,43 @@ uint8_t Mapper4::mapPRGView(uint16_t cpuAddress) const {
 void Mapper4::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (BANK_SELECT_OR_BANK_DATA.contains(cpuAddress)) {
         if ((cpuAddress & 1) == 0) {
-            bankSelect = value;
+            registers.bankSelect = value;
         }
         else {
-            uint8_t bankRegister = bankSelect & 0x7;
+            uint8_t bankRegister = registers.bankSelect & 0x7;
 
             if (/*bankRegister >= 0 &&*/ bankRegister < 6) {
-                chrSwitchableBankSelect[bankRegister] = value;
+                registers.chrSwitchableBankSelect[bankRegister] = value;
             }
             else { // if(bankRegister >= 6 && bankRegister <= 7) {
-                prgSwitchableBankSelect[bankRegister & 1] = value & 0x3F;
+                registers.prgSwitchableBankSelect[bankRegister & 1] = value & 0x3F;
             }
         }
     }
     else if (MIRRORING_OR_PRG_RAM_PROTECT.contains(cpuAddress)) {
         if ((cpuAddress & 1) == 0) {
-            mirroring = value & 1;
+            registers.mirroring = value & 1;
         }
         else {
-            prgRamProtect = value;
+            registers.prgRamProtect = value;
         }
     }
     else if (IRQ_LATCH_OR_IRQ_RELOAD.contains(cpuAddress)) {
         if ((cpuAddress & 1) == 0) {
-            irqReloadValue = value;
+            registers.irqReloadValue = value;
         }
         else {
-            irqTimer = 0;
-            irqReloadPending = true;
+            registers.irqTimer = 0;
+            registers.irqReloadPending = true;
         }
     }
     else if (IRQ_DISABLE_OR_IRQ_ENABLE.contains(cpuAddress)) {
         if ((cpuAddress & 1) == 0) {
-            irqEnabled = false;
-            irqRequest = false;
+            registers.irqEnabled = false;
+            registers.irqRequest = false;
         }
         else {
-            irqEnabled = true;
+            registers.irqEnabled = true;
         }
     }
     else if (canWriteToPRGRam()) {
@@ -123,35 +152,35 @@ void Mapper4::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
 }
 
 uint8_t Mapper4::mapCHRView(uint16_t ppuAddress) const {
-    bool chrRomBankMode = (bankSelect >> 7) & 1;
+    bool chrRomBankMode = (registers.bankSelect >> 7) & 1;
     uint16_t addressMask2KB = ppuAddress & MASK<2 * KB>();
     uint16_t addressMaskKB = ppuAddress & MASK<KB>();
 
     if (CHR_RANGE.contains(ppuAddress)) {
         uint32_t mappedAddress;
         if (CHR_ROM_2KB_SWITCHABLE_1[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = (2 * KB) * (chrSwitchableBankSelect[0] >> 1) + addressMask2KB;
+            mappedAddress = (2 * KB) * (registers.chrSwitchableBankSelect[0] >> 1) + addressMask2KB;
         }
         else if (CHR_ROM_2KB_SWITCHABLE_2[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = (2 * KB) * (chrSwitchableBankSelect[1] >> 1) + addressMask2KB;
+            mappedAddress = (2 * KB) * (registers.chrSwitchableBankSelect[1] >> 1) + addressMask2KB;
         }
         else if (CHR_ROM_1KB_SWITCHABLE_1[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = KB * chrSwitchableBankSelect[2] + addressMaskKB;
+            mappedAddress = KB * registers.chrSwitchableBankSelect[2] + addressMaskKB;
         }
         else if (CHR_ROM_1KB_SWITCHABLE_2[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = KB * chrSwitchableBankSelect[3] + addressMaskKB;
+            mappedAddress = KB * registers.chrSwitchableBankSelect[3] + addressMaskKB;
         }
         else if (CHR_ROM_1KB_SWITCHABLE_3[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = KB * chrSwitchableBankSelect[4] + addressMaskKB;
+            mappedAddress = KB * registers.chrSwitchableBankSelect[4] + addressMaskKB;
         }
         else { // if (CHR_ROM_1KB_SWITCHABLE_4[chrRomBankMode].contains(ppuAddress)) {
-            mappedAddress = KB * chrSwitchableBankSelect[5] + addressMaskKB;
+            mappedAddress = KB * registers.chrSwitchableBankSelect[5] + addressMaskKB;
         }
         return chr[mappedAddress];
     }
     else if (config.alternativeNametableLayout) {
         if (ALTERNATIVE_NAMETABLE_RANGE.contains(ppuAddress)) {
-            return customNametable[ppuAddress & MASK<4 * KB>()];
+            return state.nametableRam[ppuAddress & MASK<4 * KB>()];
         }
     }
 
@@ -161,7 +190,9 @@ uint8_t Mapper4::mapCHRView(uint16_t ppuAddress) const {
 void Mapper4::mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
     if (config.alternativeNametableLayout) {
         if (ALTERNATIVE_NAMETABLE_RANGE.contains(ppuAddress)) {
-            customNametable[ppuAddress & MASK<4 * KB>()] = value;
+            uint8_t& byte = state.nametableRam[ppuAddress & MASK<4 * KB>()];
+            byte = value;
+            writeTracker.markWritten(&byte);
         }
     }
 }
@@ -171,48 +202,36 @@ Mapper::MirrorMode Mapper4::getMirrorMode() const {
         return MirrorMode::FOUR_SCREEN;
     }
     else {
-        return mirroring ? MirrorMode::HORIZONTAL : MirrorMode::VERTICAL;
+        return registers.mirroring ? MirrorMode::HORIZONTAL : MirrorMode::VERTICAL;
     }
 }
 
 bool Mapper4::canReadFromPRGRam() const {
-    bool prgRamChipEnable = (prgRamProtect >> 7) & 1;
+    bool prgRamChipEnable = (registers.prgRamProtect >> 7) & 1;
     return prgRamChipEnable;
 }
 
 bool Mapper4::canWriteToPRGRam() const {
-    bool writeProtection = (prgRamProtect >> 6) & 1;
+    bool writeProtection = (registers.prgRamProtect >> 6) & 1;
     return canReadFromPRGRam() && !writeProtection;
 }
 
 void Mapper4::serialize(Serializer& s) const {
-    s.serializeUInt8(bankSelect);
-    s.serializeUInt8(bankData);
-    s.serializeBool(mirroring);
-    s.serializeUInt8(prgRamProtect);
-    s.serializeUInt8(irqReloadValue);
-    s.serializeUInt8(irqTimer);
-    s.serializeBool(irqEnabled);
-    s.serializeBool(irqReloadPending);
-    s.serializeBool(irqRequest);
-    s.serializeArray(prgSwitchableBankSelect, s.uInt8Func);
-    s.serializeArray(chrSwitchableBankSelect, s.uInt8Func);
-    s.serializeVector(prgRam.data, s.uInt8Func);
-    s.serializeVector(customNametable, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
+    s.serializePartialArray(state.nametableRam, config.alternativeNametableLayout ? state.nametableRam.size() : 0);
 }
 
 void Mapper4::deserialize(Deserializer& d) {
-    d.deserializeUInt8(bankSelect);
-    d.deserializeUInt8(bankData);
-    d.deserializeBool(mirroring);
-    d.deserializeUInt8(prgRamProtect);
-    d.deserializeUInt8(irqReloadValue);
-    d.deserializeUInt8(irqTimer);
-    d.deserializeBool(irqEnabled);
-    d.deserializeBool(irqReloadPending);
-    d.deserializeBool(irqRequest);
-    d.deserializeArray(prgSwitchableBankSelect, d.uInt8Func);
-    d.deserializeArray(chrSwitchableBankSelect, d.uInt8Func);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
-    d.deserializeVector(customNametable, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
+    d.deserializePartialArray(state.nametableRam);
+}
+
+void Mapper4::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper4&>(other).registers, onDifference);
+}
+
+void Mapper4::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
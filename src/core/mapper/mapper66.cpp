@@ -2,21 +2,22 @@
 
 #include "core/cartridge.hpp"
 
-Mapper66::Mapper66(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam) {
+Mapper66::Mapper66(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker) {
 
     reset();
 }
 
 void Mapper66::reset() {
-    currentPRGBank = 0;
-    currentCHRBank = 0;
+    registers.currentPRGBank = 0;
+    registers.currentCHRBank = 0;
 }
 
 uint8_t Mapper66::mapPRGView(uint16_t cpuAddress) const {
     if (PRG_RANGE.contains(cpuAddress)) {
-        uint32_t mappedAddress = (PRG_ROM_CHUNK_SIZE << 1) * currentPRGBank + (cpuAddress & MASK<32 * KB>());
+        uint32_t mappedAddress = (PRG_ROM_CHUNK_SIZE << 1) * registers.currentPRGBank + (cpuAddress & MASK<32 * KB>());
         return prg[mappedAddress];
     }
     else {
@@ -26,8 +27,8 @@ uint8_t Mapper66::mapPRGView(uint16_t cpuAddress) const {
 
 void Mapper66::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (BANK_SELECT_RANGE.contains(cpuAddress)) {
-        currentCHRBank = value & 0x3;
-        currentPRGBank = (value >> 4) & 0x3;
+        registers.currentCHRBank = value & 0x3;
+        registers.currentPRGBank = (value >> 4) & 0x3;
     }
     else {
         prgRam.tryWrite(cpuAddress, value);
@@ -36,7 +37,7 @@ void Mapper66::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
 
 uint8_t Mapper66::mapCHRView(uint16_t ppuAddress) const {
     if (CHR_RANGE.contains(ppuAddress)) {
-        uint32_t mappedAddress = CHR_ROM_CHUNK_SIZE * currentCHRBank + (ppuAddress & MASK<8 * KB>());
+        uint32_t mappedAddress = CHR_ROM_CHUNK_SIZE * registers.currentCHRBank + (ppuAddress & MASK<8 * KB>());
         return chr[mappedAddress];
     }
 
@@ -48,12 +49,18 @@ void Mapper66::mapCHRWrite(uint16_t /*ppuAddress*/, uint8_t /*value*/) {
 }
 
 void Mapper66::serialize(Serializer& s) const {
-    s.serializeUInt8(currentPRGBank);
-    s.serializeUInt8(currentCHRBank);
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
 }
 void Mapper66::deserialize(Deserializer& d) {
-    d.deserializeUInt8(currentPRGBank);
-    d.deserializeUInt8(currentCHRBank);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
+}
+
+void Mapper66::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper66&>(other).registers, onDifference);
+}
+
+void Mapper66::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
@@ -1,20 +1,21 @@
 #include "core/mapper/mapper7.hpp"
 
-Mapper7::Mapper7(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam),
-    chrRam(config.chrChunks == 0) {
+Mapper7::Mapper7(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker),
+    chrRam(config.chrChunks == 0, state.chrRam, writeTracker) {
 
     reset();
 }
 
 void Mapper7::reset() {
-    bankSelect = 0;
+    registers.bankSelect = 0;
 }
 
 uint8_t Mapper7::mapPRGView(uint16_t cpuAddress) const {
     if (PRG_RANGE.contains(cpuAddress)) {
-        uint8_t currentBank = bankSelect & 0x7;
+        uint8_t currentBank = registers.bankSelect & 0x7;
         uint32_t mappedAddress = (PRG_ROM_CHUNK_SIZE << 1) * currentBank + (cpuAddress & MASK<32 * KB>());
         return prg[mappedAddress];
     }
@@ -25,7 +26,7 @@ uint8_t Mapper7::mapPRGView(uint16_t cpuAddress) const {
 
 void Mapper7::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (PRG_RANGE.contains(cpuAddress)) {
-        bankSelect = value;
+        registers.bankSelect = value;
     }
     else {
         prgRam.tryWrite(cpuAddress, value);
@@ -41,22 +42,30 @@ void Mapper7::mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
 }
 
 Mapper::MirrorMode Mapper7::getMirrorMode() const {
-    bool mirrorMode = (bankSelect >> 4) & 1;
+    bool mirrorMode = (registers.bankSelect >> 4) & 1;
     return mirrorMode ? MirrorMode::ONE_SCREEN_UPPER_BANK : MirrorMode::ONE_SCREEN_LOWER_BANK;
 }
 
 void Mapper7::serialize(Serializer& s) const {
-    s.serializeUInt8(bankSelect);
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
     if (chrRam.isEnabled) {
-        s.serializeVector(chrRam.data, s.uInt8Func);
+        chrRam.serialize(s);
     }
 }
 
 void Mapper7::deserialize(Deserializer& d) {
-    d.deserializeUInt8(bankSelect);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
     if (chrRam.isEnabled) {
-        d.deserializeVector(chrRam.data, d.uInt8Func);
+        chrRam.deserialize(d);
     }
+}
+
+void Mapper7::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper7&>(other).registers, onDifference);
+}
+
+void Mapper7::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
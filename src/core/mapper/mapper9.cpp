@@ -1,27 +1,28 @@
 #include "core/mapper/mapper9.hpp"
 
-Mapper9::Mapper9(const Config& config, const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr) :
-    Mapper(config, prg, chr),
-    prgRam(config.hasBatteryBackedPrgRam) {
+Mapper9::Mapper9(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker) :
+    Mapper(config, prg, chr, state, writeTracker),
+    registers(createRegisters<Registers>()),
+    prgRam(config.hasBatteryBackedPrgRam, state.prgRam, writeTracker) {
 
     reset();
 }
 
 void Mapper9::reset() {
-    prgBankSelect = 0;
-    chrLatch1 = 0;
-    chrLatch2 = 0;
-    chrBank1Select = {};
-    chrBank2Select = {};
+    registers.prgBankSelect = 0;
+    registers.chrLatch1 = 0;
+    registers.chrLatch2 = 0;
+    registers.chrBank1Select = {};
+    registers.chrBank2Select = {};
 
-    mirroring = (config.initialMirrorMode == MirrorMode::HORIZONTAL);
+    registers.mirroring = (config.initialMirrorMode == MirrorMode::HORIZONTAL);
 }
 
 uint8_t Mapper9::mapPRGView(uint16_t cpuAddress) const {
     if (PRG_RANGE.contains(cpuAddress)) {
         uint32_t mappedAddress;
         if (PRG_ROM_SWITCHABLE.contains(cpuAddress)) {
-            mappedAddress = (8 * KB) * prgBankSelect + (cpuAddress & MASK<8 * KB>());
+            mappedAddress = (8 * KB) * registers.prgBankSelect + (cpuAddress & MASK<8 * KB>());
         }
         else { // if (PRG_ROM_FIXED.contains(cpuAddress)) {
             // 3 8KB chunks fixed to the last 3 banks
@@ -37,22 +38,22 @@ uint8_t Mapper9::mapPRGView(uint16_t cpuAddress) const {
 
 void Mapper9::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
     if (PRG_ROM_BANK_SELECT.contains(cpuAddress)) {
-        prgBankSelect = value & 0xF;
+        registers.prgBankSelect = value & 0xF;
     }
     else if (CHR_ROM_BANK_1_SELECT_OPTION_1.contains(cpuAddress)) {
-        chrBank1Select[0] = value & 0x1F;
+        registers.chrBank1Select[0] = value & 0x1F;
     }
     else if (CHR_ROM_BANK_1_SELECT_OPTION_2.contains(cpuAddress)) {
-        chrBank1Select[1] = value & 0x1F;
+        registers.chrBank1Select[1] = value & 0x1F;
     }
     else if (CHR_ROM_BANK_2_SELECT_OPTION_1.contains(cpuAddress)) {
-        chrBank2Select[0] = value & 0x1F;
+        registers.chrBank2Select[0] = value & 0x1F;
     }
     else if (CHR_ROM_BANK_2_SELECT_OPTION_2.contains(cpuAddress)) {
-        chrBank2Select[1] = value & 0x1F;
+        registers.chrBank2Select[1] = value & 0x1F;
     }
     else if (MIRRORING.contains(cpuAddress)) {
-        mirroring = value & 0x1;
+        registers.mirroring = value & 0x1;
     }
     else {
         prgRam.tryWrite(cpuAddress, value);
@@ -63,10 +64,10 @@ uint8_t Mapper9::mapCHRView(uint16_t ppuAddress) const {
     if (CHR_RANGE.contains(ppuAddress)) {
         uint32_t mappedAddress;
         if (CHR_ROM_SWITCHABLE_1.contains(ppuAddress)) {
-            mappedAddress = (4 * KB) * chrBank1Select[chrLatch1] + (ppuAddress & MASK<4 * KB>());
+            mappedAddress = (4 * KB) * registers.chrBank1Select[registers.chrLatch1] + (ppuAddress & MASK<4 * KB>());
         }
         else { // if (CHR_ROM_SWITCHABLE_2.contains(ppuAddress)) {
-            mappedAddress = (4 * KB) * chrBank2Select[chrLatch2] + (ppuAddress & MASK<4 * KB>());
+            mappedAddress = (4 * KB) * registers.chrBank2Select[registers.chrLatch2] + (ppuAddress & MASK<4 * KB>());
         }
         return chr[mappedAddress];
     }
@@ -78,23 +79,23 @@ uint8_t Mapper9::mapCHRRead(uint16_t ppuAddress) {
     if (CHR_RANGE.contains(ppuAddress)) {
         uint32_t mappedAddress;
         if (CHR_ROM_SWITCHABLE_1.contains(ppuAddress)) {
-            mappedAddress = (4 * KB) * chrBank1Select[chrLatch1] + (ppuAddress & MASK<4 * KB>());
+            mappedAddress = (4 * KB) * registers.chrBank1Select[registers.chrLatch1] + (ppuAddress & MASK<4 * KB>());
         }
         else { // if (CHR_ROM_SWITCHABLE_2.contains(ppuAddress)) {
-            mappedAddress = (4 * KB) * chrBank2Select[chrLatch2] + (ppuAddress & MASK<4 * KB>());
+            mappedAddress = (4 * KB) * registers.chrBank2Select[registers.chrLatch2] + (ppuAddress & MASK<4 * KB>());
         }
 
         if (ppuAddress == LATCH_1_DISABLE) {
-            chrLatch1 = false;
+            registers.chrLatch1 = false;
         }
         else if (ppuAddress == LATCH_1_ENABLE) {
-            chrLatch1 = true;
+            registers.chrLatch1 = true;
         }
         else if (LATCH_2_DISABLE.contains(ppuAddress)) {
-            chrLatch2 = false;
+            registers.chrLatch2 = false;
         }
         else if (LATCH_2_ENABLE.contains(ppuAddress)) {
-            chrLatch2 = true;
+            registers.chrLatch2 = true;
         }
 
         return chr[mappedAddress];
@@ -108,25 +109,23 @@ void Mapper9::mapCHRWrite(uint16_t /*ppuAddress*/, uint8_t /*value*/) {
 }
 
 Mapper::MirrorMode Mapper9::getMirrorMode() const {
-    return mirroring ? MirrorMode::HORIZONTAL : MirrorMode::VERTICAL;
+    return registers.mirroring ? MirrorMode::HORIZONTAL : MirrorMode::VERTICAL;
 }
 
 void Mapper9::serialize(Serializer& s) const {
-    s.serializeUInt8(prgBankSelect);
-    s.serializeBool(chrLatch1);
-    s.serializeBool(chrLatch2);
-    s.serializeArray(chrBank1Select, s.uInt8Func);
-    s.serializeArray(chrBank2Select, s.uInt8Func);
-    s.serializeBool(mirroring);
-    s.serializeVector(prgRam.data, s.uInt8Func);
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
 }
 
 void Mapper9::deserialize(Deserializer& d) {
-    d.deserializeUInt8(prgBankSelect);
-    d.deserializeBool(chrLatch1);
-    d.deserializeBool(chrLatch2);
-    d.deserializeArray(chrBank1Select, d.uInt8Func);
-    d.deserializeArray(chrBank2Select, d.uInt8Func);
-    d.deserializeBool(mirroring);
-    d.deserializeVector(prgRam.data, d.uInt8Func);
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
+}
+
+void Mapper9::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const Mapper9&>(other).registers, onDifference);
+}
+
+void Mapper9::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
 }
\ No newline at end of file
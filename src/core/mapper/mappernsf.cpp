@@ -0,0 +1,82 @@
+#include "core/mapper/mappernsf.hpp"
+
+#include "core/cartridge.hpp"
+
+MapperNSF::MapperNSF(const Config& config, ByteView prg, ByteView chr, State& state, WriteTracker& writeTracker, const Header& header) :
+    Mapper(config, prg, chr, state, writeTracker),
+    header(header),
+    padding(header.isBankswitched ? (header.loadAddress & MASK<BANK_SIZE>()) : (header.loadAddress - PRG_RANGE.lo)),
+    registers(createRegisters<Registers>()),
+    prgRam(true, state.prgRam, writeTracker),
+    chrRam(true, state.chrRam, writeTracker) {
+
+    reset();
+}
+
+void MapperNSF::reset() {
+    if (header.isBankswitched) {
+        registers.banks = header.initialBanks;
+    }
+    else {
+        // Without bankswitching the data is laid out flat from $8000
+        for (uint8_t i = 0; i < registers.banks.size(); i++) {
+            registers.banks[i] = i;
+        }
+    }
+}
+
+uint8_t MapperNSF::mapPRGView(uint16_t cpuAddress) const {
+    if (PRG_RANGE.contains(cpuAddress)) {
+        uint8_t bank = registers.banks[(cpuAddress >> 12) & 0x7];
+        uint32_t mappedAddress = BANK_SIZE * bank + (cpuAddress & MASK<BANK_SIZE>());
+        if (mappedAddress < padding || mappedAddress - padding >= prg.size) {
+            return 0;
+        }
+        return prg[mappedAddress - padding];
+    }
+    else if (IDLE_LOOP_RANGE.contains(cpuAddress)) {
+        // JMP IDLE_LOOP_ADDRESS
+        static constexpr std::array<uint8_t, 3> idleLoop = { 0x4C, IDLE_LOOP_ADDRESS & 0xFF, IDLE_LOOP_ADDRESS >> 8 };
+        return idleLoop[cpuAddress - IDLE_LOOP_RANGE.lo];
+    }
+    else {
+        return prgRam.tryRead(cpuAddress).value_or(0);
+    }
+}
+
+void MapperNSF::mapPRGWrite(uint16_t cpuAddress, uint8_t value) {
+    if (BANK_SELECT_RANGE.contains(cpuAddress)) {
+        registers.banks[cpuAddress - BANK_SELECT_RANGE.lo] = value;
+    }
+    else {
+        prgRam.tryWrite(cpuAddress, value);
+    }
+}
+
+uint8_t MapperNSF::mapCHRView(uint16_t ppuAddress) const {
+    return readChrRomOrRam(ppuAddress, chr, chrRam);
+}
+
+void MapperNSF::mapCHRWrite(uint16_t ppuAddress, uint8_t value) {
+    chrRam.tryWrite(ppuAddress, value);
+}
+
+void MapperNSF::serialize(Serializer& s) const {
+    Schema::serialize(s, registers);
+    prgRam.serialize(s);
+    chrRam.serialize(s);
+}
+
+void MapperNSF::deserialize(Deserializer& d) {
+    Schema::deserialize(d, registers);
+    prgRam.deserialize(d);
+    chrRam.deserialize(d);
+}
+
+void MapperNSF::diffRegisters(const Mapper& other, const OnDifference& onDifference) const {
+    Schema::diff(registers, static_cast<const MapperNSF&>(other).registers, onDifference);
+}
+
+void MapperNSF::hashRegisters(StateHash& h) const {
+    Schema::hash(h, registers);
+}
@@ -0,0 +1,91 @@
+#include "core/nsfplayer.hpp"
+
+NsfPlayer::NsfPlayer(Bus& bus) :
+    bus(bus),
+    header(*bus.cartridge.getNsfHeader()),
+    currentSong(0),
+    playTimer(0),
+    playPending(false) {
+
+    uint16_t playSpeed = header.playSpeedNtsc != 0 ? header.playSpeedNtsc : DEFAULT_PLAY_SPEED;
+    playPeriod = playSpeed * CPU_CLOCK_RATE;
+
+    // The starting song is 1-based in the header
+    bool isStartingSongValid = header.startingSong >= 1 && header.startingSong <= getSongCount();
+    startSong(isStartingSongValid ? header.startingSong - 1 : 0);
+}
+
+uint8_t NsfPlayer::getSongCount() const {
+    return header.songCount != 0 ? header.songCount : 1;
+}
+
+uint8_t NsfPlayer::getCurrentSong() const {
+    return currentSong;
+}
+
+void NsfPlayer::startSong(uint8_t song) {
+    // Initializing a tune (https://www.nesdev.org/wiki/NSF#Initializing_a_tune)
+    // Resetting the bus clears the internal RAM and writes the initial banks
+    currentSong = song;
+    bus.reset();
+
+    for (uint32_t address = 0x6000; address <= 0x7FFF; address++) {
+        bus.write(static_cast<uint16_t>(address), 0);
+    }
+
+    for (uint16_t address = 0x4000; address <= 0x4013; address++) {
+        bus.write(address, 0);
+    }
+    bus.write(0x4015, 0x00);
+    bus.write(0x4015, 0x0F);
+    bus.write(0x4017, 0x40); // Disables the frame IRQ
+
+    // The song number goes in A and the region in X (0 for NTSC)
+    CPU::State& cpu = bus.state.cpu;
+    cpu.a = song;
+    cpu.x = 0;
+    callRoutine(header.initAddress);
+
+    // The first play call waits for the init routine to return
+    playTimer = 0;
+    playPending = false;
+}
+
+void NsfPlayer::run(uint64_t cycles) {
+    for (uint64_t i = 0; i < cycles; i++) {
+        playTimer += MICROSECONDS_PER_SECOND;
+        if (playTimer >= playPeriod) {
+            playTimer -= playPeriod;
+            playPending = true;
+        }
+
+        // A play call that comes due while a routine is still running is delayed until it returns
+        if (playPending && isIdle()) {
+            playPending = false;
+            callRoutine(header.playAddress);
+        }
+
+        bus.executeAudioCycle();
+    }
+}
+
+void NsfPlayer::callRoutine(uint16_t address) {
+    // JSR pushes the address of its last byte, and RTS adds one to the address it pulls
+    static constexpr uint16_t RETURN_ADDRESS = MapperNSF::IDLE_LOOP_ADDRESS - 1;
+    static constexpr uint16_t STACK_OFFSET = 0x100;
+
+    CPU::State& cpu = bus.state.cpu;
+    bus.write(STACK_OFFSET + cpu.sp, RETURN_ADDRESS >> 8);
+    cpu.sp--;
+    bus.write(STACK_OFFSET + cpu.sp, RETURN_ADDRESS & 0xFF);
+    cpu.sp--;
+
+    // The routine starts on the next cycle
+    cpu.pc = address;
+    cpu.remainingCycles = 0;
+}
+
+bool NsfPlayer::isIdle() const {
+    const CPU::State& cpu = bus.state.cpu;
+    return cpu.remainingCycles == 0 && cpu.pc == MapperNSF::IDLE_LOOP_ADDRESS;
+}
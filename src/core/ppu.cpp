@@ -1,87 +1,152 @@
 #include "core/ppu.hpp"
 
-#include "core/mapper/mapper4.hpp"
+#include <algorithm>
 
-PPU::PPU(Cartridge& cartridge) : cartridge(cartridge) {
-    workingDisplay = std::make_unique<Display>();
-    finishedDisplay = std::make_unique<Display>();
-
-    resetPPU();
+PPU::PPU(Cartridge& cartridge, State& state, WriteTracker& writeTracker) : cartridge(cartridge), state(state), writeTracker(writeTracker) {
+    workingDisplay = &displays[0];
+    finishedDisplay = &displays[1];
 }
 
 void PPU::resetPPU() {
-    control.data = 0;
-    mask.data = 0;
-    status.data = 0;
-
-    ppuBusData = 0;
-    vramAddress.data = 0;
-    temporaryVramAddress.data = 0;
-    addressLatch = 0;
-    palleteRam = {};
-
-    scanline = 0;
-    cycle = 0;
-    oddFrame = false;
-
-    patternTableLoShifter = 0;
-    patternTableHiShifter = 0;
-    attributeTableLoShifter = 0;
-    attributeTableHiShifter = 0;
-    nextNameTableByte = 0;
-    nextPatternTableLo = 0;
-    nextPatternTableHi = 0;
-    nextAttributeTableLo = 0;
-    nextAttributeTableHi = 0;
-    fineX = 0;
-
-    nameTable = {};
+    state.control.data = 0;
+    state.mask.data = 0;
+    state.status.data = 0;
+
+    state.ppuBusData = 0;
+    state.vramAddress.data = 0;
+    state.temporaryVramAddress.data = 0;
+    state.addressLatch = 0;
+    state.palleteRam = {};
+
+    state.scanline = 0;
+    state.cycle = 0;
+    state.oddFrame = false;
+
+    state.patternTableLoShifter = 0;
+    state.patternTableHiShifter = 0;
+    state.attributeTableLoShifter = 0;
+    state.attributeTableHiShifter = 0;
+    state.nextNameTableByte = 0;
+    state.nextPatternTableLo = 0;
+    state.nextPatternTableHi = 0;
+    state.nextAttributeTableLo = 0;
+    state.nextAttributeTableHi = 0;
+    state.fineX = 0;
+
+    state.nameTable = {};
 
     workingDisplay->fill(std::array<uint32_t, 256>{});
     finishedDisplay->fill(std::array<uint32_t, 256>{});
 
     // Reset the OAM buffer to 0xFF so that sprites start off the screen
-    oamBuffer.fill(0xFF);
+    state.oamBuffer.fill(0xFF);
+
+    state.oamAddress = 0;
+
+    state.currentScanlineSprites = {};
+    state.numCurrentScanlineSprites = 0;
+    state.sprite0OnCurrentScanline = false;
 
-    oamAddress = 0;
+    state.frameReadyFlag = false;
 
-    currentScanlineSprites.reserve(MAX_SPRITES);
-    sprite0OnCurrentScanline = false;
+    state.nmiRequest = false;
 
-    frameReadyFlag = false;
+    state.nmiDelayCounter = 0;
 
-    nmiRequest = false;
-    irqRequest = false;
+    state.totalDots = 0;
+}
+
+const PPU::Display& PPU::getFinishedDisplay() const {
+    return *finishedDisplay;
+}
 
-    nmiDelayCounter = 0;
+bool PPU::frameReady() const {
+    return state.frameReadyFlag;
+}
+
+void PPU::clearFrameReady() {
+    state.frameReadyFlag = false;
 }
 
 bool PPU::nmiRequested() const {
-    return nmiRequest;
+    return state.nmiRequest;
 }
 
 void PPU::clearNMIRequest() {
-    nmiRequest = false;
+    state.nmiRequest = false;
+}
+
+PPU::FramePosition PPU::getFramePosition() const {
+    // The dot skipped on odd frames is the first dot of scanline 0, so later dots of those frames come one earlier
+    bool skippedDot = state.oddFrame && state.scanline >= 0;
+    uint32_t dot = (state.scanline + 1) * DOTS_PER_SCANLINE + state.cycle - skippedDot;
+    return { dot, state.oddFrame };
+}
+
+uint64_t PPU::getTotalDots() const {
+    return state.totalDots;
+}
+
+uint32_t PPU::getFrameLength(bool oddFrame) {
+    return SCANLINES_PER_FRAME * DOTS_PER_SCANLINE - oddFrame;
 }
 
-bool PPU::irqRequested() const {
-    return irqRequest;
+uint32_t PPU::countScanlineCounterClocksBefore(uint32_t dot, bool oddFrame) {
+    // The counter is clocked on scanlines 0 to 239, the first of which starts after the pre-render scanline
+    uint32_t firstClockDot = DOTS_PER_SCANLINE + SCANLINE_COUNTER_DOT - oddFrame;
+    if (dot <= firstClockDot) {
+        return 0;
+    }
+    return std::min((dot - firstClockDot - 1) / DOTS_PER_SCANLINE + 1, NUM_VISIBLE_SCANLINES);
+}
+
+uint64_t PPU::countScanlineCounterClocks(FramePosition position, uint64_t dots) {
+    uint64_t clocks = 0;
+    while (dots > 0) {
+        uint32_t frameLength = getFrameLength(position.oddFrame);
+        uint32_t span = static_cast<uint32_t>(std::min<uint64_t>(dots, frameLength - position.dot));
+        clocks += countScanlineCounterClocksBefore(position.dot + span, position.oddFrame) - countScanlineCounterClocksBefore(position.dot, position.oddFrame);
+        dots -= span;
+
+        position.dot += span;
+        if (position.dot == frameLength) {
+            position = { 0, !position.oddFrame };
+        }
+    }
+    return clocks;
+}
+
+uint64_t PPU::dotsUntilScanlineCounterClock(FramePosition position, uint32_t clocks) {
+    uint64_t dots = 0;
+    while (true) {
+        uint32_t clocksBefore = countScanlineCounterClocksBefore(position.dot, position.oddFrame);
+        uint32_t clocksLeftInFrame = NUM_VISIBLE_SCANLINES - clocksBefore;
+        if (clocks <= clocksLeftInFrame) {
+            uint32_t scanline = clocksBefore + clocks - 1;
+            uint32_t clockDot = (scanline + 1) * DOTS_PER_SCANLINE + SCANLINE_COUNTER_DOT - position.oddFrame;
+            return dots + (clockDot - position.dot);
+        }
+        clocks -= clocksLeftInFrame;
+
+        dots += getFrameLength(position.oddFrame) - position.dot;
+        position = { 0, !position.oddFrame };
+    }
 }
 
 uint8_t PPU::view(uint8_t ppuRegister) const {
     switch (static_cast<Register>(ppuRegister)) {
         case Register::PPUSTATUS:
-            return status.data;
+            return state.status.data;
 
         case Register::OAMDATA:
-            return oamBuffer[oamAddress];
+            return state.oamBuffer[state.oamAddress];
 
         case Register::PPUDATA: {
-            uint8_t data = ppuBusData;
+            uint8_t data = state.ppuBusData;
 
             // Pallete addresses get returned immediately
-            if (PALLETE_RAM_RANGE.contains(vramAddress.data & 0x3FFF)) {
-                data = ppuView(vramAddress.data & 0x3FFF);
+            if (PALLETE_RAM_RANGE.contains(state.vramAddress.data & 0x3FFF)) {
+                data = ppuView(state.vramAddress.data & 0x3FFF);
             }
             return data;
         }
@@ -94,29 +159,29 @@ uint8_t PPU::view(uint8_t ppuRegister) const {
 uint8_t PPU::read(uint8_t ppuRegister) {
     switch (static_cast<Register>(ppuRegister)) {
         case Register::PPUSTATUS: {
-            uint8_t data = status.data;
-            status.vBlankStarted = 0;
-            addressLatch = 0;
+            uint8_t data = state.status.data;
+            Status::VBlankStarted::set(state.status.data, 0);
+            state.addressLatch = 0;
             return data;
         }
 
         case Register::OAMDATA:
-            return oamBuffer[oamAddress];
+            return state.oamBuffer[state.oamAddress];
 
         case Register::PPUDATA: {
-            uint8_t data = ppuBusData;
+            uint8_t data = state.ppuBusData;
 
-            ppuBusData = ppuRead(vramAddress.data & 0x3FFF);
+            state.ppuBusData = ppuRead(state.vramAddress.data & 0x3FFF);
 
             // Open bus is the bottom 5 bits of the bus
-            status.openBus = ppuBusData & 0x1F;
+            Status::OpenBus::set(state.status.data, state.ppuBusData & 0x1F);
 
             // Pallete addresses get returned immediately
-            if (PALLETE_RAM_RANGE.contains(vramAddress.data & 0x3FFF)) {
-                data = ppuBusData;
+            if (PALLETE_RAM_RANGE.contains(state.vramAddress.data & 0x3FFF)) {
+                data = state.ppuBusData;
             }
 
-            vramAddress.data += (control.vramAddressIncrement ? 32 : 1);
+            state.vramAddress.data += (Control::VramAddressIncrement::get(state.control.data) ? 32 : 1);
 
             return data;
         }
@@ -129,64 +194,65 @@ uint8_t PPU::read(uint8_t ppuRegister) {
 void PPU::write(uint8_t ppuRegister, uint8_t value) {
     switch (static_cast<Register>(ppuRegister)) {
         case Register::PPUCTRL: {
-            bool oldNmiFlag = control.nmiEnabled;
+            bool oldNmiFlag = Control::NmiEnabled::get(state.control.data);
 
-            control.data = value;
+            state.control.data = value;
 
-            bool newNmiFlag = control.nmiEnabled;
+            bool newNmiFlag = Control::NmiEnabled::get(state.control.data);
 
             // From (https://www.nesdev.org/wiki/PPU_registers#PPUCTRL): 
             // If the PPU is currently in vertical blank, and the PPUSTATUS ($2002) vblank flag is still set (1), changing the NMI flag in bit 7 of $2000 from 0 to 1 will immediately generate an NMI. 
-            if (status.vBlankStarted && !oldNmiFlag && newNmiFlag) {
-                nmiDelayCounter = NMI_DELAY_TIME;
+            if (Status::VBlankStarted::get(state.status.data) && !oldNmiFlag && newNmiFlag) {
+                state.nmiDelayCounter = NMI_DELAY_TIME;
             }
 
-            temporaryVramAddress.nametableX = control.nametableX;
-            temporaryVramAddress.nametableY = control.nametableY;
+            InternalRegister::NametableX::set(state.temporaryVramAddress.data, Control::NametableX::get(state.control.data));
+            InternalRegister::NametableY::set(state.temporaryVramAddress.data, Control::NametableY::get(state.control.data));
             break;
         }
 
         case Register::PPUMASK:
-            mask.data = value;
+            state.mask.data = value;
             break;
 
         case Register::OAMADDR:
-            oamAddress = value;
+            state.oamAddress = value;
             break;
 
         case Register::OAMDATA:
-            oamBuffer[oamAddress] = value;
+            state.oamBuffer[state.oamAddress] = value;
+            writeTracker.markWritten(&state.oamBuffer[state.oamAddress]);
             break;
 
         case Register::PPUSCROLL:
-            if (addressLatch == 0) {
-                fineX = value & 0x7;
-                temporaryVramAddress.coarseX = value >> 3;
+            if (state.addressLatch == 0) {
+                state.fineX = value & 0x7;
+                InternalRegister::CoarseX::set(state.temporaryVramAddress.data, value >> 3);
             }
             else {
-                temporaryVramAddress.fineY = value & 0x7;
-                temporaryVramAddress.coarseY = value >> 3;
+                InternalRegister::FineY::set(state.temporaryVramAddress.data, value & 0x7);
+                InternalRegister::CoarseY::set(state.temporaryVramAddress.data, value >> 3);
             }
-            addressLatch ^= 1;
+            state.addressLatch ^= 1;
             break;
 
         case Register::PPUADDR:
-            if (addressLatch == 0) {
-                temporaryVramAddress.data &= 0x00FF;
-                temporaryVramAddress.data |= (value << 8);
+            if (state.addressLatch == 0) {
+                state.temporaryVramAddress.data &= 0x00FF;
+                state.temporaryVramAddress.data |= (value << 8);
             }
             else {
-                temporaryVramAddress.data &= 0xFF00;
-                temporaryVramAddress.data |= value;
+                state.temporaryVramAddress.data &= 0xFF00;
+                state.temporaryVramAddress.data |= value;
 
-                vramAddress.data = temporaryVramAddress.data;
+                state.vramAddress.data = state.temporaryVramAddress.data;
             }
-            addressLatch ^= 1;
+            state.addressLatch ^= 1;
             break;
 
         case Register::PPUDATA:
-            ppuWrite(vramAddress.data & 0x3FFF, value);
-            vramAddress.data += (control.vramAddressIncrement ? 32 : 1);
+            ppuWrite(state.vramAddress.data & 0x3FFF, value);
+            state.vramAddress.data += (Control::VramAddressIncrement::get(state.control.data) ? 32 : 1);
             break;
 
         default:
@@ -218,15 +284,15 @@ uint8_t PPU::getPalleteRamIndexWrite(uint16_t address) const {
 }
 
 uint8_t PPU::viewPalleteRam(uint16_t address) const {
-    uint8_t data = palleteRam[getPalleteRamIndexRead(address)] & 0x3F;
-    if (mask.greyscale) {
+    uint8_t data = state.palleteRam[getPalleteRamIndexRead(address)] & 0x3F;
+    if (Mask::Greyscale::get(state.mask.data)) {
         data &= 0x30;
     }
     return data;
 }
 
 uint16_t PPU::getNameTableIndex(uint16_t address) const {
-    Mapper::MirrorMode mirrorMode = cartridge.mapper->getMirrorMode();
+    Mapper::MirrorMode mirrorMode = cartridge.getMirrorMode();
 
     // Nametable mirroring maps each of the four quadrants of the address space [0x000 - 0xFFF] to either nametable A or nametable B
     uint8_t quadrant = (address >> 10) & 0x3;
@@ -257,28 +323,28 @@ uint16_t PPU::getNameTableIndex(uint16_t address) const {
 }
 
 uint8_t PPU::viewNameTable(uint16_t address) const {
-    if (cartridge.mapper->getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
-        return nameTable[getNameTableIndex(address)];
+    if (cartridge.getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
+        return state.nameTable[getNameTableIndex(address)];
     }
     else {
         // Mapper handles nametables in 4 screen mode
-        return cartridge.mapper->mapCHRView(address);
+        return cartridge.mapCHRView(address);
     }
 }
 
 uint8_t PPU::readNameTable(uint16_t address) {
-    if (cartridge.mapper->getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
-        return nameTable[getNameTableIndex(address)];
+    if (cartridge.getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
+        return state.nameTable[getNameTableIndex(address)];
     }
     else {
         // Mapper handles nametables in 4 screen mode
-        return cartridge.mapper->mapCHRRead(address);
+        return cartridge.mapCHRRead(address);
     }
 }
 
 uint8_t PPU::ppuView(uint16_t address) const {
     if (PATTERN_TABLE_RANGE.contains(address)) {
-        return cartridge.mapper->mapCHRView(address);
+        return cartridge.mapCHRView(address);
     }
     else if (NAMETABLE_RANGE.contains(address)) {
         return viewNameTable(address);
@@ -293,7 +359,7 @@ uint8_t PPU::ppuView(uint16_t address) const {
 
 uint8_t PPU::ppuRead(uint16_t address) {
     if (PATTERN_TABLE_RANGE.contains(address)) {
-        return cartridge.mapper->mapCHRRead(address);
+        return cartridge.mapCHRRead(address);
     }
     else if (NAMETABLE_RANGE.contains(address)) {
         return readNameTable(address);
@@ -308,38 +374,41 @@ uint8_t PPU::ppuRead(uint16_t address) {
 
 void PPU::ppuWrite(uint16_t address, uint8_t value) {
     if (PATTERN_TABLE_RANGE.contains(address)) {
-        cartridge.mapper->mapCHRWrite(address, value);
+        cartridge.mapCHRWrite(address, value);
     }
     else if (NAMETABLE_RANGE.contains(address)) {
-        if (cartridge.mapper->getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
-            nameTable[getNameTableIndex(address)] = value;
+        if (cartridge.getMirrorMode() != Mapper::MirrorMode::FOUR_SCREEN) {
+            uint8_t& byte = state.nameTable[getNameTableIndex(address)];
+            byte = value;
+            writeTracker.markWritten(&byte);
         }
         else {
             // Mapper handles nametables in 4 screen mode
-            cartridge.mapper->mapCHRWrite(address, value);
+            cartridge.mapCHRWrite(address, value);
         }
     }
     else if (PALLETE_RAM_RANGE.contains(address)) {
-        palleteRam[getPalleteRamIndexWrite(address)] = value;
+        uint8_t& byte = state.palleteRam[getPalleteRamIndexWrite(address)];
+        byte = value;
+        writeTracker.markWritten(&byte);
     }
 }
 
-std::unique_ptr<PPU::PatternTables> PPU::getPatternTables(uint8_t backgroundPalleteNumber, uint8_t spritePalleteNumber) const {
-    std::unique_ptr<PPU::PatternTables> tables = std::make_unique<PPU::PatternTables>();
+void PPU::getPatternTables(PatternTables& tables, uint8_t backgroundPalleteNumber, uint8_t spritePalleteNumber) const {
 
     for (int i = 0; i < 2; i++) {
         bool isBackground = !i;
-        bool tableNumber = isBackground ? control.backgroundPatternTable : control.spritePatternTable;
+        bool tableNumber = isBackground ? Control::BackgroundPatternTable::get(state.control.data) : Control::SpritePatternTable::get(state.control.data);
         uint8_t palleteNumber = isBackground ? backgroundPalleteNumber : spritePalleteNumber;
-        PatternTable& table = isBackground ? tables->backgroundPatternTable : tables->spritePatternTable;
+        PatternTable& table = isBackground ? tables.backgroundPatternTable : tables.spritePatternTable;
 
         for (int tileRow = 0; tileRow < PATTERN_TABLE_NUM_TILES; tileRow++) {
             for (int tileCol = 0; tileCol < PATTERN_TABLE_NUM_TILES; tileCol++) {
                 uint16_t tableOffset = PATTERN_TABLE_TILE_BYTES * (PATTERN_TABLE_NUM_TILES * tileRow + tileCol);
 
                 for (int spriteRow = 0; spriteRow < PATTERN_TABLE_TILE_SIZE; spriteRow++) {
-                    uint8_t loBits = cartridge.mapper->mapCHRView(PATTERN_TABLE_TOTAL_BYTES * tableNumber + tableOffset + spriteRow);
-                    uint8_t hiBits = cartridge.mapper->mapCHRView(PATTERN_TABLE_TOTAL_BYTES * tableNumber + tableOffset + spriteRow + 0x8);
+                    uint8_t loBits = cartridge.mapCHRView(PATTERN_TABLE_TOTAL_BYTES * tableNumber + tableOffset + spriteRow);
+                    uint8_t hiBits = cartridge.mapCHRView(PATTERN_TABLE_TOTAL_BYTES * tableNumber + tableOffset + spriteRow + 0x8);
 
                     for (int spriteCol = 0; spriteCol < PATTERN_TABLE_TILE_SIZE; spriteCol++) {
                         bool currentLoBit = (loBits >> spriteCol) & 1;
@@ -356,25 +425,23 @@ std::unique_ptr<PPU::PatternTables> PPU::getPatternTables(uint8_t backgroundPall
             }
         }
     }
-
-    return tables;
 }
 
 void PPU::executeCycle() {
-    if (nmiDelayCounter > 0) {
-        nmiDelayCounter--;
-        if (nmiDelayCounter == 0) {
-            nmiRequest = true;
+    if (state.nmiDelayCounter > 0) {
+        state.nmiDelayCounter--;
+        if (state.nmiDelayCounter == 0) {
+            state.nmiRequest = true;
         }
     }
 
-    if (scanline == -1) {
+    if (state.scanline == -1) {
         preRenderScanline();
     }
-    else if (scanline >= 0 && scanline <= 239) {
+    else if (state.scanline >= 0 && state.scanline <= 239) {
         visibleScanlines();
     }
-    else if (scanline == 240) {
+    else if (state.scanline == 240) {
         // Do nothing on this scanline
     }
     else { // if (scanline >= 241 && scanline <= 260) {
@@ -384,26 +451,17 @@ void PPU::executeCycle() {
     incrementCycle();
 }
 
-void PPU::handleMapper4IRQ() {
-    if (cartridge.mapper->config.id == 4) {
-        // We can static_cast instead of dynamic_cast because we explicitly checked id
-        Mapper4* mapper4 = static_cast<Mapper4*>(cartridge.mapper.get());
-        mapper4->clockIRQTimer();
-        irqRequest = mapper4->irqRequested();
-    }
-}
-
 void PPU::preRenderScanline() {
-    if (cycle == 1) {
-        status.vBlankStarted = 0;
-        status.sprite0Hit = 0;
-        status.spriteOverflow = 0;
+    if (state.cycle == 1) {
+        Status::VBlankStarted::set(state.status.data, 0);
+        Status::Sprite0Hit::set(state.status.data, 0);
+        Status::SpriteOverflow::set(state.status.data, 0);
     }
-    else if (cycle >= 280 && cycle <= 304) {
+    else if (state.cycle >= 280 && state.cycle <= 304) {
         if (isRenderingEnabled()) {
-            vramAddress.fineY = static_cast<uint16_t>(temporaryVramAddress.fineY);
-            vramAddress.nametableY = static_cast<uint16_t>(temporaryVramAddress.nametableY);
-            vramAddress.coarseY = static_cast<uint16_t>(temporaryVramAddress.coarseY);
+            InternalRegister::FineY::set(state.vramAddress.data, InternalRegister::FineY::get(state.temporaryVramAddress.data));
+            InternalRegister::NametableY::set(state.vramAddress.data, InternalRegister::NametableY::get(state.temporaryVramAddress.data));
+            InternalRegister::CoarseY::set(state.vramAddress.data, InternalRegister::CoarseY::get(state.temporaryVramAddress.data));
         }
     }
 
@@ -413,79 +471,74 @@ void PPU::preRenderScanline() {
 void PPU::visibleScanlines() {
     doRenderingPipeline();
 
-    if (cycle >= 1 && cycle <= 256) {
-        if (cycle == 1) {
+    if (state.cycle >= 1 && state.cycle <= 256) {
+        if (state.cycle == 1) {
             // TODO: Not cycle accruate
             fillCurrentScanlineSprites();
         }
 
         drawPixel();
 
-        if (scanline == 239 && cycle == 256) {
+        if (state.scanline == 239 && state.cycle == 256) {
             // We have finished drawing all visible pixels, so the display is ready
             std::swap(workingDisplay, finishedDisplay);
 
-            frameReadyFlag = true;
-        }
-    }
-    else if (cycle == 280) { // TODO: Think this should really be 260, but breaks things...
-        if (isRenderingEnabled()) {
-            handleMapper4IRQ();
+            state.frameReadyFlag = true;
         }
     }
 }
 
 void PPU::verticalBlankScanlines() {
-    if (scanline == 241 && cycle == 1) {
-        status.vBlankStarted = 1;
-        if (control.nmiEnabled) {
-            nmiDelayCounter = NMI_DELAY_TIME;
+    if (state.scanline == 241 && state.cycle == 1) {
+        Status::VBlankStarted::set(state.status.data, 1);
+        if (Control::NmiEnabled::get(state.control.data)) {
+            state.nmiDelayCounter = NMI_DELAY_TIME;
         }
     }
 }
 
 void PPU::doRenderingPipeline() {
-    if (cycle >= 1 && cycle <= 256) {
+    if (state.cycle >= 1 && state.cycle <= 256) {
         doStandardFetchCycle();
 
-        if (cycle == 256) {
+        if (state.cycle == 256) {
             if (isRenderingEnabled()) {
                 incrementY();
             }
         }
     }
-    else if (cycle >= 257 && cycle <= 320) {
-        if (cycle == 257) {
-            if (mask.showBackground) {
+    else if (state.cycle >= 257 && state.cycle <= 320) {
+        if (state.cycle == 257) {
+            if (Mask::ShowBackground::get(state.mask.data)) {
                 reloadShifters();
             }
 
             if (isRenderingEnabled()) {
-                vramAddress.coarseX = static_cast<uint16_t>(temporaryVramAddress.coarseX);
-                vramAddress.nametableX = static_cast<uint16_t>(temporaryVramAddress.nametableX);
+                InternalRegister::CoarseX::set(state.vramAddress.data, InternalRegister::CoarseX::get(state.temporaryVramAddress.data));
+                InternalRegister::NametableX::set(state.vramAddress.data, InternalRegister::NametableX::get(state.temporaryVramAddress.data));
             }
         }
 
-        switch (cycle % 8) {
+        switch (state.cycle % 8) {
             case 1: case 3: fetchNameTableByte(); break; // Garbage nametable fetches
         }
     }
-    else if (cycle >= 321 && cycle <= 336) {
+    else if (state.cycle >= 321 && state.cycle <= 336) {
         doStandardFetchCycle();
     }
     else { // if (cycle >= 337 && cycle <= 340) {
-        if (cycle == 337 || cycle == 339) fetchNameTableByte(); // Unused nametable fetches
+        if (state.cycle == 337 || state.cycle == 339) fetchNameTableByte(); // Unused nametable fetches
     }
 }
 
 void PPU::doStandardFetchCycle() {
-    if (mask.showBackground) {
+    if (Mask::ShowBackground::get(state.mask.data)) {
         shiftShifters();
     }
 
-    switch (cycle % 8) {
+    switch (state.cycle % 8) {
         case 1:
-            if (mask.showBackground) {
+            if (Mask::ShowBackground::get(state.mask.data)) {
                 reloadShifters();
             }
             fetchNameTableByte();
@@ -508,58 +561,58 @@ void PPU::doStandardFetchCycle() {
 }
 
 void PPU::fetchNameTableByte() {
-    nextNameTableByte = readNameTable(0x2000 + (vramAddress.data & 0x0FFF));
+    state.nextNameTableByte = readNameTable(0x2000 + (state.vramAddress.data & 0x0FFF));
 }
 
 void PPU::fetchAttributeTableByte() {
     uint16_t offset =
-        (vramAddress.nametableY << 11) |
-        (vramAddress.nametableX << 10) |
-        ((vramAddress.coarseY >> 2) << 3) |
-        (vramAddress.coarseX >> 2);
+        (InternalRegister::NametableY::get(state.vramAddress.data) << 11) |
+        (InternalRegister::NametableX::get(state.vramAddress.data) << 10) |
+        ((InternalRegister::CoarseY::get(state.vramAddress.data) >> 2) << 3) |
+        (InternalRegister::CoarseX::get(state.vramAddress.data) >> 2);
     uint8_t nextAttributeTableByte = readNameTable(0x23C0 + offset);
 
     // Extract the correct 2 bit portion of the attribute table byte
-    if (vramAddress.coarseY & 0x02) {
+    if (InternalRegister::CoarseY::get(state.vramAddress.data) & 0x02) {
         nextAttributeTableByte >>= 4;
     }
-    if (vramAddress.coarseX & 0x02) {
+    if (InternalRegister::CoarseX::get(state.vramAddress.data) & 0x02) {
         nextAttributeTableByte >>= 2;
     }
-    nextAttributeTableLo = nextAttributeTableByte & 0x1;
-    nextAttributeTableHi = nextAttributeTableByte & 0x2;
+    state.nextAttributeTableLo = nextAttributeTableByte & 0x1;
+    state.nextAttributeTableHi = nextAttributeTableByte & 0x2;
 }
 
 void PPU::fetchPatternTableByteLo() {
     uint16_t address =
-        (control.backgroundPatternTable << 12) |
-        (nextNameTableByte << 4) |
-        vramAddress.fineY;
-    nextPatternTableLo = cartridge.mapper->mapCHRRead(address);
+        (Control::BackgroundPatternTable::get(state.control.data) << 12) |
+        (state.nextNameTableByte << 4) |
+        InternalRegister::FineY::get(state.vramAddress.data);
+    state.nextPatternTableLo = cartridge.mapCHRRead(address);
 }
 
 void PPU::fetchPatternTableByteHi() {
     uint16_t address =
-        (control.backgroundPatternTable << 12) |
-        (nextNameTableByte << 4) |
-        vramAddress.fineY;
-    nextPatternTableHi = cartridge.mapper->mapCHRRead(address + 8);
+        (Control::BackgroundPatternTable::get(state.control.data) << 12) |
+        (state.nextNameTableByte << 4) |
+        InternalRegister::FineY::get(state.vramAddress.data);
+    state.nextPatternTableHi = cartridge.mapCHRRead(address + 8);
 }
 
 void PPU::drawPixel() {
     // Get color from background
     uint8_t backgroundPatternTable = 0;
     uint8_t backgroundAttributeTable = 0;
-    if (mask.showBackground) {
-        if (mask.showBackgroundLeft || cycle >= 9) {
-            uint8_t shift = 15 - fineX;
+    if (Mask::ShowBackground::get(state.mask.data)) {
+        if (Mask::ShowBackgroundLeft::get(state.mask.data) || state.cycle >= 9) {
+            uint8_t shift = 15 - state.fineX;
 
-            bool backgroundPatternTableLo = (patternTableLoShifter >> shift) & 1;
-            bool backgroundPatternTableHi = (patternTableHiShifter >> shift) & 1;
+            bool backgroundPatternTableLo = (state.patternTableLoShifter >> shift) & 1;
+            bool backgroundPatternTableHi = (state.patternTableHiShifter >> shift) & 1;
             backgroundPatternTable = (backgroundPatternTableHi << 1) | static_cast<uint8_t>(backgroundPatternTableLo);
 
-            bool backgroundAttributeTableLo = (attributeTableLoShifter >> shift) & 1;
-            bool backgroundAttributeTableHi = (attributeTableHiShifter >> shift) & 1;
+            bool backgroundAttributeTableLo = (state.attributeTableLoShifter >> shift) & 1;
+            bool backgroundAttributeTableHi = (state.attributeTableHiShifter >> shift) & 1;
             backgroundAttributeTable = (backgroundAttributeTableHi << 1) | static_cast<uint8_t>(backgroundAttributeTableLo);
         }
     }
@@ -571,13 +624,13 @@ void PPU::drawPixel() {
     uint8_t spriteAttributeTable = 0;
     bool spritePriority = 0;
     bool sprite0Rendered = false;
-    if (mask.showSprites) {
-        if (mask.showSpritesLeft || cycle >= 9) {
-            for (int i = 0; i < static_cast<int>(currentScanlineSprites.size()); i++) {
-                const SpriteData& spriteData = currentScanlineSprites[i];
+    if (Mask::ShowSprites::get(state.mask.data)) {
+        if (Mask::ShowSpritesLeft::get(state.mask.data) || state.cycle >= 9) {
+            for (int i = 0; i < state.numCurrentScanlineSprites; i++) {
+                const SpriteData& spriteData = state.currentScanlineSprites[i];
                 const OAMEntry& sprite = spriteData.oam;
 
-                int differenceX = (cycle - 1) - sprite.x;
+                int differenceX = (state.cycle - 1) - sprite.x;
                 if (differenceX < 0 || differenceX >= 8) {
                     continue;
                 }
@@ -601,7 +654,7 @@ void PPU::drawPixel() {
                 // In that case we should draw it and ignore the rest of the sprites.
                 // This is because priority between sprites is determined by their location in OAM (priority between sprite and background is determined by spritePriority variable)
                 if (spritePatternTable) {
-                    if (i == 0 && sprite0OnCurrentScanline) {
+                    if (i == 0 && state.sprite0OnCurrentScanline) {
                         sprite0Rendered = true;
                     }
                     break;
@@ -627,47 +680,47 @@ void PPU::drawPixel() {
         finalColorIndex = spriteColorIndex;
     }
 
-    if (sprite0Rendered && bothVisible && mask.showBackground && mask.showSprites && (cycle - 1) != 0xFF) {
-        bool renderingLeft = mask.showBackgroundLeft && mask.showSpritesLeft;
-        if (renderingLeft || (!renderingLeft && cycle >= 9)) {
-            status.sprite0Hit = 1;
+    if (sprite0Rendered && bothVisible && Mask::ShowBackground::get(state.mask.data) && Mask::ShowSprites::get(state.mask.data) && (state.cycle - 1) != 0xFF) {
+        bool renderingLeft = Mask::ShowBackgroundLeft::get(state.mask.data) && Mask::ShowSpritesLeft::get(state.mask.data);
+        if (renderingLeft || (!renderingLeft && state.cycle >= 9)) {
+            Status::Sprite0Hit::set(state.status.data, 1);
         }
     }
 
     uint32_t finalColor = SCREEN_COLORS[finalColorIndex];
 
     // Modify the final color based on the PPU's emphasis bits
-    if (mask.emphRed || mask.emphGreen || mask.emphBlue) {
+    if (Mask::EmphRed::get(state.mask.data) || Mask::EmphGreen::get(state.mask.data) || Mask::EmphBlue::get(state.mask.data)) {
         uint8_t colorColumn = finalColorIndex & 0xF;
         if (colorColumn != 0xE && colorColumn != 0xF) {
-            BitField<16, 8, uint32_t> red{ finalColor };
-            BitField<8, 8, uint32_t>  green{ finalColor };
-            BitField<0, 8, uint32_t>  blue{ finalColor };
+            Color color{ finalColor };
 
             uint8_t attenuationRed = 0;
             uint8_t attenuationGreen = 0;
             uint8_t attenuationBlue = 0;
 
-            if (mask.emphRed) {
+            if (Mask::EmphRed::get(state.mask.data)) {
                 attenuationGreen++;
                 attenuationBlue++;
             }
-            if (mask.emphGreen) {
+            if (Mask::EmphGreen::get(state.mask.data)) {
                 attenuationRed++;
                 attenuationBlue++;
             }
-            if (mask.emphBlue) {
+            if (Mask::EmphBlue::get(state.mask.data)) {
                 attenuationRed++;
                 attenuationGreen++;
             }
 
-            red = ATTENUATION_TABLE[(attenuationRed << 8) | red];
-            green = ATTENUATION_TABLE[(attenuationGreen << 8) | green];
-            blue = ATTENUATION_TABLE[(attenuationBlue << 8) | blue];
+            Color::Red::set(color.data, ATTENUATION_TABLE[(attenuationRed << 8) | Color::Red::get(color.data)]);
+            Color::Green::set(color.data, ATTENUATION_TABLE[(attenuationGreen << 8) | Color::Green::get(color.data)]);
+            Color::Blue::set(color.data, ATTENUATION_TABLE[(attenuationBlue << 8) | Color::Blue::get(color.data)]);
+
+            finalColor = color.data;
         }
     }
 
-    (*workingDisplay)[scanline][cycle - 1] = finalColor;
+    (*workingDisplay)[state.scanline][state.cycle - 1] = finalColor;
 }
 
 void PPU::reloadShifters() {
@@ -676,49 +729,51 @@ void PPU::reloadShifters() {
         shiftRegister |= data;
     };
 
-    reloadShifter(patternTableLoShifter, nextPatternTableLo);
-    reloadShifter(patternTableHiShifter, nextPatternTableHi);
-    reloadShifter(attributeTableLoShifter, nextAttributeTableLo ? 0xFF : 0x00);
-    reloadShifter(attributeTableHiShifter, nextAttributeTableHi ? 0xFF : 0x00);
+    reloadShifter(state.patternTableLoShifter, state.nextPatternTableLo);
+    reloadShifter(state.patternTableHiShifter, state.nextPatternTableHi);
+    reloadShifter(state.attributeTableLoShifter, state.nextAttributeTableLo ? 0xFF : 0x00);
+    reloadShifter(state.attributeTableHiShifter, state.nextAttributeTableHi ? 0xFF : 0x00);
 }
 
 void PPU::shiftShifters() {
-    patternTableLoShifter <<= 1;
-    patternTableHiShifter <<= 1;
-    attributeTableLoShifter <<= 1;
-    attributeTableHiShifter <<= 1;
+    state.patternTableLoShifter <<= 1;
+    state.patternTableHiShifter <<= 1;
+    state.attributeTableLoShifter <<= 1;
+    state.attributeTableHiShifter <<= 1;
 }
 
 bool PPU::isRenderingEnabled() const {
-    return mask.showBackground || mask.showSprites;
+    return Mask::ShowBackground::get(state.mask.data) || Mask::ShowSprites::get(state.mask.data);
 }
 
 void PPU::incrementCycle() {
-    if (cycle < 340) {
-        cycle++;
+    state.totalDots++;
+
+    if (state.cycle < 340) {
+        state.cycle++;
     }
     else {
-        if (scanline < 260) {
-            scanline++;
+        if (state.scanline < 260) {
+            state.scanline++;
         }
         else {
-            scanline = -1;
-            oddFrame ^= 1;
+            state.scanline = -1;
+            state.oddFrame ^= 1;
         }
 
         // Skip a cycle on odd frame numbers
-        if (scanline == 0 && oddFrame) {
-            cycle = 1;
+        if (state.scanline == 0 && state.oddFrame) {
+            state.cycle = 1;
         }
         else {
-            cycle = 0;
+            state.cycle = 0;
         }
     }
 }
 
 // The code for this function is based on pseudocode from https://www.nesdev.org/wiki/PPU_scrolling
 void PPU::incrementCoarseX() {
-    uint16_t& v = vramAddress.data;
+    uint16_t& v = state.vramAddress.data;
 
     if ((v & 0x001F) == 31) { // if coarse X == 31
         v &= ~0x001F; // coarse X = 0
@@ -731,7 +786,7 @@ void PPU::incrementCoarseX() {
 
 // The code for this function is based on pseudocode from https://www.nesdev.org/wiki/PPU_scrolling
 void PPU::incrementY() {
-    uint16_t& v = vramAddress.data;
+    uint16_t& v = state.vramAddress.data;
 
     if ((v & 0x7000) != 0x7000) { // if fine Y < 7
         v += 0x1000; // increment fine Y
@@ -754,45 +809,45 @@ void PPU::incrementY() {
 }
 
 void PPU::fillCurrentScanlineSprites() {
-    currentScanlineSprites.clear();
-    sprite0OnCurrentScanline = false;
+    state.numCurrentScanlineSprites = 0;
+    state.sprite0OnCurrentScanline = false;
     for (int i = 0; i < OAM_SPRITES; i++) {
         uint8_t index = i << 2;
         OAMEntry sprite = {
-            oamBuffer[index],
-            oamBuffer[index + 1],
-            oamBuffer[index + 2],
-            oamBuffer[index + 3]
+            state.oamBuffer[index],
+            state.oamBuffer[index + 1],
+            state.oamBuffer[index + 2],
+            state.oamBuffer[index + 3]
         };
 
-        uint8_t spriteHeight = control.spriteSize ? 16 : 8;
+        uint8_t spriteHeight = Control::SpriteSize::get(state.control.data) ? 16 : 8;
 
         // NES sprite renders are delayed by one scanline, so they will end up one scanline below where it is specified in OAM
         // As a result, NES programmers place their sprite value MINUS 1 into OAM.
         // I manually remove this offset by adding 1 because I determine which sprites will be rendered for a particular scanline at the start of a scanline, not during a previous one.
-        int differenceY = scanline - (sprite.y + 1);
+        int differenceY = state.scanline - (sprite.y + 1);
 
         if (differenceY >= 0 && differenceY < spriteHeight) {
-            if (currentScanlineSprites.size() == MAX_SPRITES) {
-                status.spriteOverflow = true;
+            if (state.numCurrentScanlineSprites == MAX_SPRITES) {
+                Status::SpriteOverflow::set(state.status.data, true);
                 break;
             }
             else {
                 // Adding 1 to the y value of visible sprites for aforementioned reason
                 sprite.y++;
 
-                uint8_t y = scanline - sprite.y;
+                uint8_t y = state.scanline - sprite.y;
 
                 bool flipVertical = (sprite.attributes >> 7) & 1;
                 if (flipVertical) {
-                    y = control.spriteSize ? (15 - y) : (7 - y);
+                    y = Control::SpriteSize::get(state.control.data) ? (15 - y) : (7 - y);
                 }
 
                 uint16_t spritePatternTableAddr;
 
-                if (!control.spriteSize) {
+                if (!Control::SpriteSize::get(state.control.data)) {
                     spritePatternTableAddr =
-                        (control.spritePatternTable << 12) |
+                        (Control::SpritePatternTable::get(state.control.data) << 12) |
                         (sprite.tileIndex << 4) |
                         y;
                 }
@@ -811,13 +866,13 @@ void PPU::fillCurrentScanlineSprites() {
                     }
                 }
 
-                uint8_t spritePatternTableLo = cartridge.mapper->mapCHRRead(spritePatternTableAddr);
-                uint8_t spritePatternTableHi = cartridge.mapper->mapCHRRead(spritePatternTableAddr + 8);
+                uint8_t spritePatternTableLo = cartridge.mapCHRRead(spritePatternTableAddr);
+                uint8_t spritePatternTableHi = cartridge.mapCHRRead(spritePatternTableAddr + 8);
 
-                currentScanlineSprites.push_back({ sprite, spritePatternTableLo, spritePatternTableHi });
+                state.currentScanlineSprites[state.numCurrentScanlineSprites++] = { sprite, spritePatternTableLo, spritePatternTableHi };
 
                 if (i == 0) {
-                    sprite0OnCurrentScanline = true;
+                    state.sprite0OnCurrentScanline = true;
                 }
             }
         }
@@ -832,105 +887,15 @@ std::array<uint32_t, 0x20> PPU::getPalleteRamColors() const {
     std::array<uint32_t, 0x20> result;
     for (int i = 0; i < 0x20; i++) {
         uint8_t index = getPalleteRamIndexRead(i);
-        result[i] = SCREEN_COLORS[palleteRam[index] & 0x3F];
+        result[i] = SCREEN_COLORS[state.palleteRam[index] & 0x3F];
     }
     return result;
 }
 
 void PPU::serialize(Serializer& s) const {
-    s.serializeUInt8(control.data);
-    s.serializeUInt8(mask.data);
-    s.serializeUInt8(status.data);
-    s.serializeBool(addressLatch);
-    s.serializeUInt16(temporaryVramAddress.data);
-    s.serializeUInt16(vramAddress.data);
-    s.serializeUInt8(fineX);
-    s.serializeUInt8(ppuBusData);
-    s.serializeArray(palleteRam, s.uInt8Func);
-    s.serializeArray(nameTable, s.uInt8Func);
-    s.serializeInt32(scanline);
-    s.serializeInt32(cycle);
-    s.serializeBool(oddFrame);
-    s.serializeUInt16(patternTableLoShifter);
-    s.serializeUInt16(patternTableHiShifter);
-    s.serializeUInt16(attributeTableLoShifter);
-    s.serializeUInt16(attributeTableHiShifter);
-    s.serializeUInt8(nextNameTableByte);
-    s.serializeUInt8(nextPatternTableLo);
-    s.serializeUInt8(nextPatternTableHi);
-    s.serializeBool(nextAttributeTableLo);
-    s.serializeBool(nextAttributeTableHi);
-    s.serializeUInt8(oamAddress);
-    s.serializeBool(nmiRequest);
-    s.serializeBool(irqRequest);
-    s.serializeArray(oamBuffer, s.uInt8Func);
-
-    if (s.version.minor >= 1) {
-        std::function<void(const SpriteData&)> spriteDataFunc = [&](const SpriteData& spriteData) -> void {
-            uint32_t oam =
-                spriteData.oam.y |
-                (spriteData.oam.tileIndex << 8) |
-                (spriteData.oam.attributes << 16) |
-                (spriteData.oam.x << 24);
-            s.serializeUInt32(oam); // TODO: In future version make each field a seperate entry
-            s.serializeUInt8(spriteData.patternTableLo);
-            s.serializeUInt8(spriteData.patternTableHi);
-        };
-
-        s.serializeVector(currentScanlineSprites, spriteDataFunc);
-        s.serializeBool(sprite0OnCurrentScanline);
-        s.serializeUInt8(nmiDelayCounter);
-    }
+    Schema::serialize(s, state);
 }
 
 void PPU::deserialize(Deserializer& d) {
-    d.deserializeUInt8(control.data);
-    d.deserializeUInt8(mask.data);
-    d.deserializeUInt8(status.data);
-    d.deserializeBool(addressLatch);
-    d.deserializeUInt16(temporaryVramAddress.data);
-    d.deserializeUInt16(vramAddress.data);
-    d.deserializeUInt8(fineX);
-    d.deserializeUInt8(ppuBusData);
-    d.deserializeArray(palleteRam, d.uInt8Func);
-    d.deserializeArray(nameTable, d.uInt8Func);
-    d.deserializeInt32(scanline);
-    d.deserializeInt32(cycle);
-    d.deserializeBool(oddFrame);
-    d.deserializeUInt16(patternTableLoShifter);
-    d.deserializeUInt16(patternTableHiShifter);
-    d.deserializeUInt16(attributeTableLoShifter);
-    d.deserializeUInt16(attributeTableHiShifter);
-    d.deserializeUInt8(nextNameTableByte);
-    d.deserializeUInt8(nextPatternTableLo);
-    d.deserializeUInt8(nextPatternTableHi);
-    d.deserializeBool(nextAttributeTableLo);
-    d.deserializeBool(nextAttributeTableHi);
-    d.deserializeUInt8(oamAddress);
-    d.deserializeBool(nmiRequest);
-    d.deserializeBool(irqRequest);
-    d.deserializeArray(oamBuffer, d.uInt8Func);
-
-    if (d.version.minor >= 1) {
-        std::function<void(SpriteData&)> spriteDataFunc = [&](SpriteData& spriteData) -> void {
-            uint32_t oamTemp;
-            d.deserializeUInt32(oamTemp); // TODO: In future version make each field a seperate entry
-            spriteData.oam.y = oamTemp & 0xFF;
-            spriteData.oam.tileIndex = (oamTemp >> 8) & 0xFF;
-            spriteData.oam.attributes = (oamTemp >> 16) & 0xFF;
-            spriteData.oam.x = (oamTemp >> 24) & 0xFF;
-
-            d.deserializeUInt8(spriteData.patternTableLo);
-            d.deserializeUInt8(spriteData.patternTableHi);
-        };
-
-        d.deserializeVector(currentScanlineSprites, spriteDataFunc);
-        d.deserializeBool(sprite0OnCurrentScanline);
-        d.deserializeUInt8(nmiDelayCounter);
-    }
-    else {
-        currentScanlineSprites.clear();
-        sprite0OnCurrentScanline = false;
-        nmiDelayCounter = 0;
-    }
+    Schema::deserialize(d, state);
 }
\ No newline at end of file
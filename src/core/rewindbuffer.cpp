@@ -0,0 +1,252 @@
+#include "core/rewindbuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+RewindBuffer::RewindBuffer(size_t maxBytes) :
+    maxBytes(maxBytes),
+    usedBytes(0),
+    currentFrame(0),
+    firstInputFrame(0),
+    snapshotsSinceKeyframe(0),
+    scratch(std::make_unique<Bus::State>()) {
+}
+
+void RewindBuffer::restart(Bus& bus) {
+    while (!snapshots.empty()) {
+        dropSnapshot(snapshots.back());
+        snapshots.pop_back();
+    }
+    inputs.clear();
+    usedBytes = 0;
+
+    currentFrame = 0;
+    firstInputFrame = 0;
+    takeSnapshot(bus);
+}
+
+void RewindBuffer::recordFrame(Bus& bus, Input input) {
+    inputs.push_back(input);
+    usedBytes += sizeof(Input);
+    currentFrame++;
+
+    if (currentFrame % SNAPSHOT_INTERVAL == 0) {
+        takeSnapshot(bus);
+    }
+}
+
+bool RewindBuffer::stepBack(Bus& bus, std::vector<Input>& replayInputs) {
+    // Showing the previous frame means running it again, so the snapshot has to be from before it started
+    if (currentFrame < 2) {
+        return false;
+    }
+    uint64_t targetFrame = currentFrame - 1;
+
+    size_t index = snapshots.size();
+    while (index > 0 && snapshots[index - 1].frame > targetFrame - 1) {
+        index--;
+    }
+    if (index == 0) {
+        return false;
+    }
+    index--;
+
+    const Snapshot& snapshot = snapshots[index];
+    decodeSnapshot(index, *scratch);
+    bus.loadSnapshot(*scratch);
+
+    replayInputs.assign(
+        inputs.begin() + static_cast<ptrdiff_t>(snapshot.frame - firstInputFrame),
+        inputs.begin() + static_cast<ptrdiff_t>(targetFrame - firstInputFrame)
+    );
+
+    // The frames after the target are forgotten, and will be recorded again if the console runs forwards from here
+    currentFrame = targetFrame;
+    usedBytes -= sizeof(Input) * (inputs.size() - (targetFrame - firstInputFrame));
+    inputs.resize(static_cast<size_t>(targetFrame - firstInputFrame));
+
+    bool droppedKeyframe = false;
+    while (snapshots.back().frame > targetFrame) {
+        droppedKeyframe |= snapshots.back().isKeyframe;
+        dropSnapshot(snapshots.back());
+        snapshots.pop_back();
+    }
+
+    snapshotsSinceKeyframe = 0;
+    size_t keyframeIndex = snapshots.size() - 1;
+    while (!snapshots[keyframeIndex].isKeyframe) {
+        keyframeIndex--;
+        snapshotsSinceKeyframe++;
+    }
+    if (droppedKeyframe) {
+        // The console has nothing in common with the decoded keyframe, so the next snapshots are compared against all of it
+        decodeSnapshot(keyframeIndex, *keyframe.state);
+        keyframe.generation = 0;
+    }
+
+    return true;
+}
+
+void RewindBuffer::takeSnapshot(Bus& bus) {
+    // The APU may be behind the rest of the console. The channels are not fetched from an APU thread, which would make the
+    // emulation thread wait for the audio thread every few frames. Running the console again only depends on the registers the
+    // CPU can read, which this APU keeps up to date itself, so a rewound console still replays the same frames.
+    bus.apu.synchronize();
+
+    std::vector<uint8_t> delta;
+    if (!spareBuffers.empty()) {
+        delta = std::move(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+
+    bool isKeyframe = snapshots.empty() || snapshotsSinceKeyframe + 1 >= KEYFRAME_INTERVAL;
+    if (isKeyframe) {
+        encodeDelta(bus, nullptr, delta);
+        bus.saveSnapshot(keyframe);
+        snapshotsSinceKeyframe = 0;
+    }
+    else {
+        encodeDelta(bus, &keyframe, delta);
+        snapshotsSinceKeyframe++;
+    }
+
+    usedBytes += delta.size();
+    snapshots.push_back({ currentFrame, isKeyframe, std::move(delta) });
+
+    // The newest keyframe and the snapshots after it are always kept
+    bool hasOlderKeyframe = snapshotsSinceKeyframe + 1 < snapshots.size();
+    while (usedBytes > maxBytes && hasOlderKeyframe) {
+        dropOldestKeyframe();
+        hasOlderKeyframe = snapshotsSinceKeyframe + 1 < snapshots.size();
+    }
+}
+
+void RewindBuffer::dropSnapshot(Snapshot& snapshot) {
+    usedBytes -= snapshot.delta.size();
+    snapshot.delta.clear();
+    spareBuffers.push_back(std::move(snapshot.delta));
+}
+
+void RewindBuffer::dropOldestKeyframe() {
+    do {
+        dropSnapshot(snapshots.front());
+        snapshots.pop_front();
+    } while (!snapshots.front().isKeyframe);
+
+    // The input from before the oldest snapshot can no longer be replayed
+    while (firstInputFrame < snapshots.front().frame) {
+        inputs.pop_front();
+        usedBytes -= sizeof(Input);
+        firstInputFrame++;
+    }
+}
+
+void RewindBuffer::decodeSnapshot(size_t index, Bus::State& state) const {
+    size_t keyframeIndex = index;
+    while (!snapshots[keyframeIndex].isKeyframe) {
+        keyframeIndex--;
+    }
+
+    std::memset(static_cast<void*>(&state), 0, sizeof(Bus::State));
+    applyDelta(snapshots[keyframeIndex].delta, state);
+    if (keyframeIndex != index) {
+        applyDelta(snapshots[index].delta, state);
+    }
+}
+
+// A delta is a list of runs. Each run is the number of words that are the same as the reference, followed by the number of words
+// that differ and then those words XORed with the reference. The counts are stored 7 bits at a time, with the top bit marking
+// that another byte follows.
+void RewindBuffer::encodeDelta(const Bus& bus, const Bus::Snapshot* reference, std::vector<uint8_t>& delta) {
+    const uint8_t* current = reinterpret_cast<const uint8_t*>(&bus.state);
+    const uint8_t* previous = reference != nullptr ? reinterpret_cast<const uint8_t*>(reference->state.get()) : nullptr;
+
+    // Pages that were not written since the reference was saved are the same in both, so they are skipped without being compared
+    auto isPageUnchanged = [&](size_t index) {
+        return previous != nullptr && index % WORDS_PER_PAGE == 0 && !bus.writeTracker.wasWrittenSince(index / WORDS_PER_PAGE, reference->generation);
+    };
+
+    auto getWord = [&](size_t index) -> uint64_t {
+        uint64_t word;
+        std::memcpy(&word, current + index * sizeof(uint64_t), sizeof(uint64_t));
+        if (previous != nullptr) {
+            uint64_t previousWord;
+            std::memcpy(&previousWord, previous + index * sizeof(uint64_t), sizeof(uint64_t));
+            word ^= previousWord;
+        }
+        return word;
+    };
+
+    auto writeCount = [&](size_t count) {
+        while (count >= 0x80) {
+            delta.push_back(static_cast<uint8_t>(count | 0x80));
+            count >>= 7;
+        }
+        delta.push_back(static_cast<uint8_t>(count));
+    };
+
+    delta.clear();
+    size_t index = 0;
+    while (index < NUM_STATE_WORDS) {
+        size_t sameStart = index;
+        while (index < NUM_STATE_WORDS) {
+            if (isPageUnchanged(index)) {
+                index = std::min(index + WORDS_PER_PAGE, NUM_STATE_WORDS);
+            }
+            else if (getWord(index) == 0) {
+                index++;
+            }
+            else {
+                break;
+            }
+        }
+
+        size_t differentStart = index;
+        while (index < NUM_STATE_WORDS && getWord(index) != 0) {
+            index++;
+        }
+
+        writeCount(differentStart - sameStart);
+        writeCount(index - differentStart);
+
+        size_t offset = delta.size();
+        delta.resize(offset + (index - differentStart) * sizeof(uint64_t));
+        for (size_t i = differentStart; i < index; i++) {
+            uint64_t word = getWord(i);
+            std::memcpy(delta.data() + offset, &word, sizeof(uint64_t));
+            offset += sizeof(uint64_t);
+        }
+    }
+}
+
+void RewindBuffer::applyDelta(const std::vector<uint8_t>& delta, Bus::State& state) {
+    uint8_t* output = reinterpret_cast<uint8_t*>(&state);
+
+    size_t position = 0;
+    auto readCount = [&]() -> size_t {
+        size_t count = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = delta[position++];
+            count |= static_cast<size_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return count;
+    };
+
+    size_t index = 0;
+    while (position < delta.size()) {
+        index += readCount();
+        size_t numDifferent = readCount();
+        for (size_t i = 0; i < numDifferent; i++, index++) {
+            uint64_t word;
+            uint64_t difference;
+            std::memcpy(&word, output + index * sizeof(uint64_t), sizeof(uint64_t));
+            std::memcpy(&difference, delta.data() + position, sizeof(uint64_t));
+            word ^= difference;
+            std::memcpy(output + index * sizeof(uint64_t), &word, sizeof(uint64_t));
+            position += sizeof(uint64_t);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#include "core/rollbacksession.hpp"
+
+#include <algorithm>
+#include <utility>
+
+RollbackSession::RollbackSession(Bus& bus, int localPlayer, RunFrame runFrame) :
+    bus(bus),
+    localPlayer(localPlayer),
+    runFrame(std::move(runFrame)),
+    rollbackFrames(MAX_ROLLBACK_FRAMES),
+    currentFrame(0),
+    confirmedRemoteFrames(0),
+    firstMispredictedFrame(NO_MISPREDICTION),
+    inputs{} {
+}
+
+void RollbackSession::addRemoteInput(uint32_t frame, uint8_t buttons) {
+    // The other player cannot get far enough ahead to send input past the history
+    if (frame < confirmedRemoteFrames || frame >= currentFrame + INPUT_HISTORY / 2) {
+        return;
+    }
+
+    FrameInput& input = getInput(frame);
+    if (input.isRemoteReceived) {
+        return;
+    }
+
+    // Frames that were already run used a prediction
+    if (frame < currentFrame && input.remote != buttons) {
+        firstMispredictedFrame = std::min(firstMispredictedFrame, frame);
+    }
+
+    input.remote = buttons;
+    input.isRemoteReceived = true;
+
+    // Input can arrive out of order, so the confirmed frames only move up to the first gap
+    while (getInput(confirmedRemoteFrames).isRemoteReceived) {
+        confirmedRemoteFrames++;
+    }
+}
+
+uint32_t RollbackSession::fitRollbackFrames(double frameNs, double frameTimeNs) {
+    double framesWithinBudget = frameNs > 0.0 ? frameTimeNs * FRAME_TIME_BUDGET / frameNs : MAX_ROLLBACK_FRAMES;
+    return static_cast<uint32_t>(std::clamp(framesWithinBudget, 1.0, static_cast<double>(MAX_ROLLBACK_FRAMES)));
+}
+
+void RollbackSession::setRollbackFrames(uint32_t frames) {
+    rollbackFrames = std::clamp<uint32_t>(frames, 1, MAX_ROLLBACK_FRAMES);
+}
+
+uint32_t RollbackSession::getRollbackFrames() const {
+    return rollbackFrames;
+}
+
+bool RollbackSession::canAdvance() const {
+    // Any frame with predicted input has to still have its snapshot, which is always the case within the window
+    return currentFrame < confirmedRemoteFrames + rollbackFrames;
+}
+
+uint32_t RollbackSession::advanceFrame(uint8_t localButtons) {
+    uint32_t resimulatedFrames = 0;
+    if (firstMispredictedFrame != NO_MISPREDICTION) {
+        // The frames were already heard with the wrong input, so they are run again in silence
+        bus.apu.setAudioOutputEnabled(false);
+        bus.loadSnapshot(snapshots[firstMispredictedFrame % MAX_ROLLBACK_FRAMES]);
+        for (uint32_t frame = firstMispredictedFrame; frame < currentFrame; frame++) {
+            runFrameWithInput(frame, true);
+            resimulatedFrames++;
+        }
+        bus.apu.setAudioOutputEnabled(true);
+        firstMispredictedFrame = NO_MISPREDICTION;
+    }
+
+    getInput(currentFrame).local = localButtons;
+    runFrameWithInput(currentFrame, false);
+    currentFrame++;
+
+    return resimulatedFrames;
+}
+
+uint32_t RollbackSession::getCurrentFrame() const {
+    return currentFrame;
+}
+
+uint32_t RollbackSession::getConfirmedRemoteFrames() const {
+    return confirmedRemoteFrames;
+}
+
+uint8_t RollbackSession::getLocalInput(uint32_t frame) const {
+    const FrameInput& input = inputs[frame % INPUT_HISTORY];
+    return input.frame == frame ? input.local : 0;
+}
+
+RollbackSession::FrameInput& RollbackSession::getInput(uint32_t frame) {
+    // A slot is reused once the frame it held is too old to be needed
+    FrameInput& input = inputs[frame % INPUT_HISTORY];
+    if (input.frame != frame) {
+        input = { frame, 0, 0, false };
+    }
+    return input;
+}
+
+uint8_t RollbackSession::predictRemoteInput() const {
+    if (confirmedRemoteFrames == 0) {
+        return 0;
+    }
+    return inputs[(confirmedRemoteFrames - 1) % INPUT_HISTORY].remote;
+}
+
+void RollbackSession::runFrameWithInput(uint32_t frame, bool isResimulation) {
+    bus.saveSnapshot(snapshots[frame % MAX_ROLLBACK_FRAMES]);
+
+    FrameInput& input = getInput(frame);
+    if (!input.isRemoteReceived) {
+        input.remote = predictRemoteInput();
+    }
+
+    if (localPlayer == 0) {
+        runFrame(input.local, input.remote, isResimulation);
+    }
+    else {
+        runFrame(input.remote, input.local, isResimulation);
+    }
+}
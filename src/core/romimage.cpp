@@ -0,0 +1,144 @@
+#include "core/romimage.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROMIMAGE_USE_MMAP
+#endif
+
+RomImage::RomImage() : data(nullptr), size(0), isMapped(false), hash{} {}
+
+RomImage::~RomImage() {
+#ifdef ROMIMAGE_USE_MMAP
+    if (isMapped) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+}
+
+std::shared_ptr<const RomImage> RomImage::open(const std::string& filePath) {
+    // Images stay cached only while some cartridge still holds them
+    static std::mutex cacheMutex;
+    static std::map<std::string, std::weak_ptr<const RomImage>> cache;
+
+    std::error_code error;
+    std::string key = std::filesystem::weakly_canonical(filePath, error).string();
+    if (error) {
+        key = filePath;
+    }
+    std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(filePath, error);
+    if (error) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        std::shared_ptr<const RomImage> cached = it->second.lock();
+        if (cached != nullptr && cached->lastWriteTime == lastWriteTime) {
+            return cached;
+        }
+    }
+
+    std::shared_ptr<RomImage> image = load(filePath);
+    if (image == nullptr) {
+        return nullptr;
+    }
+    image->lastWriteTime = lastWriteTime;
+
+    // Drop any entries whose images have since been released
+    for (auto entry = cache.begin(); entry != cache.end();) {
+        entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+    }
+    cache[key] = image;
+
+    return image;
+}
+
+ByteView RomImage::getData() const {
+    return { data, size };
+}
+
+const Sha256::Digest& RomImage::getHash() const {
+    return hash;
+}
+
+std::shared_ptr<RomImage> RomImage::load(const std::string& filePath) {
+    // The constructor is private, so make_shared cannot be used here
+    std::shared_ptr<RomImage> image(new RomImage());
+    if (!image->tryMap(filePath) && !image->tryRead(filePath)) {
+        return nullptr;
+    }
+
+    // This is the only pass over the whole file. Parsing afterwards only touches the header.
+    image->hash = Sha256::hash(image->getData());
+    return image;
+}
+
+bool RomImage::tryMap(const std::string& filePath) {
+#ifdef ROMIMAGE_USE_MMAP
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(fileStat.st_size);
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    // The whole file is hashed straight away, so ask for it to be read ahead
+    madvise(mapped, fileSize, MADV_WILLNEED);
+
+    data = static_cast<const uint8_t*>(mapped);
+    size = fileSize;
+    isMapped = true;
+    return true;
+#else
+    (void)filePath;
+    return false;
+#endif
+}
+
+bool RomImage::tryRead(const std::string& filePath) {
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+
+    std::streamoff fileSize = file.tellg();
+    if (fileSize < 0) {
+        return false;
+    }
+    file.seekg(0);
+
+    fallbackArena = Arena(static_cast<size_t>(fileSize));
+    uint8_t* buffer = fallbackArena.allocateArray<uint8_t>(static_cast<size_t>(fileSize));
+    if (fileSize > 0) {
+        file.read(reinterpret_cast<char*>(buffer), fileSize);
+        if (!file) {
+            return false;
+        }
+    }
+
+    data = buffer;
+    size = static_cast<size_t>(fileSize);
+    return true;
+}
@@ -0,0 +1,162 @@
+#include "core/warmstartcache.hpp"
+
+#include "util/serializer.hpp"
+#include "util/util.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <system_error>
+#include <vector>
+
+WarmStartCache::WarmStartCache(const std::string& directory) : directory(directory) {
+}
+
+WarmStartCache::Status WarmStartCache::apply(Bus& bus) {
+    const std::shared_ptr<const RomImage>& romImage = bus.cartridge.getRomImage();
+    if (romImage == nullptr || bus.cartridge.getNsfHeader() != nullptr) {
+        return { Status::Code::UNSUPPORTED, 0, "Warm start is not available for NSF files." };
+    }
+
+    std::string filePath = getFilePath(romImage->getHash());
+    uint64_t powerOnHash = bus.hashState().combined();
+
+    // Put back if the cached state turns out to be corrupted, or if the game never strobes the controllers
+    std::unique_ptr<Bus::State> powerOnState = std::make_unique<Bus::State>();
+    bus.saveSnapshot(*powerOnState);
+
+    Status status;
+    if (tryRestore(bus, filePath, powerOnHash, status)) {
+        return status;
+    }
+    bus.loadSnapshot(*powerOnState);
+
+    // Nobody hears the frames that are skipped
+    bus.apu.setAudioOutputEnabled(false);
+    uint64_t skippedCycles = runToFirstStrobe(bus);
+    bus.apu.setAudioOutputEnabled(true);
+
+    bool strobed = bus.state.strobe;
+    if (!strobed) {
+        bus.loadSnapshot(*powerOnState);
+        skippedCycles = 0;
+    }
+
+    if (!write(bus, filePath, powerOnHash, strobed, skippedCycles)) {
+        return { Status::Code::WRITING_ERROR, skippedCycles, "Could not write the warm start cache file " + filePath + "." };
+    }
+    if (!strobed) {
+        return { Status::Code::NO_STROBE, 0, "The game does not read the controllers while starting up, so it is started from power-on." };
+    }
+    return {
+        Status::Code::CAPTURED,
+        skippedCycles,
+        "Skipped " + std::to_string(skippedCycles / CYCLES_PER_FRAME) + " frames of starting up, and cached the state in " + filePath + "."
+    };
+}
+
+std::string WarmStartCache::getFilePath(const Sha256::Digest& romHash) const {
+    std::string fileName;
+    for (uint8_t byte : romHash) {
+        fileName += toHexString8(byte);
+    }
+    return (std::filesystem::path(directory) / (fileName + ".warm")).string();
+}
+
+bool WarmStartCache::tryRestore(Bus& bus, const std::string& filePath, uint64_t powerOnHash, Status& status) const {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Deserializer d({ bytes.data(), bytes.size() });
+    uint32_t fileID;
+    uint8_t fileVersion;
+    uint32_t coreVersion;
+    uint32_t stateSize;
+    uint64_t cachedPowerOnHash;
+    bool strobed;
+    uint64_t skippedCycles;
+    d.deserializeUInt32(fileID);
+    d.deserializeUInt8(fileVersion);
+    d.deserializeUInt32(coreVersion);
+    d.deserializeUInt32(stateSize);
+    d.deserializeUInt64(cachedPowerOnHash);
+    d.deserializeBool(strobed);
+    d.deserializeUInt64(skippedCycles);
+
+    // Anything else is left over from another build, or from different battery backed RAM, and is replaced
+    if (!d.good() || fileID != FILE_ID || fileVersion != FILE_VERSION || coreVersion != Bus::CORE_VERSION
+        || stateSize != sizeof(Bus::State) || cachedPowerOnHash != powerOnHash) {
+        return false;
+    }
+
+    if (!strobed) {
+        status = { Status::Code::NO_STROBE, 0, "The game does not read the controllers while starting up, so it is started from power-on." };
+        return true;
+    }
+
+    bus.deserializeAll(d);
+    if (!d.good()) {
+        return false;
+    }
+
+    status = {
+        Status::Code::RESTORED,
+        skippedCycles,
+        "Skipped " + std::to_string(skippedCycles / CYCLES_PER_FRAME) + " frames of starting up, restored from " + filePath + "."
+    };
+    return true;
+}
+
+uint64_t WarmStartCache::runToFirstStrobe(Bus& bus) const {
+    // A strobe is always followed by a write that ends it a few cycles later, so it is checked after every cycle
+    uint64_t cycles = 0;
+    while (!bus.state.strobe && cycles < MAX_BOOT_FRAMES * CYCLES_PER_FRAME) {
+        bus.executeCycle();
+        cycles++;
+    }
+    return cycles;
+}
+
+bool WarmStartCache::write(Bus& bus, const std::string& filePath, uint64_t powerOnHash, bool strobed, uint64_t skippedCycles) const {
+    Serializer s;
+    s.serializeUInt32(FILE_ID);
+    s.serializeUInt8(FILE_VERSION);
+    s.serializeUInt32(Bus::CORE_VERSION);
+    s.serializeUInt32(static_cast<uint32_t>(sizeof(Bus::State)));
+    s.serializeUInt64(powerOnHash);
+    s.serializeBool(strobed);
+    s.serializeUInt64(skippedCycles);
+
+    if (strobed) {
+        bus.serializeAll(s);
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    // Many instances of the emulator may start the same game at once, so the file is written under a name of its own
+    // and then renamed, which replaces any existing file in one step
+    std::string temporaryFilePath = filePath + "." + std::to_string(std::random_device()()) + ".tmp";
+    {
+        std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+        const std::vector<uint8_t>& buffer = s.getBuffer();
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (!file.flush()) {
+            file.close();
+            std::filesystem::remove(temporaryFilePath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryFilePath, filePath, error);
+    if (error) {
+        std::filesystem::remove(temporaryFilePath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#include "io/audioratecontrol.hpp"
+
+#include <algorithm>
+
+AudioRateControl::AudioRateControl(double sampleRate, size_t targetQueueDepth) :
+    nominalSampleRate(sampleRate),
+    targetQueueDepth(static_cast<double>(std::max<size_t>(targetQueueDepth, 1))),
+    smoothedQueueDepth(static_cast<double>(targetQueueDepth)),
+    sampleRate(sampleRate) {}
+
+double AudioRateControl::update(size_t queueDepth) {
+    smoothedQueueDepth += (static_cast<double>(queueDepth) - smoothedQueueDepth) * DEPTH_SMOOTHING;
+
+    // Synthesize more samples per frame while the queue is below its target, and fewer while it is above
+    double error = std::clamp((targetQueueDepth - smoothedQueueDepth) / targetQueueDepth, -1.0, 1.0);
+    sampleRate = nominalSampleRate * (1.0 + MAX_ADJUSTMENT * error);
+
+    return sampleRate;
+}
+
+double AudioRateControl::getSampleRate() const {
+    return sampleRate;
+}
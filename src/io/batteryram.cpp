@@ -0,0 +1,208 @@
+#include "io/batteryram.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BATTERYRAM_USE_MMAP
+#endif
+
+BatteryRam::BatteryRam() :
+    data(nullptr),
+    isMapped(false),
+    readOnly(false),
+    fallbackData{},
+    lockedFile(-1),
+    pageSize(0),
+    numPages(0),
+    dirtyPages(0),
+    stopRequested(false) {}
+
+BatteryRam::~BatteryRam() {
+    if (flushThread.joinable()) {
+        // The flush thread writes out any remaining dirty pages before it exits
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopRequested = true;
+        }
+        wakeCondition.notify_one();
+        flushThread.join();
+    }
+
+#ifdef BATTERYRAM_USE_MMAP
+    if (isMapped) {
+        munmap(data, sizeof(Data));
+    }
+    if (lockedFile >= 0) {
+        ::close(lockedFile); // Releases the lock
+    }
+#endif
+}
+
+std::string BatteryRam::getSaveFilePath(const std::string& romFilePath) {
+    return std::filesystem::path(romFilePath).replace_extension(".sav").string();
+}
+
+bool BatteryRam::open(const std::string& filePath) {
+    this->filePath = filePath;
+    if (!tryMap() && !tryRead()) {
+        return false;
+    }
+
+    numPages = sizeof(Data) / pageSize;
+    if (!readOnly) {
+        flushThread = std::thread(&BatteryRam::runFlushThread, this);
+    }
+    return true;
+}
+
+bool BatteryRam::isReadOnly() const {
+    return readOnly;
+}
+
+void BatteryRam::load(Data& prgRam) const {
+    std::memcpy(prgRam.data(), data, sizeof(Data));
+}
+
+void BatteryRam::update(const Data& prgRam) {
+    if (readOnly) {
+        return;
+    }
+
+    // Comparing the pages once a frame costs less than tracking every write to the RAM,
+    // and it also notices when a save state replaces the RAM as a whole.
+    // Only this thread writes to data, so it can be read without the mutex.
+    uint32_t changedPages = 0;
+    for (size_t page = 0; page < numPages; page++) {
+        size_t offset = page * pageSize;
+        if (std::memcmp(data + offset, prgRam.data() + offset, pageSize) != 0) {
+            changedPages |= 1u << page;
+        }
+    }
+
+    if (changedPages == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t page = 0; page < numPages; page++) {
+        if ((changedPages >> page) & 1) {
+            size_t offset = page * pageSize;
+            std::memcpy(data + offset, prgRam.data() + offset, pageSize);
+        }
+    }
+    dirtyPages |= changedPages;
+}
+
+bool BatteryRam::tryMap() {
+#ifdef BATTERYRAM_USE_MMAP
+    int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Two instances sharing the mapping would overwrite each other's saves, so only the first one to open the file writes to it.
+    // The lock is held until the descriptor is closed, which is kept open for as long as the file is, even if it cannot be mapped.
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        readOnly = true;
+        return false;
+    }
+    lockedFile = fd;
+
+    // New files, and files saved by emulators that stored less RAM, are extended with zeros
+    struct stat fileStat;
+    bool isTooShort = fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(Data));
+    if (isTooShort && ftruncate(fd, sizeof(Data)) != 0) {
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, sizeof(Data), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(mapped);
+    isMapped = true;
+
+    // msync works on whole pages of the mapping
+    long systemPageSize = sysconf(_SC_PAGESIZE);
+    bool isPageSizeUsable = systemPageSize > 0 && static_cast<size_t>(systemPageSize) < sizeof(Data);
+    pageSize = isPageSizeUsable ? static_cast<size_t>(systemPageSize) : sizeof(Data);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool BatteryRam::tryRead() {
+    // A missing or short file leaves the rest of the RAM zeroed
+    std::ifstream file(filePath, std::ios::binary);
+    if (file) {
+        file.read(reinterpret_cast<char*>(fallbackData.data()), fallbackData.size());
+    }
+
+    // Make sure the file can be written before relying on it, unless it belongs to another instance and is never written
+    if (readOnly) {
+        data = fallbackData.data();
+        pageSize = KB;
+        return true;
+    }
+    std::ofstream output(filePath, std::ios::binary | std::ios::app);
+    if (!output) {
+        return false;
+    }
+
+    data = fallbackData.data();
+    pageSize = KB;
+    return true;
+}
+
+void BatteryRam::runFlushThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    bool stopping = false;
+    while (!stopping) {
+        wakeCondition.wait_for(lock, FLUSH_INTERVAL, [this]() { return stopRequested; });
+        stopping = stopRequested;
+
+        uint32_t pages = dirtyPages;
+        dirtyPages = 0;
+        if (pages == 0) {
+            continue;
+        }
+
+        // Without a mapping the file is written from a copy, so the emulation thread is free to keep updating the RAM meanwhile
+        Data snapshot;
+        if (!isMapped) {
+            std::memcpy(snapshot.data(), data, sizeof(Data));
+        }
+
+        lock.unlock();
+        flush(pages, snapshot);
+        lock.lock();
+    }
+}
+
+void BatteryRam::flush(uint32_t pages, const Data& snapshot) {
+#ifdef BATTERYRAM_USE_MMAP
+    if (isMapped) {
+        for (size_t page = 0; page < numPages; page++) {
+            if ((pages >> page) & 1) {
+                msync(data + page * pageSize, pageSize, MS_SYNC);
+            }
+        }
+        return;
+    }
+#endif
+
+    (void)pages;
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+}
@@ -1,8 +1,10 @@
 #include "io/emulatorthread.hpp"
+#include <algorithm>
 #include <cstdint>
 
 #include <QElapsedTimer>
 #include <QString>
+#include <QStringList>
 
 #include <iostream>
 
@@ -18,7 +20,9 @@ EmulatorThread::EmulatorThread(
 	sharedKeyInput(sharedKeyInput),
 	keyInputMutex(keyInputMutex),
 	audioSamples(audioSamples),
-	saveState(bus, QString::fromStdString(romFilePath)) {
+	audioTargetQueueSamples(getAudioTargetQueueSamples()),
+	audioRateControl(AUDIO_SAMPLE_RATE, audioTargetQueueSamples),
+	saveState(bus) {
 	isRunning.store(false);
 
 	Cartridge::Status status = bus.tryInitDevices(romFilePath);
@@ -26,16 +30,57 @@ EmulatorThread::EmulatorThread(
 		qFatal("%s", status.message.c_str());
 	}
 
-	const Mapper::Config& config = bus.cartridge->mapper->config;
-	std::cerr << "ROM loaded successfully.\n";
-	std::cerr << "Mapper: " << static_cast<int>(config.id) << "\n";
-	std::cerr << "PRG ROM chunks: " << static_cast<int>(config.prgChunks) << "\n";
-	std::cerr << "CHR ROM chunks: " << static_cast<int>(config.chrChunks) << "\n";
-	std::cerr << "Initial mirroring: " << (config.initialMirrorMode == Mapper::MirrorMode::HORIZONTAL ? "Horizontal\n" : "Vertical\n");
-	std::cerr << "Battery backed PRG RAM: " << (config.hasBatteryBackedPrgRam ? "Yes\n" : "No\n");
-	std::cerr << "CHR RAM: " << (config.chrChunks == 0 ? "Yes\n" : "No\n");
-	std::cerr << "Alternative nametable layout: " << (config.alternativeNametableLayout ? "Yes\n" : "No\n");
-	std::cerr << std::endl;
+	const MapperNSF::Header* nsfHeader = bus.cartridge.getNsfHeader();
+	if (nsfHeader != nullptr) {
+		std::cerr << "NSF loaded successfully.\n";
+		std::cerr << "Songs: " << static_cast<int>(nsfHeader->songCount) << "\n";
+		std::cerr << "Bankswitched: " << (nsfHeader->isBankswitched ? "Yes\n" : "No\n");
+		std::cerr << std::endl;
+	}
+	else {
+		const Mapper::Config& config = bus.cartridge.mapper->config;
+		std::cerr << "ROM loaded successfully.\n";
+		std::cerr << "Mapper: " << static_cast<int>(config.id) << "\n";
+		std::cerr << "PRG ROM chunks: " << static_cast<int>(config.prgChunks) << "\n";
+		std::cerr << "CHR ROM chunks: " << static_cast<int>(config.chrChunks) << "\n";
+		std::cerr << "Initial mirroring: " << (config.initialMirrorMode == Mapper::MirrorMode::HORIZONTAL ? "Horizontal\n" : "Vertical\n");
+		std::cerr << "Battery backed PRG RAM: " << (config.hasBatteryBackedPrgRam ? "Yes\n" : "No\n");
+		std::cerr << "CHR RAM: " << (config.chrChunks == 0 ? "Yes\n" : "No\n");
+		std::cerr << "Alternative nametable layout: " << (config.alternativeNametableLayout ? "Yes\n" : "No\n");
+		std::cerr << std::endl;
+	}
+
+	// The player starts the first song right away, which resets the console, so a save state is loaded afterwards
+	if (nsfHeader != nullptr) {
+		nsfPlayer.emplace(bus);
+	}
+	lastNsfButtons = 0;
+
+	// The saved RAM is loaded before the save state, which brings its own copy of the RAM
+	if (nsfHeader == nullptr && bus.cartridge.mapper->config.hasBatteryBackedPrgRam) {
+		std::string batteryFilePath = BatteryRam::getSaveFilePath(romFilePath);
+		batteryRam = std::make_unique<BatteryRam>();
+		if (batteryRam->open(batteryFilePath)) {
+			batteryRam->load(bus.state.mapper.prgRam);
+			if (batteryRam->isReadOnly()) {
+				std::cerr << batteryFilePath << " is in use by another instance, battery backed PRG RAM will not be saved" << std::endl;
+			}
+			else {
+				std::cerr << "Battery backed PRG RAM is saved to " << batteryFilePath << std::endl;
+			}
+		}
+		else {
+			std::cerr << "Could not open " << batteryFilePath << ", battery backed PRG RAM will not be saved" << std::endl;
+			batteryRam.reset();
+		}
+	}
+
+	// Skipping ahead depends on the saved RAM, which some games read while starting up, and is pointless when a save state follows
+	QString warmStartDirectory = qEnvironmentVariable("NES_WARM_START_CACHE");
+	if (!warmStartDirectory.isEmpty() && nsfHeader == nullptr && !saveFilePathOption.has_value()) {
+		WarmStartCache::Status warmStartStatus = WarmStartCache(warmStartDirectory.toStdString()).apply(bus);
+		std::cerr << warmStartStatus.message << std::endl;
+	}
 
 	if (saveFilePathOption.has_value()) {
 		QString saveFilePath = QString::fromStdString(saveFilePathOption.value());
@@ -43,8 +88,72 @@ EmulatorThread::EmulatorThread(
 		std::cerr << saveStatus.message << std::endl;
 	}
 
-	scaledAudioClock = 0;
+	netplaySettings = parseNetplaySettings(qEnvironmentVariable("NES_NETPLAY"));
+	if (netplaySettings.has_value() && nsfHeader != nullptr) {
+		std::cerr << "Netplay is not available for NSF files." << std::endl;
+		netplaySettings.reset();
+	}
+
+	fixedRollbackFrames = static_cast<uint32_t>(std::clamp(
+		qEnvironmentVariableIntValue("NES_NETPLAY_ROLLBACK"), 0, static_cast<int>(RollbackSession::MAX_ROLLBACK_FRAMES)));
+	netplayFrameNs = 0.0;
+
+	netplayStatsEnabled = qEnvironmentVariableIntValue("NES_NETPLAY_STATS") != 0;
+	netplayStatsFrames = 0;
+	netplayStalledFrames = 0;
+	resimulatedFrames = 0;
+	maxResimulatedFrames = 0;
+	maxNetplayFrameNs = 0;
+
+	if (nsfHeader == nullptr && !netplaySettings.has_value()) {
+		rewindBuffer = std::make_unique<RewindBuffer>(REWIND_BUFFER_BYTES);
+		rewindBuffer->restart(bus);
+	}
+
+	bus.apu.setAudioRates(INSTRUCTIONS_PER_SECOND, AUDIO_SAMPLE_RATE);
 	soundReady = false;
+	audioMuted = false;
+
+	audioStatsEnabled = qEnvironmentVariableIntValue("NES_AUDIO_STATS") != 0;
+	audioStatsFrames = 0;
+	minAudioQueueDepth = SIZE_MAX;
+	maxAudioQueueDepth = 0;
+
+	if (qEnvironmentVariableIntValue("NES_APU_THREAD") != 0 && netplaySettings.has_value()) {
+		// Frames that are run again after a rollback have to stay silent, which only the APU on this thread knows about
+		std::cerr << "Audio is synthesized on the emulation thread during netplay." << std::endl;
+	}
+	else if (qEnvironmentVariableIntValue("NES_APU_THREAD") != 0) {
+		apuThread = std::make_unique<APUThread>([this](const float* samples, size_t numSamples) {
+			queueAudioSamples(samples, numSamples);
+		});
+		apuThread->setAudioRates(INSTRUCTIONS_PER_SECOND, AUDIO_SAMPLE_RATE);
+		bus.apu.setAPUThread(apuThread.get());
+		std::cerr << "Synthesizing audio on a separate thread." << std::endl;
+	}
+
+	runAheadFrames = std::clamp(qEnvironmentVariableIntValue("NES_RUN_AHEAD"), 0, MAX_RUN_AHEAD_FRAMES);
+	if (runAheadFrames > 0 && nsfHeader != nullptr) {
+		std::cerr << "Run-ahead is not available for NSF files." << std::endl;
+		runAheadFrames = 0;
+	}
+	else if (runAheadFrames > 0 && netplaySettings.has_value()) {
+		std::cerr << "Run-ahead is not available during netplay." << std::endl;
+		runAheadFrames = 0;
+	}
+	else if (runAheadFrames > 0 && apuThread != nullptr) {
+		// The APU thread would synthesize the frames run ahead, which are never heard
+		std::cerr << "Run-ahead is not available while synthesizing audio on a separate thread." << std::endl;
+		runAheadFrames = 0;
+	}
+	else if (runAheadFrames > 0) {
+		std::cerr << "Running " << runAheadFrames << " frame" << (runAheadFrames == 1 ? "" : "s") << " ahead." << std::endl;
+	}
+
+	runAheadStatsEnabled = qEnvironmentVariableIntValue("NES_RUN_AHEAD_STATS") != 0;
+	runAheadStatsFrames = 0;
+	runAheadStatsNs = 0;
+	maxRunAheadNs = 0;
 
 	localKeyInput = {};
 	lastResetCount = 0;
@@ -52,7 +161,10 @@ EmulatorThread::EmulatorThread(
 	lastFrameStepCount = 0;
 	lastSaveCount = 0;
 	lastLoadCount = 0;
+	lastQuickSaveCount = 0;
+	lastQuickLoadCount = 0;
 	debugWindowOpenLastFrame = false;
+	nextPatternTablesBuffer = 0;
 
 	qRegisterMetaType<DebugWindowState>("DebugWindowState");
 }
@@ -60,6 +172,12 @@ EmulatorThread::EmulatorThread(
 EmulatorThread::~EmulatorThread() {
 	isRunning.store(false);
 	wait();
+
+	// The APU thread queues samples through this object, so it is stopped before any members are destroyed
+	if (apuThread != nullptr) {
+		bus.apu.setAPUThread(nullptr);
+		apuThread.reset();
+	}
 }
 
 void EmulatorThread::requestStop() {
@@ -69,6 +187,13 @@ void EmulatorThread::requestStop() {
 void EmulatorThread::run() {
 	isRunning.store(true);
 
+	if (netplaySettings.has_value() && !startNetplay()) {
+		// Carry on as a single player game
+		netplaySettings.reset();
+		rewindBuffer = std::make_unique<RewindBuffer>(REWIND_BUFFER_BYTES);
+		rewindBuffer->restart(bus);
+	}
+
 	QElapsedTimer framePacingTimer;
 	framePacingTimer.start();
 	int64_t nextFrameTargetNs = framePacingTimer.nsecsElapsed() + TARGET_FRAME_NS;
@@ -83,8 +208,21 @@ void EmulatorThread::run() {
 		// Check reset
 		uint8_t numResets = localKeyInput.resetCount - lastResetCount;
 		lastResetCount = localKeyInput.resetCount;
-		if (numResets >= 1) { // Only perform a max of one reset each frame
-			bus.reset();
+		if (numResets >= 1 && rollbackSession != nullptr) {
+			std::cerr << "Resetting is not available during netplay." << std::endl;
+		}
+		else if (numResets >= 1) { // Only perform a max of one reset each frame
+			if (nsfPlayer.has_value()) {
+				nsfPlayer->startSong(nsfPlayer->getCurrentSong());
+			}
+			else {
+				bus.reset();
+			}
+
+			// The history cannot be replayed across a reset
+			if (rewindBuffer != nullptr) {
+				rewindBuffer->restart(bus);
+			}
 
 			recentPCs.erase();
 
@@ -95,30 +233,61 @@ void EmulatorThread::run() {
 		uint8_t numLoads = localKeyInput.loadCount - lastLoadCount;
 		lastLoadCount = localKeyInput.loadCount;
 		bool loadedSaveStateThisFrame = false;
-		if (numLoads >= 1) { // Only perform a max of one load each frame
-			SaveState::LoadStatus saveStatus = saveState.loadSaveState(localKeyInput.mostRecentSaveFilePath);
-			std::cerr << saveStatus.message << std::endl;
+		if (numLoads >= 1 && rollbackSession != nullptr) {
+			std::cerr << "Loading save states is not available during netplay." << std::endl;
+		}
+		else if (numLoads >= 1) { // Only perform a max of one load each frame
+			saveState.requestLoad(localKeyInput.mostRecentSaveFilePath);
+		}
+
+		// The file is read in the background, so a save state is loaded on one of the frames after it was requested
+		if (std::optional<SaveState::LoadStatus> loadStatus = saveState.applyLoad()) {
+			std::cerr << loadStatus->message << std::endl;
+			loadedSaveStateThisFrame = loadStatus->code == SaveState::LoadStatus::Code::SUCCESS;
+		}
 
-			if (saveStatus.code == SaveState::LoadStatus::Code::SUCCESS) {
-				recentPCs.erase();
-				loadedSaveStateThisFrame = true;
+		uint8_t numQuickLoads = localKeyInput.quickLoadCount - lastQuickLoadCount;
+		lastQuickLoadCount = localKeyInput.quickLoadCount;
+		if (numQuickLoads >= 1 && rollbackSession != nullptr) {
+			std::cerr << "Loading save states is not available during netplay." << std::endl;
+		}
+		else if (numQuickLoads >= 1) { // Only perform a max of one quick load each frame
+			loadedSaveStateThisFrame = quickLoad(localKeyInput.quickLoadSlot) || loadedSaveStateThisFrame;
+		}
+
+		if (loadedSaveStateThisFrame) {
+			if (rewindBuffer != nullptr) {
+				rewindBuffer->restart(bus);
 			}
+
+			recentPCs.erase();
 		}
 
 		uint8_t numSaves = localKeyInput.saveCount - lastSaveCount;
 		lastSaveCount = localKeyInput.saveCount;
 		if (numSaves >= 1) { // Only perform a max of one save each frame
-			SaveState::CreateStatus saveStatus = saveState.createSaveState(localKeyInput.mostRecentSaveFilePath);
-			std::cerr << saveStatus.message << std::endl;
+			saveState.requestCreate(localKeyInput.mostRecentSaveFilePath);
+		}
+		while (std::optional<SaveState::CreateStatus> createStatus = saveState.takeCreateStatus()) {
+			std::cerr << createStatus->message << std::endl;
+		}
+
+		uint8_t numQuickSaves = localKeyInput.quickSaveCount - lastQuickSaveCount;
+		lastQuickSaveCount = localKeyInput.quickSaveCount;
+		if (numQuickSaves >= 1) { // Only perform a max of one quick save each frame
+			quickSave(localKeyInput.quickSaveSlot);
 		}
 
 		// Handle controller input
 		bus.setController(0, localKeyInput.controller1ButtonMask);
 		bus.setController(1, localKeyInput.controller2ButtonMask);
 
+		if (nsfPlayer.has_value()) {
+			updateNsfSong();
+		}
+
 		// Check audio
-		bool muted = localKeyInput.muted || localKeyInput.paused;
-		if (muted) scaledAudioClock = 0;
+		bool muted = localKeyInput.muted || localKeyInput.paused || localKeyInput.rewinding;
 
 		// Check if the debug window was opened this frame so it can update even if the game is paused
 		bool debugWindowOpenedThisFrame = localKeyInput.debugWindowEnabled && !debugWindowOpenLastFrame;
@@ -136,26 +305,49 @@ void EmulatorThread::run() {
 		bool shouldOutputGameFrame;
 		bool shouldOutputDebugFrame;
 		if (!localKeyInput.paused) {
-			runUntilFrameReady();
-			shouldOutputGameFrame = true;
+			if (rollbackSession != nullptr) {
+				shouldOutputGameFrame = updateNetplay(true);
+			}
+			else if (localKeyInput.rewinding && rewindBuffer != nullptr) {
+				// Once the start of the history is reached, the oldest frame stays on screen
+				shouldOutputGameFrame = rewindFrame();
+			}
+			else {
+				runRecordedFrame();
+				if (runAheadFrames > 0) {
+					runAhead();
+				}
+				shouldOutputGameFrame = true;
+			}
 			shouldOutputDebugFrame = localKeyInput.debugWindowEnabled;
 		}
 		else {
-			if (numFrameSteps) {
+			if (rollbackSession != nullptr) {
+				// The other player may be waiting for this one, so input is still exchanged while paused
+				updateNetplay(false);
+				shouldOutputGameFrame = false;
+				shouldOutputDebugFrame = debugWindowOpenedThisFrame;
+			}
+			else if (numFrameSteps) {
 				for (int i = 0; i < numFrameSteps; i++) {
-					runUntilFrameReady();
+					runRecordedFrame();
 				}
 				shouldOutputGameFrame = true;
 				shouldOutputDebugFrame = true;
 			}
 			else if (numSteps) {
 				runSteps(numSteps);
-				shouldOutputGameFrame = bus.ppu->frameReadyFlag;
+				shouldOutputGameFrame = bus.ppu.frameReady();
 				shouldOutputDebugFrame = true;
+
+				// The history is made of whole frames, so it starts over from wherever the steps ended
+				if (rewindBuffer != nullptr) {
+					rewindBuffer->restart(bus);
+				}
 			}
 			else if (loadedSaveStateThisFrame) {
 				// If we just loaded a save state and the game is paused, show the first frame of the new state
-				runUntilFrameReady();
+				runRecordedFrame();
 				shouldOutputGameFrame = true;
 				shouldOutputDebugFrame = localKeyInput.debugWindowEnabled;
 			}
@@ -165,30 +357,34 @@ void EmulatorThread::run() {
 			}
 		}
 
+		if (batteryRam) {
+			batteryRam->update(bus.state.mapper.prgRam);
+		}
+
 		if (!isRunning.load()) break;
 
 		// Output frames
 		if (shouldOutputGameFrame) {
-			const PPU::Display& display = *(bus.ppu->finishedDisplay);
+			const PPU::Display& display = bus.ppu.getFinishedDisplay();
 			QImage image(reinterpret_cast<const uint8_t*>(&display), 256, 240, QImage::Format_ARGB32_Premultiplied);
 			emit frameReadySignal(image.copy());
-			bus.ppu->frameReadyFlag = false;
+			bus.ppu.clearFrameReady();
 		}
 
 		if (shouldOutputDebugFrame) {
-			std::unique_ptr<PPU::PatternTables> patternTablesTemp = bus.ppu->getPatternTables(localKeyInput.backgroundPallete, localKeyInput.spritePallete);
-			std::shared_ptr<PPU::PatternTables> patternTables(std::move(patternTablesTemp));
+			std::shared_ptr<PPU::PatternTables> patternTables = getPatternTablesBuffer();
+			bus.ppu.getPatternTables(*patternTables, localKeyInput.backgroundPallete, localKeyInput.spritePallete);
 
 			DebugWindowState state = {
-				bus.cpu->getPC(),
-				bus.cpu->getA(),
-				bus.cpu->getX(),
-				bus.cpu->getY(),
-				bus.cpu->getSP(),
-				bus.cpu->getSR(),
+				bus.cpu.getPC(),
+				bus.cpu.getA(),
+				bus.cpu.getX(),
+				bus.cpu.getY(),
+				bus.cpu.getSP(),
+				bus.cpu.getSR(),
 				localKeyInput.backgroundPallete,
 				localKeyInput.spritePallete,
-				bus.ppu->getPalleteRamColors(),
+				bus.ppu.getPalleteRamColors(),
 				patternTables,
 				getInsts()
 			};
@@ -197,13 +393,15 @@ void EmulatorThread::run() {
 		}
 
 		// Calculate extra sleep time needed due to audio overflow
-		// TODO: Also handle audio underflow
+		// Rate control keeps the audio queue near its target as long as audio and video only drift apart slowly, see updateAudioRate.
+		// This is a fallback for when the queue still fills up far past its target, like after the audio device stalled.
 		if (!muted) {
+			size_t maxAudioQueueSize = 2 * audioTargetQueueSamples;
 			size_t currentAudioQueueSize = audioSamples.size();
-			if (currentAudioQueueSize > AUDIO_QUEUE_TARGET_FILL_SAMPLES) {
+			if (currentAudioQueueSize > maxAudioQueueSize) {
 				// We have too much audio buffered, which means we are generating audio samples faster than they can be played.
 				// Since audio sample generation speed is synchronized with frame output speed, delaying the next frame will also delay the audio sample generation.
-				int64_t excessAudioNs = ((currentAudioQueueSize - AUDIO_QUEUE_TARGET_FILL_SAMPLES) * static_cast<int64_t>(1e9)) / AUDIO_SAMPLE_RATE;
+				int64_t excessAudioNs = ((currentAudioQueueSize - maxAudioQueueSize) * static_cast<int64_t>(1e9)) / AUDIO_SAMPLE_RATE;
 				if (excessAudioNs > static_cast<int64_t>(1e6)) { // 1ms
 					// Delay next frame target by a portion of the excess
 					int64_t delayNs = excessAudioNs / 5;
@@ -236,25 +434,11 @@ void EmulatorThread::run() {
 }
 
 bool EmulatorThread::executeCycle() {
-	uint16_t currentPC = bus.cpu->getPC();
+	uint16_t currentPC = bus.cpu.getPC();
 
 	bus.executeCycle();
 
-	uint16_t nextPC = bus.cpu->getPC();
-
-	bool muted = localKeyInput.muted || localKeyInput.paused;
-	if (!muted) {
-		while (scaledAudioClock >= INSTRUCTIONS_PER_SECOND) {
-			audioSamples.forcePush(bus.apu->getAudioSample());
-			if (!soundReady) {
-				soundReady = true;
-				emit soundReadySignal();
-			}
-
-			scaledAudioClock -= INSTRUCTIONS_PER_SECOND;
-		}
-		scaledAudioClock += AUDIO_SAMPLE_RATE;
-	}
+	uint16_t nextPC = bus.cpu.getPC();
 
 	if (nextPC != currentPC) {
 		if (localKeyInput.debugWindowEnabled) {
@@ -265,14 +449,362 @@ bool EmulatorThread::executeCycle() {
 	return false;
 }
 
+std::shared_ptr<PPU::PatternTables> EmulatorThread::getPatternTablesBuffer() {
+	// A buffer can be reused once the GUI thread has released its copy of the pointer
+	for (std::shared_ptr<PPU::PatternTables>& buffer : patternTablesBuffers) {
+		if (buffer.use_count() == 1) {
+			return buffer;
+		}
+	}
+
+	std::shared_ptr<PPU::PatternTables>& buffer = patternTablesBuffers[nextPatternTablesBuffer];
+	nextPatternTablesBuffer = (nextPatternTablesBuffer + 1) % patternTablesBuffers.size();
+	buffer = std::make_shared<PPU::PatternTables>();
+	return buffer;
+}
+
+void EmulatorThread::outputAudioFrame() {
+	// Audio played backwards is just noise, so rewinding is silent
+	bool muted = localKeyInput.muted || localKeyInput.paused || localKeyInput.rewinding;
+	audioMuted.store(muted);
+
+	// The APU synthesizes a whole frame of samples at once, which are then queued in bulk
+	bus.apu.endAudioFrame();
+	if (!muted) {
+		updateAudioRate();
+	}
+
+	if (apuThread != nullptr) {
+		// The APU thread queues the frame itself once it has synthesized it
+		return;
+	}
+
+	size_t numSamples = bus.apu.readAudioSamples(audioFrameSamples.data(), audioFrameSamples.size());
+	queueAudioSamples(audioFrameSamples.data(), numSamples);
+}
+
+void EmulatorThread::updateAudioRate() {
+	size_t queueDepth = audioSamples.size();
+	double sampleRate = audioRateControl.update(queueDepth);
+
+	if (apuThread != nullptr) {
+		apuThread->adjustAudioSampleRate(sampleRate);
+	}
+	else {
+		bus.apu.adjustAudioSampleRate(sampleRate);
+	}
+
+	if (audioStatsEnabled) {
+		updateAudioStats(queueDepth);
+	}
+}
+
+void EmulatorThread::updateAudioStats(size_t queueDepth) {
+	minAudioQueueDepth = std::min(minAudioQueueDepth, queueDepth);
+	maxAudioQueueDepth = std::max(maxAudioQueueDepth, queueDepth);
+
+	audioStatsFrames++;
+	if (audioStatsFrames < FPS) {
+		return;
+	}
+
+	std::cerr << "Audio queue depth: " << queueDepth
+		<< " (min " << minAudioQueueDepth << ", max " << maxAudioQueueDepth << ", target " << audioTargetQueueSamples << ") samples"
+		<< ", rate: " << audioRateControl.getSampleRate() << " Hz"
+		<< ", underruns: " << audioSamples.getUnderrunCount()
+		<< ", overruns: " << audioSamples.getOverrunCount() << std::endl;
+
+	audioStatsFrames = 0;
+	minAudioQueueDepth = SIZE_MAX;
+	maxAudioQueueDepth = 0;
+}
+
+void EmulatorThread::queueAudioSamples(const float* samples, size_t numSamples) {
+	// May be called from the APU thread
+	if (audioMuted.load() || numSamples == 0) {
+		return;
+	}
+
+	// If the queue is full, the samples that do not fit are dropped
+	audioSamples.push(samples, numSamples);
+
+	if (!soundReady.exchange(true)) {
+		emit soundReadySignal();
+	}
+}
+
 void EmulatorThread::runUntilFrameReady() {
-	int cycles = 0;
-	static constexpr int CYCLE_LIMIT = EXPECTED_CPU_CYCLES_PER_FRAME + 5;
+	if (nsfPlayer.has_value()) {
+		// The PPU is not run while playing music, so a frame is just a frame's worth of cycles
+		nsfPlayer->run(EXPECTED_CPU_CYCLES_PER_FRAME);
+		outputAudioFrame();
+		return;
+	}
 
-	while (!bus.ppu->frameReadyFlag && cycles < CYCLE_LIMIT) {
+	int cycles = 0;
+	while (!bus.ppu.frameReady() && cycles < FRAME_CYCLE_LIMIT) {
 		executeCycle();
 		cycles++;
 	}
+
+	outputAudioFrame();
+}
+
+void EmulatorThread::runRecordedFrame() {
+	// A frame that has not been shown yet was already recorded when it finished
+	bool isFrameAlreadyReady = bus.ppu.frameReady();
+	runUntilFrameReady();
+
+	if (rewindBuffer != nullptr && !isFrameAlreadyReady) {
+		rewindBuffer->recordFrame(bus, { localKeyInput.controller1ButtonMask, localKeyInput.controller2ButtonMask });
+	}
+}
+
+bool EmulatorThread::rewindFrame() {
+	if (!rewindBuffer->stepBack(bus, rewindReplayInputs)) {
+		return false;
+	}
+
+	// Restart the APU thread from the restored state. Rewind snapshots do not wait for the audio thread, so its channels
+	// continue from wherever they were last fetched, which only affects how the sound resumes.
+	if (apuThread != nullptr) {
+		bus.apu.setAPUThread(apuThread.get());
+	}
+
+	// The snapshot was taken just as a frame finished, so the flag is cleared before running each frame
+	for (const RewindBuffer::Input& input : rewindReplayInputs) {
+		bus.setController(0, input.controller1);
+		bus.setController(1, input.controller2);
+		bus.ppu.clearFrameReady();
+		runUntilFrameReady();
+	}
+
+	return true;
+}
+
+void EmulatorThread::runAhead() {
+	QElapsedTimer runAheadTimer;
+	runAheadTimer.start();
+
+	bus.saveSnapshot(runAheadSnapshot);
+	bus.apu.setAudioOutputEnabled(false);
+
+	for (int i = 0; i < runAheadFrames; i++) {
+		bus.ppu.clearFrameReady();
+		runFrameWithoutOutput();
+	}
+
+	// The displays are not part of the state, so the last frame run ahead is the one shown
+	bus.apu.setAudioOutputEnabled(true);
+	bus.loadSnapshot(runAheadSnapshot);
+
+	if (runAheadStatsEnabled) {
+		updateRunAheadStats(runAheadTimer.nsecsElapsed());
+	}
+}
+
+void EmulatorThread::runFrameWithoutOutput() {
+	// For frames that are run ahead or run again after a rollback, which are never heard and would only clutter the debugger's PC history
+	int cycles = 0;
+	while (!bus.ppu.frameReady() && cycles < FRAME_CYCLE_LIMIT) {
+		bus.executeCycle();
+		cycles++;
+	}
+}
+
+void EmulatorThread::updateRunAheadStats(int64_t runAheadNs) {
+	runAheadStatsNs += runAheadNs;
+	maxRunAheadNs = std::max(maxRunAheadNs, runAheadNs);
+
+	runAheadStatsFrames++;
+	if (runAheadStatsFrames < FPS) {
+		return;
+	}
+
+	double averageMs = runAheadStatsNs / 1e6 / runAheadStatsFrames;
+	std::cerr << "Run-ahead of " << runAheadFrames << " frame" << (runAheadFrames == 1 ? "" : "s")
+		<< ": " << averageMs << " ms per frame"
+		<< " (max " << maxRunAheadNs / 1e6 << " ms, " << 100.0 * averageMs * 1e6 / TARGET_FRAME_NS << "% of the frame time)" << std::endl;
+
+	runAheadStatsFrames = 0;
+	runAheadStatsNs = 0;
+	maxRunAheadNs = 0;
+}
+
+void EmulatorThread::quickSave(uint8_t slot) {
+	if (slot >= quickSaveSlots.size()) {
+		return;
+	}
+
+	// The APU thread may be ahead of the console's copy of the channels
+	bus.apu.synchronizeChannels();
+	bus.saveSnapshot(quickSaveSlots[slot]);
+	std::cerr << "Saved to quick-save slot " << slot + 1 << "." << std::endl;
+}
+
+bool EmulatorThread::quickLoad(uint8_t slot) {
+	if (slot >= quickSaveSlots.size() || quickSaveSlots[slot].state == nullptr) {
+		std::cerr << "Quick-save slot " << slot + 1 << " is empty." << std::endl;
+		return false;
+	}
+
+	bus.loadSnapshot(quickSaveSlots[slot]);
+
+	// Restart the APU thread from the restored state
+	if (apuThread != nullptr) {
+		bus.apu.setAPUThread(apuThread.get());
+	}
+
+	std::cerr << "Loaded quick-save slot " << slot + 1 << "." << std::endl;
+	return true;
+}
+
+std::optional<EmulatorThread::NetplaySettings> EmulatorThread::parseNetplaySettings(const QString& setting) {
+	if (setting.isEmpty()) {
+		return std::nullopt;
+	}
+
+	QStringList parts = setting.split(',');
+	bool isPlayerValid = false;
+	bool isLocalPortValid = false;
+	bool isRemotePortValid = false;
+	NetplaySettings settings;
+	if (parts.size() == 4) {
+		settings.player = parts[0].toInt(&isPlayerValid);
+		settings.localPort = parts[1].toUShort(&isLocalPortValid);
+		settings.remoteHost = parts[2];
+		settings.remotePort = parts[3].toUShort(&isRemotePortValid);
+	}
+
+	if (!isPlayerValid || (settings.player != 1 && settings.player != 2) || !isLocalPortValid || !isRemotePortValid) {
+		std::cerr << "NES_NETPLAY should be <player>,<local port>,<remote host>,<remote port>, e.g. 1,7001,127.0.0.1,7002. Netplay is turned off." << std::endl;
+		return std::nullopt;
+	}
+	return settings;
+}
+
+bool EmulatorThread::startNetplay() {
+	const NetplaySettings& settings = netplaySettings.value();
+
+	netplayConnection = std::make_unique<NetplayConnection>();
+	if (!netplayConnection->open(settings.localPort, settings.remoteHost, settings.remotePort)) {
+		std::cerr << netplayConnection->getErrorString().toStdString() << ". Netplay is turned off." << std::endl;
+		netplayConnection.reset();
+		return false;
+	}
+
+	rollbackSession = std::make_unique<RollbackSession>(bus, settings.player - 1, [this](uint8_t controller1, uint8_t controller2, bool isResimulation) {
+		runNetplayFrame(controller1, controller2, isResimulation);
+	});
+
+	// Until the first frame has been timed, nothing is predicted
+	rollbackSession->setRollbackFrames(fixedRollbackFrames > 0 ? fixedRollbackFrames : 1);
+
+	std::cerr << "Netplay as player " << settings.player << " on port " << settings.localPort
+		<< ", with " << settings.remoteHost.toStdString() << ":" << settings.remotePort;
+	if (fixedRollbackFrames > 0) {
+		std::cerr << ", rolling back up to " << fixedRollbackFrames << " frames" << std::endl;
+	}
+	else {
+		std::cerr << ", rolling back as far as fits in a frame" << std::endl;
+	}
+	return true;
+}
+
+bool EmulatorThread::updateNetplay(bool canRunFrame) {
+	netplayConnection->receive(*rollbackSession);
+
+	// While the other player is too far behind, the game waits for them
+	bool ranFrame = canRunFrame && rollbackSession->canAdvance();
+	uint32_t numResimulated = 0;
+	int64_t frameNs = 0;
+	if (ranFrame) {
+		QElapsedTimer frameTimer;
+		frameTimer.start();
+		numResimulated = rollbackSession->advanceFrame(localKeyInput.controller1ButtonMask);
+		frameNs = frameTimer.nsecsElapsed();
+
+		if (fixedRollbackFrames == 0) {
+			fitRollbackWindow(numResimulated + 1, frameNs);
+		}
+	}
+
+	netplayConnection->send(*rollbackSession);
+
+	if (netplayStatsEnabled && canRunFrame) {
+		updateNetplayStats(ranFrame, numResimulated, frameNs);
+	}
+	return ranFrame;
+}
+
+void EmulatorThread::fitRollbackWindow(uint32_t numFramesRun, int64_t frameNs) {
+	double ns = static_cast<double>(frameNs) / numFramesRun;
+	netplayFrameNs = std::max(ns, netplayFrameNs + (ns - netplayFrameNs) / 16.0);
+
+	rollbackSession->setRollbackFrames(RollbackSession::fitRollbackFrames(netplayFrameNs, TARGET_FRAME_NS));
+}
+
+void EmulatorThread::runNetplayFrame(uint8_t controller1, uint8_t controller2, bool isResimulation) {
+	bus.setController(0, controller1);
+	bus.setController(1, controller2);
+	bus.ppu.clearFrameReady();
+
+	if (isResimulation) {
+		runFrameWithoutOutput();
+	}
+	else {
+		runUntilFrameReady();
+	}
+}
+
+void EmulatorThread::updateNetplayStats(bool ranFrame, uint32_t numResimulated, int64_t frameNs) {
+	if (!ranFrame) {
+		netplayStalledFrames++;
+	}
+	resimulatedFrames += numResimulated;
+	maxResimulatedFrames = std::max(maxResimulatedFrames, numResimulated);
+	maxNetplayFrameNs = std::max(maxNetplayFrameNs, frameNs);
+
+	netplayStatsFrames++;
+	if (netplayStatsFrames < FPS) {
+		return;
+	}
+
+	uint32_t remoteFramesBehind = rollbackSession->getCurrentFrame() - std::min(rollbackSession->getCurrentFrame(), rollbackSession->getConfirmedRemoteFrames());
+	std::cerr << "Netplay frame " << rollbackSession->getCurrentFrame()
+		<< ": remote input " << remoteFramesBehind << " frames behind"
+		<< " (window " << rollbackSession->getRollbackFrames() << ")"
+		<< ", stalled " << netplayStalledFrames << " frames"
+		<< ", resimulated " << resimulatedFrames << " frames (at most " << maxResimulatedFrames << " at once)"
+		<< ", slowest frame " << maxNetplayFrameNs / 1e6 << " ms" << std::endl;
+
+	netplayStatsFrames = 0;
+	netplayStalledFrames = 0;
+	resimulatedFrames = 0;
+	maxResimulatedFrames = 0;
+	maxNetplayFrameNs = 0;
+}
+
+void EmulatorThread::updateNsfSong() {
+	uint8_t buttons = localKeyInput.controller1ButtonMask;
+	uint8_t pressedButtons = buttons & ~lastNsfButtons;
+	lastNsfButtons = buttons;
+
+	uint8_t songCount = nsfPlayer->getSongCount();
+	uint8_t song = nsfPlayer->getCurrentSong();
+	if (pressedButtons & (1 << static_cast<int>(Controller::Button::RIGHT))) {
+		song = (song + 1) % songCount;
+	}
+	else if (pressedButtons & (1 << static_cast<int>(Controller::Button::LEFT))) {
+		song = (song + songCount - 1) % songCount;
+	}
+	else {
+		return;
+	}
+
+	nsfPlayer->startSong(song);
+	recentPCs.erase();
+	std::cerr << "Playing song " << (song + 1) << " of " << static_cast<int>(songCount) << std::endl;
 }
 
 void EmulatorThread::runSteps(uint8_t numSteps) {
@@ -286,6 +818,8 @@ void EmulatorThread::runSteps(uint8_t numSteps) {
 			cycles++;
 		}
 	}
+
+	outputAudioFrame();
 }
 
 std::array<QString, DebugWindowState::NUM_INSTS_TOTAL> EmulatorThread::getInsts() const {
@@ -293,7 +827,7 @@ std::array<QString, DebugWindowState::NUM_INSTS_TOTAL> EmulatorThread::getInsts(
 	auto recentPCsCopy = recentPCs;
 
 	auto toString = [&](uint16_t addr) {
-		std::string text = "$" + toHexString16(addr) + ": " + bus.cpu->toString(addr);
+		std::string text = "$" + toHexString16(addr) + ": " + bus.cpu.toString(addr);
 		return QString(text.c_str());
 	};
 
@@ -304,10 +838,10 @@ std::array<QString, DebugWindowState::NUM_INSTS_TOTAL> EmulatorThread::getInsts(
 	}
 
 	// Current PC and upcoming x PCs
-	uint16_t lastPC = bus.cpu->getPC();
+	uint16_t lastPC = bus.cpu.getPC();
 	for (int i = DebugWindowState::NUM_INSTS_ABOVE_AND_BELOW; i < DebugWindowState::NUM_INSTS_TOTAL; i++) {
 		insts[i] = toString(lastPC);
-		const CPU::Opcode& op = bus.cpu->getOpcode(lastPC);
+		const CPU::Opcode& op = bus.cpu.getOpcode(lastPC);
 		lastPC += op.addressingMode.instructionSize;
 	}
 
@@ -129,63 +129,27 @@ void MainWindow::keyPressEvent(QKeyEvent* event) {
 			localKeyInput.muted ^= 1;
 			updateAudioState();
 			break;
+		case REWIND_KEY:
+			localKeyInput.rewinding = true;
+			break;
 		case SAVE_KEY:
-			// Block the emulator thread until the user chooses a file
 			{
-				std::lock_guard<std::mutex> guard(keyInputMutex);
-				bool wasPaused = localKeyInput.paused;
-				if (!wasPaused) {
-					localKeyInput.paused = true;
-					updateAudioState();
-				}
-
-				QString file = QFileDialog::getSaveFileName(
-					this, "Create save state", QDir::homePath(), "(*.sstate)"
-				);
+				QString file = chooseSaveStateFile(true);
 				if (!file.isEmpty()) {
 					localKeyInput.mostRecentSaveFilePath = file;
 					localKeyInput.saveCount++;
 				}
-
-				if (!wasPaused) {
-					localKeyInput.paused = false;
-					updateAudioState();
-				}
-
-				sharedKeyInput = localKeyInput;
 			}
-
-			// Already passed user input to emulator thread, so we can return
-			return;
+			break;
 		case LOAD_KEY:
-			// Block the emulator thread until the user chooses a file
 			{
-				std::lock_guard<std::mutex> guard(keyInputMutex);
-
-				bool wasPaused = localKeyInput.paused;
-				if (!wasPaused) {
-					localKeyInput.paused = true;
-					updateAudioState();
-				}
-
-				QString file = QFileDialog::getOpenFileName(
-					this, "Load save state", QDir::homePath(), "(*.sstate)"
-				);
+				QString file = chooseSaveStateFile(false);
 				if (!file.isEmpty()) {
 					localKeyInput.mostRecentSaveFilePath = file;
 					localKeyInput.loadCount++;
 				}
-
-				if (!wasPaused) {
-					localKeyInput.paused = false;
-					updateAudioState();
-				}
-
-				sharedKeyInput = localKeyInput;
 			}
-
-			// Already passed user input to emulator thread, so we can return
-			return;
+			break;
 		case QUICK_LOAD_KEY:
 			localKeyInput.loadCount++;
 			break;
@@ -214,6 +178,16 @@ void MainWindow::keyPressEvent(QKeyEvent* event) {
 			}
 			break;
 		default:
+			for (uint8_t slot = 0; slot < KeyboardInput::NUM_QUICK_SAVE_SLOTS; slot++) {
+				if (event->key() == QUICK_SAVE_SLOT_KEYS[slot]) {
+					localKeyInput.quickSaveSlot = slot;
+					localKeyInput.quickSaveCount++;
+				}
+				else if (event->key() == QUICK_LOAD_SLOT_KEYS[slot]) {
+					localKeyInput.quickLoadSlot = slot;
+					localKeyInput.quickLoadCount++;
+				}
+			}
 			break;
 	}
 
@@ -223,6 +197,29 @@ void MainWindow::keyPressEvent(QKeyEvent* event) {
 	}
 }
 
+QString MainWindow::chooseSaveStateFile(bool isSaving) {
+	bool wasPaused = localKeyInput.paused;
+	if (!wasPaused) {
+		localKeyInput.paused = true;
+		updateAudioState();
+
+		std::lock_guard<std::mutex> guard(keyInputMutex);
+		sharedKeyInput = localKeyInput;
+	}
+
+	// The dialog runs its own event loop, during which the emulator thread keeps reading the input as usual
+	QString file = isSaving
+		? QFileDialog::getSaveFileName(this, "Create save state", QDir::homePath(), "(*.sstate)")
+		: QFileDialog::getOpenFileName(this, "Load save state", QDir::homePath(), "(*.sstate)");
+
+	// The caller shares the input again once it has added the request
+	if (!wasPaused) {
+		localKeyInput.paused = false;
+		updateAudioState();
+	}
+	return file;
+}
+
 void MainWindow::keyReleaseEvent(QKeyEvent* event) {
 	switch (event->key()) {
 		case UP_KEY:
@@ -249,6 +246,9 @@ void MainWindow::keyReleaseEvent(QKeyEvent* event) {
 		case A_KEY:
 			setControllerData(0, Controller::Button::A, 0);
 			break;
+		case REWIND_KEY:
+			localKeyInput.rewinding = false;
+			break;
 		default:
 			break;
 	}
@@ -291,6 +291,9 @@ void MainWindow::createAudioSink() {
 	if (!audioSink) {
 		defaultAudioDevice = QMediaDevices::defaultAudioOutput();
 		audioSink = new QAudioSink(defaultAudioDevice, audioFormat, this);
+
+		// Otherwise the device buffer adds more latency than the queue itself
+		audioSink->setBufferSize(static_cast<qsizetype>(getAudioTargetQueueSamples() * sizeof(float)));
 		audioSink->start(audioPlayer);
 
 		updateAudioState();
@@ -0,0 +1,83 @@
+#include "io/netplayconnection.hpp"
+
+#include <algorithm>
+
+#include <QByteArray>
+#include <QHostInfo>
+#include <QNetworkDatagram>
+
+NetplayConnection::NetplayConnection() : remotePort(0), remoteConfirmedFrames(0) {
+}
+
+bool NetplayConnection::open(uint16_t localPort, const QString& remoteHost, uint16_t remotePort) {
+    remoteAddress = QHostAddress(remoteHost);
+    if (remoteAddress.isNull()) {
+        QHostInfo hostInfo = QHostInfo::fromName(remoteHost);
+        if (hostInfo.addresses().isEmpty()) {
+            errorString = "Could not find " + remoteHost + ": " + hostInfo.errorString();
+            return false;
+        }
+        remoteAddress = hostInfo.addresses().first();
+    }
+    this->remotePort = remotePort;
+
+    if (!socket.bind(QHostAddress::Any, localPort)) {
+        errorString = "Could not use port " + QString::number(localPort) + ": " + socket.errorString();
+        return false;
+    }
+    return true;
+}
+
+QString NetplayConnection::getErrorString() const {
+    return errorString;
+}
+
+void NetplayConnection::receive(RollbackSession& session) {
+    while (socket.hasPendingDatagrams()) {
+        QNetworkDatagram datagram = socket.receiveDatagram();
+        QByteArray data = datagram.data();
+        Deserializer d(ByteView{ reinterpret_cast<const uint8_t*>(data.constData()), static_cast<size_t>(data.size()) });
+
+        uint32_t packetID;
+        uint32_t confirmedFrames;
+        uint32_t firstFrame;
+        uint8_t numFrames;
+        d.deserializeUInt32(packetID);
+        d.deserializeUInt32(confirmedFrames);
+        d.deserializeUInt32(firstFrame);
+        d.deserializeUInt8(numFrames);
+        if (!d.good() || packetID != PACKET_ID) {
+            continue;
+        }
+
+        // Packets can arrive out of order, so an older packet must not move this back
+        remoteConfirmedFrames = std::max(remoteConfirmedFrames, confirmedFrames);
+
+        for (uint32_t i = 0; i < numFrames; i++) {
+            uint8_t buttons;
+            d.deserializeUInt8(buttons);
+            if (!d.good()) {
+                break;
+            }
+            session.addRemoteInput(firstFrame + i, buttons);
+        }
+    }
+}
+
+void NetplayConnection::send(const RollbackSession& session) {
+    uint32_t currentFrame = session.getCurrentFrame();
+    uint32_t firstFrame = std::max(remoteConfirmedFrames, currentFrame - std::min(currentFrame, MAX_FRAMES_PER_PACKET));
+    firstFrame = std::min(firstFrame, currentFrame);
+
+    packet.clear();
+    packet.serializeUInt32(PACKET_ID);
+    packet.serializeUInt32(session.getConfirmedRemoteFrames());
+    packet.serializeUInt32(firstFrame);
+    packet.serializeUInt8(static_cast<uint8_t>(currentFrame - firstFrame));
+    for (uint32_t frame = firstFrame; frame < currentFrame; frame++) {
+        packet.serializeUInt8(session.getLocalInput(frame));
+    }
+
+    const std::vector<uint8_t>& buffer = packet.getBuffer();
+    socket.writeDatagram(reinterpret_cast<const char*>(buffer.data()), static_cast<qint64>(buffer.size()), remoteAddress, remotePort);
+}
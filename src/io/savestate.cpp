@@ -2,90 +2,160 @@
 
 #include "core/cpu.hpp"
 #include "core/ppu.hpp"
-#include "io/qtserializer.hpp"
 
-#include <QByteArray>
-#include <QByteArrayView>
-#include <QCryptographicHash>
+#include <utility>
+
 #include <QDir>
 #include <QFile>
 #include <QIODevice>
+#include <QSaveFile>
 
-SaveState::SaveState(Bus& bus, const QString& romFilePath) :
+SaveState::SaveState(Bus& bus) :
     bus(bus),
-    ROM_HASH(createRomHash(romFilePath)) {
+    latestLoadNumber(0),
+    stopRequested(false) {
+    ioThread = std::thread(&SaveState::runIOThread, this);
 }
 
-std::optional<SaveState::RomHash> SaveState::createRomHash(const QString& romFilePath) const {
-    QFile romFile(romFilePath);
-    if (!romFile.open(QIODevice::ReadOnly)) {
-        return std::nullopt;
+SaveState::~SaveState() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
     }
+    wakeCondition.notify_one();
+    ioThread.join();
+}
 
-    QCryptographicHash hash(QCryptographicHash::Sha256);
-    if (!hash.addData(&romFile)) {
+std::optional<SaveState::RomHash> SaveState::getRomHash() const {
+    // The hash is taken once when the ROM image is loaded, so the file does not have to be read again here
+    const std::shared_ptr<const RomImage>& romImage = bus.cartridge.getRomImage();
+    if (romImage == nullptr) {
         return std::nullopt;
     }
+    return romImage->getHash();
+}
 
-    QByteArray result = hash.result();
-    if (result.size() != HASH_BYTES) {
-        return std::nullopt;
+void SaveState::requestCreate(const QString& filePath) {
+    std::optional<RomHash> romHash = getRomHash();
+    if (!romHash.has_value()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        createStatuses.push_back({
+            CreateStatus::Code::HASH_ERROR,
+            "Failed to create save state: Could not hash current ROM file."
+        });
+        return;
     }
 
-    RomHash romHash;
-    for (int i = 0; i < HASH_BYTES; i++) {
-        romHash[i] = result[i];
-    }
-    return romHash;
-}
+    Serializer s;
+    s.version = { VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH };
 
-SaveState::CreateStatus SaveState::createSaveState(const QString& saveFilePath) const {
-    static const std::string ERROR_MESSAGE_START = "Failed to create save state: ";
+    bus.serializeAll(s);
 
-    if (!ROM_HASH.has_value()) {
-        return {
-            CreateStatus::Code::HASH_ERROR,
-            ERROR_MESSAGE_START + "Could not hash current ROM file."
-        };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({ false, filePath, romHash.value(), s.getBuffer(), 0 });
     }
+    wakeCondition.notify_one();
+}
 
-    QtSerializer s;
-    if (s.openFile(saveFilePath)) {
-        s.serializeUInt32(FORMAT_ID);
-        s.serializeUInt8(VERSION_MAJOR);
-        s.serializeUInt8(VERSION_MINOR);
-        s.serializeUInt8(VERSION_PATCH);
-        s.serializeArray(ROM_HASH.value(), s.uInt8Func);
+std::optional<SaveState::CreateStatus> SaveState::takeCreateStatus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (createStatuses.empty()) {
+        return std::nullopt;
+    }
 
-        s.version = { VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH };
+    CreateStatus status = std::move(createStatuses.front());
+    createStatuses.pop_front();
+    return status;
+}
 
-        bus.serialize(s);
-        bus.cpu->serialize(s);
-        bus.ppu->serialize(s);
-        bus.apu->serialize(s);
-        bus.cartridge->mapper->serialize(s);
+void SaveState::requestLoad(const QString& filePath) {
+    std::optional<RomHash> romHash = getRomHash();
 
-        if (!s.good()) {
-            return {
-                CreateStatus::Code::WRITING_ERROR,
-                ERROR_MESSAGE_START + "Error writing to file."
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        latestLoadNumber++;
+        if (!romHash.has_value()) {
+            loadedFile = LoadedFile{
+                { LoadStatus::Code::HASH_ERROR, "Failed to load save state: Could not hash current ROM file." },
+                {},
+                {}
             };
+            return;
         }
 
+        // A file that was read for an earlier request is no longer wanted
+        loadedFile.reset();
+        requests.push_back({ true, filePath, romHash.value(), {}, latestLoadNumber });
+    }
+    wakeCondition.notify_one();
+}
+
+std::optional<SaveState::LoadStatus> SaveState::applyLoad() {
+    std::optional<LoadedFile> file;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(file, loadedFile);
+    }
+
+    if (!file.has_value()) {
+        return std::nullopt;
+    }
+    return applyLoadedFile(file.value());
+}
+
+SaveState::LoadStatus SaveState::loadSaveState(const QString& filePath) {
+    std::optional<RomHash> romHash = getRomHash();
+    if (!romHash.has_value()) {
         return {
-            CreateStatus::Code::SUCCESS,
-            "Successfully created save state."
+            LoadStatus::Code::HASH_ERROR,
+            "Failed to load save state: Could not hash current ROM file."
         };
     }
-    else {
+
+    return applyLoadedFile(readFile(filePath, romHash.value()));
+}
+
+SaveState::CreateStatus SaveState::writeFile(const QString& filePath, const RomHash& romHash, const std::vector<uint8_t>& body) {
+    static const std::string ERROR_MESSAGE_START = "Failed to create save state: ";
+
+    // Written to a temporary file that only replaces the existing one once it is complete,
+    // so that a failed write never destroys an earlier save state
+    QSaveFile file(filePath);
+    if (filePath.isEmpty() || !file.open(QIODevice::WriteOnly)) {
         return {
             CreateStatus::Code::INVALID_FILE,
             ERROR_MESSAGE_START + "Could not create file."
         };
     }
+
+    // The header is left uncompressed, so that a file can be checked before the body is decompressed
+    Serializer header;
+    header.serializeUInt32(FORMAT_ID);
+    header.serializeUInt8(VERSION_MAJOR);
+    header.serializeUInt8(VERSION_MINOR);
+    header.serializeUInt8(VERSION_PATCH);
+    header.serializeArray(romHash);
+
+    const std::vector<uint8_t>& headerBuffer = header.getBuffer();
+    QByteArray bytes(reinterpret_cast<const char*>(headerBuffer.data()), static_cast<qsizetype>(headerBuffer.size()));
+    bytes.append(qCompress(body.data(), static_cast<qsizetype>(body.size())));
+
+    qint64 bytesWritten = file.write(bytes);
+    if (bytesWritten != bytes.size() || !file.commit()) {
+        return {
+            CreateStatus::Code::WRITING_ERROR,
+            ERROR_MESSAGE_START + "Error writing to file."
+        };
+    }
+
+    return {
+        CreateStatus::Code::SUCCESS,
+        "Successfully created save state."
+    };
 }
 
-SaveState::LoadStatus SaveState::loadSaveState(const QString& filePath) {
+SaveState::LoadedFile SaveState::readFile(const QString& filePath, const RomHash& romHash) {
     static const std::string ERROR_MESSAGE_START = "Failed to load save state: ";
 
     struct Header {
@@ -96,68 +166,117 @@ SaveState::LoadStatus SaveState::loadSaveState(const QString& filePath) {
         RomHash romHash;
     };
 
-    if (!ROM_HASH.has_value()) {
-        return {
-            LoadStatus::Code::HASH_ERROR,
-            ERROR_MESSAGE_START + "Could not hash current ROM file."
-        };
+    auto fail = [](LoadStatus::Code code, const std::string& message) {
+        return LoadedFile{ { code, ERROR_MESSAGE_START + message }, {}, {} };
+    };
+
+    QFile file(filePath);
+    if (filePath.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return fail(LoadStatus::Code::INVALID_FILE, "Could not open file.");
     }
 
-    QtDeserializer d;
-    if (d.openFile(filePath)) {
-        Header header;
+    QByteArray bytes = file.readAll();
+    Deserializer d({ reinterpret_cast<const uint8_t*>(bytes.constData()), static_cast<size_t>(bytes.size()) });
+    Header header;
 
-        d.deserializeUInt32(header.formatID);
-        if (header.formatID != FORMAT_ID) {
-            return {
-                LoadStatus::Code::INVALID_FORMAT,
-                ERROR_MESSAGE_START + "File is not of the correct format."
-            };
-        }
+    d.deserializeUInt32(header.formatID);
+    if (header.formatID != FORMAT_ID) {
+        return fail(LoadStatus::Code::INVALID_FORMAT, "File is not of the correct format.");
+    }
 
-        d.deserializeUInt8(header.versionMajor);
-        d.deserializeUInt8(header.versionMinor);
-        d.deserializeUInt8(header.versionPatch);
-        if (header.versionMajor != VERSION_MAJOR) {
-            return {
-                LoadStatus::Code::INVALID_VERSION,
-                ERROR_MESSAGE_START + "Save state major version does not match current major version."
-            };
-        }
+    d.deserializeUInt8(header.versionMajor);
+    d.deserializeUInt8(header.versionMinor);
+    d.deserializeUInt8(header.versionPatch);
+    if (header.versionMajor != VERSION_MAJOR) {
+        return fail(LoadStatus::Code::INVALID_VERSION, "Save state major version does not match current major version.");
+    }
 
-        d.deserializeArray(header.romHash, d.uInt8Func);
-        if (header.romHash != ROM_HASH.value()) {
-            return {
-                LoadStatus::Code::HASH_ERROR,
-                ERROR_MESSAGE_START + "ROM hash from save state does not match current ROM hash."
-            };
+    d.deserializeArray(header.romHash);
+    if (header.romHash != romHash) {
+        return fail(LoadStatus::Code::HASH_ERROR, "ROM hash from save state does not match current ROM hash.");
+    }
+
+    // Files from before version 1.2 store the body uncompressed
+    ByteView body = d.getRemaining();
+    LoadedFile loadedFile{
+        { LoadStatus::Code::SUCCESS, "Successfully loaded save state." },
+        { header.versionMajor, header.versionMinor, header.versionPatch },
+        {}
+    };
+    if (header.versionMinor >= FIRST_COMPRESSED_MINOR_VERSION) {
+        loadedFile.body = qUncompress(body.data, static_cast<qsizetype>(body.size));
+        if (loadedFile.body.isEmpty()) {
+            return fail(LoadStatus::Code::READING_ERROR, "Error reading from file. The save file might be corrupted.");
         }
+    }
+    else {
+        loadedFile.body = QByteArray(reinterpret_cast<const char*>(body.data), static_cast<qsizetype>(body.size));
+    }
+    return loadedFile;
+}
 
-        d.version = { header.versionMajor, header.versionMinor, header.versionPatch };
+SaveState::LoadStatus SaveState::applyLoadedFile(const LoadedFile& loadedFile) {
+    if (loadedFile.status.code != LoadStatus::Code::SUCCESS) {
+        return loadedFile.status;
+    }
 
-        bus.deserialize(d);
-        bus.cpu->deserialize(d);
-        bus.ppu->deserialize(d);
-        bus.apu->deserialize(d);
-        bus.cartridge->mapper->deserialize(d);
+    // A corrupted body is only noticed partway through loading it, so the console is put back the same way it would be loaded
+    Serializer previous;
+    previous.version = { VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH };
+    bus.serializeAll(previous);
 
-        // TODO: More robust save file checking
-        if (!d.good()) {
-            return {
-                LoadStatus::Code::READING_ERROR,
-                ERROR_MESSAGE_START + "Error reading from file. The save file might be corrupted."
-            };
-        }
+    const QByteArray& body = loadedFile.body;
+    Deserializer d({ reinterpret_cast<const uint8_t*>(body.constData()), static_cast<size_t>(body.size()) });
+    d.version = loadedFile.version;
+
+    bus.deserializeAll(d);
+
+    if (!d.good()) {
+        const std::vector<uint8_t>& previousBuffer = previous.getBuffer();
+        Deserializer restore({ previousBuffer.data(), previousBuffer.size() });
+        restore.version = previous.version;
+        bus.deserializeAll(restore);
 
         return {
-            LoadStatus::Code::SUCCESS,
-            "Successfully loaded save state."
+            LoadStatus::Code::READING_ERROR,
+            "Failed to load save state: Error reading from file. The save file might be corrupted."
         };
     }
-    else {
-        return {
-            LoadStatus::Code::INVALID_FILE,
-            ERROR_MESSAGE_START + "Could not open file."
-        };
+
+    return loadedFile.status;
+}
+
+void SaveState::runIOThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wakeCondition.wait(lock, [this]() { return stopRequested || !requests.empty(); });
+        if (requests.empty()) {
+            return;
+        }
+
+        Request request = std::move(requests.front());
+        requests.pop_front();
+
+        // Nothing is left to apply a load to once the emulator is stopping, but save states are still written
+        if (request.isLoad && (stopRequested || request.loadNumber != latestLoadNumber)) {
+            continue;
+        }
+
+        lock.unlock();
+        if (request.isLoad) {
+            LoadedFile file = readFile(request.filePath, request.romHash);
+            lock.lock();
+
+            // Another load may have been requested while the file was being read
+            if (request.loadNumber == latestLoadNumber) {
+                loadedFile = std::move(file);
+            }
+        }
+        else {
+            CreateStatus status = writeFile(request.filePath, request.romHash, request.body);
+            lock.lock();
+            createStatuses.push_back(std::move(status));
+        }
     }
-}
\ No newline at end of file
+}
@@ -11,14 +11,14 @@
 int main(int argc, char* argv[]) {
     QApplication app(argc, argv);
 
-    // Choose the .nes file to run.
+    // Choose the .nes or .nsf file to run.
     // Use input from the command line argument if provided, otherwise choose from file dialog
     // The second command line argument is optional and starts the ROM from a save state (.sstate file)
     std::string romFilePath;
     std::optional<std::string> saveFilePath;
     switch (argc) {
         case 1:
-            romFilePath = QFileDialog::getOpenFileName(nullptr, "Choose a .nes file to open.", QDir::homePath(), "(*.nes)").toStdString();
+            romFilePath = QFileDialog::getOpenFileName(nullptr, "Choose a .nes or .nsf file to open.", QDir::homePath(), "(*.nes *.nsf)").toStdString();
             if (romFilePath.empty()) {
                 qFatal("No ROM file selected.");
             }
@@ -0,0 +1,136 @@
+#include "core/bus.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+// Checks that the core is deterministic by running two consoles side by side with the same input,
+// and reporting the first frame on which their states stop matching, along with the fields that differ.
+// The second console first runs for a while on its own input and is then reset, so that state a reset leaves behind,
+// like a field that resetPPU or resetAPU forgets to initialize, also shows up as a difference.
+//
+// Usage: NES_Lockstep path/to/game.nes [frames] [warmup frames] [seed]
+
+static constexpr int DEFAULT_FRAMES = 3600;
+static constexpr int DEFAULT_WARMUP_FRAMES = 300;
+
+// 262 scanlines, 341 cycles per scanline, 3 PPU cycles per CPU cycle
+static constexpr int CYCLE_LIMIT = (262 * 341) / 3 + 5;
+
+static void runFrame(Bus& bus, uint8_t buttons) {
+    bus.setController(0, buttons);
+    bus.ppu.clearFrameReady();
+
+    int cycles = 0;
+    while (!bus.ppu.frameReady() && cycles < CYCLE_LIMIT) {
+        bus.executeCycle();
+        cycles++;
+    }
+}
+
+// Games ignore most buttons that are only pressed for a frame, so each random input is held for a while
+class RandomInput {
+public:
+    explicit RandomInput(uint32_t seed) : rng(seed), buttons(0), framesLeft(0) {}
+
+    uint8_t next() {
+        if (framesLeft == 0) {
+            buttons = static_cast<uint8_t>(rng());
+            framesLeft = 1 + rng() % 30;
+        }
+        framesLeft--;
+        return buttons;
+    }
+
+private:
+    std::mt19937 rng;
+    uint8_t buttons;
+    uint32_t framesLeft;
+};
+
+template <typename State>
+static void printDifferences(const char* component, uint64_t hashA, uint64_t hashB, const State& stateA, const State& stateB) {
+    if (hashA == hashB) {
+        return;
+    }
+
+    std::cout << "  " << component << ":";
+    Schema::diff(stateA, stateB, [](const std::string& path) {
+        std::cout << " " << path;
+    });
+    std::cout << "\n";
+}
+
+static void printMapperDifference(Bus& a, Bus& b) {
+    // The MMC3 scanline counter is only brought up to date lazily, so it has to be synchronized first, as before a save state
+    a.synchronizeScanlineCounter();
+    b.synchronizeScanlineCounter();
+
+    std::cout << "  mapper:";
+    a.cartridge.mapper->diff(*b.cartridge.mapper, [](const std::string& path) {
+        std::cout << " " << path;
+    });
+    std::cout << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 5) {
+        std::cerr << "Usage: " << argv[0] << " path/to/game.nes [frames] [warmup frames] [seed]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string romFilePath = argv[1];
+    int frames = argc > 2 ? std::atoi(argv[2]) : DEFAULT_FRAMES;
+    int warmupFrames = argc > 3 ? std::atoi(argv[3]) : DEFAULT_WARMUP_FRAMES;
+    uint32_t seed = argc > 4 ? static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10)) : 1;
+
+    // Each console holds its whole state inline, which is too much for the stack
+    std::unique_ptr<Bus> a = std::make_unique<Bus>();
+    std::unique_ptr<Bus> b = std::make_unique<Bus>();
+    for (Bus* bus : { a.get(), b.get() }) {
+        Cartridge::Status status = bus->tryInitDevices(romFilePath);
+        if (status.code != Cartridge::Code::SUCCESS) {
+            std::cerr << status.message << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (a->cartridge.getNsfHeader() != nullptr) {
+        std::cerr << "NSF files are not supported, they do not run the PPU." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    RandomInput warmupInput(seed + 1);
+    for (int i = 0; i < warmupFrames; i++) {
+        runFrame(*b, warmupInput.next());
+    }
+    b->reset();
+
+    RandomInput input(seed);
+    for (int frame = 0; frame <= frames; frame++) {
+        Bus::StateHashes hashesA = a->hashState();
+        Bus::StateHashes hashesB = b->hashState();
+        if (hashesA.combined() != hashesB.combined()) {
+            std::cout << "States differ after " << frame << " frames (hashes " << std::hex << hashesA.combined() << " and " << hashesB.combined() << std::dec << ")\n";
+            printDifferences("bus", hashesA.bus, hashesB.bus, a->state, b->state);
+            printDifferences("cpu", hashesA.cpu, hashesB.cpu, a->state.cpu, b->state.cpu);
+            printDifferences("ppu", hashesA.ppu, hashesB.ppu, a->state.ppu, b->state.ppu);
+            printDifferences("apu", hashesA.apu, hashesB.apu, a->state.apu, b->state.apu);
+            if (hashesA.mapper != hashesB.mapper) {
+                printMapperDifference(*a, *b);
+            }
+            return EXIT_FAILURE;
+        }
+
+        if (frame < frames) {
+            uint8_t buttons = input.next();
+            runFrame(*a, buttons);
+            runFrame(*b, buttons);
+        }
+    }
+
+    std::cout << "States matched for " << frames << " frames (final hash " << std::hex << a->hashState().combined() << std::dec << ")" << std::endl;
+    return EXIT_SUCCESS;
+}
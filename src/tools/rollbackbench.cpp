@@ -0,0 +1,130 @@
+#include "core/bus.hpp"
+#include "core/rollbacksession.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Measures how long a rollback netplay frame takes in the worst case, when the remote input always arrives as late as
+// the session allows and never matches the prediction, so that every frame rolls back and runs the skipped frames again.
+// A frame has to stay well within the 16.6 ms a frame lasts at 60 FPS, or the game slows down whenever input is mispredicted.
+// Unless a rollback window is given, it is fitted to the time a plain frame takes, the same way the emulator does during netplay.
+// Times are wall clock times, which is what the player sees. The CPU time is printed as well, since the two only match on a machine
+// where nothing else competes for the core.
+//
+// Usage: NES_RollbackBench path/to/game.nes [frames] [rollback frames]
+
+static constexpr int DEFAULT_FRAMES = 600;
+
+// Plain frames run to measure how long a frame takes, before the session starts
+static constexpr int TIMED_FRAMES = 60;
+
+// 262 scanlines, 341 cycles per scanline, 3 PPU cycles per CPU cycle
+static constexpr int CYCLE_LIMIT = (262 * 341) / 3 + 5;
+
+static constexpr double FRAME_BUDGET_MS = 1000.0 / 60.0;
+
+static double getCpuMs() {
+    return 1000.0 * static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+static void runFrame(Bus& bus, uint8_t controller1, uint8_t controller2) {
+    bus.setController(0, controller1);
+    bus.setController(1, controller2);
+    bus.ppu.clearFrameReady();
+
+    int cycles = 0;
+    while (!bus.ppu.frameReady() && cycles < CYCLE_LIMIT) {
+        bus.executeCycle();
+        cycles++;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " path/to/game.nes [frames] [rollback frames]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string romFilePath = argv[1];
+    int frames = argc > 2 ? std::atoi(argv[2]) : DEFAULT_FRAMES;
+    int fixedRollbackFrames = argc > 3 ? std::atoi(argv[3]) : 0;
+
+    // The console holds its whole state inline, which is too much for the stack
+    std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+    Cartridge::Status status = bus->tryInitDevices(romFilePath);
+    if (status.code != Cartridge::Code::SUCCESS) {
+        std::cerr << status.message << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (bus->cartridge.getNsfHeader() != nullptr) {
+        std::cerr << "NSF files are not supported, they do not run the PPU." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto timingStart = std::chrono::steady_clock::now();
+    double timingStartCpuMs = getCpuMs();
+    for (int i = 0; i < TIMED_FRAMES; i++) {
+        runFrame(*bus, static_cast<uint8_t>(i), 0);
+    }
+    double plainFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timingStart).count() / TIMED_FRAMES;
+    double plainFrameCpuMs = (getCpuMs() - timingStartCpuMs) / TIMED_FRAMES;
+
+    RollbackSession session(*bus, 0, [&bus](uint8_t controller1, uint8_t controller2, bool) {
+        runFrame(*bus, controller1, controller2);
+    });
+    if (fixedRollbackFrames > 0) {
+        session.setRollbackFrames(static_cast<uint32_t>(fixedRollbackFrames));
+    }
+    else {
+        session.setRollbackFrames(RollbackSession::fitRollbackFrames(plainFrameMs, FRAME_BUDGET_MS));
+    }
+    uint32_t rollbackFrames = session.getRollbackFrames();
+    std::cout << "A plain frame takes " << plainFrameMs << " ms (" << plainFrameCpuMs << " ms of CPU time), rolling back up to "
+        << rollbackFrames << " frame" << (rollbackFrames == 1 ? "" : "s") << "\n";
+
+    // The remote buttons change every frame, so the last received input is always a wrong prediction
+    auto remoteButtons = [](uint32_t frame) {
+        return static_cast<uint8_t>(frame * 37 + 1);
+    };
+
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    uint64_t resimulatedFrames = 0;
+    int framesOverBudget = 0;
+    double startCpuMs = getCpuMs();
+    for (int i = 0; i < frames; i++) {
+        uint32_t currentFrame = session.getCurrentFrame();
+        if (currentFrame >= rollbackFrames - 1) {
+            session.addRemoteInput(currentFrame - (rollbackFrames - 1), remoteButtons(currentFrame));
+        }
+        if (!session.canAdvance()) {
+            std::cerr << "The session stalled on frame " << currentFrame << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        resimulatedFrames += session.advanceFrame(static_cast<uint8_t>(i));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+        if (ms > FRAME_BUDGET_MS) {
+            framesOverBudget++;
+        }
+    }
+
+    double cpuMs = getCpuMs() - startCpuMs;
+
+    std::cout << frames << " frames, " << resimulatedFrames << " resimulated ("
+        << static_cast<double>(resimulatedFrames) / std::max(frames, 1) << " per frame)\n";
+    std::cout << "Average " << totalMs / std::max(frames, 1) << " ms (" << cpuMs / std::max(frames, 1) << " ms of CPU time), slowest "
+        << maxMs << " ms per frame, "
+        << framesOverBudget << " frames over the " << FRAME_BUDGET_MS << " ms budget" << std::endl;
+    return framesOverBudget == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
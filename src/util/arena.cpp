@@ -0,0 +1,91 @@
+#include "util/arena.hpp"
+
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+Arena::Arena() : memory(nullptr), capacity(0), used(0), usesHugePages(false) {}
+
+Arena::Arena(size_t capacity) : memory(nullptr), capacity(capacity), used(0), usesHugePages(false) {
+    if (capacity == 0) {
+        return;
+    }
+
+#ifdef __linux__
+    // Round up to a whole number of huge pages and ask the kernel to back the mapping with them.
+    // This is only a hint, so the arena still works if transparent huge pages are disabled.
+    if (capacity >= HUGE_PAGE_SIZE) {
+        size_t mappedSize = (capacity + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, mappedSize, MADV_HUGEPAGE);
+            memory = static_cast<uint8_t*>(mapped);
+            this->capacity = mappedSize;
+            usesHugePages = true;
+            return;
+        }
+    }
+#endif
+
+    memory = static_cast<uint8_t*>(::operator new(capacity, std::align_val_t{ alignof(std::max_align_t) }));
+}
+
+Arena::~Arena() {
+    release();
+}
+
+Arena::Arena(Arena&& other) noexcept :
+    memory(std::exchange(other.memory, nullptr)),
+    capacity(std::exchange(other.capacity, 0)),
+    used(std::exchange(other.used, 0)),
+    usesHugePages(std::exchange(other.usesHugePages, false)) {
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        release();
+        memory = std::exchange(other.memory, nullptr);
+        capacity = std::exchange(other.capacity, 0);
+        used = std::exchange(other.used, 0);
+        usesHugePages = std::exchange(other.usesHugePages, false);
+    }
+    return *this;
+}
+
+uint8_t* Arena::allocate(size_t size, size_t alignment) {
+    size_t alignedOffset = (used + alignment - 1) & ~(alignment - 1);
+    if (memory == nullptr || alignedOffset + size > capacity) {
+        return nullptr;
+    }
+
+    used = alignedOffset + size;
+    return memory + alignedOffset;
+}
+
+size_t Arena::getCapacity() const {
+    return capacity;
+}
+
+size_t Arena::getUsed() const {
+    return used;
+}
+
+void Arena::release() {
+    if (memory == nullptr) {
+        return;
+    }
+
+#ifdef __linux__
+    if (usesHugePages) {
+        munmap(memory, capacity);
+        memory = nullptr;
+        return;
+    }
+#endif
+
+    ::operator delete(memory, std::align_val_t{ alignof(std::max_align_t) });
+    memory = nullptr;
+}
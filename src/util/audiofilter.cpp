@@ -0,0 +1,49 @@
+#include "util/audiofilter.hpp"
+
+AudioFilter::AudioFilter(Type type, double cutoffFrequency) : type(type), cutoffFrequency(cutoffFrequency), coefficient(1.0f) {
+    reset();
+}
+
+void AudioFilter::setSampleRate(double sampleRate) {
+    static constexpr double PI = 3.14159265358979323846;
+
+    // Discretized RC filter
+    double rc = 1.0 / (2.0 * PI * cutoffFrequency);
+    double dt = 1.0 / sampleRate;
+
+    if (type == Type::HIGH_PASS) {
+        coefficient = static_cast<float>(rc / (rc + dt));
+    }
+    else {
+        coefficient = static_cast<float>(dt / (rc + dt));
+    }
+}
+
+void AudioFilter::reset() {
+    lastInput = 0.0f;
+    lastOutput = 0.0f;
+}
+
+void AudioFilter::process(float* samples, size_t numSamples) {
+    // Each output depends on the one before it, so the filter state is kept in locals for the whole block
+    float input = lastInput;
+    float output = lastOutput;
+
+    if (type == Type::HIGH_PASS) {
+        for (size_t i = 0; i < numSamples; i++) {
+            output = coefficient * (output + samples[i] - input);
+            input = samples[i];
+            samples[i] = output;
+        }
+    }
+    else {
+        for (size_t i = 0; i < numSamples; i++) {
+            input = samples[i];
+            output += coefficient * (input - output);
+            samples[i] = output;
+        }
+    }
+
+    lastInput = input;
+    lastOutput = output;
+}
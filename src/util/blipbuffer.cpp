@@ -0,0 +1,96 @@
+#include "util/blipbuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+BlipBuffer::BlipBuffer() : timeFactor(0) {
+    clear();
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate) {
+    timeFactor = static_cast<uint64_t>(std::llround((sampleRate / clockRate) * static_cast<double>(1ULL << FRACTION_BITS)));
+}
+
+void BlipBuffer::clear() {
+    offset = 0;
+    integrator = 0;
+    buffer = {};
+}
+
+void BlipBuffer::addDelta(uint32_t time, int32_t delta) {
+    uint64_t position = offset + time * timeFactor;
+    size_t index = static_cast<size_t>(position >> FRACTION_BITS);
+    if (index + KERNEL_WIDTH > buffer.size()) {
+        // The buffer is full, which only happens if samples are not being read
+        return;
+    }
+
+    int phase = static_cast<int>(position >> (FRACTION_BITS - PHASE_BITS)) & (PHASE_COUNT - 1);
+    const std::array<int32_t, KERNEL_WIDTH>& taps = getKernel()[phase];
+    for (int i = 0; i < KERNEL_WIDTH; i++) {
+        buffer[index + i] += static_cast<int64_t>(delta) * taps[i];
+    }
+}
+
+void BlipBuffer::endFrame(uint32_t clocks) {
+    static constexpr uint64_t MAX_OFFSET = static_cast<uint64_t>(MAX_SAMPLES) << FRACTION_BITS;
+    offset = std::min(offset + clocks * timeFactor, MAX_OFFSET);
+}
+
+size_t BlipBuffer::samplesAvailable() const {
+    return static_cast<size_t>(offset >> FRACTION_BITS);
+}
+
+size_t BlipBuffer::readSamples(float* output, size_t maxSamples) {
+    static constexpr float OUTPUT_SCALE = 1.0f / (static_cast<float>(AMPLITUDE_UNIT) * static_cast<float>(KERNEL_UNIT));
+
+    size_t count = std::min(samplesAvailable(), maxSamples);
+    for (size_t i = 0; i < count; i++) {
+        integrator += buffer[i];
+        output[i] = static_cast<float>(integrator) * OUTPUT_SCALE;
+    }
+
+    // Move the deltas that have not been read yet to the front
+    std::copy(buffer.begin() + count, buffer.end(), buffer.begin());
+    std::fill(buffer.end() - count, buffer.end(), 0);
+    offset -= static_cast<uint64_t>(count) << FRACTION_BITS;
+
+    return count;
+}
+
+const BlipBuffer::Kernel& BlipBuffer::getKernel() {
+    static const Kernel kernel = []() {
+        // Blackman windowed sinc with a cutoff just below the output Nyquist frequency.
+        // Each phase is the impulse shifted by a fraction of a sample, centred between taps KERNEL_WIDTH / 2 - 1 and KERNEL_WIDTH / 2.
+        static constexpr double PI = 3.14159265358979323846;
+        static constexpr double CUTOFF = 0.45; // In cycles per output sample
+        static constexpr double HALF_WIDTH = KERNEL_WIDTH / 2;
+
+        Kernel result;
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            double center = (HALF_WIDTH - 1) + static_cast<double>(phase) / PHASE_COUNT;
+
+            std::array<double, KERNEL_WIDTH> impulse;
+            double sum = 0.0;
+            for (int i = 0; i < KERNEL_WIDTH; i++) {
+                double t = i - center;
+                double x = 2.0 * CUTOFF * t;
+                double sinc = (x == 0.0) ? 1.0 : std::sin(PI * x) / (PI * x);
+                double window = 0.42 + 0.5 * std::cos(PI * t / HALF_WIDTH) + 0.08 * std::cos(2.0 * PI * t / HALF_WIDTH);
+                impulse[i] = sinc * std::max(window, 0.0);
+                sum += impulse[i];
+            }
+
+            // Round each tap, then give the rounding error to the largest tap so the phase sums to exactly KERNEL_UNIT
+            int32_t total = 0;
+            for (int i = 0; i < KERNEL_WIDTH; i++) {
+                result[phase][i] = static_cast<int32_t>(std::lround(impulse[i] / sum * KERNEL_UNIT));
+                total += result[phase][i];
+            }
+            result[phase][KERNEL_WIDTH / 2 - 1 + (phase >= PHASE_COUNT / 2)] += KERNEL_UNIT - total;
+        }
+        return result;
+    }();
+
+    return kernel;
+}
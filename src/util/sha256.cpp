@@ -0,0 +1,125 @@
+#include "util/sha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr std::array<uint32_t, 64> ROUND_CONSTANTS = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static constexpr uint32_t rotateRight(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+Sha256::Sha256() :
+    h{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    block{},
+    blockUsed(0),
+    totalBytes(0) {
+}
+
+void Sha256::update(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    totalBytes += size;
+
+    // Top up a partially filled block first
+    if (blockUsed > 0) {
+        size_t count = std::min(size, BLOCK_SIZE - blockUsed);
+        std::memcpy(block.data() + blockUsed, data, count);
+        blockUsed += count;
+        data += count;
+        size -= count;
+
+        if (blockUsed < BLOCK_SIZE) {
+            return;
+        }
+        processBlock(block.data());
+        blockUsed = 0;
+    }
+
+    // Whole blocks are hashed straight from the input without copying
+    while (size >= BLOCK_SIZE) {
+        processBlock(data);
+        data += BLOCK_SIZE;
+        size -= BLOCK_SIZE;
+    }
+
+    std::memcpy(block.data(), data, size);
+    blockUsed = size;
+}
+
+Sha256::Digest Sha256::finalize() {
+    uint64_t totalBits = totalBytes * 8;
+
+    // Padding is a single 1 bit, zeros, then the message length in bits as a big endian 64 bit integer
+    block[blockUsed++] = 0x80;
+    if (blockUsed > BLOCK_SIZE - 8) {
+        std::fill(block.begin() + blockUsed, block.end(), 0);
+        processBlock(block.data());
+        blockUsed = 0;
+    }
+    std::fill(block.begin() + blockUsed, block.end() - 8, 0);
+    for (int i = 0; i < 8; i++) {
+        block[BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(totalBits >> (8 * i));
+    }
+    processBlock(block.data());
+
+    Digest digest;
+    for (size_t i = 0; i < h.size(); i++) {
+        digest[4 * i + 0] = static_cast<uint8_t>(h[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(h[i]);
+    }
+    return digest;
+}
+
+Sha256::Digest Sha256::hash(ByteView data) {
+    Sha256 sha;
+    sha.update(data.data, data.size);
+    return sha.finalize();
+}
+
+void Sha256::processBlock(const uint8_t* data) {
+    std::array<uint32_t, 64> w;
+    for (int i = 0; i < 16; i++) {
+        w[i] = (static_cast<uint32_t>(data[4 * i]) << 24) | (static_cast<uint32_t>(data[4 * i + 1]) << 16) |
+               (static_cast<uint32_t>(data[4 * i + 2]) << 8) | static_cast<uint32_t>(data[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t temp1 = hh + s1 + ch + ROUND_CONSTANTS[i] + w[i];
+        uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + maj;
+
+        hh = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}